@@ -0,0 +1,262 @@
+/*--------------------------------------------------------------------*/
+/* atom.c                                                             */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atom.h"
+
+/* The number of buckets the table starts with */
+#define ATOM_INITIAL_BUCKETS 64
+
+/* An interned string */
+struct atom {
+   /* the next atom in the same hash bucket */
+   struct atom *psNext;
+   /* the full hash of the string, kept to make rehashing cheap */
+   size_t ulHash;
+   /* the number of references held to this atom */
+   size_t ulRefCount;
+   /* the string length of pcString */
+   size_t ulLength;
+   /* the string, stored in the same allocation right after the atom */
+   const char *pcString;
+};
+
+/* A table of live atoms */
+struct atomTable {
+   /* the array of hash bucket chains (NULL until the first atom) */
+   struct atom **ppsBuckets;
+   /* the number of buckets in ppsBuckets, always a power of two */
+   size_t ulBucketCount;
+   /* the number of live atoms in the table */
+   size_t ulAtomCount;
+};
+
+size_t Atom_hash(const char *pcStr, size_t ulLength) {
+   size_t ulHash = (size_t) 2166136261UL;
+   size_t i;
+
+   assert(pcStr != NULL);
+
+   for(i = 0; i < ulLength; i++) {
+      ulHash ^= (unsigned char) pcStr[i];
+      ulHash *= (size_t) 16777619UL;
+   }
+   return ulHash;
+}
+
+/*
+  Doubles the number of buckets in oAtTable (or allocates the initial
+  buckets) and redistributes the existing atoms. Returns SUCCESS, or
+  MEMORY_ERROR if the new bucket array could not be allocated, in which
+  case the table is unchanged.
+*/
+static int Atom_grow(AtomTable_T oAtTable) {
+   struct atom **ppsNew;
+   struct atom *psAtom;
+   struct atom *psNext;
+   size_t ulNewCount;
+   size_t i;
+
+   assert(oAtTable != NULL);
+
+   if(oAtTable->ulBucketCount == 0)
+      ulNewCount = ATOM_INITIAL_BUCKETS;
+   else
+      ulNewCount = 2 * oAtTable->ulBucketCount;
+
+   ppsNew = calloc(ulNewCount, sizeof(struct atom *));
+   if(ppsNew == NULL)
+      return MEMORY_ERROR;
+
+   for(i = 0; i < oAtTable->ulBucketCount; i++) {
+      for(psAtom = oAtTable->ppsBuckets[i]; psAtom != NULL;
+          psAtom = psNext) {
+         psNext = psAtom->psNext;
+         psAtom->psNext = ppsNew[psAtom->ulHash & (ulNewCount - 1)];
+         ppsNew[psAtom->ulHash & (ulNewCount - 1)] = psAtom;
+      }
+   }
+
+   free(oAtTable->ppsBuckets);
+   oAtTable->ppsBuckets = ppsNew;
+   oAtTable->ulBucketCount = ulNewCount;
+   return SUCCESS;
+}
+
+AtomTable_T AtomTable_new(void) {
+   struct atomTable *psTable;
+
+   psTable = malloc(sizeof(struct atomTable));
+   if(psTable == NULL)
+      return NULL;
+
+   psTable->ppsBuckets = NULL;
+   psTable->ulBucketCount = 0;
+   psTable->ulAtomCount = 0;
+   return psTable;
+}
+
+void AtomTable_free(AtomTable_T oAtTable) {
+   struct atom *psAtom;
+   struct atom *psNext;
+   size_t i;
+
+   if(oAtTable == NULL)
+      return;
+
+   for(i = 0; i < oAtTable->ulBucketCount; i++) {
+      for(psAtom = oAtTable->ppsBuckets[i]; psAtom != NULL;
+          psAtom = psNext) {
+         psNext = psAtom->psNext;
+         free(psAtom);
+      }
+   }
+   free(oAtTable->ppsBuckets);
+   free(oAtTable);
+}
+
+int Atom_new(AtomTable_T oAtTable, const char *pcStr, size_t ulLength,
+             Atom_T *poAResult) {
+   struct atom *psAtom;
+   size_t ulHash;
+   size_t ulBucket;
+
+   assert(oAtTable != NULL);
+   assert(pcStr != NULL);
+   assert(poAResult != NULL);
+
+   ulHash = Atom_hash(pcStr, ulLength);
+
+   /* reuse the existing atom for this string, if there is one */
+   if(oAtTable->ulBucketCount != 0) {
+      ulBucket = ulHash & (oAtTable->ulBucketCount - 1);
+      for(psAtom = oAtTable->ppsBuckets[ulBucket]; psAtom != NULL;
+          psAtom = psAtom->psNext) {
+         if(psAtom->ulHash == ulHash && psAtom->ulLength == ulLength &&
+            memcmp(psAtom->pcString, pcStr, ulLength) == 0) {
+            psAtom->ulRefCount++;
+            *poAResult = psAtom;
+            return SUCCESS;
+         }
+      }
+   }
+
+   /* keep chains short by growing once the table is fully loaded */
+   if(oAtTable->ulAtomCount >= oAtTable->ulBucketCount) {
+      if(Atom_grow(oAtTable) != SUCCESS) {
+         *poAResult = NULL;
+         return MEMORY_ERROR;
+      }
+   }
+
+   psAtom = malloc(sizeof(struct atom) + ulLength + 1);
+   if(psAtom == NULL) {
+      *poAResult = NULL;
+      return MEMORY_ERROR;
+   }
+   psAtom->ulHash = ulHash;
+   psAtom->ulRefCount = 1;
+   psAtom->ulLength = ulLength;
+   psAtom->pcString = (const char *) (psAtom + 1);
+   memcpy((char *) psAtom->pcString, pcStr, ulLength);
+   ((char *) psAtom->pcString)[ulLength] = '\0';
+
+   ulBucket = ulHash & (oAtTable->ulBucketCount - 1);
+   psAtom->psNext = oAtTable->ppsBuckets[ulBucket];
+   oAtTable->ppsBuckets[ulBucket] = psAtom;
+   oAtTable->ulAtomCount++;
+
+   *poAResult = psAtom;
+   return SUCCESS;
+}
+
+Atom_T Atom_dup(Atom_T oAAtom) {
+   assert(oAAtom != NULL);
+
+   ((struct atom *) oAAtom)->ulRefCount++;
+   return oAAtom;
+}
+
+void Atom_free(AtomTable_T oAtTable, Atom_T oAAtom) {
+   struct atom **ppsLink;
+
+   assert(oAtTable != NULL);
+
+   if(oAAtom == NULL)
+      return;
+
+   assert(oAAtom->ulRefCount > 0);
+   if(--((struct atom *) oAAtom)->ulRefCount != 0)
+      return;
+
+   /* unlink from its bucket chain */
+   ppsLink = &oAtTable->ppsBuckets[oAAtom->ulHash
+                                   & (oAtTable->ulBucketCount - 1)];
+   while(*ppsLink != oAAtom)
+      ppsLink = &(*ppsLink)->psNext;
+   *ppsLink = oAAtom->psNext;
+   oAtTable->ulAtomCount--;
+
+   free((struct atom *) oAAtom);
+
+   /* release the bucket array itself once nothing is interned */
+   if(oAtTable->ulAtomCount == 0) {
+      free(oAtTable->ppsBuckets);
+      oAtTable->ppsBuckets = NULL;
+      oAtTable->ulBucketCount = 0;
+   }
+}
+
+const char *Atom_getString(Atom_T oAAtom) {
+   assert(oAAtom != NULL);
+
+   return oAAtom->pcString;
+}
+
+size_t Atom_getLength(Atom_T oAAtom) {
+   assert(oAAtom != NULL);
+
+   return oAAtom->ulLength;
+}
+
+size_t Atom_getHash(Atom_T oAAtom) {
+   assert(oAAtom != NULL);
+
+   return oAAtom->ulHash;
+}
+
+int Atom_compare(Atom_T oAAtom1, Atom_T oAAtom2) {
+   assert(oAAtom1 != NULL);
+   assert(oAAtom2 != NULL);
+
+   if(oAAtom1 == oAAtom2)
+      return 0;
+   return strcmp(oAAtom1->pcString, oAAtom2->pcString);
+}
+
+int Atom_compareChars(Atom_T oAAtom, const char *pcStr,
+                      size_t ulLength) {
+   int iCompare;
+
+   assert(oAAtom != NULL);
+   assert(pcStr != NULL);
+
+   iCompare = memcmp(oAAtom->pcString, pcStr,
+                     (oAAtom->ulLength < ulLength) ? oAAtom->ulLength
+                                                   : ulLength);
+   if(iCompare != 0 || oAAtom->ulLength == ulLength)
+      return iCompare;
+   return (oAAtom->ulLength < ulLength) ? -1 : 1;
+}
+
+int Atom_compareString(Atom_T oAAtom, const char *pcStr) {
+   assert(oAAtom != NULL);
+   assert(pcStr != NULL);
+
+   return strcmp(oAAtom->pcString, pcStr);
+}
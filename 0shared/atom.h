@@ -0,0 +1,107 @@
+/*--------------------------------------------------------------------*/
+/* atom.h                                                             */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#ifndef ATOM_INCLUDED
+#define ATOM_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  An atom is an interned, reference-counted string. All atoms for
+  equal strings in one atom table are the same object, so equal names
+  share one buffer and two atoms from the same table are equal exactly
+  when they are the same pointer.
+*/
+typedef const struct atom * Atom_T;
+
+/*
+  An AtomTable_T holds a set of atoms. Tables share nothing with each
+  other, so atoms from different tables may be used from different
+  threads without any locking.
+*/
+typedef struct atomTable *AtomTable_T;
+
+/*
+  Returns a new, empty atom table, or NULL if insufficient memory is
+  available.
+*/
+AtomTable_T AtomTable_new(void);
+
+/*
+  Frees oAtTable and every atom still in it, whatever their reference
+  counts.
+*/
+void AtomTable_free(AtomTable_T oAtTable);
+
+/*
+  Interns the ulLength characters at pcStr (which need not be
+  '\0'-terminated) in oAtTable and takes one reference to the
+  resulting atom. Returns an int SUCCESS status and sets *poAResult to
+  be the atom if successful. Otherwise, sets *poAResult to NULL and
+  returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int Atom_new(AtomTable_T oAtTable, const char *pcStr, size_t ulLength,
+             Atom_T *poAResult);
+
+/* Takes one more reference to oAAtom and returns it. */
+Atom_T Atom_dup(Atom_T oAAtom);
+
+/*
+  Drops one reference to oAAtom, which must be in oAtTable, destroying
+  it and freeing its memory when no references remain.
+*/
+void Atom_free(AtomTable_T oAtTable, Atom_T oAAtom);
+
+/* Returns the '\0'-terminated string held by oAAtom. */
+const char *Atom_getString(Atom_T oAAtom);
+
+/*
+  Returns the length (not including trailing '\0') of the string
+  held by oAAtom.
+*/
+size_t Atom_getLength(Atom_T oAAtom);
+
+/*
+  Returns the hash of the ulLength characters at pcStr (which need not
+  be '\0'-terminated), the same one Atom_getHash returns for an atom
+  of those characters.
+*/
+size_t Atom_hash(const char *pcStr, size_t ulLength);
+
+/* Returns the hash of the string held by oAAtom, computed once when
+   it was interned. */
+size_t Atom_getHash(Atom_T oAAtom);
+
+/*
+  Compares oAAtom1 and oAAtom2 lexicographically based on their
+  strings, answering without a string comparison when they are the
+  same atom.
+  Returns <0, 0, or >0 if oAAtom1 is "less than", "equal to", or
+  "greater than" oAAtom2, respectively.
+*/
+int Atom_compare(Atom_T oAAtom1, Atom_T oAAtom2);
+
+/*
+  Compares oAAtom's string with the ulLength characters at pcStr (which
+  need not be '\0'-terminated, and must not contain '\0')
+  lexicographically, as Atom_compareString would compare them as a
+  string. Both lengths being known, this reads no further than the
+  shorter.
+  Returns <0, 0, or >0 if oAAtom is "less than", "equal to", or
+  "greater than" those characters, respectively.
+*/
+int Atom_compareChars(Atom_T oAAtom, const char *pcStr,
+                      size_t ulLength);
+
+/*
+  Compares oAAtom's string with pcStr lexicographically.
+  Returns <0, 0, or >0 if oAAtom is "less than", "equal to", or
+  "greater than" pcStr, respectively.
+*/
+int Atom_compareString(Atom_T oAAtom, const char *pcStr);
+
+#endif
@@ -7,146 +7,138 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "dynarray.h"
 #include "path.h"
 
-/* An absolute path */
+/* The location of one component within a path's buffers */
+struct pathComponent {
+   /* The offset of the component's first character */
+   size_t ulOffset;
+   /* The string length of the component */
+   size_t ulLength;
+};
+
+/*
+  An absolute path. Each path is a single allocation: this struct is
+  immediately followed by its component table and then by its two
+  character buffers, so creating or freeing a path is one call to the
+  allocator.
+*/
 struct path {
    /* The string representation of the path,
       which uses '/' as the component delimiter */
    const char *pcPath;
    /* The string length of pcPath */
    size_t ulLength;
-   /* The ordered collection of component strings in the path */
-   DynArray_T oDComponents;
+   /* The number of components in the path */
+   size_t ulDepth;
+   /* The offset and length of each component, in order */
+   const struct pathComponent *psComponents;
+   /* A copy of pcPath with each '/' replaced by '\0', so that every
+      component can be handed out as a string by slicing this buffer */
+   const char *pcComponents;
 };
 
 /*
-  Frees pcStr. This wrapper is used to match the requirements of the
-  callback function pointer passed to DynArray_map. pvExtra is unused.
+  Validates pcPath and counts its components. Returns SUCCESS and sets
+  *pulDepth and *pulLength to the number of components in pcPath and
+  its string length, respectively, if pcPath is well-formed. Otherwise,
+  returns BAD_PATH if pcPath is the empty string, or begins or ends
+  with a '/', or contains consecutive '/' delimiters.
 */
-static void Path_freeString(char *pcStr, void *pvExtra) {
-   /* pcStr may be NULL, as this is a no-op to free.
-      pvExtra may be NULL, as it is unused. */
-   free(pcStr);
-}
-
-/*
-  Sets *poDComponents to be an ordered collection of component strings
-  in pcPath, or NULL if an error occurs.
-  Returns one of the following statuses:
-  * SUCCESS if no error occurrs
-  * BAD_PATH if pcPath is the empty string,
-             or begins or ends with a '/',
-             or contains consecutive '/' delimiters
-  * MEMORY_ERROR if memory could not be allocated to complete request
-*/
-static int Path_split(const char *pcPath, DynArray_T *poDComponents) {
-   const char *pcStart = pcPath;
-   const char *pcEnd = pcPath;
-   char *pcCopy;
-   DynArray_T oDSubstrings;
+static int Path_scan(const char *pcPath, size_t *pulDepth,
+                     size_t *pulLength) {
+   const char *pcCurr;
+   size_t ulDepth = 1;
 
    assert(pcPath != NULL);
-   assert(poDComponents != NULL);
+   assert(pulDepth != NULL);
+   assert(pulLength != NULL);
 
-   /* path cannot be empty string */
-   if(*pcPath == '\0') {
-      *poDComponents = NULL;
+   /* path cannot be empty string, and no component can start with
+      a delimiter */
+   if(*pcPath == '\0' || *pcPath == '/')
       return BAD_PATH;
-   }
 
-   oDSubstrings = DynArray_new(0);
-   if(oDSubstrings == NULL) {
-      *poDComponents = NULL;
-      return MEMORY_ERROR;
-   }
-
-   /* validate and split pcPath */
-   while(*pcEnd != '\0') {
-      pcEnd = pcStart;
-      /* component can't start with delimiter */
-      if(*pcEnd == '/') {
-         DynArray_map(oDSubstrings,
-                      (void (*)(void*, void*)) Path_freeString, NULL);
-         DynArray_free(oDSubstrings);
-         *poDComponents = NULL;
-         return BAD_PATH;
+   for(pcCurr = pcPath; *pcCurr != '\0'; pcCurr++) {
+      if(*pcCurr == '/') {
+         /* next component can't be empty */
+         if(pcCurr[1] == '/' || pcCurr[1] == '\0')
+            return BAD_PATH;
+         ulDepth++;
       }
+   }
 
-      /* advance pcEnd to end of next token */
-      while(*pcEnd != '/' && *pcEnd != '\0')
-         pcEnd++;
-
-      /* final component can't end with slash */
-      if(*pcEnd == '\0' && *(pcEnd-1) == '/') {
-         DynArray_map(oDSubstrings,
-                      (void (*)(void*, void*)) Path_freeString, NULL);
-         DynArray_free(oDSubstrings);
-         *poDComponents = NULL;
-         return BAD_PATH;
-      }
+   *pulDepth = ulDepth;
+   *pulLength = (size_t)(pcCurr - pcPath);
+   return SUCCESS;
+}
 
-      pcCopy = calloc((size_t)(pcEnd-pcStart+1), sizeof(char));
-      if(pcCopy == NULL) {
-         DynArray_map(oDSubstrings,
-                      (void (*)(void*, void*)) Path_freeString, NULL);
-         DynArray_free(oDSubstrings);
-         *poDComponents = NULL;
-         return MEMORY_ERROR;
-      }
+/*
+  Allocates a path able to hold a pathname of string length ulLength
+  with ulDepth components, and lays out its internal pointers. The
+  contents of the component table and buffers are left unset.
+  Returns the new path, or NULL if memory could not be allocated.
+*/
+static struct path *Path_alloc(size_t ulLength, size_t ulDepth) {
+   struct path *psNew;
+   char *pcBuffers;
 
-      if( DynArray_add(oDSubstrings, pcCopy) == 0) {
-         DynArray_map(oDSubstrings,
-                      (void (*)(void*, void*)) Path_freeString, NULL);
-         DynArray_free(oDSubstrings);
-         *poDComponents = NULL;
-         return MEMORY_ERROR;
-      }
+   assert(ulDepth > 0);
 
-      while(pcStart != pcEnd) {
-         *pcCopy = *pcStart;
-         pcCopy++;
-         pcStart++;
-      }
+   psNew = malloc(sizeof(struct path)
+                  + ulDepth * sizeof(struct pathComponent)
+                  + 2 * (ulLength + 1));
+   if(psNew == NULL)
+      return NULL;
 
-      pcStart++;
-   }
+   psNew->ulLength = ulLength;
+   psNew->ulDepth = ulDepth;
+   psNew->psComponents = (struct pathComponent *) (psNew + 1);
+   pcBuffers = (char *) (psNew->psComponents + ulDepth);
+   psNew->pcPath = pcBuffers;
+   psNew->pcComponents = pcBuffers + ulLength + 1;
 
-   *poDComponents = oDSubstrings;
-   return SUCCESS;
+   return psNew;
 }
 
-
 int Path_new(const char *pcPath, Path_T *poPResult) {
    struct path *psNew;
-   int iSplitResult;
+   struct pathComponent *psComponent;
+   char *pcComponents;
+   size_t ulDepth, ulLength, i;
+   int iScanResult;
 
    assert(pcPath != NULL);
    assert(poPResult != NULL);
 
-   psNew = calloc(1, sizeof(struct path));
-   if(psNew == NULL) {
+   iScanResult = Path_scan(pcPath, &ulDepth, &ulLength);
+   if(iScanResult != SUCCESS) {
       *poPResult = NULL;
-      return MEMORY_ERROR;
+      return iScanResult;
    }
 
-   /* instantiate and fill list of components */
-   iSplitResult = Path_split(pcPath, &psNew->oDComponents);
-   if(iSplitResult != SUCCESS) {
-      Path_free(psNew);
+   psNew = Path_alloc(ulLength, ulDepth);
+   if(psNew == NULL) {
       *poPResult = NULL;
-      return iSplitResult;
+      return MEMORY_ERROR;
    }
 
-   psNew->ulLength = strlen(pcPath);
-   psNew->pcPath = malloc(psNew->ulLength+1);
-   if(psNew->pcPath == NULL) {
-      Path_free(psNew);
-      *poPResult = NULL;
-      return MEMORY_ERROR;
+   memcpy((char *) psNew->pcPath, pcPath, ulLength + 1);
+   pcComponents = (char *) psNew->pcComponents;
+   memcpy(pcComponents, pcPath, ulLength + 1);
+
+   /* record each component and terminate it in the split buffer */
+   psComponent = (struct pathComponent *) psNew->psComponents;
+   psComponent->ulOffset = 0;
+   for(i = 0; i < ulLength; i++) {
+      if(pcComponents[i] == '/') {
+         pcComponents[i] = '\0';
+         psComponent->ulLength = i - psComponent->ulOffset;
+         psComponent++;
+         psComponent->ulOffset = i + 1;
+      }
    }
-   strcpy((char *)psNew->pcPath, pcPath);
+   psComponent->ulLength = ulLength - psComponent->ulOffset;
 
    *poPResult = psNew;
    return SUCCESS;
@@ -154,11 +146,8 @@ int Path_new(const char *pcPath, Path_T *poPResult) {
 
 int Path_prefix(Path_T oPPath, size_t ulDepth, Path_T *poPResult) {
    struct path *psNew;
-   size_t ulIndex, ulLength, ulSum;
-   const char *pcComponent;
-   char *pcCopy;
-   char *pcBuild;
-   char *pcInsert;
+   const struct pathComponent *psLast;
+   size_t ulLength;
 
    assert(oPPath != NULL);
    assert(poPResult != NULL);
@@ -175,60 +164,23 @@ int Path_prefix(Path_T oPPath, size_t ulDepth, Path_T *poPResult) {
       return NO_SUCH_PATH;
    }
 
-   psNew = calloc(1, sizeof(struct path));
-   if(psNew == NULL) {
-      *poPResult = NULL;
-      return MEMORY_ERROR;
-   }
-
-   psNew->oDComponents = DynArray_new(ulDepth);
-   if(psNew->oDComponents == NULL) {
-      Path_free(psNew);
-      *poPResult = NULL;
-      return MEMORY_ERROR;
-   }
+   /* the prefix ends where its last component does */
+   psLast = &oPPath->psComponents[ulDepth - 1];
+   ulLength = psLast->ulOffset + psLast->ulLength;
 
-   pcBuild = calloc(Path_getStrLength(oPPath)+1, sizeof(char));
-   if(pcBuild == NULL) {
-      Path_free(psNew);
+   psNew = Path_alloc(ulLength, ulDepth);
+   if(psNew == NULL) {
       *poPResult = NULL;
       return MEMORY_ERROR;
    }
 
-   pcInsert = pcBuild;
-   ulSum = 0;
-
-   for(ulIndex = 0; ulIndex < ulDepth; ulIndex++) {
-      /* deep copy each component to new DynArray */
-      pcComponent = Path_getComponent(oPPath, ulIndex);
-      ulLength = strlen(pcComponent);
-      pcCopy = calloc(ulLength + 1, sizeof(char));
-      if(pcCopy == NULL) {
-         free(pcBuild);
-         Path_free(psNew);
-         *poPResult = NULL;
-         return MEMORY_ERROR;
-      }
-      strcpy(pcCopy, pcComponent);
-      (void) DynArray_set(psNew->oDComponents, ulIndex, pcCopy);
-      /* construct prefix's pathname string */
-      strcpy(pcInsert, pcComponent);
-      pcInsert[ulLength] = '/';
-      ulSum += ulLength + 1;
-      pcInsert += ulLength + 1;
-   }
-   pcBuild[ulSum-1] = '\0';
-
-   /* shrink allocation to fit prefix's pathname string if needed */
-   pcInsert = realloc(pcBuild, ulSum);
-   if(pcInsert == NULL) {
-      free(pcBuild);
-      Path_free(psNew);
-      *poPResult = NULL;
-      return MEMORY_ERROR;
-   }
-   psNew->ulLength = ulSum-1;
-   psNew->pcPath = pcInsert;
+   /* the prefix's components sit at the same offsets as in oPPath */
+   memcpy((struct pathComponent *) psNew->psComponents,
+          oPPath->psComponents, ulDepth * sizeof(struct pathComponent));
+   memcpy((char *) psNew->pcPath, oPPath->pcPath, ulLength);
+   ((char *) psNew->pcPath)[ulLength] = '\0';
+   memcpy((char *) psNew->pcComponents, oPPath->pcComponents, ulLength);
+   ((char *) psNew->pcComponents)[ulLength] = '\0';
 
    *poPResult = psNew;
    return SUCCESS;
@@ -242,15 +194,7 @@ int Path_dup(Path_T oPPath, Path_T *poPResult) {
 }
 
 void Path_free(Path_T oPPath) {
-   if(oPPath != NULL) {
-      free((char *)oPPath->pcPath);
-
-      if(oPPath->oDComponents != NULL) {
-         DynArray_map(oPPath->oDComponents,
-                      (void (*)(void*, void*)) Path_freeString, NULL);
-         DynArray_free(oPPath->oDComponents);
-      }
-   }
+   /* the struct, its component table, and its buffers are one block */
    free((struct path*) oPPath);
 }
 
@@ -283,7 +227,7 @@ int Path_compareString(Path_T oPPath, const char *pcStr) {
 size_t Path_getDepth(Path_T oPPath) {
    assert(oPPath != NULL);
 
-   return DynArray_getLength(oPPath->oDComponents);
+   return oPPath->ulDepth;
 }
 
 size_t Path_getSharedPrefixDepth(Path_T oPPath1, Path_T oPPath2) {
@@ -299,8 +243,12 @@ size_t Path_getSharedPrefixDepth(Path_T oPPath1, Path_T oPPath2) {
    else
       ulMin = ulDepth2;
    for(i = 0; i < ulMin; i++) {
-      if(strcmp(Path_getComponent(oPPath1, i),
-                Path_getComponent(oPPath2, i)))
+      const struct pathComponent *psC1 = &oPPath1->psComponents[i];
+      const struct pathComponent *psC2 = &oPPath2->psComponents[i];
+      if(psC1->ulLength != psC2->ulLength ||
+         memcmp(oPPath1->pcComponents + psC1->ulOffset,
+                oPPath2->pcComponents + psC2->ulOffset,
+                psC1->ulLength))
          return i;
    }
    return ulMin;
@@ -312,5 +260,12 @@ const char *Path_getComponent(Path_T oPPath, size_t ulLevel) {
    if(ulLevel >= Path_getDepth(oPPath))
       return NULL;
 
-   return DynArray_get(oPPath->oDComponents, ulLevel);
+   return oPPath->pcComponents + oPPath->psComponents[ulLevel].ulOffset;
+}
+
+size_t Path_getComponentLength(Path_T oPPath, size_t ulLevel) {
+   assert(oPPath != NULL);
+   assert(ulLevel < Path_getDepth(oPPath));
+
+   return oPPath->psComponents[ulLevel].ulLength;
 }
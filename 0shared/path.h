@@ -93,4 +93,11 @@ size_t Path_getSharedPrefixDepth(Path_T oPPath1, Path_T oPPath2);
 */
 const char *Path_getComponent(Path_T oPPath, size_t ulLevel);
 
+/*
+  Returns the string length of the component of oPPath at level
+  ulLevel, counted as in Path_getComponent, which must be less than
+  oPPath's depth.
+*/
+size_t Path_getComponentLength(Path_T oPPath, size_t ulLevel);
+
 #endif
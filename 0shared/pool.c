@@ -0,0 +1,128 @@
+/*--------------------------------------------------------------------*/
+/* pool.c                                                             */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+/* The number of objects carved from each slab */
+#define POOL_SLAB_OBJECTS 512
+
+/* A type with the strictest alignment a pooled object may need */
+union poolAlign {
+   void *pv;
+   long l;
+   double d;
+};
+
+/*
+  The header of one slab. The slab's objects follow it in the same
+  allocation; the union keeps the first of them suitably aligned.
+*/
+union slab {
+   /* the next slab in the pool */
+   union slab *psNext;
+   /* unused; forces the header to be a multiple of the alignment */
+   union poolAlign align;
+};
+
+/* A released object, threaded onto the pool's free list */
+struct freeObject {
+   /* the next released object */
+   struct freeObject *psNext;
+};
+
+/* A pool of fixed-size objects */
+struct pool {
+   /* the size of each object, rounded up to the alignment */
+   size_t ulObjectSize;
+   /* every slab allocated for this pool */
+   union slab *psSlabs;
+   /* released objects, ready to be handed out again */
+   struct freeObject *psFree;
+   /* the next never-used object in the newest slab */
+   char *pcNext;
+   /* the end of the newest slab */
+   char *pcEnd;
+};
+
+Pool_T Pool_new(size_t ulObjectSize) {
+   struct pool *psPool;
+   const size_t ulAlign = sizeof(union poolAlign);
+
+   /* every object must be able to hold a free list link */
+   if(ulObjectSize < sizeof(struct freeObject))
+      ulObjectSize = sizeof(struct freeObject);
+
+   psPool = malloc(sizeof(struct pool));
+   if(psPool == NULL)
+      return NULL;
+
+   psPool->ulObjectSize =
+      (ulObjectSize + ulAlign - 1) / ulAlign * ulAlign;
+   psPool->psSlabs = NULL;
+   psPool->psFree = NULL;
+   psPool->pcNext = NULL;
+   psPool->pcEnd = NULL;
+   return psPool;
+}
+
+void Pool_free(Pool_T oPlPool) {
+   union slab *psSlab;
+   union slab *psNext;
+
+   if(oPlPool == NULL)
+      return;
+
+   for(psSlab = oPlPool->psSlabs; psSlab != NULL; psSlab = psNext) {
+      psNext = psSlab->psNext;
+      free(psSlab);
+   }
+   free(oPlPool);
+}
+
+void *Pool_alloc(Pool_T oPlPool) {
+   union slab *psSlab;
+   void *pvObject;
+
+   assert(oPlPool != NULL);
+
+   /* prefer reusing a released object */
+   if(oPlPool->psFree != NULL) {
+      pvObject = oPlPool->psFree;
+      oPlPool->psFree = oPlPool->psFree->psNext;
+      return pvObject;
+   }
+
+   /* start a new slab once the newest one is used up */
+   if(oPlPool->pcNext == oPlPool->pcEnd) {
+      psSlab = malloc(sizeof(union slab)
+                      + POOL_SLAB_OBJECTS * oPlPool->ulObjectSize);
+      if(psSlab == NULL)
+         return NULL;
+      psSlab->psNext = oPlPool->psSlabs;
+      oPlPool->psSlabs = psSlab;
+      oPlPool->pcNext = (char *) (psSlab + 1);
+      oPlPool->pcEnd = oPlPool->pcNext
+                       + POOL_SLAB_OBJECTS * oPlPool->ulObjectSize;
+   }
+
+   pvObject = oPlPool->pcNext;
+   oPlPool->pcNext += oPlPool->ulObjectSize;
+   return pvObject;
+}
+
+void Pool_release(Pool_T oPlPool, void *pvObject) {
+   struct freeObject *psObject = pvObject;
+
+   assert(oPlPool != NULL);
+
+   if(pvObject == NULL)
+      return;
+
+   psObject->psNext = oPlPool->psFree;
+   oPlPool->psFree = psObject;
+}
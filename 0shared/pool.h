@@ -0,0 +1,43 @@
+/*--------------------------------------------------------------------*/
+/* pool.h                                                             */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#ifndef POOL_INCLUDED
+#define POOL_INCLUDED
+
+#include <stddef.h>
+
+/*
+  A Pool_T hands out objects of one fixed size, carved from large
+  slabs. Released objects are kept for reuse by the same pool, and
+  freeing the pool returns every slab at once, so objects that die
+  together can be dropped without visiting each one.
+*/
+typedef struct pool *Pool_T;
+
+/*
+  Returns a new, empty pool of objects of ulObjectSize bytes each, or
+  NULL if insufficient memory is available.
+*/
+Pool_T Pool_new(size_t ulObjectSize);
+
+/*
+  Frees oPlPool and all of its slabs, including every object allocated
+  from it that has not been released.
+*/
+void Pool_free(Pool_T oPlPool);
+
+/*
+  Returns an uninitialized object from oPlPool, or NULL if
+  insufficient memory is available.
+*/
+void *Pool_alloc(Pool_T oPlPool);
+
+/*
+  Returns pvObject, which must have been allocated from oPlPool, to
+  oPlPool for reuse.
+*/
+void Pool_release(Pool_T oPlPool, void *pvObject);
+
+#endif
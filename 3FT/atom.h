@@ -0,0 +1 @@
+../0shared/atom.h
\ No newline at end of file
@@ -0,0 +1,239 @@
+/*--------------------------------------------------------------------*/
+/* epoch.c                                                            */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+/* pthread keys and sched_yield are POSIX, not ISO C */
+#define _XOPEN_SOURCE 600
+
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "epoch.h"
+
+/* The number of reader slots; threads beyond this many share slots */
+#define EPOCH_SLOTS 64
+
+/* The size of a cache line, which each slot is padded out to */
+#define EPOCH_LINE 64
+
+/* How many retired objects may pile up before a writer frees them */
+#define EPOCH_BATCH 128
+
+/*
+  The reader counts of one slot. A reader counts itself under the
+  phase it entered in, so a reclaimer can wait out exactly the readers
+  that started before it flipped the phase.
+*/
+union epochSlot {
+   /* the number of readers inside each phase */
+   size_t aulActive[2];
+   /* unused; keeps neighbouring slots off each other's cache line */
+   char acLine[EPOCH_LINE];
+};
+
+/* An object waiting to be freed */
+struct retired {
+   /* the object retired just before this one */
+   struct retired *psNext;
+   /* the function that frees the object */
+   void (*pfFree)(void *pvObject);
+   /* the object itself */
+   void *pvObject;
+};
+
+/* The reader slots of one structure and the objects retired from it */
+struct epoch {
+   /* the reader counts, one cache line per slot */
+   union epochSlot aSlots[EPOCH_SLOTS];
+   /* the phase that new readers count themselves under, 0 or 1 */
+   size_t ulPhase;
+   /* guards the fields below and serializes reclamation */
+   pthread_mutex_t sMutex;
+   /* retired objects, newest first */
+   struct retired *psRetired;
+   /* the number of objects in psRetired */
+   size_t ulRetired;
+};
+
+/* Each thread's slot, handed out round-robin on its first read */
+static pthread_once_t sSlotOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t sSlotKey;
+static int iSlotKeyStatus = -1;
+static size_t ulNextSlot;
+/* the key's values point into this array, one element per slot */
+static char acSlotTags[EPOCH_SLOTS];
+
+/* Creates the key that remembers each thread's slot. */
+static void Epoch_makeSlotKey(void) {
+   iSlotKeyStatus = pthread_key_create(&sSlotKey, NULL);
+}
+
+/*
+  Returns the calling thread's slot, assigning one on first use. If no
+  key could be made, every thread shares slot 0, which is still correct.
+*/
+static size_t Epoch_getSlot(void) {
+   char *pcTag;
+   size_t ulSlot;
+
+   (void) pthread_once(&sSlotOnce, Epoch_makeSlotKey);
+   if(iSlotKeyStatus != 0)
+      return 0;
+
+   pcTag = pthread_getspecific(sSlotKey);
+   if(pcTag != NULL)
+      return (size_t) (pcTag - acSlotTags);
+
+   ulSlot = __atomic_fetch_add(&ulNextSlot, 1, __ATOMIC_RELAXED)
+            % EPOCH_SLOTS;
+   (void) pthread_setspecific(sSlotKey, &acSlotTags[ulSlot]);
+   return ulSlot;
+}
+
+Epoch_T Epoch_new(void) {
+   struct epoch *psEpoch;
+   size_t i;
+
+   psEpoch = malloc(sizeof(struct epoch));
+   if(psEpoch == NULL)
+      return NULL;
+
+   if(pthread_mutex_init(&psEpoch->sMutex, NULL) != 0) {
+      free(psEpoch);
+      return NULL;
+   }
+   for(i = 0; i < EPOCH_SLOTS; i++) {
+      psEpoch->aSlots[i].aulActive[0] = 0;
+      psEpoch->aSlots[i].aulActive[1] = 0;
+   }
+   psEpoch->ulPhase = 0;
+   psEpoch->psRetired = NULL;
+   psEpoch->ulRetired = 0;
+   return psEpoch;
+}
+
+/*
+  Frees psRetired, a list of retired objects newest first, oldest
+  object first: a later object may still be referred to by an earlier
+  one's free function, but never the other way around.
+*/
+static void Epoch_freeList(struct retired *psRetired) {
+   struct retired *psReversed = NULL;
+   struct retired *psNext;
+
+   for(; psRetired != NULL; psRetired = psNext) {
+      psNext = psRetired->psNext;
+      psRetired->psNext = psReversed;
+      psReversed = psRetired;
+   }
+   for(; psReversed != NULL; psReversed = psNext) {
+      psNext = psReversed->psNext;
+      (*psReversed->pfFree)(psReversed->pvObject);
+      free(psReversed);
+   }
+}
+
+void Epoch_free(Epoch_T oEEpoch) {
+   if(oEEpoch == NULL)
+      return;
+
+   Epoch_freeList(oEEpoch->psRetired);
+   (void) pthread_mutex_destroy(&oEEpoch->sMutex);
+   free(oEEpoch);
+}
+
+size_t Epoch_enter(Epoch_T oEEpoch) {
+   union epochSlot *psSlot;
+   size_t ulPhase;
+
+   assert(oEEpoch != NULL);
+
+   psSlot = &oEEpoch->aSlots[Epoch_getSlot()];
+   for(;;) {
+      ulPhase = __atomic_load_n(&oEEpoch->ulPhase, __ATOMIC_SEQ_CST);
+      __atomic_fetch_add(&psSlot->aulActive[ulPhase], 1,
+                         __ATOMIC_SEQ_CST);
+      /* a reclaimer that flipped the phase meanwhile may not have
+         seen this reader, so count again under the new phase */
+      if(__atomic_load_n(&oEEpoch->ulPhase, __ATOMIC_SEQ_CST)
+         == ulPhase)
+         return (size_t) (psSlot - oEEpoch->aSlots) * 2 + ulPhase;
+      __atomic_fetch_sub(&psSlot->aulActive[ulPhase], 1,
+                         __ATOMIC_RELEASE);
+   }
+}
+
+void Epoch_leave(Epoch_T oEEpoch, size_t ulTicket) {
+   assert(oEEpoch != NULL);
+   assert(ulTicket < 2 * EPOCH_SLOTS);
+
+   __atomic_fetch_sub(&oEEpoch->aSlots[ulTicket / 2]
+                         .aulActive[ulTicket % 2],
+                      1, __ATOMIC_RELEASE);
+}
+
+/*
+  Takes every object retired to oEEpoch so far, waits until no reader
+  that might see one is left, and frees them. The caller must hold
+  oEEpoch's mutex.
+*/
+static void Epoch_reclaimLocked(Epoch_T oEEpoch) {
+   struct retired *psRetired;
+   size_t ulOld;
+   size_t i;
+
+   assert(oEEpoch != NULL);
+
+   psRetired = oEEpoch->psRetired;
+   oEEpoch->psRetired = NULL;
+   oEEpoch->ulRetired = 0;
+
+   /* readers that start from now on cannot reach psRetired, so only
+      those counted under the old phase need to finish */
+   ulOld = oEEpoch->ulPhase;
+   __atomic_store_n(&oEEpoch->ulPhase, 1 - ulOld, __ATOMIC_SEQ_CST);
+   for(i = 0; i < EPOCH_SLOTS; i++)
+      while(__atomic_load_n(&oEEpoch->aSlots[i].aulActive[ulOld],
+                            __ATOMIC_SEQ_CST) != 0)
+         (void) sched_yield();
+
+   Epoch_freeList(psRetired);
+}
+
+void Epoch_retire(Epoch_T oEEpoch, void (*pfFree)(void *pvObject),
+                  void *pvObject) {
+   struct retired *psRetired;
+
+   assert(oEEpoch != NULL);
+   assert(pfFree != NULL);
+
+   psRetired = malloc(sizeof(struct retired));
+
+   (void) pthread_mutex_lock(&oEEpoch->sMutex);
+   if(psRetired == NULL) {
+      /* nowhere to keep pvObject, so wait until it is safe to free */
+      Epoch_reclaimLocked(oEEpoch);
+      (void) pthread_mutex_unlock(&oEEpoch->sMutex);
+      (*pfFree)(pvObject);
+      return;
+   }
+
+   psRetired->pfFree = pfFree;
+   psRetired->pvObject = pvObject;
+   psRetired->psNext = oEEpoch->psRetired;
+   oEEpoch->psRetired = psRetired;
+   if(++oEEpoch->ulRetired >= EPOCH_BATCH)
+      Epoch_reclaimLocked(oEEpoch);
+   (void) pthread_mutex_unlock(&oEEpoch->sMutex);
+}
+
+void Epoch_reclaim(Epoch_T oEEpoch) {
+   assert(oEEpoch != NULL);
+
+   (void) pthread_mutex_lock(&oEEpoch->sMutex);
+   Epoch_reclaimLocked(oEEpoch);
+   (void) pthread_mutex_unlock(&oEEpoch->sMutex);
+}
@@ -0,0 +1,61 @@
+/*--------------------------------------------------------------------*/
+/* epoch.h                                                            */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#ifndef EPOCH_INCLUDED
+#define EPOCH_INCLUDED
+
+#include <stddef.h>
+
+/*
+  An Epoch_T lets readers traverse a shared structure without taking
+  any lock, while writers unlink parts of it. A reader brackets each
+  traversal with Epoch_enter and Epoch_leave; a writer that unlinks an
+  object hands it to Epoch_retire instead of freeing it, and it is
+  freed only once every reader that might still see it has left.
+  Readers touch only a counter of their own, so they do not contend
+  with each other.
+*/
+typedef struct epoch *Epoch_T;
+
+/*
+  Returns a new epoch with nothing retired, or NULL if insufficient
+  memory is available.
+*/
+Epoch_T Epoch_new(void);
+
+/*
+  Frees every object still retired to oEEpoch, and then oEEpoch
+  itself. No reader may be inside oEEpoch. Does nothing if oEEpoch is
+  NULL.
+*/
+void Epoch_free(Epoch_T oEEpoch);
+
+/*
+  Marks the calling thread as reading under oEEpoch, and returns a
+  ticket to pass to the matching Epoch_leave. No object retired after
+  this call returns is freed before that Epoch_leave.
+*/
+size_t Epoch_enter(Epoch_T oEEpoch);
+
+/* Ends the read that Epoch_enter on oEEpoch returned ulTicket for. */
+void Epoch_leave(Epoch_T oEEpoch, size_t ulTicket);
+
+/*
+  Arranges for (*pfFree)(pvObject) to be called once no reader that
+  entered oEEpoch before this call is still inside it. pvObject must
+  already be unreachable for new readers. Occasionally frees a batch
+  of earlier retired objects, waiting for readers to leave if need
+  be; if memory runs out, waits and frees pvObject at once.
+*/
+void Epoch_retire(Epoch_T oEEpoch, void (*pfFree)(void *pvObject),
+                  void *pvObject);
+
+/*
+  Frees every object retired to oEEpoch so far, first waiting for
+  every reader that might still see one to leave.
+*/
+void Epoch_reclaim(Epoch_T oEEpoch);
+
+#endif
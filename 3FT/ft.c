@@ -1,25 +1,190 @@
 /* ft.c */
 
+/* pthread_rwlock_t is POSIX, not ISO C, so ask for it explicitly */
+#define _XOPEN_SOURCE 600
+
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "ft.h"
 #include "nodeFT.h"
-#include "dynarray.h"
+#include "pathIndex.h"
+#include "epoch.h"
+#include "image.h"
+#include "journal.h"
+#include "idTable.h"
+#include "reclaimer.h"
+
+/*
+  A File Tree is a representation of a hierarchy of directories and
+  files. Each FT_T is one such tree, with 12 state variables:
+*/
+struct ft {
+   /* 1. a pointer to the root node in the hierarchy */
+   Node_T oNRoot;
+   /* 2. a counter of the number of nodes in the hierarchy, changed
+         atomically, since writers on different directories can change
+         it at the same time in concurrent mode; it still counts
+         removed subtrees until the reclaimer has counted them (see
+         FT_getCount) */
+   size_t ulCount;
+   /* 3. an index from full pathname to node, or NULL while the
+         optional index is turned off */
+   PathIndex_T oIIndex;
+   /* 4. a flag for being in concurrent mode (TRUE), in which every
+         operation takes sLock, or not (FALSE) */
+   boolean bConcurrent;
+   /* 5. a lock shared by readers and held exclusively by writers
+         that cannot work under directory latches */
+   pthread_rwlock_t sLock;
+   /* 6. the epoch that lock-free lookups run in, or NULL outside
+         concurrent mode */
+   Epoch_T oEEpoch;
+   /* 7. a flag for being a snapshot (TRUE), which shares its nodes
+         with the tree it was taken from and is never changed, or not
+         (FALSE) */
+   boolean bSnapshot;
+   /* 8. the journal that every change is recorded in, or NULL if
+         none is open */
+   struct ftJournal *psJournal;
+   /* 9. the table of IDs that every node in the hierarchy has one
+         of, or NULL until the first root is made; always NULL in a
+         snapshot */
+   IdTable_T oItIds;
+   /* 10. the reclaimer that removed subtrees are freed by in the
+          background, or NULL to free them before the change returns;
+          always NULL in a snapshot */
+   Reclaimer_T oRReclaimer;
+};
+
+/* An FT's journal, and the files it is checkpointed with */
+struct ftJournal {
+   /* the journal being appended to */
+   Journal_T oJJournal;
+   /* the image that checkpoints save the FT to */
+   char *pcImage;
+   /* the name the journal is moved to while a checkpoint saves the
+      image, which holds changes not in the image yet as long as it
+      exists */
+   char *pcOld;
+   /* a flag for pcOld existing (TRUE) or not (FALSE) */
+   boolean bRotated;
+   /* a lock that lets only one checkpoint run at a time */
+   pthread_mutex_t sCheckpointLock;
+};
+
+/* The suffix of the journal's name while a checkpoint runs */
+#define FT_OLD_SUFFIX ".old"
 
 /*
-  A File Tree is a representation of a hierarchy of directories and 
-  files, represented as an AO with 3 state variables:
+  The functions that take no FT_T all work on one default tree,
+  represented as an AO with 2 state variables:
 */
 
 /* 1. a flag for being in an initialized state (TRUE) or not (FALSE) */
 static boolean bIsInitialized;
-/* 2. a pointer to the root node in the hierarchy */
-static Node_T oNRoot;
-/* 3. a counter of the number of nodes in the hierarchy */
-static size_t ulCount;
+/* 2. the default tree, meaningful only while initialized; its lock
+      lives as long as the program, so it is initialized only once */
+static struct ft sDefaultTree = {NULL, 0, NULL, FALSE,
+                                 PTHREAD_RWLOCK_INITIALIZER, NULL,
+                                 FALSE, NULL, NULL, NULL};
+
+/*
+  The status that latched writers give up with when the path they would
+  change is shared with a snapshot, so that the change is retried with
+  the whole FT locked. A directory handle also uses it to fall back to
+  latching its directory top-down while a change may be at work on
+  it. Never returned to clients.
+*/
+#define FT_SHARED (MEMORY_ERROR + 1)
+
+
+
+/*
+  Acquires oFTree's lock for reading if oFTree is in concurrent mode,
+  waiting while a writer holds it. Any number of readers may hold the
+  lock at once.
+*/
+static void FT_lockRead(FT_T oFTree)
+{
+   int iStatus;
+
+   assert(oFTree != NULL);
+
+   if (oFTree->bConcurrent)
+   {
+      iStatus = pthread_rwlock_rdlock(&oFTree->sLock);
+      assert(iStatus == 0);
+      (void)iStatus;
+   }
+}
+
+/*
+  Acquires oFTree's lock for writing if oFTree is in concurrent mode,
+  waiting until no other reader or writer holds it.
+*/
+static void FT_lockWrite(FT_T oFTree)
+{
+   int iStatus;
+
+   assert(oFTree != NULL);
+
+   if (oFTree->bConcurrent)
+   {
+      iStatus = pthread_rwlock_wrlock(&oFTree->sLock);
+      assert(iStatus == 0);
+      (void)iStatus;
+   }
+}
+
+/*
+  Releases the lock on oFTree taken by FT_lockRead or FT_lockWrite.
+*/
+static void FT_unlock(FT_T oFTree)
+{
+   int iStatus;
+
+   assert(oFTree != NULL);
+
+   if (oFTree->bConcurrent)
+   {
+      iStatus = pthread_rwlock_unlock(&oFTree->sLock);
+      assert(iStatus == 0);
+      (void)iStatus;
+   }
+}
+
+/*
+  Records the change eOp to pcPath, with contents pvContents of
+  ulLength bytes if it takes any, in oFTree's journal, if it has one.
+  The caller has just made the change, and still holds whatever lock
+  or latch kept other writers from changing the same path meanwhile,
+  so that the journal sees changes in the order they were made.
+*/
+static void FT_record(FT_T oFTree, JournalOp eOp, const char *pcPath,
+                      const void *pvContents, size_t ulLength)
+{
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+
+   if (oFTree->psJournal != NULL)
+      Journal_append(oFTree->psJournal->oJJournal, eOp, pcPath,
+                     pvContents, ulLength);
+}
 
+/*
+  Writes out a batch of oFTree's journal, if it has one and a whole
+  batch is waiting. The caller holds no lock or latch on oFTree, so
+  that other writers go on while the batch is synced.
+*/
+static void FT_commit(FT_T oFTree)
+{
+   assert(oFTree != NULL);
 
+   if (oFTree->psJournal != NULL)
+      Journal_commit(oFTree->psJournal->oJJournal);
+}
 
 /* --------------------------------------------------------------------
 
@@ -33,105 +198,115 @@ static size_t ulCount;
 */
 
 /*
-  Traverses the FT starting at the root as far as possible towards
-  absolute path oPPath. If able to traverse, returns an int SUCCESS
-  status and sets *poNFurthest to the furthest node reached (which may
-  be only a prefix of oPPath, or even NULL if the root is NULL).
-  Otherwise, sets *poNFurthest to NULL and returns with status:
-  * CONFLICTING_PATH if the root's path is not a prefix of oPPath
-  * MEMORY_ERROR if memory could not be allocated to complete request
+  Descends from oNCurr, a node on absolute path oPPath, as far as
+  possible towards oPPath. Returns an int SUCCESS status and sets
+  *poNFurthest to the furthest node reached (which may be oNCurr
+  itself).
+
+  Each level is matched by comparing a child's final component against
+  the component of oPPath at that level, so no prefix Path_T objects
+  are built and the traversal performs no heap allocation.
 */
-static int FT_traversePath(Path_T oPPath, Node_T *poNFurthest)
+static int FT_descend(Node_T oNCurr, Path_T oPPath,
+                      Node_T *poNFurthest)
 {
-   int iStatus;
-   Path_T oPPrefix = NULL;
-   Node_T oNCurr;
    Node_T oNChild = NULL;
    size_t ulDepth;
    size_t i;
-   size_t ulChildID;
 
+   assert(oNCurr != NULL);
    assert(oPPath != NULL);
    assert(poNFurthest != NULL);
 
-   /* root is NULL -> won't find anything */
-   if (oNRoot == NULL)
-   {
-      *poNFurthest = NULL;
-      return SUCCESS;
-   }
-
-   iStatus = Path_prefix(oPPath, 1, &oPPrefix);
-   if (iStatus != SUCCESS)
-   {
-      *poNFurthest = NULL;
-      return iStatus;
-   }
-
-   if (Path_comparePath(Node_getPath(oNRoot), oPPrefix))
-   {
-      Path_free(oPPrefix);
-      *poNFurthest = NULL;
-      return CONFLICTING_PATH;
-   }
-   Path_free(oPPrefix);
-   oPPrefix = NULL;
-
-   oNCurr = oNRoot;
    ulDepth = Path_getDepth(oPPath);
-   for (i = 2; i <= ulDepth; i++)
+   for (i = Node_getDepth(oNCurr); i < ulDepth; i++)
    {
-      iStatus = Path_prefix(oPPath, i, &oPPrefix);
-      if (iStatus != SUCCESS)
-      {
-         *poNFurthest = NULL;
-         return iStatus;
-      }
-      if (Node_hasChild(oNCurr, oPPrefix, &ulChildID))
+      if (Node_findChild(oNCurr, Path_getComponent(oPPath, i),
+                         &oNChild))
       {
-         /* go to that child and continue with next prefix */
-         Path_free(oPPrefix);
-         oPPrefix = NULL;
-         iStatus = Node_getChild(oNCurr, ulChildID, &oNChild);
-         if (iStatus != SUCCESS)
-         {
-            *poNFurthest = NULL;
-            return iStatus;
-         }
+         /* go to that child and continue with next component */
          oNCurr = oNChild;
       }
       else
       {
-         /* oNCurr doesn't have child with path oPPrefix:
+         /* oNCurr doesn't have child with this component:
             this is as far as we can go */
          break;
       }
    }
 
-   Path_free(oPPrefix);
    *poNFurthest = oNCurr;
    return SUCCESS;
 }
 
 /*
-  Traverses the FT to find a node with absolute path pcPath. Returns a
-  int SUCCESS status and sets *poNResult to be the node, if found.
+  Traverses oFTree starting at the root as far as possible towards
+  absolute path oPPath. If able to traverse, returns an int SUCCESS
+  status and sets *poNFurthest to the furthest node reached (which may
+  be only a prefix of oPPath, or even NULL if the root is NULL).
+  Otherwise, sets *poNFurthest to NULL and returns with status:
+  * CONFLICTING_PATH if the root's path is not a prefix of oPPath
+*/
+static int FT_traversePath(FT_T oFTree, Path_T oPPath,
+                           Node_T *poNFurthest)
+{
+   assert(oFTree != NULL);
+   assert(oPPath != NULL);
+   assert(poNFurthest != NULL);
+
+   /* root is NULL -> won't find anything */
+   if (oFTree->oNRoot == NULL)
+   {
+      *poNFurthest = NULL;
+      return SUCCESS;
+   }
+
+   if (Atom_compareString(Node_getName(oFTree->oNRoot),
+                          Path_getComponent(oPPath, 0)))
+   {
+      *poNFurthest = NULL;
+      return CONFLICTING_PATH;
+   }
+
+   return FT_descend(oFTree->oNRoot, oPPath, poNFurthest);
+}
+
+/*
+  Traverses oFTree to find a node with absolute path pcPath. Returns
+  an int SUCCESS status and sets *poNResult to be the node, if found.
   Otherwise, sets *poNResult to NULL and returns with status:
-  * INITIALIZATION_ERROR if the DT is not in an initialized state
   * BAD_PATH if pcPath does not represent a well-formatted path
   * CONFLICTING_PATH if the root's path is not a prefix of pcPath
   * NO_SUCH_PATH if no node with pcPath exists in the hierarchy
   * MEMORY_ERROR if memory could not be allocated to complete request
  */
-static int FT_findNode(const char *pcPath, Node_T *poNResult)
+static int FT_findNode(FT_T oFTree, const char *pcPath,
+                       Node_T *poNResult)
 {
    Path_T oPPath = NULL;
    Node_T oNFound = NULL;
+   size_t ulLength;
    int iStatus;
 
+   assert(oFTree != NULL);
    assert(pcPath != NULL);
    assert(poNResult != NULL);
 
+   /* with the index on, a node in the tree is found in one probe;
+      only a miss needs the full parse to say why */
+   if (oFTree->oIIndex != NULL)
+   {
+      ulLength = strlen(pcPath);
+      oNFound = PathIndex_get(oFTree->oIIndex,
+                              PathIndex_hash(pcPath, ulLength),
+                              pcPath, ulLength);
+      if (oNFound != NULL)
+      {
+         *poNResult = oNFound;
+         return SUCCESS;
+      }
+   }
+
    iStatus = Path_new(pcPath, &oPPath);
    if (iStatus != SUCCESS)
    {
@@ -139,7 +314,7 @@ static int FT_findNode(const char *pcPath, Node_T *poNResult)
       return iStatus;
    }
 
-   iStatus = FT_traversePath(oPPath, &oNFound);
+   iStatus = FT_traversePath(oFTree, oPPath, &oNFound);
    if (iStatus != SUCCESS)
    {
       Path_free(oPPath);
@@ -154,7 +329,9 @@ static int FT_findNode(const char *pcPath, Node_T *poNResult)
       return NO_SUCH_PATH;
    }
 
-   if (Path_comparePath(Node_getPath(oNFound), oPPath) != 0)
+   /* every level traversed matched oPPath, so the node found is
+      oPPath exactly when it is as deep as oPPath */
+   if (Node_getDepth(oNFound) != Path_getDepth(oPPath))
    {
       Path_free(oPPath);
       *poNResult = NULL;
@@ -167,80 +344,232 @@ static int FT_findNode(const char *pcPath, Node_T *poNResult)
 }
 
 /*
-   Inserts a new node into the FT with absolute path pcPath and type
-   nodeType. If the nodeType is NODE_FILE, the node's contents are set
-   to pvContents and the node's size field is set to ulLength. Returns 
-   SUCCESS if the new node is inserted successfully.
-   Otherwise, returns:
-   * INITIALIZATION_ERROR if the FT is not in an initialized state
-   * BAD_PATH if pcPath does not represent a well-formatted path
-   * CONFLICTING_PATH if the root exists but is not a prefix of pcPath,
-                      or if the node is a file and would be the FT root
-   * NOT_A_DIRECTORY if a proper prefix of pcPath exists as a file
-   * ALREADY_IN_TREE if pcPath is already in the FT (as dir or file)
-   * MEMORY_ERROR if memory could not be allocated to complete request
+  Returns the path index hash of the first ulDepth components of
+  oPPath, which must be at least 1 and at most oPPath's depth.
 */
-static int FT_insertNode(const char *pcPath, NodeType nodeType,
-                         void *pvContents, size_t ulLength)
+static size_t FT_hashPrefix(Path_T oPPath, size_t ulDepth)
 {
-   int iStatus;
-   Path_T oPPath = NULL;
-   Node_T oNFirstNew = NULL;
-   Node_T oNCurr = NULL;
-   size_t ulDepth, ulIndex;
-   size_t ulNewNodes = 0;
-
-   assert(pcPath != NULL);
+   const char *pcComponent;
+   size_t ulHash;
+   size_t i;
 
-   /* validate pcPath and generate a Path_T for it */
-   iStatus = Path_new(pcPath, &oPPath);
-   if (iStatus != SUCCESS)
-      return iStatus;
+   assert(oPPath != NULL);
+   assert(ulDepth >= 1);
 
-   /* find the closest ancestor of oPPath already in the tree */
-   iStatus = FT_traversePath(oPPath, &oNCurr);
-   if (iStatus != SUCCESS)
+   pcComponent = Path_getComponent(oPPath, 0);
+   ulHash = PathIndex_hash(pcComponent, strlen(pcComponent));
+   for (i = 1; i < ulDepth; i++)
    {
-      Path_free(oPPath);
-      return iStatus;
+      pcComponent = Path_getComponent(oPPath, i);
+      ulHash = PathIndex_hashChild(ulHash, pcComponent,
+                                   strlen(pcComponent));
    }
+   return ulHash;
+}
 
-   /* no ancestor node found, so if root is not NULL,
-      pcPath isn't underneath root. */
-   if (oNCurr == NULL && oNRoot != NULL)
+/*
+  Returns the node after oNNode in a pre-order walk of the subtree
+  rooted at oNRoot, updating *pulIndex as Node_nextInSubtree does, or
+  NULL once the walk is done. Updates *pulHash from the hash of
+  oNNode's path to that of the next node's, unwinding the hashes of
+  any directories it climbs out of.
+*/
+static Node_T FT_nextHashed(Node_T oNRoot, Node_T oNNode,
+                            size_t *pulIndex, size_t *pulHash)
+{
+   Node_T oNNext;
+   Atom_T oAName;
+
+   assert(oNRoot != NULL);
+   assert(oNNode != NULL);
+   assert(pulIndex != NULL);
+   assert(pulHash != NULL);
+
+   oNNext = Node_nextInSubtree(oNRoot, oNNode, pulIndex);
+   if (oNNext == NULL)
+      return NULL;
+   while (oNNode != Node_getParent(oNNext))
    {
-      Path_free(oPPath);
-      return CONFLICTING_PATH;
+      oAName = Node_getName(oNNode);
+      *pulHash = PathIndex_hashParent(*pulHash, Atom_getString(oAName),
+                                      Atom_getLength(oAName));
+      oNNode = Node_getParent(oNNode);
    }
+   oAName = Node_getName(oNNext);
+   *pulHash = PathIndex_hashChild(*pulHash, Atom_getString(oAName),
+                                  Atom_getLength(oAName));
+   return oNNext;
+}
 
-   /* The parent node we're inserting to must be a directory or root */
-   if ((oNCurr != NULL) && (Node_getType(oNCurr) != NODE_DIR))
+/*
+  Adds the subtree rooted at oNNode, whose path hashes to ulHash, to
+  oFTree's path index. The index must already have room for every node
+  in the subtree.
+*/
+static void FT_indexSubtree(FT_T oFTree, Node_T oNNode, size_t ulHash)
+{
+   Node_T oNNext = oNNode;
+   size_t ulIndex = 0;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(oNNode != NULL);
+   assert(oFTree->oIIndex != NULL);
+
+   do
    {
-      Path_free(oPPath);
-      return NOT_A_DIRECTORY;
+      iStatus = PathIndex_put(oFTree->oIIndex, ulHash, oNNext);
+      assert(iStatus == SUCCESS);
+   } while ((oNNext = FT_nextHashed(oNNode, oNNext, &ulIndex,
+                                    &ulHash)) != NULL);
+   (void) iStatus;
+}
+
+/*
+  Removes the subtree rooted at oNNode, whose path hashes to ulHash,
+  from oFTree's path index, so that none of its nodes can be found
+  there once they are freed.
+*/
+static void FT_unindexSubtree(FT_T oFTree, Node_T oNNode,
+                              size_t ulHash)
+{
+   Node_T oNNext = oNNode;
+   size_t ulIndex = 0;
+
+   assert(oFTree != NULL);
+   assert(oNNode != NULL);
+   assert(oFTree->oIIndex != NULL);
+
+   do
+      PathIndex_remove(oFTree->oIIndex, ulHash, oNNext);
+   while ((oNNext = FT_nextHashed(oNNode, oNNext, &ulIndex,
+                                  &ulHash)) != NULL);
+}
+
+/*
+  Makes oNNode, a node of oFTree that is not a snapshot, and all its
+  ancestors private to oFTree, copying top-down any that a snapshot
+  still shares (see Node_unshare) and updating the root and the path
+  index to match. Returns SUCCESS and sets *poNResult to oNNode's
+  private version and, while the path index is on, *pulHash to the
+  hash of its path. Otherwise, returns MEMORY_ERROR if memory could
+  not be allocated to complete request; the FT then reads the same as
+  before, though some of the path may already be private.
+*/
+static int FT_unsharePath(FT_T oFTree, Node_T oNNode,
+                          Node_T *poNResult, size_t *pulHash)
+{
+   Node_T oNParent;
+   Node_T oNCopy = NULL;
+   Atom_T oAName;
+   size_t ulHash = 0;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(oNNode != NULL);
+   assert(poNResult != NULL);
+   assert(pulHash != NULL);
+   assert(!oFTree->bSnapshot);
+
+   /* the parent must be private before its child can be relinked */
+   oAName = Node_getName(oNNode);
+   oNParent = Node_getParent(oNNode);
+   if (oNParent != NULL)
+   {
+      iStatus = FT_unsharePath(oFTree, oNParent, &oNParent, &ulHash);
+      if (iStatus != SUCCESS)
+         return iStatus;
+      if (oFTree->oIIndex != NULL)
+         ulHash = PathIndex_hashChild(ulHash, Atom_getString(oAName),
+                                      Atom_getLength(oAName));
    }
+   else if (oFTree->oIIndex != NULL)
+      ulHash = PathIndex_hash(Atom_getString(oAName),
+                              Atom_getLength(oAName));
 
-   ulDepth = Path_getDepth(oPPath);
-   if (oNCurr == NULL)
-   { /* new root! */
-      ulIndex = 1;
+   iStatus = Node_unshare(oNNode, &oFTree->oNRoot, &oNCopy);
+   if (iStatus != SUCCESS)
+      return iStatus;
 
-      /* a file cannot be a root */
-      if (nodeType == NODE_FILE) {
-         Path_free(oPPath);
-         return CONFLICTING_PATH;
+   if (oNCopy != oNNode)
+   {
+      /* the index entry taken out leaves room for the new one */
+      if (oFTree->oIIndex != NULL)
+      {
+         PathIndex_remove(oFTree->oIIndex, ulHash, oNNode);
+         iStatus = PathIndex_put(oFTree->oIIndex, ulHash, oNCopy);
+         assert(iStatus == SUCCESS);
       }
    }
-   else
+
+   *poNResult = oNCopy;
+   *pulHash = ulHash;
+   return SUCCESS;
+}
+
+/*
+  Makes sure that oFTree has a table of IDs, and that ulExtra more IDs
+  can be handed out from it without allocating memory. Returns
+  SUCCESS, or MEMORY_ERROR if memory could not be allocated to
+  complete request.
+*/
+static int FT_reserveIds(FT_T oFTree, size_t ulExtra)
+{
+   IdTable_T oItIds;
+
+   assert(oFTree != NULL);
+   assert(!oFTree->bSnapshot);
+
+   if (oFTree->oItIds == NULL)
    {
-      ulIndex = Path_getDepth(Node_getPath(oNCurr)) + 1;
+      oItIds = IdTable_new();
+      if (oItIds == NULL)
+         return MEMORY_ERROR;
+      __atomic_store_n(&oFTree->oItIds, oItIds, __ATOMIC_RELEASE);
+   }
+   return IdTable_reserve(oFTree->oItIds, ulExtra);
+}
 
-      /* oNCurr is the node we're trying to insert */
-      if (ulIndex == ulDepth + 1 && !Path_comparePath(oPPath,
-                                             Node_getPath(oNCurr))) {
-         Path_free(oPPath);
-         return ALREADY_IN_TREE;
-      }
+/*
+  Creates the nodes for levels ulIndex through the last of absolute
+  path oPPath in oFTree, below oNCurr, the existing node at level
+  ulIndex - 1 (or NULL if the new nodes start a new tree). The last
+  node gets type nodeType, and if it is a file, contents pvContents of
+  size ulLength; all the others are directories. Returns SUCCESS and
+  sets *poNFirstNew to the first new node and *pulNewNodes to the
+  number of new nodes if successful. Otherwise, creates no nodes and
+  returns MEMORY_ERROR if memory could not be allocated to complete
+  request.
+*/
+static int FT_addChain(FT_T oFTree, Path_T oPPath, Node_T oNCurr,
+                       size_t ulIndex, NodeType nodeType,
+                       void *pvContents, size_t ulLength,
+                       Node_T *poNFirstNew, size_t *pulNewNodes)
+{
+   int iStatus;
+   Node_T oNFirstNew = NULL;
+   size_t ulDepth;
+   size_t ulNewNodes = 0;
+   size_t ulHash = 0;
+   size_t ulFirstHash = 0;
+
+   assert(oFTree != NULL);
+   assert(oPPath != NULL);
+   assert(poNFirstNew != NULL);
+   assert(pulNewNodes != NULL);
+
+   ulDepth = Path_getDepth(oPPath);
+
+   /* make sure every new node can be indexed without failing, and
+      start from the hash of the deepest existing ancestor */
+   if (oFTree->oIIndex != NULL)
+   {
+      iStatus = PathIndex_reserve(oFTree->oIIndex,
+                                  ulDepth - ulIndex + 1);
+      if (iStatus != SUCCESS)
+         return iStatus;
+      if (ulIndex > 1)
+         ulHash = FT_hashPrefix(oPPath, ulIndex - 1);
    }
 
    /* starting at oNCurr, build rest of the path one level at a time */
@@ -248,367 +577,3834 @@ static int FT_insertNode(const char *pcPath, NodeType nodeType,
    {
       Path_T oPPrefix = NULL;
       Node_T oNNewNode = NULL;
+      NodeType levelType = (ulIndex == ulDepth) ? nodeType : NODE_DIR;
 
-      /* generate a Path_T for this level */
-      iStatus = Path_prefix(oPPath, ulIndex, &oPPrefix);
-      if (iStatus != SUCCESS)
-      {
-         Path_free(oPPath);
-         if (oNFirstNew != NULL)
-            (void)Node_free(oNFirstNew);
-         return iStatus;
-      }
-
-      /* insert the new node for this level */
-      /* if ulIndex == ulDepth, nodeType is passed in case a file is
-         being inserted */
-      if (ulIndex == ulDepth)
+      /* insert the new node for this level; below an existing node,
+         it needs only its own name, so no prefix of oPPath is built
+         and no ancestor's name is compared again */
+      if (oNCurr != NULL)
+         iStatus = Node_newChild(oNCurr,
+                                 Path_getComponent(oPPath, ulIndex - 1),
+                                 levelType, pvContents, ulLength,
+                                 &oNNewNode);
+      else
       {
-         iStatus = Node_new(oPPrefix, nodeType, oNCurr, &oNNewNode);
-
+         iStatus = Path_prefix(oPPath, ulIndex, &oPPrefix);
          if (iStatus == SUCCESS)
+         {
+            iStatus = Node_new(oPPrefix, levelType, NULL, &oNNewNode);
+            Path_free(oPPrefix);
+         }
+
+         /* if ulIndex == ulDepth, a file being inserted gets its
+            contents */
+         if (iStatus == SUCCESS && ulIndex == ulDepth)
             Node_setContents(oNNewNode, pvContents, ulLength);
       }
-      else
-      {
-         iStatus = Node_new(oPPrefix, NODE_DIR, oNCurr, &oNNewNode);
-      }
 
       if (iStatus != SUCCESS)
       {
-         Path_free(oPPath);
-         Path_free(oPPrefix);
          if (oNFirstNew != NULL)
+         {
+            if (oFTree->oIIndex != NULL)
+               FT_unindexSubtree(oFTree, oNFirstNew, ulFirstHash);
             (void)Node_free(oNFirstNew);
+         }
          return iStatus;
       }
 
+      /* index the new node; room was reserved above */
+      if (oFTree->oIIndex != NULL)
+      {
+         const char *pcComponent =
+            Path_getComponent(oPPath, ulIndex - 1);
+         if (ulIndex == 1)
+            ulHash = PathIndex_hash(pcComponent, strlen(pcComponent));
+         else
+            ulHash = PathIndex_hashChild(ulHash, pcComponent,
+                                         strlen(pcComponent));
+         iStatus = PathIndex_put(oFTree->oIIndex, ulHash, oNNewNode);
+         assert(iStatus == SUCCESS);
+      }
+
       /* set up for next level */
-      Path_free(oPPrefix);
       oNCurr = oNNewNode;
       ulNewNodes++;
       if (oNFirstNew == NULL)
+      {
          oNFirstNew = oNCurr;
+         ulFirstHash = ulHash;
+      }
       ulIndex++;
    }
 
-   Path_free(oPPath);
-   /* update DT state variables to reflect insertion */
-   if (oNRoot == NULL)
-      oNRoot = oNFirstNew;
-   ulCount += ulNewNodes;
-
+   *poNFirstNew = oNFirstNew;
+   *pulNewNodes = ulNewNodes;
    return SUCCESS;
 }
 
 /*
-  Removes the FT node with absolute path pcPath and type nodeType.
-  Returns SUCCESS if found and removed.
-  Otherwise, returns:
-  * INITIALIZATION_ERROR if the FT is not in an initialized state
-  * BAD_PATH if pcPath does not represent a well-formatted path
-  * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
-  * NO_SUCH_PATH if absolute path pcPath does not exist in the FT
+  Adds ulAdded nodes to and takes ulRemoved nodes from oFTree's node
+  count. Writers on different directories can get here at the same
+  time in concurrent mode, so the count is changed atomically.
+*/
+static void FT_adjustCount(FT_T oFTree, size_t ulAdded,
+                           size_t ulRemoved)
+{
+   assert(oFTree != NULL);
+
+   if (ulAdded != 0)
+      (void)__atomic_add_fetch(&oFTree->ulCount, ulAdded,
+                               __ATOMIC_RELAXED);
+   if (ulRemoved != 0)
+      (void)__atomic_sub_fetch(&oFTree->ulCount, ulRemoved,
+                               __ATOMIC_RELAXED);
+}
+
+/*
+  Returns the number of nodes in oFTree, after taking out of its count
+  the nodes of removed subtrees that the reclaimer has counted since.
+*/
+static size_t FT_getCount(FT_T oFTree)
+{
+   assert(oFTree != NULL);
+
+   /* a snapshot shares the live tree's store, whose counts are the
+      live tree's to take */
+   if (!oFTree->bSnapshot && oFTree->oNRoot != NULL)
+      FT_adjustCount(oFTree, 0, Node_takeReclaimed(oFTree->oNRoot));
+   return __atomic_load_n(&oFTree->ulCount, __ATOMIC_RELAXED);
+}
+
+/*
+  Inserts a new node into oFTree with absolute path oPPath and type
+  nodeType, given oNCurr, the furthest node towards oPPath that
+  FT_traversePath reaches. If the nodeType is NODE_FILE, the node's
+  contents are set to pvContents and the node's size field is set to
+  ulLength. Returns SUCCESS and sets *poNReached to the new node if it
+  is inserted successfully. Otherwise, sets *poNReached to oNCurr, or
+  to NULL for MEMORY_ERROR, and returns:
+  * CONFLICTING_PATH if the root exists but is not a prefix of oPPath,
+                     or if the node is a file and would be the FT root
+  * NOT_A_DIRECTORY if a proper prefix of oPPath exists as a file
+  * ALREADY_IN_TREE if oPPath is already in the FT (as dir or file)
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+static int FT_insertAt(FT_T oFTree, Path_T oPPath, Node_T oNCurr,
+                       NodeType nodeType, void *pvContents,
+                       size_t ulLength, Node_T *poNReached)
+{
+   int iStatus;
+   Node_T oNFirstNew = NULL;
+   Node_T oNLast;
+   size_t ulDepth, ulIndex;
+   size_t ulNewNodes = 0;
+   size_t ulHash;
+
+   assert(oFTree != NULL);
+   assert(oPPath != NULL);
+   assert(poNReached != NULL);
+
+   *poNReached = oNCurr;
+
+   /* no ancestor node found, so if root is not NULL,
+      oPPath isn't underneath root. */
+   if (oNCurr == NULL && oFTree->oNRoot != NULL)
+      return CONFLICTING_PATH;
+
+   /* The parent node we're inserting to must be a directory or root */
+   if ((oNCurr != NULL) && (Node_getType(oNCurr) != NODE_DIR))
+      return NOT_A_DIRECTORY;
+
+   ulDepth = Path_getDepth(oPPath);
+   if (oNCurr == NULL)
+   { /* new root! */
+      ulIndex = 1;
+
+      /* a file cannot be a root */
+      if (nodeType == NODE_FILE)
+         return CONFLICTING_PATH;
+
+      /* the new nodes are given IDs only once the chain is whole */
+      iStatus = FT_reserveIds(oFTree, ulDepth);
+      if (iStatus != SUCCESS)
+      {
+         *poNReached = NULL;
+         return iStatus;
+      }
+   }
+   else
+   {
+      ulIndex = Node_getDepth(oNCurr) + 1;
+
+      /* oNCurr is the node we're trying to insert: every level
+         traversed matched oPPath, so it is as deep as oPPath */
+      if (ulIndex == ulDepth + 1)
+         return ALREADY_IN_TREE;
+
+      /* a snapshot must not see the new nodes */
+      iStatus = FT_unsharePath(oFTree, oNCurr, &oNCurr, &ulHash);
+      if (iStatus != SUCCESS)
+      {
+         *poNReached = NULL;
+         return iStatus;
+      }
+   }
+
+   iStatus = FT_addChain(oFTree, oPPath, oNCurr, ulIndex, nodeType,
+                         pvContents, ulLength, &oNFirstNew,
+                         &ulNewNodes);
+   if (iStatus != SUCCESS)
+   {
+      *poNReached = NULL;
+      return iStatus;
+   }
+
+   /* update DT state variables to reflect insertion; a new root is
+      published only once it is complete, for lock-free readers */
+   if (oFTree->oNRoot == NULL)
+   {
+      Node_setIds(oNFirstNew, oFTree->oItIds);
+      Node_setEpoch(oNFirstNew, oFTree->oEEpoch);
+      Node_setReclaimer(oNFirstNew, oFTree->oRReclaimer);
+      __atomic_store_n(&oFTree->oNRoot, oNFirstNew, __ATOMIC_RELEASE);
+   }
+   FT_adjustCount(oFTree, ulNewNodes, 0);
+
+   /* the chain added is a single line of nodes */
+   for (oNLast = oNFirstNew; ulNewNodes > 1; ulNewNodes--)
+   {
+      iStatus = Node_getChild(oNLast, 0, &oNLast);
+      assert(iStatus == SUCCESS);
+   }
+   *poNReached = oNLast;
+   return SUCCESS;
+}
+
+/*
+   Inserts a new node into oFTree with absolute path pcPath and type
+   nodeType. If the nodeType is NODE_FILE, the node's contents are set
+   to pvContents and the node's size field is set to ulLength. Returns 
+   SUCCESS if the new node is inserted successfully.
+   Otherwise, returns:
+   * BAD_PATH if pcPath does not represent a well-formatted path
+   * CONFLICTING_PATH if the root exists but is not a prefix of pcPath,
+                      or if the node is a file and would be the FT root
+   * NOT_A_DIRECTORY if a proper prefix of pcPath exists as a file
+   * ALREADY_IN_TREE if pcPath is already in the FT (as dir or file)
+   * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+static int FT_insertNode(FT_T oFTree, const char *pcPath,
+                         NodeType nodeType, void *pvContents,
+                         size_t ulLength)
+{
+   int iStatus;
+   Path_T oPPath = NULL;
+   Node_T oNCurr = NULL;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+
+   /* validate pcPath and generate a Path_T for it */
+   iStatus = Path_new(pcPath, &oPPath);
+   if (iStatus != SUCCESS)
+      return iStatus;
+
+   /* find the closest ancestor of oPPath already in the tree */
+   iStatus = FT_traversePath(oFTree, oPPath, &oNCurr);
+   if (iStatus == SUCCESS)
+      iStatus = FT_insertAt(oFTree, oPPath, oNCurr, nodeType,
+                            pvContents, ulLength, &oNCurr);
+   Path_free(oPPath);
+   return iStatus;
+}
+
+/*
+  Removes the node of oFTree with absolute path pcPath and type
+  nodeType. Returns SUCCESS if found and removed.
+  Otherwise, returns:
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
+  * NO_SUCH_PATH if absolute path pcPath does not exist in the FT
   * NOT_A_DIRECTORY if nodeType is NODE_DIR and pcPath is in the FT as
   * a file not a directory
   * NOT_A_FILE if nodeType is NODE_FILE and pcPath is in the FT as
   * a directory not a file
   * MEMORY_ERROR if memory could not be allocated to complete request
 */
-static int FT_rmNode(const char *pcPath, NodeType nodeType)
+static int FT_rmNode(FT_T oFTree, const char *pcPath,
+                     NodeType nodeType)
+{
+   int iStatus;
+   Node_T oNFound = NULL;
+   Node_T oNParent;
+   size_t ulHash;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+
+   iStatus = FT_findNode(oFTree, pcPath, &oNFound);
+
+   if (iStatus != SUCCESS)
+      return iStatus;
+
+   /* check that the node matches the expected type */
+   if (Node_getType(oNFound) != nodeType)
+      return (nodeType == NODE_DIR) ? NOT_A_DIRECTORY : NOT_A_FILE;
+
+   /* the node itself may stay shared, but the directory it leaves is
+      changed and so must be private */
+   oNParent = Node_getParent(oNFound);
+   if (oNParent != NULL)
+   {
+      iStatus = FT_unsharePath(oFTree, oNParent, &oNParent, &ulHash);
+      if (iStatus != SUCCESS)
+         return iStatus;
+   }
+
+   /* no removed node may stay reachable through the index */
+   if (oFTree->oIIndex != NULL)
+      FT_unindexSubtree(oFTree, oNFound,
+                        PathIndex_hash(pcPath, strlen(pcPath)));
+
+   /* the whole tree going leaves nothing to count, whatever the
+      reclaimer has yet to count of subtrees removed earlier */
+   if (oNFound == oFTree->oNRoot)
+   {
+      __atomic_store_n(&oFTree->oNRoot, NULL, __ATOMIC_RELAXED);
+      (void)Node_free(oNFound);
+      oFTree->ulCount = 0;
+   }
+   else
+      FT_adjustCount(oFTree, 0, Node_free(oNFound));
+
+   return SUCCESS;
+}
+
+/* --------------------------------------------------------------------
+
+  In concurrent mode, a change that neither creates nor removes the
+  root holds the FT lock only for reading, so that writers working in
+  different directories run side by side. The functions below keep
+  such writers apart with per-directory latches instead, taken
+  hand-over-hand on the way down from the root. A directory's latch
+  covers its list of children and the fields of each file in it; the
+  root's latch also covers the root itself. A thread only ever waits
+  for a latch while holding the latch of that node's parent (or, for
+  the root, the FT lock), so latches are always taken top-down and no
+  node can be freed while a thread is on its way to it.
+
+  None of this applies while the path index is on: its table is
+  shared by the whole tree, so every change then takes the FT lock
+  for writing, and readers need no latches. Nor does it apply to a
+  change whose path a snapshot still shares: copying the path may
+  replace the root, so such a writer gives up with FT_SHARED and
+  starts over with the FT lock held for writing. Snapshots are taken
+  under that lock too, so nothing becomes shared while a latched
+  writer is at work.
+*/
+
+/*
+  Returns TRUE if operations on oFTree, whose lock the caller holds,
+  must coordinate with directory latches, and FALSE if not.
+*/
+static boolean FT_usesLatches(FT_T oFTree)
+{
+   assert(oFTree != NULL);
+
+   return (boolean)(oFTree->bConcurrent && oFTree->oIIndex == NULL);
+}
+
+/*
+  Acquires oNNode's latch for writing if bExclusive is TRUE, or for
+  reading if not.
+*/
+static void FT_latch(Node_T oNNode, boolean bExclusive)
+{
+   assert(oNNode != NULL);
+
+   if (bExclusive)
+      Node_lockWrite(oNNode);
+   else
+      Node_lockRead(oNNode);
+}
+
+/*
+  Waits out every thread still inside the subtree rooted at directory
+  oNNode, whose parent's latch the caller holds for writing. Taking
+  and dropping each directory's latch from the top down means that
+  each thread found inside is chased downwards until it leaves, while
+  no new one can get in past the parent.
+*/
+static void FT_drainSubtree(Node_T oNNode)
+{
+   Node_T oNNext = oNNode;
+   size_t ulIndex = 0;
+
+   assert(oNNode != NULL);
+
+   /* each directory is drained before the walk reads its children */
+   do
+      if (Node_getType(oNNext) == NODE_DIR)
+      {
+         Node_lockWrite(oNNext);
+         Node_unlock(oNNext);
+      }
+   while ((oNNext = Node_nextInSubtree(oNNode, oNNext,
+                                       &ulIndex)) != NULL);
+}
+
+/*
+  Finds the node of oFTree with absolute path pcPath, latching the
+  directories on the way down. oFTree must use latches, and the caller
+  must hold its lock for reading. Returns SUCCESS and sets *poNResult
+  to the node and *poNLatched to the node whose latch covers it (its
+  parent, or the node itself if it is the root), which is left latched
+  for writing if bExclusive is TRUE and for reading if not. Otherwise,
+  leaves nothing latched, sets both to NULL, and returns the status
+  FT_findNode would, or FT_SHARED if bExclusive is TRUE and a
+  directory on the way is shared with a snapshot.
+*/
+static int FT_findLatched(FT_T oFTree, const char *pcPath,
+                          boolean bExclusive, Node_T *poNResult,
+                          Node_T *poNLatched)
+{
+   Path_T oPPath = NULL;
+   Node_T oNCurr;
+   Node_T oNChild = NULL;
+   size_t ulDepth;
+   size_t i;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+   assert(poNResult != NULL);
+   assert(poNLatched != NULL);
+
+   *poNResult = NULL;
+   *poNLatched = NULL;
+
+   iStatus = Path_new(pcPath, &oPPath);
+   if (iStatus != SUCCESS)
+      return iStatus;
+
+   if (oFTree->oNRoot == NULL)
+   {
+      Path_free(oPPath);
+      return NO_SUCH_PATH;
+   }
+   if (Atom_compareString(Node_getName(oFTree->oNRoot),
+                          Path_getComponent(oPPath, 0)))
+   {
+      Path_free(oPPath);
+      return CONFLICTING_PATH;
+   }
+
+   /* the latch left held is the one on the last directory passed */
+   ulDepth = Path_getDepth(oPPath);
+   oNCurr = oFTree->oNRoot;
+   FT_latch(oNCurr, (boolean)(bExclusive && ulDepth <= 2));
+   for (i = 1; i < ulDepth; i++)
+   {
+      if (bExclusive && Node_isShared(oNCurr))
+      {
+         Node_unlock(oNCurr);
+         Path_free(oPPath);
+         return FT_SHARED;
+      }
+      if (!Node_findChild(oNCurr, Path_getComponent(oPPath, i),
+                          &oNChild))
+      {
+         Node_unlock(oNCurr);
+         Path_free(oPPath);
+         return NO_SUCH_PATH;
+      }
+      if (i == ulDepth - 1)
+         break;
+
+      /* a file has no children, so the path goes no further */
+      if (Node_getType(oNChild) != NODE_DIR)
+      {
+         Node_unlock(oNCurr);
+         Path_free(oPPath);
+         return NO_SUCH_PATH;
+      }
+      FT_latch(oNChild, (boolean)(bExclusive && i + 2 == ulDepth));
+      Node_unlock(oNCurr);
+      oNCurr = oNChild;
+   }
+
+   Path_free(oPPath);
+   *poNResult = (ulDepth == 1) ? oNCurr : oNChild;
+   *poNLatched = oNCurr;
+   return SUCCESS;
+}
+
+/*
+  Inserts a new node into oFTree as FT_insertNode does. oFTree must use
+  latches and have a root, and the caller must hold its lock for
+  reading. Descends with read latches, and latches for writing only
+  the directory that gains the new nodes. While trading that
+  directory's read latch for a write latch, keeps its parent latched
+  so that it cannot be removed in between, then looks again in case
+  another writer added the child first. Returns FT_SHARED if a
+  directory on the way is shared with a snapshot.
+*/
+static int FT_insertLatched(FT_T oFTree, const char *pcPath,
+                            NodeType nodeType, void *pvContents,
+                            size_t ulLength)
 {
+   Path_T oPPath = NULL;
+   Node_T oNParent = NULL;
+   Node_T oNCurr;
+   Node_T oNChild = NULL;
+   Node_T oNFirstNew = NULL;
+   boolean bWriting = FALSE;
+   size_t ulDepth;
+   size_t ulNewNodes = 0;
+   size_t i = 1;
    int iStatus;
+
+   assert(oFTree != NULL);
+   assert(oFTree->oNRoot != NULL);
+   assert(pcPath != NULL);
+
+   iStatus = Path_new(pcPath, &oPPath);
+   if (iStatus != SUCCESS)
+      return iStatus;
+
+   if (Atom_compareString(Node_getName(oFTree->oNRoot),
+                          Path_getComponent(oPPath, 0)))
+   {
+      Path_free(oPPath);
+      return CONFLICTING_PATH;
+   }
+   ulDepth = Path_getDepth(oPPath);
+   if (ulDepth == 1)
+   {
+      Path_free(oPPath);
+      return ALREADY_IN_TREE;
+   }
+
+   /* oNCurr is the deepest directory reached, and oNParent (latched
+      too, unless oNCurr is the root) is its parent */
+   oNCurr = oFTree->oNRoot;
+   Node_lockRead(oNCurr);
+   for (;;)
+   {
+      if (Node_isShared(oNCurr))
+      {
+         iStatus = FT_SHARED;
+         break;
+      }
+      if (Node_findChild(oNCurr, Path_getComponent(oPPath, i),
+                         &oNChild))
+      {
+         /* a file in the way is reported before the path being
+            taken, as FT_insertAt does */
+         if (Node_getType(oNChild) != NODE_DIR)
+         {
+            iStatus = NOT_A_DIRECTORY;
+            break;
+         }
+         if (i == ulDepth - 1)
+         {
+            iStatus = ALREADY_IN_TREE;
+            break;
+         }
+
+         /* step down, keeping two levels latched */
+         Node_lockRead(oNChild);
+         if (oNParent != NULL)
+            Node_unlock(oNParent);
+         oNParent = oNCurr;
+         oNCurr = oNChild;
+         bWriting = FALSE;
+         i++;
+      }
+      else if (!bWriting)
+      {
+         Node_unlock(oNCurr);
+         Node_lockWrite(oNCurr);
+         bWriting = TRUE;
+      }
+      else
+      {
+         /* the new directories on the way are filled in under
+            oNCurr's latch, not their own, so a handle must not latch
+            one of them until they all are */
+         if (i + 1 < ulDepth)
+            Node_beginDetach(oNCurr);
+         iStatus = FT_addChain(oFTree, oPPath, oNCurr, i + 1, nodeType,
+                               pvContents, ulLength, &oNFirstNew,
+                               &ulNewNodes);
+         if (i + 1 < ulDepth)
+            Node_endDetach(oNCurr);
+         if (iStatus == SUCCESS)
+         {
+            FT_adjustCount(oFTree, ulNewNodes, 0);
+            FT_record(oFTree, (nodeType == NODE_DIR) ?
+                         JOURNAL_INSERT_DIR : JOURNAL_INSERT_FILE,
+                      pcPath, pvContents, ulLength);
+         }
+         break;
+      }
+   }
+
+   Node_unlock(oNCurr);
+   if (oNParent != NULL)
+      Node_unlock(oNParent);
+   Path_free(oPPath);
+   return iStatus;
+}
+
+/*
+  Removes the node of oFTree with absolute path pcPath and type
+  nodeType as FT_rmNode does. oFTree must use latches, the caller must
+  hold its lock for reading, and pcPath must not name the root.
+  Latches the node's parent for writing, and waits for every other
+  thread to leave the node's subtree before freeing it. Returns
+  FT_SHARED if a directory on the way is shared with a snapshot.
+*/
+static int FT_rmLatched(FT_T oFTree, const char *pcPath,
+                        NodeType nodeType)
+{
    Node_T oNFound = NULL;
+   Node_T oNLatched = NULL;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+
+   iStatus = FT_findLatched(oFTree, pcPath, TRUE, &oNFound,
+                            &oNLatched);
+   if (iStatus != SUCCESS)
+      return iStatus;
+   assert(oNFound != oNLatched);
+
+   if (Node_getType(oNFound) != nodeType)
+      iStatus = (nodeType == NODE_DIR) ? NOT_A_DIRECTORY : NOT_A_FILE;
+   else
+   {
+      /* marked before the drain, so that a handle latching a
+         directory of the subtree meanwhile sees the mark once it
+         holds the latch */
+      if (nodeType == NODE_DIR)
+      {
+         Node_beginDetach(oNFound);
+         FT_drainSubtree(oNFound);
+      }
+      FT_adjustCount(oFTree, 0, Node_free(oNFound));
+      FT_record(oFTree, (nodeType == NODE_DIR) ?
+                   JOURNAL_RM_DIR : JOURNAL_RM_FILE,
+                pcPath, NULL, 0);
+   }
+
+   Node_unlock(oNLatched);
+   return iStatus;
+}
+
+/*
+  Finds the node of oFTree with absolute path pcPath for a caller that
+  holds oFTree's lock, reading or writing it according to bExclusive.
+  Returns the status and node FT_findNode would. If oFTree uses
+  latches, leaves the latch covering the node held in the same mode
+  and sets *poNLatched to its owner; otherwise sets *poNLatched to
+  NULL. Either way, the caller passes *poNLatched to FT_unlatch when
+  done with the node.
+*/
+static int FT_find(FT_T oFTree, const char *pcPath, boolean bExclusive,
+                   Node_T *poNResult, Node_T *poNLatched)
+{
+   assert(oFTree != NULL);
+   assert(poNLatched != NULL);
+
+   if (FT_usesLatches(oFTree))
+      return FT_findLatched(oFTree, pcPath, bExclusive, poNResult,
+                            poNLatched);
+
+   *poNLatched = NULL;
+   return FT_findNode(oFTree, pcPath, poNResult);
+}
+
+/* Releases the latch on oNLatched, if any, left held by FT_find. */
+static void FT_unlatch(Node_T oNLatched)
+{
+   if (oNLatched != NULL)
+      Node_unlock(oNLatched);
+}
+
+/*
+  Inserts a new node into oFTree as FT_insertNode does, locking oFTree
+  as its mode requires.
+*/
+static int FT_insert(FT_T oFTree, const char *pcPath,
+                     NodeType nodeType, void *pvContents,
+                     size_t ulLength)
+{
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(!oFTree->bSnapshot);
+
+   FT_lockRead(oFTree);
+   if (FT_usesLatches(oFTree) && oFTree->oNRoot != NULL)
+   {
+      iStatus = FT_insertLatched(oFTree, pcPath, nodeType, pvContents,
+                                 ulLength);
+      if (iStatus != FT_SHARED)
+      {
+         FT_unlock(oFTree);
+         FT_commit(oFTree);
+         return iStatus;
+      }
+   }
+   FT_unlock(oFTree);
+
+   /* a new root, the path index, or a path shared with a snapshot
+      needs the whole tree */
+   FT_lockWrite(oFTree);
+   iStatus = FT_insertNode(oFTree, pcPath, nodeType, pvContents,
+                           ulLength);
+   if (iStatus == SUCCESS)
+      FT_record(oFTree, (nodeType == NODE_DIR) ?
+                   JOURNAL_INSERT_DIR : JOURNAL_INSERT_FILE,
+                pcPath, pvContents, ulLength);
+   FT_unlock(oFTree);
+   FT_commit(oFTree);
+   return iStatus;
+}
+
+/*
+  Removes the node of oFTree with absolute path pcPath and type
+  nodeType as FT_rmNode does, locking oFTree as its mode requires.
+*/
+static int FT_rm(FT_T oFTree, const char *pcPath, NodeType nodeType)
+{
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+   assert(!oFTree->bSnapshot);
+
+   /* a path with no delimiter can name only the root */
+   FT_lockRead(oFTree);
+   if (FT_usesLatches(oFTree) && strchr(pcPath, '/') != NULL)
+   {
+      iStatus = FT_rmLatched(oFTree, pcPath, nodeType);
+      if (iStatus != FT_SHARED)
+      {
+         FT_unlock(oFTree);
+         FT_commit(oFTree);
+         return iStatus;
+      }
+   }
+   FT_unlock(oFTree);
+
+   /* removing the root, using the path index, or changing a path
+      shared with a snapshot needs the whole tree */
+   FT_lockWrite(oFTree);
+   iStatus = FT_rmNode(oFTree, pcPath, nodeType);
+   if (iStatus == SUCCESS)
+      FT_record(oFTree, (nodeType == NODE_DIR) ?
+                   JOURNAL_RM_DIR : JOURNAL_RM_FILE,
+                pcPath, NULL, 0);
+   FT_unlock(oFTree);
+   FT_commit(oFTree);
+   return iStatus;
+}
+
+/* --------------------------------------------------------------------
+
+  In concurrent mode with the path index off, lookups take no lock at
+  all, not even the FT lock for reading. They walk down from the root
+  inside the FT's epoch, so no node they pass can be freed under them
+  even if a writer removes it meanwhile. Node_findChild and
+  Node_readContents check the version of each directory searched and
+  of the node read, and retry whatever a writer changed under them.
+  The path index's table has no such protection, so while it is on,
+  lookups share the FT lock as before.
+*/
+
+/*
+  Finds the node of oFTree with absolute path pcPath without taking any
+  lock or latch, for a caller inside oFTree's epoch. Returns the status
+  and node FT_findNode would.
+*/
+static int FT_findLockFree(FT_T oFTree, const char *pcPath,
+                           Node_T *poNResult)
+{
+   Path_T oPPath = NULL;
+   Node_T oNCurr;
+   size_t ulDepth;
+   size_t i;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+   assert(poNResult != NULL);
+
+   *poNResult = NULL;
+
+   iStatus = Path_new(pcPath, &oPPath);
+   if (iStatus != SUCCESS)
+      return iStatus;
+
+   oNCurr = __atomic_load_n(&oFTree->oNRoot, __ATOMIC_ACQUIRE);
+   if (oNCurr == NULL)
+   {
+      Path_free(oPPath);
+      return NO_SUCH_PATH;
+   }
+   if (Atom_compareString(Node_getName(oNCurr),
+                          Path_getComponent(oPPath, 0)))
+   {
+      Path_free(oPPath);
+      return CONFLICTING_PATH;
+   }
+
+   ulDepth = Path_getDepth(oPPath);
+   for (i = 1; i < ulDepth; i++)
+   {
+      if (!Node_findChild(oNCurr, Path_getComponent(oPPath, i),
+                          &oNCurr))
+      {
+         Path_free(oPPath);
+         return NO_SUCH_PATH;
+      }
+   }
+
+   Path_free(oPPath);
+   *poNResult = oNCurr;
+   return SUCCESS;
+}
+
+/*
+  Looks up the node of oFTree with absolute path pcPath for a caller
+  that only reads it, without a lock if oFTree's mode allows. Returns
+  the status FT_findNode would; on SUCCESS, also sets *pbIsFile to
+  whether the node is a file and *ppvContents and *pulLength to its
+  contents and their size, all as of one moment, and *pulId to its ID
+  unless pulId is NULL.
+*/
+static int FT_lookup(FT_T oFTree, const char *pcPath,
+                     boolean *pbIsFile, void **ppvContents,
+                     size_t *pulLength, size_t *pulId)
+{
+   Node_T oNNode = NULL;
+   Node_T oNLatched = NULL;
+   boolean bLockFree;
+   size_t ulTicket = 0;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+   assert(pbIsFile != NULL);
+   assert(ppvContents != NULL);
+   assert(pulLength != NULL);
+
+   /* the index may be turned on just after this check, but writers
+      keep the tree safe for lock-free readers in either case */
+   bLockFree = (boolean)(oFTree->bConcurrent &&
+                         __atomic_load_n(&oFTree->oIIndex,
+                                         __ATOMIC_RELAXED) == NULL);
+   if (bLockFree)
+   {
+      ulTicket = Epoch_enter(oFTree->oEEpoch);
+      iStatus = FT_findLockFree(oFTree, pcPath, &oNNode);
+   }
+   else
+   {
+      FT_lockRead(oFTree);
+      iStatus = FT_find(oFTree, pcPath, FALSE, &oNNode, &oNLatched);
+   }
+
+   if (iStatus == SUCCESS)
+   {
+      *pbIsFile = (boolean)(Node_getType(oNNode) == NODE_FILE);
+      Node_readContents(oNNode, ppvContents, pulLength);
+      if (pulId != NULL)
+         *pulId = Node_getId(oNNode);
+   }
+
+   if (bLockFree)
+      Epoch_leave(oFTree->oEEpoch, ulTicket);
+   else
+   {
+      FT_unlatch(oNLatched);
+      FT_unlock(oFTree);
+   }
+   return iStatus;
+}
+
+FT_T FT_new(void)
+{
+   struct ft *psTree;
+
+   psTree = malloc(sizeof(struct ft));
+   if (psTree == NULL)
+      return NULL;
+
+   psTree->oNRoot = NULL;
+   psTree->ulCount = 0;
+   psTree->oIIndex = NULL;
+   psTree->bConcurrent = FALSE;
+   psTree->oEEpoch = NULL;
+   psTree->bSnapshot = FALSE;
+   psTree->psJournal = NULL;
+   psTree->oItIds = NULL;
+   psTree->oRReclaimer = NULL;
+   if (pthread_rwlock_init(&psTree->sLock, NULL) != 0)
+   {
+      free(psTree);
+      return NULL;
+   }
+   return psTree;
+}
+
+/*
+  Syncs and closes psJournal's journal, if it is open, and frees
+  psJournal. Returns the status Journal_close gave.
+*/
+static int FT_freeJournal(struct ftJournal *psJournal)
+{
+   int iStatus;
+
+   assert(psJournal != NULL);
+
+   iStatus = Journal_close(psJournal->oJJournal);
+   (void)pthread_mutex_destroy(&psJournal->sCheckpointLock);
+   free(psJournal->pcImage);
+   free(psJournal->pcOld);
+   free(psJournal);
+   return iStatus;
+}
+
+/*
+  Closes oFTree's journal, if it has one, as FT_freeJournal does.
+  Returns SUCCESS, or the status Journal_close gave.
+*/
+static int FT_dropJournal(FT_T oFTree)
+{
+   struct ftJournal *psJournal;
+
+   assert(oFTree != NULL);
+
+   psJournal = oFTree->psJournal;
+   if (psJournal == NULL)
+      return SUCCESS;
+
+   oFTree->psJournal = NULL;
+   return FT_freeJournal(psJournal);
+}
+
+/*
+  Frees pvEpoch, an Epoch_T, for a reclaimer. Returns TRUE, as that
+  is all there is to do.
+*/
+static boolean FT_freeEpoch(void *pvEpoch)
+{
+   Epoch_free(pvEpoch);
+   return TRUE;
+}
+
+/*
+  Frees every node of oFTree, its path index, and its epoch, and
+  closes its journal, leaving it an empty tree with the index,
+  concurrent mode and background reclamation turned off. Nodes shared
+  with a snapshot, or with the tree a snapshot was taken from, live on
+  in that tree. With background reclamation on, the nodes and epoch
+  are handed to the reclaimer, which frees them and then itself.
+*/
+static void FT_clear(FT_T oFTree)
+{
+   Epoch_T oEEpoch;
+
+   assert(oFTree != NULL);
+
+   (void)FT_dropJournal(oFTree);
+
+   /* the table goes with the tree, so its IDs need not be given back
+      one by one; things retired to the epoch may belong to the tree,
+      so the epoch is freed before it, after whatever was handed over
+      earlier, and the root is left none to wait on, as no reader is
+      left */
+   oEEpoch = oFTree->oEEpoch;
+   if (oFTree->oRReclaimer != NULL)
+   {
+      if (oFTree->oNRoot != NULL)
+      {
+         Node_forgetIds(oFTree->oNRoot);
+         Node_setEpoch(oFTree->oNRoot, NULL);
+      }
+      if (oEEpoch != NULL &&
+          Reclaimer_add(oFTree->oRReclaimer, FT_freeEpoch,
+                        oEEpoch) != SUCCESS)
+      {
+         Reclaimer_wait(oFTree->oRReclaimer);
+         Epoch_free(oEEpoch);
+      }
+      oEEpoch = NULL;
+   }
+
+   if (oFTree->bSnapshot && oFTree->oNRoot != NULL)
+   {
+      Node_dropTree(oFTree->oNRoot);
+      oFTree->oNRoot = NULL;
+      oFTree->ulCount = 0;
+   }
+   else if (oFTree->oNRoot)
+   {
+      (void)Node_free(oFTree->oNRoot);
+      oFTree->oNRoot = NULL;
+      oFTree->ulCount = 0;
+   }
+
+   PathIndex_free(oFTree->oIIndex);
+   oFTree->oIIndex = NULL;
+   IdTable_free(oFTree->oItIds);
+   oFTree->oItIds = NULL;
+
+   /* with no reader left, everything retired is freed at once */
+   Epoch_free(oEEpoch);
+   oFTree->oEEpoch = NULL;
+   oFTree->bConcurrent = FALSE;
+   Reclaimer_free(oFTree->oRReclaimer);
+   oFTree->oRReclaimer = NULL;
+}
+
+void FT_free(FT_T oFTree)
+{
+   if (oFTree == NULL)
+      return;
+
+   FT_clear(oFTree);
+   (void)pthread_rwlock_destroy(&oFTree->sLock);
+   free(oFTree);
+}
+
+int FT_insertDirIn(FT_T oFTree, const char *pcPath)
+{
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+
+   return FT_insert(oFTree, pcPath, NODE_DIR, NULL, 0);
+}
+
+boolean FT_containsDirIn(FT_T oFTree, const char *pcPath)
+{
+   int iStatus;
+   boolean bIsFile = FALSE;
+   void *pvContents;
+   size_t ulLength;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+
+   iStatus = FT_lookup(oFTree, pcPath, &bIsFile, &pvContents,
+                       &ulLength, NULL);
+   return (boolean)(iStatus == SUCCESS && !bIsFile);
+}
+
+int FT_rmDirIn(FT_T oFTree, const char *pcPath)
+{
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+
+   return FT_rm(oFTree, pcPath, NODE_DIR);
+}
+
+int FT_insertFileIn(FT_T oFTree, const char *pcPath, void *pvContents,
+                    size_t ulLength)
+{
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+
+   return FT_insert(oFTree, pcPath, NODE_FILE, pvContents, ulLength);
+}
+
+/* One path of a batch given to FT_insertFilesIn */
+struct ftBatchItem {
+   /* the path */
+   const char *pcPath;
+   /* its position in the batch */
+   size_t ulItem;
+};
+
+/*
+  Compares the batch items pointed to by pvItem1 and pvItem2 by path,
+  and items with the same path by position, for qsort.
+*/
+static int FT_compareItems(const void *pvItem1, const void *pvItem2)
+{
+   const struct ftBatchItem *psItem1 = pvItem1;
+   const struct ftBatchItem *psItem2 = pvItem2;
+   int iCompare;
+
+   assert(pvItem1 != NULL);
+   assert(pvItem2 != NULL);
+
+   iCompare = strcmp(psItem1->pcPath, psItem2->pcPath);
+   if (iCompare != 0)
+      return iCompare;
+   if (psItem1->ulItem < psItem2->ulItem)
+      return -1;
+   return (psItem1->ulItem > psItem2->ulItem);
+}
+
+int FT_insertFilesIn(FT_T oFTree, const char **apcPaths,
+                     void **apvContents, const size_t *aulLengths,
+                     size_t ulCount, int *aiStatuses)
+{
+   struct ftBatchItem *psItems;
+   Path_T oPPath = NULL;
+   Path_T oPPrev = NULL;
+   Node_T oNCurr;
+   Node_T oNReached = NULL;
+   size_t ulShared;
+   size_t ulItem;
+   size_t i;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(apcPaths != NULL || ulCount == 0);
+   assert(apvContents != NULL || ulCount == 0);
+   assert(aulLengths != NULL || ulCount == 0);
+   assert(aiStatuses != NULL || ulCount == 0);
+   assert(!oFTree->bSnapshot);
+
+   if (ulCount == 0)
+      return SUCCESS;
+
+   psItems = malloc(ulCount * sizeof(struct ftBatchItem));
+   if (psItems == NULL)
+   {
+      for (i = 0; i < ulCount; i++)
+         aiStatuses[i] = MEMORY_ERROR;
+      return MEMORY_ERROR;
+   }
+
+   /* sorting brings the paths under each directory together, and
+      keeps repeats in the order given */
+   for (i = 0; i < ulCount; i++)
+   {
+      assert(apcPaths[i] != NULL);
+      psItems[i].pcPath = apcPaths[i];
+      psItems[i].ulItem = i;
+   }
+   qsort(psItems, ulCount, sizeof(struct ftBatchItem), FT_compareItems);
+
+   /* the whole batch is one change to the tree */
+   FT_lockWrite(oFTree);
+   for (i = 0; i < ulCount; i++)
+   {
+      ulItem = psItems[i].ulItem;
+      iStatus = Path_new(psItems[i].pcPath, &oPPath);
+      if (iStatus != SUCCESS)
+      {
+         aiStatuses[ulItem] = iStatus;
+         continue;
+      }
+
+      /* start from the deepest node reached for the last path that
+         is also on this one, rather than from the root */
+      oNCurr = oNReached;
+      if (oNCurr != NULL)
+      {
+         ulShared = Path_getSharedPrefixDepth(oPPrev, oPPath);
+         while (oNCurr != NULL && Node_getDepth(oNCurr) > ulShared)
+            oNCurr = Node_getParent(oNCurr);
+      }
+      if (oNCurr != NULL)
+         iStatus = FT_descend(oNCurr, oPPath, &oNCurr);
+      else
+         iStatus = FT_traversePath(oFTree, oPPath, &oNCurr);
+
+      if (iStatus == SUCCESS)
+         iStatus = FT_insertAt(oFTree, oPPath, oNCurr, NODE_FILE,
+                               apvContents[ulItem], aulLengths[ulItem],
+                               &oNReached);
+      else
+         oNReached = NULL;
+      if (iStatus == SUCCESS)
+         FT_record(oFTree, JOURNAL_INSERT_FILE, apcPaths[ulItem],
+                   apvContents[ulItem], aulLengths[ulItem]);
+      aiStatuses[ulItem] = iStatus;
+
+      if (oPPrev != NULL)
+         Path_free(oPPrev);
+      oPPrev = oPPath;
+   }
+   FT_unlock(oFTree);
+   FT_commit(oFTree);
+
+   if (oPPrev != NULL)
+      Path_free(oPPrev);
+   free(psItems);
+   return SUCCESS;
+}
+
+/* --------------------------------------------------------------------
+
+  A batch of lookups is sorted by path, like a batch of inserts, and
+  dealt out in runs to a few lanes, each walking its run in order. A
+  lane starts each path from the deepest node it found for the path
+  before, so a directory shared by a run of paths is searched once.
+  The lanes take turns one step at a time, and a lane that reaches a
+  node only prefetches it, and on its next turn the node's children,
+  before searching them; so the cache misses of all the lanes overlap
+  rather than following one another.
+*/
+
+/* The number of lanes a batch of lookups is dealt out to */
+#define FT_LANES 8
+
+/* One lane of a batch of lookups */
+struct ftLane {
+   /* the range of sorted batch items still to look up */
+   size_t ulNext;
+   size_t ulEnd;
+   /* the path being looked up, or NULL between paths, and its
+      position in the batch */
+   Path_T oPPath;
+   size_t ulItem;
+   /* the last path looked up before it, or NULL */
+   Path_T oPPrev;
+   /* the nodes found for the first ulFound components of oPPath, or
+      of oPPrev between paths */
+   Node_T *aoNFound;
+   size_t ulFound;
+   /* whether the children of the last node found were prefetched */
+   boolean bPrefetched;
+};
+
+/* Where the results of a batch of lookups go; any may be NULL */
+struct ftResults {
+   int *aiStatuses;
+   boolean *abIsFile;
+   size_t *aulSizes;
+   boolean *abContains;
+};
+
+/*
+  Stores in psResults at position ulItem the status iStatus of a
+  lookup and, if it is SUCCESS, what FT_statIn reports for the node
+  found, oNNode.
+*/
+static void FT_setResult(struct ftResults *psResults, size_t ulItem,
+                         int iStatus, Node_T oNNode)
+{
+   void *pvContents;
+   size_t ulLength;
+   boolean bIsFile;
+
+   assert(psResults != NULL);
+   assert(iStatus != SUCCESS || oNNode != NULL);
+
+   if (iStatus == SUCCESS)
+   {
+      bIsFile = (boolean)(Node_getType(oNNode) == NODE_FILE);
+      if (psResults->abIsFile != NULL)
+         psResults->abIsFile[ulItem] = bIsFile;
+      if (bIsFile && psResults->aulSizes != NULL)
+      {
+         Node_readContents(oNNode, &pvContents, &ulLength);
+         psResults->aulSizes[ulItem] = ulLength;
+      }
+   }
+   if (psResults->aiStatuses != NULL)
+      psResults->aiStatuses[ulItem] = iStatus;
+   if (psResults->abContains != NULL)
+      psResults->abContains[ulItem] = (boolean)(iStatus == SUCCESS);
+}
+
+/*
+  Finishes psLane's current path with status iStatus, storing it and
+  the node found, oNNode, in psResults.
+*/
+static void FT_laneEnd(struct ftLane *psLane,
+                       struct ftResults *psResults, int iStatus,
+                       Node_T oNNode)
+{
+   assert(psLane != NULL);
+   assert(psLane->oPPath != NULL);
+
+   FT_setResult(psResults, psLane->ulItem, iStatus, oNNode);
+   if (psLane->oPPrev != NULL)
+      Path_free(psLane->oPPrev);
+   psLane->oPPrev = psLane->oPPath;
+   psLane->oPPath = NULL;
+}
+
+/*
+  Takes one step of psLane's walk through psItems in oFTree, storing
+  the results of any path it finishes in psResults: starts its next
+  path, prefetches the children of the last node found, or searches
+  them for the next component. Returns FALSE if psLane had no path
+  left to look up, or TRUE otherwise.
+*/
+static boolean FT_laneStep(FT_T oFTree, struct ftLane *psLane,
+                           const struct ftBatchItem *psItems,
+                           struct ftResults *psResults)
+{
+   Node_T oNCurr;
+   size_t ulShared;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(psLane != NULL);
+   assert(psItems != NULL);
+   assert(psResults != NULL);
+
+   if (psLane->oPPath == NULL)
+   {
+      if (psLane->ulNext == psLane->ulEnd)
+         return FALSE;
+      psLane->ulItem = psItems[psLane->ulNext].ulItem;
+      iStatus = Path_new(psItems[psLane->ulNext].pcPath,
+                         &psLane->oPPath);
+      psLane->ulNext++;
+      if (iStatus != SUCCESS)
+      {
+         psLane->oPPath = NULL;
+         FT_setResult(psResults, psLane->ulItem, iStatus, NULL);
+         return TRUE;
+      }
+
+      /* keep the nodes found on the part shared with the last path */
+      ulShared = (psLane->oPPrev == NULL) ? 0 :
+         Path_getSharedPrefixDepth(psLane->oPPrev, psLane->oPPath);
+      if (psLane->ulFound > ulShared)
+         psLane->ulFound = ulShared;
+      if (psLane->ulFound == 0)
+      {
+         oNCurr = __atomic_load_n(&oFTree->oNRoot, __ATOMIC_ACQUIRE);
+         if (oNCurr == NULL)
+         {
+            FT_laneEnd(psLane, psResults, NO_SUCH_PATH, NULL);
+            return TRUE;
+         }
+         if (Atom_compareString(Node_getName(oNCurr),
+                                Path_getComponent(psLane->oPPath, 0)))
+         {
+            FT_laneEnd(psLane, psResults, CONFLICTING_PATH, NULL);
+            return TRUE;
+         }
+         psLane->aoNFound[psLane->ulFound++] = oNCurr;
+      }
+      psLane->bPrefetched = FALSE;
+   }
+   else if (!psLane->bPrefetched)
+   {
+      Node_prefetchChildren(psLane->aoNFound[psLane->ulFound - 1]);
+      psLane->bPrefetched = TRUE;
+      return TRUE;
+   }
+   else
+   {
+      if (!Node_findChild(psLane->aoNFound[psLane->ulFound - 1],
+                          Path_getComponent(psLane->oPPath,
+                                            psLane->ulFound),
+                          &oNCurr))
+      {
+         FT_laneEnd(psLane, psResults, NO_SUCH_PATH, NULL);
+         return TRUE;
+      }
+      psLane->aoNFound[psLane->ulFound++] = oNCurr;
+      Node_prefetch(oNCurr);
+      psLane->bPrefetched = FALSE;
+   }
+
+   if (psLane->ulFound == Path_getDepth(psLane->oPPath))
+      FT_laneEnd(psLane, psResults, SUCCESS,
+                 psLane->aoNFound[psLane->ulFound - 1]);
+   return TRUE;
+}
+
+/*
+  Looks up the ulCount absolute paths apcPaths in oFTree, without a
+  lock if oFTree's mode allows, storing in psResults at position i
+  the status FT_statIn would return for apcPaths[i] and, if it is
+  SUCCESS, what FT_statIn would report. Returns SUCCESS, or
+  MEMORY_ERROR, stored as every status, if memory could not be
+  allocated to complete request.
+*/
+static int FT_lookupMany(FT_T oFTree, const char **apcPaths,
+                         size_t ulCount, struct ftResults *psResults)
+{
+   struct ftBatchItem *psItems;
+   struct ftLane asLanes[FT_LANES];
+   Node_T *aoNFound;
+   Node_T oNNode;
+   const char *pcScan;
+   size_t ulMaxDepth = 1;
+   size_t ulDepth;
+   size_t ulLanes;
+   size_t ulActive;
+   size_t ulTicket = 0;
+   size_t i;
+   boolean bLockFree;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(apcPaths != NULL || ulCount == 0);
+   assert(psResults != NULL);
+
+   if (ulCount == 0)
+      return SUCCESS;
+
+   /* sort, and find how deep a lane's walk can go */
+   psItems = malloc(ulCount * sizeof(struct ftBatchItem));
+   if (psItems != NULL)
+   {
+      for (i = 0; i < ulCount; i++)
+      {
+         assert(apcPaths[i] != NULL);
+         psItems[i].pcPath = apcPaths[i];
+         psItems[i].ulItem = i;
+         ulDepth = 1;
+         for (pcScan = apcPaths[i]; *pcScan != '\0'; pcScan++)
+            if (*pcScan == '/')
+               ulDepth++;
+         if (ulDepth > ulMaxDepth)
+            ulMaxDepth = ulDepth;
+      }
+      qsort(psItems, ulCount, sizeof(struct ftBatchItem),
+            FT_compareItems);
+   }
+   ulLanes = (ulCount < FT_LANES) ? ulCount : FT_LANES;
+   aoNFound = (psItems == NULL) ? NULL :
+      malloc(ulLanes * ulMaxDepth * sizeof(Node_T));
+   if (aoNFound == NULL)
+   {
+      free(psItems);
+      for (i = 0; i < ulCount; i++)
+         FT_setResult(psResults, i, MEMORY_ERROR, NULL);
+      return MEMORY_ERROR;
+   }
+
+   for (i = 0; i < ulLanes; i++)
+   {
+      asLanes[i].ulNext = i * ulCount / ulLanes;
+      asLanes[i].ulEnd = (i + 1) * ulCount / ulLanes;
+      asLanes[i].oPPath = NULL;
+      asLanes[i].ulItem = 0;
+      asLanes[i].oPPrev = NULL;
+      asLanes[i].aoNFound = aoNFound + i * ulMaxDepth;
+      asLanes[i].ulFound = 0;
+      asLanes[i].bPrefetched = FALSE;
+   }
+
+   /* as in FT_lookup */
+   bLockFree = (boolean)(oFTree->bConcurrent &&
+                         __atomic_load_n(&oFTree->oIIndex,
+                                         __ATOMIC_RELAXED) == NULL);
+   if (bLockFree)
+      ulTicket = Epoch_enter(oFTree->oEEpoch);
+   else
+      FT_lockRead(oFTree);
+
+   if (!bLockFree && oFTree->oIIndex != NULL)
+   {
+      /* the index finds each path in one probe */
+      for (i = 0; i < ulCount; i++)
+      {
+         iStatus = FT_findNode(oFTree, apcPaths[i], &oNNode);
+         FT_setResult(psResults, i, iStatus, oNNode);
+      }
+   }
+   else
+   {
+      ulActive = ulLanes;
+      while (ulActive > 0)
+      {
+         ulActive = 0;
+         for (i = 0; i < ulLanes; i++)
+            if (FT_laneStep(oFTree, &asLanes[i], psItems, psResults))
+               ulActive++;
+      }
+   }
+
+   if (bLockFree)
+      Epoch_leave(oFTree->oEEpoch, ulTicket);
+   else
+      FT_unlock(oFTree);
+
+   for (i = 0; i < ulLanes; i++)
+      if (asLanes[i].oPPrev != NULL)
+         Path_free(asLanes[i].oPPrev);
+   free(aoNFound);
+   free(psItems);
+   return SUCCESS;
+}
+
+boolean FT_containsFileIn(FT_T oFTree, const char *pcPath)
+{
+   int iStatus;
+   boolean bIsFile = FALSE;
+   void *pvContents;
+   size_t ulLength;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+
+   iStatus = FT_lookup(oFTree, pcPath, &bIsFile, &pvContents,
+                       &ulLength, NULL);
+   return (boolean)(iStatus == SUCCESS && bIsFile);
+}
+
+int FT_rmFileIn(FT_T oFTree, const char *pcPath)
+{
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+
+   return FT_rm(oFTree, pcPath, NODE_FILE);
+}
+
+void *FT_getFileContentsIn(FT_T oFTree, const char *pcPath)
+{
+   int iStatus;
+   boolean bIsFile;
+   void *pvContents;
+   size_t ulLength;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+
+   iStatus = FT_lookup(oFTree, pcPath, &bIsFile, &pvContents,
+                       &ulLength, NULL);
+   return (iStatus == SUCCESS) ? pvContents : NULL;
+}
+
+/*
+  Replaces the contents of the node of oFTree with absolute path
+  pcPath with pvNewContents of ulNewLength bytes, for a caller that
+  holds oFTree's lock for writing. Returns an int SUCCESS status and
+  sets *ppvOldContents to the old contents if successful. Otherwise,
+  leaves *ppvOldContents unchanged and returns the status FT_findNode
+  would, or MEMORY_ERROR if the path could not be copied away from a
+  snapshot.
+*/
+static int FT_replaceNode(FT_T oFTree, const char *pcPath,
+                          void *pvNewContents, size_t ulNewLength,
+                          void **ppvOldContents)
+{
+   int iStatus;
+   Node_T oNNode;
+   size_t ulHash;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+   assert(ppvOldContents != NULL);
+
+   iStatus = FT_findNode(oFTree, pcPath, &oNNode);
+   if (iStatus == SUCCESS)
+      iStatus = FT_unsharePath(oFTree, oNNode, &oNNode, &ulHash);
+   if (iStatus == SUCCESS)
+   {
+      *ppvOldContents = Node_getContent(oNNode);
+      Node_setContents(oNNode, pvNewContents, ulNewLength);
+   }
+   return iStatus;
+}
+
+void *FT_replaceFileContentsIn(FT_T oFTree, const char *pcPath,
+                               void *pvNewContents, size_t ulNewLength)
+{
+   int iStatus;
+   Node_T oNNode;
+   Node_T oNLatched = NULL;
+   boolean bOwnLatch;
+   void *pvOldContents = NULL;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+   assert(!oFTree->bSnapshot);
+
+   /* under latches, the latch covering the file is enough, unless a
+      snapshot shares it */
+   FT_lockRead(oFTree);
+   if (FT_usesLatches(oFTree))
+   {
+      iStatus = FT_findLatched(oFTree, pcPath, TRUE, &oNNode,
+                               &oNLatched);
+      if (iStatus == SUCCESS && Node_isShared(oNNode))
+      {
+         Node_unlock(oNLatched);
+         iStatus = FT_SHARED;
+      }
+      if (iStatus == SUCCESS)
+      {
+         /* a directory's version also covers its children, which only
+            a writer holding its own latch may change */
+         bOwnLatch = (boolean)(oNNode != oNLatched &&
+                               Node_getType(oNNode) == NODE_DIR);
+         if (bOwnLatch)
+            Node_lockWrite(oNNode);
+         pvOldContents = Node_getContent(oNNode);
+         Node_setContents(oNNode, pvNewContents, ulNewLength);
+         if (bOwnLatch)
+            Node_unlock(oNNode);
+         FT_record(oFTree, JOURNAL_REPLACE, pcPath, pvNewContents,
+                   ulNewLength);
+         Node_unlock(oNLatched);
+      }
+      if (iStatus != FT_SHARED)
+      {
+         FT_unlock(oFTree);
+         FT_commit(oFTree);
+         return pvOldContents;
+      }
+   }
+   FT_unlock(oFTree);
+
+   /* otherwise a writer needs the whole tree */
+   FT_lockWrite(oFTree);
+   iStatus = FT_replaceNode(oFTree, pcPath, pvNewContents, ulNewLength,
+                            &pvOldContents);
+   if (iStatus == SUCCESS)
+      FT_record(oFTree, JOURNAL_REPLACE, pcPath, pvNewContents,
+                ulNewLength);
+   FT_unlock(oFTree);
+   FT_commit(oFTree);
+   return pvOldContents;
+}
+
+int FT_statIn(FT_T oFTree, const char *pcPath, boolean *pbIsFile,
+              size_t *pulSize)
+{
+   int iStatus;
+   boolean bIsFile;
+   void *pvContents;
+   size_t ulLength;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+   assert(pbIsFile != NULL);
+   assert(pulSize != NULL);
+
+   iStatus = FT_lookup(oFTree, pcPath, &bIsFile, &pvContents,
+                       &ulLength, NULL);
+   if (iStatus == SUCCESS)
+   {
+      *pbIsFile = bIsFile;
+      if (*pbIsFile)
+      {
+         *pulSize = ulLength;
+      }
+   }
+   return iStatus;
+}
+
+int FT_getIdIn(FT_T oFTree, const char *pcPath, size_t *pulId)
+{
+   int iStatus;
+   boolean bIsFile;
+   void *pvContents;
+   size_t ulLength;
+   size_t ulId;
+
+   assert(oFTree != NULL);
+   assert(!oFTree->bSnapshot);
+   assert(pcPath != NULL);
+   assert(pulId != NULL);
+
+   iStatus = FT_lookup(oFTree, pcPath, &bIsFile, &pvContents,
+                       &ulLength, &ulId);
+   if (iStatus == SUCCESS)
+      *pulId = ulId;
+   return iStatus;
+}
+
+int FT_statByIdIn(FT_T oFTree, size_t ulId, boolean *pbIsFile,
+                  size_t *pulSize)
+{
+   IdTable_T oItIds;
+   Node_T oNRoot;
+   Node_T oNNode = NULL;
+   Epoch_T oEEpoch;
+   size_t ulTicket = 0;
+   void *pvContents;
+   size_t ulLength;
+
+   assert(oFTree != NULL);
+   assert(!oFTree->bSnapshot);
+   assert(pbIsFile != NULL);
+   assert(pulSize != NULL);
+
+   /* latched writers free nodes under a shared lock, and the
+      reclaimer with none, so even with the lock held the node found
+      must be kept alive by the epoch whenever there is one; no lock
+      is needed on top of it */
+   oEEpoch = oFTree->oEEpoch;
+   if (oEEpoch != NULL)
+      ulTicket = Epoch_enter(oEEpoch);
+
+   oNRoot = __atomic_load_n(&oFTree->oNRoot, __ATOMIC_ACQUIRE);
+   oItIds = __atomic_load_n(&oFTree->oItIds, __ATOMIC_ACQUIRE);
+   if (oNRoot != NULL && oItIds != NULL && ulId != 0)
+      oNNode = Node_findById(oNRoot, oItIds, ulId);
+   if (oNNode != NULL)
+   {
+      *pbIsFile = (boolean)(Node_getType(oNNode) == NODE_FILE);
+      Node_readContents(oNNode, &pvContents, &ulLength);
+      if (*pbIsFile)
+         *pulSize = ulLength;
+   }
+
+   if (oEEpoch != NULL)
+      Epoch_leave(oEEpoch, ulTicket);
+   return (oNNode != NULL) ? SUCCESS : NO_SUCH_PATH;
+}
+
+int FT_statManyIn(FT_T oFTree, const char **apcPaths, size_t ulCount,
+                  int *aiStatuses, boolean *abIsFile, size_t *aulSizes)
+{
+   struct ftResults sResults;
+
+   assert(oFTree != NULL);
+   assert(aiStatuses != NULL || ulCount == 0);
+   assert(abIsFile != NULL || ulCount == 0);
+   assert(aulSizes != NULL || ulCount == 0);
+
+   sResults.aiStatuses = aiStatuses;
+   sResults.abIsFile = abIsFile;
+   sResults.aulSizes = aulSizes;
+   sResults.abContains = NULL;
+   return FT_lookupMany(oFTree, apcPaths, ulCount, &sResults);
+}
+
+size_t FT_containsManyIn(FT_T oFTree, const char **apcPaths,
+                         size_t ulCount, boolean *abContains)
+{
+   struct ftResults sResults;
+   size_t ulFound = 0;
+   size_t i;
+
+   assert(oFTree != NULL);
+   assert(abContains != NULL || ulCount == 0);
+
+   sResults.aiStatuses = NULL;
+   sResults.abIsFile = NULL;
+   sResults.aulSizes = NULL;
+   sResults.abContains = abContains;
+   (void)FT_lookupMany(oFTree, apcPaths, ulCount, &sResults);
+
+   for (i = 0; i < ulCount; i++)
+      if (abContains[i])
+         ulFound++;
+   return ulFound;
+}
+
+/* --------------------------------------------------------------------
+
+  A directory handle keeps the ID of its directory from one call to
+  the next, so that each call finds the directory with one probe of
+  the table of IDs and then searches only that directory. A change the
+  handle does not see may take the directory out of the tree, which
+  gives back its ID, or leave it to a snapshot behind a private copy,
+  which takes over its ID; either way the ID finds the directory only
+  while it is still at the handle's path, and the handle never keeps
+  a node that could be freed. Once the ID finds nothing, the directory
+  is looked up by its path again. A snapshot has no IDs, but never
+  changes, so a handle on one keeps the node itself.
+
+  A writer that latches the directory from its handle, rather than
+  top-down, checks with Node_isDetaching that no removal or chain of
+  new directories is under way on it or above it. Such a change marks
+  its top directory before it drains or fills in anything below, so
+  the mark is seen by any handle that latches a directory it covers.
+*/
+
+/* A handle on one directory of an FT */
+struct ftDir {
+   /* the FT the directory is in */
+   FT_T oFTree;
+   /* the directory's absolute path */
+   Path_T oPPath;
+   /* the directory's ID, or 0 if it has not been found since the
+      handle was opened or last failed to find it */
+   size_t ulId;
+   /* the directory's node if the FT is a snapshot, or NULL */
+   Node_T oNDir;
+};
+
+/*
+  Returns TRUE if pcName is a single path component, or FALSE if it is
+  empty or contains a '/'.
+*/
+static boolean FT_isName(const char *pcName)
+{
+   assert(pcName != NULL);
+
+   return (boolean)(*pcName != '\0' && strchr(pcName, '/') == NULL);
+}
+
+/*
+  Returns the absolute path of the entry pcName in the directory with
+  absolute path oPPath, in a new string owned by the caller, or NULL
+  if insufficient memory is available.
+*/
+static char *FT_joinPath(Path_T oPPath, const char *pcName)
+{
+   char *pcPath;
+   size_t ulLength;
+
+   assert(oPPath != NULL);
+   assert(pcName != NULL);
+
+   ulLength = Path_getStrLength(oPPath);
+   pcPath = malloc(ulLength + strlen(pcName) + 2);
+   if (pcPath == NULL)
+      return NULL;
+
+   strcpy(pcPath, Path_getPathname(oPPath));
+   pcPath[ulLength] = '/';
+   strcpy(pcPath + ulLength + 1, pcName);
+   return pcPath;
+}
+
+/*
+  Sets *poNDir to the node of the directory of handle oDDir, for a
+  caller that holds the lock of oDDir's FT or can look up without it,
+  and is inside the FT's epoch if it has one. Finds the directory by the ID oDDir kept while it is
+  still in the tree, and otherwise looks it up again and keeps its ID.
+  Returns SUCCESS, or the status FT_findNode would, or
+  NOT_A_DIRECTORY if a file is at the path.
+*/
+static int FT_resolveDir(FTDir_T oDDir, Node_T *poNDir)
+{
+   FT_T oFTree;
+   Node_T oNRoot;
+   Node_T oNDir = NULL;
+   IdTable_T oItIds;
+   int iStatus;
+
+   assert(oDDir != NULL);
+   assert(poNDir != NULL);
+
+   oFTree = oDDir->oFTree;
+   if (oDDir->oNDir != NULL)
+   {
+      *poNDir = oDDir->oNDir;
+      return SUCCESS;
+   }
+
+   oNRoot = __atomic_load_n(&oFTree->oNRoot, __ATOMIC_ACQUIRE);
+   oItIds = __atomic_load_n(&oFTree->oItIds, __ATOMIC_ACQUIRE);
+   if (oDDir->ulId != 0 && oNRoot != NULL && oItIds != NULL)
+   {
+      oNDir = Node_findById(oNRoot, oItIds, oDDir->ulId);
+      if (oNDir != NULL)
+      {
+         *poNDir = oNDir;
+         return SUCCESS;
+      }
+   }
+
+   oDDir->ulId = 0;
+   iStatus = FT_findLockFree(oFTree, Path_getPathname(oDDir->oPPath),
+                             &oNDir);
+   if (iStatus == SUCCESS && Node_getType(oNDir) != NODE_DIR)
+      iStatus = NOT_A_DIRECTORY;
+   if (iStatus != SUCCESS)
+      return iStatus;
+
+   if (oFTree->bSnapshot)
+      oDDir->oNDir = oNDir;
+   else
+      oDDir->ulId = Node_getId(oNDir);
+   *poNDir = oNDir;
+   return SUCCESS;
+}
+
+/*
+  Finds the directory of handle oDDir, locking its FT as FT_lookup
+  does, and then, unless pcName is NULL, looks up its child pcName,
+  setting *pbIsFile, *ppvContents and *pulLength as FT_lookupAt does.
+  Returns the status FT_lookupAt would.
+*/
+static int FT_readAt(FTDir_T oDDir, const char *pcName,
+                     boolean *pbIsFile, void **ppvContents,
+                     size_t *pulLength)
+{
+   FT_T oFTree;
+   Node_T oNDir = NULL;
+   Node_T oNChild = NULL;
+   Epoch_T oEEpoch;
+   boolean bLockFree;
+   size_t ulTicket = 0;
+   int iStatus;
+
+   assert(oDDir != NULL);
+
+   /* the lookup by ID may climb through a subtree that the reclaimer
+      is freeing with no lock held, so the epoch is entered whenever
+      there is one, as FT_statByIdIn does */
+   oFTree = oDDir->oFTree;
+   bLockFree = (boolean)(oFTree->bConcurrent &&
+                         __atomic_load_n(&oFTree->oIIndex,
+                                         __ATOMIC_RELAXED) == NULL);
+   if (!bLockFree)
+      FT_lockRead(oFTree);
+   oEEpoch = oFTree->oEEpoch;
+   if (oEEpoch != NULL)
+      ulTicket = Epoch_enter(oEEpoch);
+
+   iStatus = FT_resolveDir(oDDir, &oNDir);
+   if (iStatus == SUCCESS && pcName != NULL)
+   {
+      if (Node_findChild(oNDir, pcName, &oNChild))
+      {
+         *pbIsFile = (boolean)(Node_getType(oNChild) == NODE_FILE);
+         Node_readContents(oNChild, ppvContents, pulLength);
+      }
+      else
+         iStatus = NO_SUCH_PATH;
+   }
+
+   if (oEEpoch != NULL)
+      Epoch_leave(oEEpoch, ulTicket);
+   if (!bLockFree)
+      FT_unlock(oFTree);
+   return iStatus;
+}
+
+/*
+  Latches the directory of handle oDDir for writing, for a caller that
+  holds the lock of oDDir's FT, which uses latches, for reading.
+  Returns SUCCESS and sets *poNDir to the directory's node. Otherwise,
+  leaves nothing latched and returns the status FT_resolveDir would,
+  or FT_SHARED if the directory is shared with a snapshot.
+*/
+static int FT_latchDir(FTDir_T oDDir, Node_T *poNDir)
+{
+   FT_T oFTree;
+   Node_T oNDir = NULL;
+   Node_T oNLatched = NULL;
+   Node_T oNAncestor;
+   size_t ulTicket;
+   int iStatus;
+
+   assert(oDDir != NULL);
+   assert(poNDir != NULL);
+
+   /* the node found is latched only if that needs no waiting, since a
+      writer holding the latch may itself be waiting for this thread
+      to leave the epoch; inside the epoch, the node cannot be freed
+      before its marks show whether a change is at work on it */
+   oFTree = oDDir->oFTree;
+   ulTicket = Epoch_enter(oFTree->oEEpoch);
+   iStatus = FT_resolveDir(oDDir, &oNDir);
+   if (iStatus == SUCCESS)
+   {
+      if (!Node_tryLockWrite(oNDir))
+         iStatus = FT_SHARED;
+      else if (Node_isDetaching(oNDir))
+      {
+         Node_unlock(oNDir);
+         iStatus = FT_SHARED;
+      }
+   }
+   Epoch_leave(oFTree->oEEpoch, ulTicket);
+
+   /* otherwise the directory is found from the root again, latching
+      top-down as other writers do */
+   if (iStatus == FT_SHARED)
+   {
+      iStatus = FT_findLatched(oFTree, Path_getPathname(oDDir->oPPath),
+                               FALSE, &oNDir, &oNLatched);
+      if (iStatus != SUCCESS)
+         return iStatus;
+      if (Node_getType(oNDir) != NODE_DIR)
+      {
+         Node_unlock(oNLatched);
+         return NOT_A_DIRECTORY;
+      }
+      if (oNLatched == oNDir)
+      {
+         /* only the FT lock, held for writing, could take the root */
+         Node_unlock(oNDir);
+         Node_lockWrite(oNDir);
+      }
+      else
+      {
+         Node_lockWrite(oNDir);
+         Node_unlock(oNLatched);
+      }
+   }
+   else if (iStatus != SUCCESS)
+      return iStatus;
+
+   /* no ancestor can be copied or freed while oNDir is latched */
+   for (oNAncestor = oNDir; oNAncestor != NULL;
+        oNAncestor = Node_getParent(oNAncestor))
+   {
+      if (Node_isShared(oNAncestor))
+      {
+         Node_unlock(oNDir);
+         return FT_SHARED;
+      }
+   }
+
+   *poNDir = oNDir;
+   return SUCCESS;
+}
+
+/*
+  Inserts a new file named pcName with contents pvContents of length
+  ulLength into oNDir, the directory of handle oDDir, for a caller
+  that holds the lock of oDDir's FT for writing. Copies the
+  directory's path first if a snapshot shares it; the copy takes over
+  the directory's ID, so oDDir finds it from then on. Returns SUCCESS, or the status FT_insertFileAt would.
+*/
+static int FT_insertChild(FTDir_T oDDir, Node_T oNDir,
+                          const char *pcName, void *pvContents,
+                          size_t ulLength)
+{
+   FT_T oFTree;
+   Node_T oNNew = NULL;
+   size_t ulHash = 0;
+   size_t ulIndex;
+   int iStatus;
+
+   assert(oDDir != NULL);
+   assert(oNDir != NULL);
+   assert(pcName != NULL);
+
+   /* checked first, so that a failed insert copies nothing */
+   if (Node_hasChildComponent(oNDir, pcName, &ulIndex))
+      return ALREADY_IN_TREE;
+
+   oFTree = oDDir->oFTree;
+   if (oFTree->oIIndex != NULL)
+   {
+      iStatus = PathIndex_reserve(oFTree->oIIndex, 1);
+      if (iStatus != SUCCESS)
+         return iStatus;
+   }
+
+   iStatus = FT_unsharePath(oFTree, oNDir, &oNDir, &ulHash);
+   if (iStatus != SUCCESS)
+      return iStatus;
+
+   iStatus = Node_newChild(oNDir, pcName, NODE_FILE, pvContents,
+                           ulLength, &oNNew);
+   if (iStatus != SUCCESS)
+      return iStatus;
+
+   /* room was reserved above */
+   if (oFTree->oIIndex != NULL)
+   {
+      iStatus = PathIndex_put(oFTree->oIIndex,
+                              PathIndex_hashChild(ulHash, pcName,
+                                                  strlen(pcName)),
+                              oNNew);
+      assert(iStatus == SUCCESS);
+   }
+
+   FT_adjustCount(oFTree, 1, 0);
+   return SUCCESS;
+}
+
+int FT_openDirIn(FT_T oFTree, const char *pcPath, FTDir_T *poDDir)
+{
+   struct ftDir *psDir;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(pcPath != NULL);
+   assert(poDDir != NULL);
+
+   *poDDir = NULL;
+
+   psDir = malloc(sizeof(struct ftDir));
+   if (psDir == NULL)
+      return MEMORY_ERROR;
+
+   iStatus = Path_new(pcPath, &psDir->oPPath);
+   if (iStatus != SUCCESS)
+   {
+      free(psDir);
+      return iStatus;
+   }
+   psDir->oFTree = oFTree;
+   psDir->oNDir = NULL;
+   psDir->ulId = 0;
+
+   iStatus = FT_readAt(psDir, NULL, NULL, NULL, NULL);
+   if (iStatus != SUCCESS)
+   {
+      FT_closeDir(psDir);
+      return iStatus;
+   }
+
+   *poDDir = psDir;
+   return SUCCESS;
+}
+
+void FT_closeDir(FTDir_T oDDir)
+{
+   if (oDDir == NULL)
+      return;
+
+   Path_free(oDDir->oPPath);
+   free(oDDir);
+}
+
+int FT_lookupAt(FTDir_T oDDir, const char *pcName, boolean *pbIsFile,
+                void **ppvContents, size_t *pulLength)
+{
+   assert(oDDir != NULL);
+   assert(pcName != NULL);
+   assert(pbIsFile != NULL);
+   assert(ppvContents != NULL);
+   assert(pulLength != NULL);
+
+   if (!FT_isName(pcName))
+      return BAD_PATH;
+
+   return FT_readAt(oDDir, pcName, pbIsFile, ppvContents, pulLength);
+}
+
+int FT_insertFileAt(FTDir_T oDDir, const char *pcName,
+                    void *pvContents, size_t ulLength)
+{
+   FT_T oFTree;
+   Node_T oNDir = NULL;
+   Node_T oNNew = NULL;
+   char *pcPath = NULL;
+   size_t ulTicket = 0;
+   int iStatus;
+
+   assert(oDDir != NULL);
+   assert(pcName != NULL);
+   assert(!oDDir->oFTree->bSnapshot);
+
+   if (!FT_isName(pcName))
+      return BAD_PATH;
+
+   /* the journal takes the full path, made up front so that running
+      out of memory for it leaves the FT unchanged */
+   oFTree = oDDir->oFTree;
+   if (oFTree->psJournal != NULL)
+   {
+      pcPath = FT_joinPath(oDDir->oPPath, pcName);
+      if (pcPath == NULL)
+         return MEMORY_ERROR;
+   }
+
+   FT_lockRead(oFTree);
+   if (FT_usesLatches(oFTree))
+   {
+      iStatus = FT_latchDir(oDDir, &oNDir);
+      if (iStatus == SUCCESS)
+      {
+         iStatus = Node_newChild(oNDir, pcName, NODE_FILE, pvContents,
+                                 ulLength, &oNNew);
+         if (iStatus == SUCCESS)
+         {
+            FT_adjustCount(oFTree, 1, 0);
+            if (pcPath != NULL)
+               FT_record(oFTree, JOURNAL_INSERT_FILE, pcPath,
+                         pvContents, ulLength);
+         }
+         Node_unlock(oNDir);
+      }
+      if (iStatus != FT_SHARED)
+      {
+         FT_unlock(oFTree);
+         FT_commit(oFTree);
+         free(pcPath);
+         return iStatus;
+      }
+   }
+   FT_unlock(oFTree);
+
+   /* the path index or a path shared with a snapshot needs the whole
+      tree; the ID is looked up inside the epoch as in FT_readAt, and
+      the directory found stays in the tree while the lock is held */
+   FT_lockWrite(oFTree);
+   if (oFTree->oEEpoch != NULL)
+      ulTicket = Epoch_enter(oFTree->oEEpoch);
+   iStatus = FT_resolveDir(oDDir, &oNDir);
+   if (oFTree->oEEpoch != NULL)
+      Epoch_leave(oFTree->oEEpoch, ulTicket);
+   if (iStatus == SUCCESS)
+      iStatus = FT_insertChild(oDDir, oNDir, pcName, pvContents,
+                               ulLength);
+   if (iStatus == SUCCESS && pcPath != NULL)
+      FT_record(oFTree, JOURNAL_INSERT_FILE, pcPath, pvContents,
+                ulLength);
+   FT_unlock(oFTree);
+   FT_commit(oFTree);
+   free(pcPath);
+   return iStatus;
+}
+
+int FT_statAt(FTDir_T oDDir, const char *pcName, boolean *pbIsFile,
+              size_t *pulSize)
+{
+   int iStatus;
+   boolean bIsFile;
+   void *pvContents;
+   size_t ulLength;
+
+   assert(oDDir != NULL);
+   assert(pcName != NULL);
+   assert(pbIsFile != NULL);
+   assert(pulSize != NULL);
+
+   iStatus = FT_lookupAt(oDDir, pcName, &bIsFile, &pvContents,
+                         &ulLength);
+   if (iStatus == SUCCESS)
+   {
+      *pbIsFile = bIsFile;
+      if (*pbIsFile)
+      {
+         *pulSize = ulLength;
+      }
+   }
+   return iStatus;
+}
+
+/*
+  Turns oFTree's path index on or off as FT_setPathIndexIn does, for a
+  caller that already holds oFTree's lock for writing.
+*/
+static int FT_setPathIndexLocked(FT_T oFTree, boolean bEnable)
+{
+   PathIndex_T oINew;
+   Atom_T oAName;
+
+   assert(oFTree != NULL);
+
+   if (!bEnable)
+   {
+      PathIndex_free(oFTree->oIIndex);
+      __atomic_store_n(&oFTree->oIIndex, NULL, __ATOMIC_RELAXED);
+      return SUCCESS;
+   }
+
+   if (oFTree->oIIndex != NULL)
+      return SUCCESS;
+
+   /* build the index over the whole current tree */
+   oINew = PathIndex_new();
+   if (oINew == NULL)
+      return MEMORY_ERROR;
+   if (PathIndex_reserve(oINew, FT_getCount(oFTree)) != SUCCESS)
+   {
+      PathIndex_free(oINew);
+      return MEMORY_ERROR;
+   }
+   __atomic_store_n(&oFTree->oIIndex, oINew, __ATOMIC_RELAXED);
+   if (oFTree->oNRoot != NULL)
+   {
+      oAName = Node_getName(oFTree->oNRoot);
+      FT_indexSubtree(oFTree, oFTree->oNRoot,
+                      PathIndex_hash(Atom_getString(oAName),
+                                     Atom_getLength(oAName)));
+   }
+   return SUCCESS;
+}
+
+int FT_setPathIndexIn(FT_T oFTree, boolean bEnable)
+{
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(!oFTree->bSnapshot);
+
+   FT_lockWrite(oFTree);
+   iStatus = FT_setPathIndexLocked(oFTree, bEnable);
+   FT_unlock(oFTree);
+   return iStatus;
+}
+
+int FT_setConcurrentIn(FT_T oFTree, boolean bEnable)
+{
+   assert(oFTree != NULL);
+   assert(!oFTree->bSnapshot);
+
+   /* the reclaimer needs the epoch even outside concurrent mode */
+   if (bEnable && oFTree->oEEpoch == NULL)
+   {
+      oFTree->oEEpoch = Epoch_new();
+      if (oFTree->oEEpoch == NULL)
+         return MEMORY_ERROR;
+   }
+   else if (!bEnable && oFTree->oEEpoch != NULL &&
+            oFTree->oRReclaimer == NULL)
+   {
+      /* with no reader left, everything retired is freed at once */
+      Epoch_free(oFTree->oEEpoch);
+      oFTree->oEEpoch = NULL;
+   }
+
+   if (oFTree->oNRoot != NULL)
+      Node_setEpoch(oFTree->oNRoot, oFTree->oEEpoch);
+   oFTree->bConcurrent = bEnable;
+   return SUCCESS;
+}
+
+int FT_setReclaimerIn(FT_T oFTree, boolean bEnable)
+{
+   assert(oFTree != NULL);
+   assert(!oFTree->bSnapshot);
+
+   if (bEnable && oFTree->oRReclaimer == NULL)
+   {
+      /* lookups by ID run alongside the reclaimer, in any mode, so
+         they need the epoch to keep the nodes they find alive */
+      if (oFTree->oEEpoch == NULL)
+      {
+         oFTree->oEEpoch = Epoch_new();
+         if (oFTree->oEEpoch == NULL)
+            return MEMORY_ERROR;
+      }
+      oFTree->oRReclaimer = Reclaimer_new();
+      if (oFTree->oRReclaimer == NULL)
+      {
+         if (!oFTree->bConcurrent)
+         {
+            Epoch_free(oFTree->oEEpoch);
+            oFTree->oEEpoch = NULL;
+         }
+         return MEMORY_ERROR;
+      }
+   }
+   else if (!bEnable && oFTree->oRReclaimer != NULL)
+   {
+      /* everything handed over is freed before the reclaimer goes */
+      Reclaimer_wait(oFTree->oRReclaimer);
+      Reclaimer_free(oFTree->oRReclaimer);
+      oFTree->oRReclaimer = NULL;
+      if (!oFTree->bConcurrent)
+      {
+         Epoch_free(oFTree->oEEpoch);
+         oFTree->oEEpoch = NULL;
+      }
+   }
+
+   if (oFTree->oNRoot != NULL)
+   {
+      Node_setEpoch(oFTree->oNRoot, oFTree->oEEpoch);
+      Node_setReclaimer(oFTree->oNRoot, oFTree->oRReclaimer);
+   }
+   return SUCCESS;
+}
+
+int FT_reclaimIn(FT_T oFTree)
+{
+   assert(oFTree != NULL);
+
+   if (oFTree->oRReclaimer != NULL)
+      Reclaimer_wait(oFTree->oRReclaimer);
+   return SUCCESS;
+}
+
+/*
+  Returns a snapshot of oFTree as FT_snapshotIn does, and sets *pulTag
+  to the number of the last change recorded in oFTree's journal when
+  it was taken, or to 0 if oFTree has no journal.
+*/
+static FT_T FT_takeSnapshot(FT_T oFTree, size_t *pulTag)
+{
+   FT_T oFTSnapshot;
+
+   assert(oFTree != NULL);
+   assert(pulTag != NULL);
+
+   oFTSnapshot = FT_new();
+   if (oFTSnapshot == NULL)
+      return NULL;
+   oFTSnapshot->bSnapshot = TRUE;
+
+   /* no writer may be half way through a change, so that the root
+      taken is a whole version of the tree, and every change in it,
+      and none after it, is in the journal */
+   FT_lockWrite(oFTree);
+   if (oFTree->oNRoot != NULL)
+   {
+      Node_shareTree(oFTree->oNRoot);
+      oFTSnapshot->oNRoot = oFTree->oNRoot;
+   }
+   oFTSnapshot->ulCount = FT_getCount(oFTree);
+   *pulTag = 0;
+   if (oFTree->psJournal != NULL)
+      *pulTag = Journal_getLastSeq(oFTree->psJournal->oJJournal);
+   FT_unlock(oFTree);
+   return oFTSnapshot;
+}
+
+FT_T FT_snapshotIn(FT_T oFTree)
+{
+   size_t ulTag;
+
+   assert(oFTree != NULL);
+
+   return FT_takeSnapshot(oFTree, &ulTag);
+}
+
+int FT_saveIn(FT_T oFTree, const char *pcFile)
+{
+   FT_T oFTSnapshot;
+   size_t ulTag;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(pcFile != NULL);
+
+   /* writing from a snapshot keeps oFTree locked only for a moment */
+   oFTSnapshot = FT_takeSnapshot(oFTree, &ulTag);
+   if (oFTSnapshot == NULL)
+      return MEMORY_ERROR;
+   iStatus = Image_save(oFTSnapshot->oNRoot, ulTag, pcFile);
+   FT_free(oFTSnapshot);
+   return iStatus;
+}
+
+/*
+  Replaces every node of oFTree with the private tree rooted at oNRoot
+  (or with nothing, if oNRoot is NULL) of ulNodes nodes, for a caller
+  that holds no lock on oFTree. Concurrent lookups see either the
+  whole old tree or the whole new one. Returns SUCCESS, or frees the
+  new tree, leaves oFTree unchanged, and returns MEMORY_ERROR if
+  memory could not be allocated to index the new tree or give it
+  IDs.
+*/
+static int FT_replaceRoot(FT_T oFTree, Node_T oNRoot, size_t ulNodes)
+{
+   Node_T oNOld;
+   Atom_T oAName;
+
+   assert(oFTree != NULL);
+
+   FT_lockWrite(oFTree);
+   if (oNRoot != NULL &&
+       (FT_reserveIds(oFTree, ulNodes) != SUCCESS ||
+        (oFTree->oIIndex != NULL &&
+         PathIndex_reserve(oFTree->oIIndex, ulNodes) != SUCCESS)))
+   {
+      FT_unlock(oFTree);
+      (void)Node_free(oNRoot);
+      return MEMORY_ERROR;
+   }
+
+   oNOld = oFTree->oNRoot;
+   if (oNOld != NULL)
+   {
+      if (oFTree->oIIndex != NULL)
+      {
+         oAName = Node_getName(oNOld);
+         FT_unindexSubtree(oFTree, oNOld,
+                           PathIndex_hash(Atom_getString(oAName),
+                                          Atom_getLength(oAName)));
+      }
+      __atomic_store_n(&oFTree->oNRoot, NULL, __ATOMIC_RELAXED);
+      (void)Node_free(oNOld);
+   }
+   if (oNRoot != NULL)
+   {
+      if (oFTree->oIIndex != NULL)
+      {
+         oAName = Node_getName(oNRoot);
+         FT_indexSubtree(oFTree, oNRoot,
+                         PathIndex_hash(Atom_getString(oAName),
+                                        Atom_getLength(oAName)));
+      }
+      Node_setIds(oNRoot, oFTree->oItIds);
+      Node_setEpoch(oNRoot, oFTree->oEEpoch);
+      Node_setReclaimer(oNRoot, oFTree->oRReclaimer);
+      __atomic_store_n(&oFTree->oNRoot, oNRoot, __ATOMIC_RELEASE);
+   }
+   oFTree->ulCount = ulNodes;
+   FT_unlock(oFTree);
+   return SUCCESS;
+}
+
+int FT_loadIn(FT_T oFTree, const char *pcFile)
+{
+   Node_T oNRoot = NULL;
+   size_t ulNodes = 0;
+   size_t ulTag;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(pcFile != NULL);
+   assert(!oFTree->bSnapshot);
+   assert(oFTree->psJournal == NULL);
+
+   /* the new tree is private until it replaces the old one, so it is
+      built without any lock */
+   iStatus = Image_load(pcFile, &oNRoot, &ulNodes, &ulTag);
+   if (iStatus != SUCCESS)
+      return iStatus;
+   return FT_replaceRoot(oFTree, oNRoot, ulNodes);
+}
+
+/* --------------------------------------------------------------------
+
+  A bulk load builds a tree from paths given in the order the tree
+  keeps them, in one pass and without searching. It keeps one level
+  per component of the last path loaded, each holding that path's
+  node at that depth and the children found for it so far. A new
+  path shares some leading levels with the last one; the rest are
+  closed, and the new nodes hang below the last level shared. A
+  directory is closed only once all its children have been seen, so
+  their array is then allocated at exactly the size it needs.
+*/
+
+/* One level of a bulk load */
+struct ftLevel {
+   /* the node at this depth of the last path loaded */
+   Node_T oNNode;
+   /* the node's children so far, in order, not yet linked to it */
+   Node_T *aoNPending;
+   /* the number of children used and allocated in aoNPending */
+   size_t ulPending;
+   size_t ulCapacity;
+};
+
+/* The state of one bulk load */
+struct ftLoader {
+   /* the levels, of which the first ulOpen hold the last path */
+   struct ftLevel *psLevels;
+   size_t ulOpen;
+   /* the number of levels allocated */
+   size_t ulLevels;
+   /* the root of the tree being built, or NULL before the first path */
+   Node_T oNRoot;
+   /* the number of nodes in the tree being built */
+   size_t ulNodes;
+};
+
+/*
+  Opens a new level below psLoader's deepest open one for the new
+  node oNNode. Returns SUCCESS, or MEMORY_ERROR if memory could not
+  be allocated to complete request.
+*/
+static int FT_loaderPush(struct ftLoader *psLoader, Node_T oNNode)
+{
+   struct ftLevel *psNew;
+   size_t ulLevels;
+
+   assert(psLoader != NULL);
+   assert(oNNode != NULL);
+
+   if (psLoader->ulOpen == psLoader->ulLevels)
+   {
+      ulLevels = (psLoader->ulLevels == 0) ? 16
+                                           : 2 * psLoader->ulLevels;
+      psNew = realloc(psLoader->psLevels,
+                      ulLevels * sizeof(struct ftLevel));
+      if (psNew == NULL)
+         return MEMORY_ERROR;
+      memset(psNew + psLoader->ulLevels, 0,
+             (ulLevels - psLoader->ulLevels) * sizeof(struct ftLevel));
+      psLoader->psLevels = psNew;
+      psLoader->ulLevels = ulLevels;
+   }
+   psLoader->psLevels[psLoader->ulOpen].oNNode = oNNode;
+   psLoader->psLevels[psLoader->ulOpen].ulPending = 0;
+   psLoader->ulOpen++;
+   return SUCCESS;
+}
+
+/*
+  Adds the new node oNNode to the children pending for psLevel's
+  node. Returns SUCCESS, or MEMORY_ERROR if memory could not be
+  allocated to complete request.
+*/
+static int FT_levelAdd(struct ftLevel *psLevel, Node_T oNNode)
+{
+   Node_T *aoNNew;
+   size_t ulCapacity;
+
+   assert(psLevel != NULL);
+   assert(oNNode != NULL);
+
+   if (psLevel->ulPending == psLevel->ulCapacity)
+   {
+      ulCapacity = (psLevel->ulCapacity == 0) ? 16
+                                              : 2 * psLevel->ulCapacity;
+      aoNNew = realloc(psLevel->aoNPending, ulCapacity * sizeof(Node_T));
+      if (aoNNew == NULL)
+         return MEMORY_ERROR;
+      psLevel->aoNPending = aoNNew;
+      psLevel->ulCapacity = ulCapacity;
+   }
+   psLevel->aoNPending[psLevel->ulPending++] = oNNode;
+   return SUCCESS;
+}
+
+/*
+  Closes psLoader's levels from the deepest up until only ulDepth are
+  open, linking each directory closed to all its children. Returns
+  SUCCESS, or MEMORY_ERROR if memory could not be allocated to
+  complete request.
+*/
+static int FT_loaderClose(struct ftLoader *psLoader, size_t ulDepth)
+{
+   struct ftLevel *psLevel;
+
+   assert(psLoader != NULL);
+
+   while (psLoader->ulOpen > ulDepth)
+   {
+      psLevel = &psLoader->psLevels[psLoader->ulOpen - 1];
+      if (psLevel->ulPending != 0)
+      {
+         if (Node_linkChildren(psLevel->oNNode, psLevel->aoNPending,
+                               psLevel->ulPending) != SUCCESS)
+            return MEMORY_ERROR;
+         psLevel->ulPending = 0;
+      }
+      psLoader->ulOpen--;
+   }
+   return SUCCESS;
+}
+
+/*
+  Adds to psLoader's tree the node with absolute path pcPath, a file
+  with contents pvContents of ulLength bytes if bIsFile is TRUE or a
+  directory if not, along with any of its ancestors not there yet.
+  Returns SUCCESS if successful. Otherwise, returns:
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if pcPath is not under the root, would make a
+                     file the root, or comes before a path already
+                     loaded
+  * NOT_A_DIRECTORY if a proper prefix of pcPath was loaded as a file
+  * ALREADY_IN_TREE if pcPath was already loaded (as dir or file)
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+static int FT_loaderAdd(struct ftLoader *psLoader, const char *pcPath,
+                        boolean bIsFile, void *pvContents,
+                        size_t ulLength)
+{
+   Path_T oPPath = NULL;
+   Path_T oPRoot = NULL;
+   struct ftLevel *psParent;
+   Node_T oNNew = NULL;
+   NodeType nodeType;
+   size_t ulDepth;
+   size_t i;
+   int iStatus;
+
+   assert(psLoader != NULL);
+   assert(pcPath != NULL);
+
+   iStatus = Path_new(pcPath, &oPPath);
+   if (iStatus != SUCCESS)
+      return iStatus;
+   ulDepth = Path_getDepth(oPPath);
+
+   if (psLoader->oNRoot == NULL)
+   {
+      /* the first path names the root, which is a directory */
+      if (ulDepth == 1 && bIsFile)
+         iStatus = CONFLICTING_PATH;
+      else
+         iStatus = Path_prefix(oPPath, 1, &oPRoot);
+      if (iStatus == SUCCESS)
+      {
+         iStatus = Node_new(oPRoot, NODE_DIR, NULL, &psLoader->oNRoot);
+         Path_free(oPRoot);
+      }
+      if (iStatus == SUCCESS)
+      {
+         psLoader->ulNodes = 1;
+         iStatus = FT_loaderPush(psLoader, psLoader->oNRoot);
+      }
+      if (iStatus != SUCCESS || ulDepth == 1)
+      {
+         Path_free(oPPath);
+         return iStatus;
+      }
+      i = 1;
+   }
+   else
+   {
+      if (Atom_compareString(Node_getName(psLoader->oNRoot),
+                             Path_getComponent(oPPath, 0)))
+      {
+         Path_free(oPPath);
+         return CONFLICTING_PATH;
+      }
+
+      /* keep the levels this path shares with the last one */
+      for (i = 1; i < psLoader->ulOpen && i < ulDepth; i++)
+         if (Atom_compareString(
+                Node_getName(psLoader->psLevels[i].oNNode),
+                Path_getComponent(oPPath, i)))
+            break;
+      if (i == ulDepth)
+      {
+         Path_free(oPPath);
+         return ALREADY_IN_TREE;
+      }
+      iStatus = FT_loaderClose(psLoader, i);
+      if (iStatus != SUCCESS)
+      {
+         Path_free(oPPath);
+         return iStatus;
+      }
+   }
+
+   /* the first new node must be a directory's child, and come after
+      every child it has so far */
+   psParent = &psLoader->psLevels[i - 1];
+   if (Node_getType(psParent->oNNode) != NODE_DIR)
+   {
+      Path_free(oPPath);
+      return NOT_A_DIRECTORY;
+   }
+   if (psParent->ulPending != 0 &&
+       Atom_compareString(
+          Node_getName(psParent->aoNPending[psParent->ulPending - 1]),
+          Path_getComponent(oPPath, i)) >= 0)
+   {
+      Path_free(oPPath);
+      return CONFLICTING_PATH;
+   }
+
+   for (; i < ulDepth; i++)
+   {
+      nodeType = (i == ulDepth - 1 && bIsFile) ? NODE_FILE : NODE_DIR;
+      psParent = &psLoader->psLevels[i - 1];
+      iStatus = Node_newUnlinked(psParent->oNNode,
+                                 Path_getComponent(oPPath, i),
+                                 nodeType, &oNNew);
+      if (iStatus != SUCCESS)
+         break;
+      iStatus = FT_levelAdd(psParent, oNNew);
+      if (iStatus != SUCCESS)
+      {
+         Node_discard(oNNew);
+         break;
+      }
+      psLoader->ulNodes++;
+      if (nodeType == NODE_FILE)
+         Node_setContents(oNNew, pvContents, ulLength);
+      iStatus = FT_loaderPush(psLoader, oNNew);
+      if (iStatus != SUCCESS)
+         break;
+   }
+   Path_free(oPPath);
+   return iStatus;
+}
+
+/*
+  Frees psLoader's levels, along with the tree it was building if
+  bKeepTree is FALSE.
+*/
+static void FT_loaderFree(struct ftLoader *psLoader, boolean bKeepTree)
+{
+   size_t i, j;
+
+   assert(psLoader != NULL);
+
+   /* every node not yet linked is pending at exactly one level */
+   for (i = 0; i < psLoader->ulLevels; i++)
+   {
+      if (!bKeepTree && i < psLoader->ulOpen)
+         for (j = 0; j < psLoader->psLevels[i].ulPending; j++)
+            Node_discard(psLoader->psLevels[i].aoNPending[j]);
+      free(psLoader->psLevels[i].aoNPending);
+   }
+   free(psLoader->psLevels);
+   if (!bKeepTree && psLoader->oNRoot != NULL)
+      (void)Node_free(psLoader->oNRoot);
+}
+
+int FT_bulkLoadIn(FT_T oFTree,
+                  boolean (*pfNext)(const char **ppcPath,
+                                    boolean *pbIsFile,
+                                    void **ppvContents,
+                                    size_t *pulLength, void *pvExtra),
+                  void *pvExtra)
+{
+   struct ftLoader sLoader;
+   const char *pcPath;
+   boolean bIsFile;
+   void *pvContents;
+   size_t ulLength;
+   int iStatus = SUCCESS;
+
+   assert(oFTree != NULL);
+   assert(pfNext != NULL);
+   assert(!oFTree->bSnapshot);
+   assert(oFTree->psJournal == NULL);
+
+   sLoader.psLevels = NULL;
+   sLoader.ulOpen = 0;
+   sLoader.ulLevels = 0;
+   sLoader.oNRoot = NULL;
+   sLoader.ulNodes = 0;
+
+   /* as with FT_loadIn, the new tree is private until it is done */
+   while (iStatus == SUCCESS)
+   {
+      pcPath = NULL;
+      bIsFile = FALSE;
+      pvContents = NULL;
+      ulLength = 0;
+      if (!(*pfNext)(&pcPath, &bIsFile, &pvContents, &ulLength,
+                     pvExtra))
+         break;
+      assert(pcPath != NULL);
+      iStatus = FT_loaderAdd(&sLoader, pcPath, bIsFile, pvContents,
+                             ulLength);
+   }
+   if (iStatus == SUCCESS)
+      iStatus = FT_loaderClose(&sLoader, 0);
+   FT_loaderFree(&sLoader, (boolean)(iStatus == SUCCESS));
+   if (iStatus != SUCCESS)
+      return iStatus;
+
+   return FT_replaceRoot(oFTree, sLoader.oNRoot, sLoader.ulNodes);
+}
+
+/*
+  Applies the change eOp to pcPath, with contents pvContents of
+  ulLength bytes if it takes any, to the FT_T pvExtra, whose lock the
+  caller holds for writing, as Journal_replay asks. Returns SUCCESS,
+  MEMORY_ERROR if memory could not be allocated to complete request,
+  or EOF if the change cannot be made, which means that the journal
+  does not belong with the image the FT was loaded from.
+*/
+static int FT_applyRecord(JournalOp eOp, const char *pcPath,
+                          void *pvContents, size_t ulLength,
+                          void *pvExtra)
+{
+   FT_T oFTree = pvExtra;
+   void *pvOldContents;
+   int iStatus;
+
+   assert(pcPath != NULL);
+   assert(oFTree != NULL);
+
+   switch (eOp)
+   {
+   case JOURNAL_INSERT_DIR:
+      iStatus = FT_insertNode(oFTree, pcPath, NODE_DIR, NULL, 0);
+      break;
+   case JOURNAL_INSERT_FILE:
+      iStatus = FT_insertNode(oFTree, pcPath, NODE_FILE, pvContents,
+                              ulLength);
+      break;
+   case JOURNAL_RM_DIR:
+      iStatus = FT_rmNode(oFTree, pcPath, NODE_DIR);
+      break;
+   case JOURNAL_RM_FILE:
+      iStatus = FT_rmNode(oFTree, pcPath, NODE_FILE);
+      break;
+   default:
+      iStatus = FT_replaceNode(oFTree, pcPath, pvContents, ulLength,
+                               &pvOldContents);
+      break;
+   }
+
+   if (iStatus == SUCCESS || iStatus == MEMORY_ERROR)
+      return iStatus;
+   return EOF;
+}
+
+/*
+  Replays the journal file pcFile into oFTree, whose lock the caller
+  holds for writing, skipping changes numbered *pulLast or lower, and
+  sets *pulLast to the number of the last change replayed, if any.
+  Sets *ppvBlock and *pulBlock to the block that replayed contents
+  point into, as Journal_replay does. Returns the status
+  Journal_replay gave.
+*/
+static int FT_replayFile(FT_T oFTree, const char *pcFile,
+                         size_t *pulLast, void **ppvBlock,
+                         size_t *pulBlock)
+{
+   assert(oFTree != NULL);
+   assert(pcFile != NULL);
+   assert(pulLast != NULL);
+
+   return Journal_replay(pcFile, *pulLast, FT_applyRecord, oFTree,
+                         pulLast, ppvBlock, pulBlock);
+}
+
+/*
+  Ties the ulBlock-byte block pvBlock, which the contents of oFTree's
+  replayed files may point into, to oFTree's nodes, or frees it if
+  pvBlock is NULL or oFTree has no nodes left. Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated to complete request,
+  in which case the caller still owns the block.
+*/
+static int FT_keepBlock(FT_T oFTree, void *pvBlock, size_t ulBlock)
+{
+   assert(oFTree != NULL);
+
+   if (pvBlock == NULL)
+      return SUCCESS;
+   if (oFTree->oNRoot == NULL)
+   {
+      Journal_release(pvBlock, ulBlock);
+      return SUCCESS;
+   }
+   return Node_addBacking(oFTree->oNRoot, pvBlock, ulBlock,
+                          Journal_release);
+}
+
+/*
+  Returns a new ftJournal for the image pcImage and the journal
+  pcJournal, with no journal open yet, or NULL if insufficient memory
+  is available.
+*/
+static struct ftJournal *FT_newJournal(const char *pcImage,
+                                       const char *pcJournal)
+{
+   struct ftJournal *psJournal;
+
+   assert(pcImage != NULL);
+   assert(pcJournal != NULL);
+
+   psJournal = calloc(1, sizeof(struct ftJournal));
+   if (psJournal == NULL)
+      return NULL;
+   psJournal->pcImage = malloc(strlen(pcImage) + 1);
+   psJournal->pcOld = malloc(strlen(pcJournal) + sizeof(FT_OLD_SUFFIX));
+   if (psJournal->pcImage == NULL || psJournal->pcOld == NULL ||
+       pthread_mutex_init(&psJournal->sCheckpointLock, NULL) != 0)
+   {
+      free(psJournal->pcImage);
+      free(psJournal->pcOld);
+      free(psJournal);
+      return NULL;
+   }
+   strcpy(psJournal->pcImage, pcImage);
+   strcpy(psJournal->pcOld, pcJournal);
+   strcat(psJournal->pcOld, FT_OLD_SUFFIX);
+   return psJournal;
+}
+
+int FT_openJournalIn(FT_T oFTree, const char *pcImage,
+                     const char *pcJournal, size_t ulBatch)
+{
+   struct ftJournal *psJournal;
+   Node_T oNRoot = NULL;
+   void *pvOld = NULL;
+   void *pvBlock = NULL;
+   size_t ulOld = 0;
+   size_t ulBlock = 0;
+   size_t ulNodes = 0;
+   size_t ulLast = 0;
+   int iStatus;
+
+   assert(oFTree != NULL);
+   assert(pcImage != NULL);
+   assert(pcJournal != NULL);
+   assert(ulBatch > 0);
+   assert(!oFTree->bSnapshot);
+   assert(oFTree->psJournal == NULL);
+
+   psJournal = FT_newJournal(pcImage, pcJournal);
+   if (psJournal == NULL)
+      return MEMORY_ERROR;
+
+   /* with no image yet, the journal starts from an empty tree */
+   iStatus = Image_load(pcImage, &oNRoot, &ulNodes, &ulLast);
+   if (iStatus == NO_SUCH_PATH)
+      iStatus = SUCCESS;
+   if (iStatus == SUCCESS)
+      iStatus = FT_replaceRoot(oFTree, oNRoot, ulNodes);
+   if (iStatus != SUCCESS)
+   {
+      (void)FT_freeJournal(psJournal);
+      return iStatus;
+   }
+
+   /* changes made while the last checkpoint ran come after those in
+      the old journal, if it is still there */
+   FT_lockWrite(oFTree);
+   iStatus = FT_replayFile(oFTree, psJournal->pcOld, &ulLast, &pvOld,
+                           &ulOld);
+   psJournal->bRotated = (boolean)(iStatus != NO_SUCH_PATH);
+   if (iStatus == NO_SUCH_PATH)
+      iStatus = SUCCESS;
+   if (iStatus == SUCCESS)
+   {
+      iStatus = FT_replayFile(oFTree, pcJournal, &ulLast, &pvBlock,
+                              &ulBlock);
+      if (iStatus == NO_SUCH_PATH)
+         iStatus = SUCCESS;
+   }
+   FT_unlock(oFTree);
+
+   if (iStatus == SUCCESS)
+      iStatus = Journal_open(pcJournal, ulLast + 1, ulBatch,
+                             &psJournal->oJJournal);
+   if (iStatus == SUCCESS)
+   {
+      iStatus = FT_keepBlock(oFTree, pvOld, ulOld);
+      if (iStatus == SUCCESS)
+         pvOld = NULL;
+   }
+   if (iStatus == SUCCESS)
+   {
+      iStatus = FT_keepBlock(oFTree, pvBlock, ulBlock);
+      if (iStatus == SUCCESS)
+         pvBlock = NULL;
+   }
+
+   if (iStatus != SUCCESS)
+   {
+      /* no node may point into a block once it is released */
+      (void)FT_replaceRoot(oFTree, NULL, 0);
+      if (pvOld != NULL)
+         Journal_release(pvOld, ulOld);
+      if (pvBlock != NULL)
+         Journal_release(pvBlock, ulBlock);
+      (void)FT_freeJournal(psJournal);
+      return iStatus;
+   }
+   oFTree->psJournal = psJournal;
+   return SUCCESS;
+}
+
+int FT_closeJournalIn(FT_T oFTree)
+{
+   assert(oFTree != NULL);
+
+   return FT_dropJournal(oFTree);
+}
+
+int FT_syncIn(FT_T oFTree)
+{
+   assert(oFTree != NULL);
+
+   if (oFTree->psJournal == NULL)
+      return SUCCESS;
+   return Journal_sync(oFTree->psJournal->oJJournal);
+}
+
+int FT_checkpointIn(FT_T oFTree)
+{
+   struct ftJournal *psJournal;
+   FT_T oFTSnapshot;
+   size_t ulTag;
+   int iStatus = SUCCESS;
+
+   assert(oFTree != NULL);
+
+   psJournal = oFTree->psJournal;
+   if (psJournal == NULL)
+      return SUCCESS;
+
+   (void)pthread_mutex_lock(&psJournal->sCheckpointLock);
+
+   /* changes made from here on go to a fresh journal, while the old
+      one stays until the image holds everything in it; if an earlier
+      checkpoint failed, or was cut short by a crash, the old one is
+      still there, and the image is simply saved again */
+   if (!psJournal->bRotated)
+   {
+      FT_lockWrite(oFTree);
+      iStatus = Journal_rotate(psJournal->oJJournal, psJournal->pcOld);
+      FT_unlock(oFTree);
+      if (iStatus == SUCCESS)
+         psJournal->bRotated = TRUE;
+   }
+
+   if (iStatus == SUCCESS)
+   {
+      oFTSnapshot = FT_takeSnapshot(oFTree, &ulTag);
+      if (oFTSnapshot == NULL)
+         iStatus = MEMORY_ERROR;
+      else
+      {
+         iStatus = Image_save(oFTSnapshot->oNRoot, ulTag,
+                              psJournal->pcImage);
+         FT_free(oFTSnapshot);
+      }
+   }
+   /* Image_save has synced the image's directory, so the rename is on
+      the disk before the old journal goes */
+   if (iStatus == SUCCESS)
+   {
+      if (remove(psJournal->pcOld) == 0)
+         psJournal->bRotated = FALSE;
+      else
+         iStatus = EOF;
+   }
+
+   (void)pthread_mutex_unlock(&psJournal->sCheckpointLock);
+   return iStatus;
+}
+
+/* --------------------------------------------------------------------
+
+  The following functions work on the default tree, each by checking
+  that it is initialized and handing it to the matching FT_T function.
+*/
+
+int FT_insertDir(const char *pcPath)
+{
+   assert(pcPath != NULL);
+   
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return FT_insertDirIn(&sDefaultTree, pcPath);
+}
+
+boolean FT_containsDir(const char *pcPath)
+{
+   assert(pcPath != NULL);
+
+   if (!bIsInitialized)
+      return FALSE;
+
+   return FT_containsDirIn(&sDefaultTree, pcPath);
+}
+
+int FT_rmDir(const char *pcPath)
+{
+   assert(pcPath != NULL);
+
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return FT_rmDirIn(&sDefaultTree, pcPath);
+}
+
+int FT_insertFile(const char *pcPath, void *pvContents,
+                  size_t ulLength)
+{
+   assert(pcPath != NULL);
+
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return FT_insertFileIn(&sDefaultTree, pcPath, pvContents, ulLength);
+}
+
+int FT_insertFiles(const char **apcPaths, void **apvContents,
+                   const size_t *aulLengths, size_t ulCount,
+                   int *aiStatuses)
+{
+   size_t i;
+
+   assert(aiStatuses != NULL || ulCount == 0);
+
+   if (!bIsInitialized)
+   {
+      for (i = 0; i < ulCount; i++)
+         aiStatuses[i] = INITIALIZATION_ERROR;
+      return INITIALIZATION_ERROR;
+   }
+
+   return FT_insertFilesIn(&sDefaultTree, apcPaths, apvContents,
+                           aulLengths, ulCount, aiStatuses);
+}
+
+boolean FT_containsFile(const char *pcPath)
+{
+   assert(pcPath != NULL);
+
+   if (!bIsInitialized)
+      return FALSE;
+
+   return FT_containsFileIn(&sDefaultTree, pcPath);
+}
+
+int FT_rmFile(const char *pcPath)
+{
+   assert(pcPath != NULL);
+   
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return FT_rmFileIn(&sDefaultTree, pcPath);
+}
+
+void *FT_getFileContents(const char *pcPath)
+{
+   assert(pcPath != NULL);
+
+   if (!bIsInitialized)
+      return NULL;
+
+   return FT_getFileContentsIn(&sDefaultTree, pcPath);
+}
+
+void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
+                             size_t ulNewLength)
+{
+   assert(pcPath != NULL);
+
+   if (!bIsInitialized)
+      return NULL;
+
+   return FT_replaceFileContentsIn(&sDefaultTree, pcPath,
+                                   pvNewContents, ulNewLength);
+}
+
+int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize)
+{
+   assert(pcPath != NULL);
+   assert(pbIsFile != NULL);
+   assert(pulSize != NULL);
+
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return FT_statIn(&sDefaultTree, pcPath, pbIsFile, pulSize);
+}
 
+int FT_getId(const char *pcPath, size_t *pulId)
+{
    assert(pcPath != NULL);
+   assert(pulId != NULL);
 
-   iStatus = FT_findNode(pcPath, &oNFound);
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
 
-   if (iStatus != SUCCESS)
-      return iStatus;
+   return FT_getIdIn(&sDefaultTree, pcPath, pulId);
+}
 
-   /* check that the node matches the expected type */
-   if (Node_getType(oNFound) != nodeType)
-      return (nodeType == NODE_DIR) ? NOT_A_DIRECTORY : NOT_A_FILE;
+int FT_statById(size_t ulId, boolean *pbIsFile, size_t *pulSize)
+{
+   assert(pbIsFile != NULL);
+   assert(pulSize != NULL);
 
-   ulCount -= Node_free(oNFound);
-   if (ulCount == 0)
-      oNRoot = NULL;
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
 
-   return SUCCESS;
+   return FT_statByIdIn(&sDefaultTree, ulId, pbIsFile, pulSize);
 }
 
-int FT_insertDir(const char *pcPath)
+int FT_statMany(const char **apcPaths, size_t ulCount,
+                int *aiStatuses, boolean *abIsFile, size_t *aulSizes)
 {
-   assert(pcPath != NULL);
-   
+   size_t i;
+
+   assert(aiStatuses != NULL || ulCount == 0);
+
    if (!bIsInitialized)
+   {
+      for (i = 0; i < ulCount; i++)
+         aiStatuses[i] = INITIALIZATION_ERROR;
       return INITIALIZATION_ERROR;
+   }
 
-   return FT_insertNode(pcPath, NODE_DIR, NULL, 0);
+   return FT_statManyIn(&sDefaultTree, apcPaths, ulCount, aiStatuses,
+                        abIsFile, aulSizes);
 }
 
-boolean FT_containsDir(const char *pcPath)
+size_t FT_containsMany(const char **apcPaths, size_t ulCount,
+                       boolean *abContains)
 {
-   int iStatus;
-   Node_T oNFound = NULL;
+   size_t i;
 
-   assert(pcPath != NULL);
+   assert(abContains != NULL || ulCount == 0);
 
    if (!bIsInitialized)
-      return FALSE;
+   {
+      for (i = 0; i < ulCount; i++)
+         abContains[i] = FALSE;
+      return 0;
+   }
 
-   iStatus = FT_findNode(pcPath, &oNFound);
-   if (iStatus == SUCCESS)
-      return (boolean)(Node_getType(oNFound) == NODE_DIR);
-   else
-      return FALSE;
+   return FT_containsManyIn(&sDefaultTree, apcPaths, ulCount,
+                            abContains);
 }
 
-int FT_rmDir(const char *pcPath)
+int FT_openDir(const char *pcPath, FTDir_T *poDDir)
 {
    assert(pcPath != NULL);
+   assert(poDDir != NULL);
 
    if (!bIsInitialized)
+   {
+      *poDDir = NULL;
       return INITIALIZATION_ERROR;
+   }
 
-   return FT_rmNode(pcPath, NODE_DIR);
+   return FT_openDirIn(&sDefaultTree, pcPath, poDDir);
 }
 
-int FT_insertFile(const char *pcPath, void *pvContents,
-                  size_t ulLength)
+int FT_init(void)
 {
-   assert(pcPath != NULL);
+   if (bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   bIsInitialized = TRUE;
+   sDefaultTree.oNRoot = NULL;
+   sDefaultTree.ulCount = 0;
+   sDefaultTree.oIIndex = NULL;
+   sDefaultTree.bConcurrent = FALSE;
+   sDefaultTree.oEEpoch = NULL;
+   sDefaultTree.bSnapshot = FALSE;
+   sDefaultTree.psJournal = NULL;
+   sDefaultTree.oRReclaimer = NULL;
+
+   return SUCCESS;
+}
 
+int FT_destroy(void)
+{
    if (!bIsInitialized)
       return INITIALIZATION_ERROR;
 
-   return FT_insertNode(pcPath, NODE_FILE, pvContents, ulLength);
-}
-/*--------------------------------------------------------------------*/
+   FT_clear(&sDefaultTree);
 
+   bIsInitialized = FALSE;
+   return SUCCESS;
+}
 
-boolean FT_containsFile(const char *pcPath)
+int FT_setPathIndex(boolean bEnable)
 {
-   int iStatus;
-   Node_T oNFound = NULL;
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
 
-   assert(pcPath != NULL);
+   return FT_setPathIndexIn(&sDefaultTree, bEnable);
+}
 
+int FT_setConcurrent(boolean bEnable)
+{
    if (!bIsInitialized)
-      return FALSE;
+      return INITIALIZATION_ERROR;
 
-   iStatus = FT_findNode(pcPath, &oNFound);
-   if (iStatus == SUCCESS)
-      return (boolean)(Node_getType(oNFound) == NODE_FILE);
-   else
-      return FALSE;
+   return FT_setConcurrentIn(&sDefaultTree, bEnable);
 }
 
-int FT_rmFile(const char *pcPath)
+int FT_setReclaimer(boolean bEnable)
 {
-   assert(pcPath != NULL);
-   
    if (!bIsInitialized)
       return INITIALIZATION_ERROR;
 
-   return FT_rmNode(pcPath, NODE_FILE);
+   return FT_setReclaimerIn(&sDefaultTree, bEnable);
 }
 
-void *FT_getFileContents(const char *pcPath)
+int FT_reclaim(void)
 {
-   int iStatus;
-   Node_T oNNode;
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
 
-   assert(pcPath != NULL);
+   return FT_reclaimIn(&sDefaultTree);
+}
 
+FT_T FT_snapshot(void)
+{
    if (!bIsInitialized)
       return NULL;
 
-   iStatus = FT_findNode(pcPath, &oNNode);
-   if (iStatus != SUCCESS)
-      return NULL;
-
-   return Node_getContent(oNNode);
+   return FT_snapshotIn(&sDefaultTree);
 }
 
-void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
-                             size_t ulNewLength)
+int FT_save(const char *pcFile)
 {
-   int iStatus;
-   Node_T oNNode;
-   void *pvOldContents;
-
-   assert(pcPath != NULL);
+   assert(pcFile != NULL);
 
    if (!bIsInitialized)
-      return NULL;
-
-   iStatus = FT_findNode(pcPath, &oNNode);
-   if (iStatus != SUCCESS)
-      return NULL;
+      return INITIALIZATION_ERROR;
 
-   pvOldContents = Node_getContent(oNNode);
-   Node_setContents(oNNode, pvNewContents, ulNewLength);
-   return pvOldContents;
+   return FT_saveIn(&sDefaultTree, pcFile);
 }
 
-int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize)
+int FT_load(const char *pcFile)
 {
-   int iStatus;
-   Node_T oNNode;
+   assert(pcFile != NULL);
 
-   assert(pcPath != NULL);
-   assert(pbIsFile != NULL);
-   assert(pulSize != NULL);
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return FT_loadIn(&sDefaultTree, pcFile);
+}
+
+int FT_bulkLoad(boolean (*pfNext)(const char **ppcPath,
+                                  boolean *pbIsFile,
+                                  void **ppvContents, size_t *pulLength,
+                                  void *pvExtra),
+                void *pvExtra)
+{
+   assert(pfNext != NULL);
 
    if (!bIsInitialized)
       return INITIALIZATION_ERROR;
 
-   iStatus = FT_findNode(pcPath, &oNNode);
-   if (iStatus != SUCCESS)
-      return iStatus;
+   return FT_bulkLoadIn(&sDefaultTree, pfNext, pvExtra);
+}
 
-   *pbIsFile = (Node_getType(oNNode) == NODE_FILE) ? TRUE : FALSE;
-   if (*pbIsFile)
-   {
-      *pulSize = Node_getContentSize(oNNode);
-   }
-   return SUCCESS;
+int FT_openJournal(const char *pcImage, const char *pcJournal,
+                   size_t ulBatch)
+{
+   assert(pcImage != NULL);
+   assert(pcJournal != NULL);
+
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return FT_openJournalIn(&sDefaultTree, pcImage, pcJournal, ulBatch);
 }
 
-int FT_init(void)
+int FT_closeJournal(void)
 {
-   if (bIsInitialized)
+   if (!bIsInitialized)
       return INITIALIZATION_ERROR;
 
-   bIsInitialized = TRUE;
-   oNRoot = NULL;
-   ulCount = 0;
+   return FT_closeJournalIn(&sDefaultTree);
+}
 
-   return SUCCESS;
+int FT_sync(void)
+{
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return FT_syncIn(&sDefaultTree);
 }
 
-int FT_destroy(void)
+int FT_checkpoint(void)
 {
    if (!bIsInitialized)
       return INITIALIZATION_ERROR;
 
-   if (oNRoot)
+   return FT_checkpointIn(&sDefaultTree);
+}
+
+/* --------------------------------------------------------------------
+
+  The following auxiliary functions are used for generating the
+  string representation of the FT. The representation is streamed
+  node by node through a small fixed-size buffer into a sink, so no
+  function here ever holds more than one path and one buffer's worth
+  of output at a time.
+*/
+
+/* The number of bytes of output gathered before calling the sink */
+#define FT_WRITER_BUFSIZE 4096
+
+/* The number of pending directories a streaming pass first makes
+   room for */
+#define FT_WRITER_PENDING 64
+
+/* A directory that a streaming pass has yet to write */
+struct ftPending {
+   /* the directory */
+   Node_T oNDir;
+   /* the length of its parent's path, which precedes it in the path
+      buffer by the time it is written */
+   size_t ulLength;
+};
+
+/* The state of one streaming pass over the FT */
+struct ftWriter {
+   /* the client's sink, and the extra argument passed along to it */
+   int (*pfSink)(const char *pcChunk, size_t ulLength, void *pvExtra);
+   void *pvExtra;
+   /* the absolute path of the node being written; deeper levels
+      append to it in place as the traversal descends */
+   char *pcPath;
+   /* the number of bytes allocated for pcPath */
+   size_t ulPathSize;
+   /* the directories found but not yet written, the next one last */
+   struct ftPending *psPending;
+   /* the number of entries in psPending */
+   size_t ulPending;
+   /* the number of entries allocated for psPending */
+   size_t ulPendingSize;
+   /* the number of bytes waiting in acBuffer */
+   size_t ulBuffered;
+   /* output gathered but not yet passed to the sink */
+   char acBuffer[FT_WRITER_BUFSIZE];
+};
+
+/*
+  Passes the output gathered in psWriter to its sink. Returns SUCCESS,
+  or the sink's status if the sink fails.
+*/
+static int FT_writerFlush(struct ftWriter *psWriter)
+{
+   int iStatus = SUCCESS;
+
+   assert(psWriter != NULL);
+
+   if (psWriter->ulBuffered != 0)
+      iStatus = (*psWriter->pfSink)(psWriter->acBuffer,
+                                    psWriter->ulBuffered,
+                                    psWriter->pvExtra);
+   psWriter->ulBuffered = 0;
+   return iStatus;
+}
+
+/*
+  Appends the ulLength bytes at pcChunk to psWriter's output, passing
+  full buffers on to the sink. Returns SUCCESS, or the sink's status if
+  the sink fails.
+*/
+static int FT_writerPut(struct ftWriter *psWriter, const char *pcChunk,
+                        size_t ulLength)
+{
+   int iStatus;
+
+   assert(psWriter != NULL);
+   assert(pcChunk != NULL);
+
+   if (psWriter->ulBuffered + ulLength > FT_WRITER_BUFSIZE)
    {
-      ulCount -= Node_free(oNRoot);
-      oNRoot = NULL;
+      iStatus = FT_writerFlush(psWriter);
+      if (iStatus != SUCCESS)
+         return iStatus;
+
+      /* a chunk too big to buffer goes straight to the sink */
+      if (ulLength > FT_WRITER_BUFSIZE)
+         return (*psWriter->pfSink)(pcChunk, ulLength,
+                                    psWriter->pvExtra);
    }
 
-   bIsInitialized = FALSE;
+   memcpy(psWriter->acBuffer + psWriter->ulBuffered, pcChunk, ulLength);
+   psWriter->ulBuffered += ulLength;
    return SUCCESS;
 }
 
-/* --------------------------------------------------------------------
-
-  The following auxiliary functions are used for generating the
-  string representation of the DT.
+/*
+  Extends the path in psWriter, currently ulLength bytes long, with a
+  delimiter and oNChild's name. Sets *pulNewLength to the new length.
+  Returns SUCCESS, or MEMORY_ERROR if the path buffer could not grow.
 */
+static int FT_writerDescend(struct ftWriter *psWriter, size_t ulLength,
+                            Node_T oNChild, size_t *pulNewLength)
+{
+   Atom_T oAName;
+   size_t ulNewLength;
+   char *pcNewPath;
+
+   assert(psWriter != NULL);
+   assert(oNChild != NULL);
+   assert(pulNewLength != NULL);
+
+   oAName = Node_getName(oNChild);
+   ulNewLength = ulLength + 1 + Atom_getLength(oAName);
+   if (ulNewLength + 1 > psWriter->ulPathSize)
+   {
+      pcNewPath = realloc(psWriter->pcPath, 2 * (ulNewLength + 1));
+      if (pcNewPath == NULL)
+         return MEMORY_ERROR;
+      psWriter->pcPath = pcNewPath;
+      psWriter->ulPathSize = 2 * (ulNewLength + 1);
+   }
+
+   psWriter->pcPath[ulLength] = '/';
+   memcpy(psWriter->pcPath + ulLength + 1, Atom_getString(oAName),
+          Atom_getLength(oAName));
+   psWriter->pcPath[ulNewLength] = '\n';
+   *pulNewLength = ulNewLength;
+   return SUCCESS;
+}
 
 /*
-  Performs a pre-order traversal of the tree rooted at n,
-  inserting each payload to DynArray_T d beginning at index i.
-  Returns the next unused index in d after the insertion(s).
+  Writes the path in psWriter's path buffer of the directory oNDir,
+  which is ulLength bytes long, and then those of oNDir's children
+  that are files. Adds oNDir's children that are directories to
+  psWriter's pending directories so that the first of them is written
+  next. Returns SUCCESS, or MEMORY_ERROR or the sink's status if
+  either fails.
 */
-static size_t FT_preOrderTraversal(Node_T n, DynArray_T d, size_t i)
+static int FT_writeDir(struct ftWriter *psWriter, Node_T oNDir,
+                       size_t ulLength)
 {
+   struct ftPending *psNewPending;
+   struct ftPending sSwap;
    size_t c;
+   size_t ulFirst;
+   size_t ulLast;
+   size_t ulChildLength;
+   Node_T oNChild = NULL;
+   int iStatus;
 
-   assert(d != NULL);
+   assert(psWriter != NULL);
+   assert(oNDir != NULL);
 
-   if (n != NULL)
+   /* each path in the buffer is kept followed by its newline */
+   iStatus = FT_writerPut(psWriter, psWriter->pcPath, ulLength + 1);
+   if (iStatus != SUCCESS)
+      return iStatus;
+
+   /* write the files as they come, and put the directories aside */
+   ulFirst = psWriter->ulPending;
+   for (c = 0; c < Node_getNumChildren(oNDir); c++)
    {
-      (void)DynArray_set(d, i, n);
-      i++;
-      /* first add all nodes that are files into the array */
-      for (c = 0; c < Node_getNumChildren(n); c++)
+      iStatus = Node_getChild(oNDir, c, &oNChild);
+      assert(iStatus == SUCCESS);
+      if (Node_getType(oNChild) == NODE_FILE)
       {
-         int iStatus;
-         Node_T oNChild = NULL;
-         iStatus = Node_getChild(n, c, &oNChild);
-         assert(iStatus == SUCCESS);
-         if (Node_getType(oNChild) == NODE_FILE)
-         {
-            (void)DynArray_set(d, i, oNChild);
-            i++;
-         }
+         iStatus = FT_writerDescend(psWriter, ulLength, oNChild,
+                                    &ulChildLength);
+         if (iStatus == SUCCESS)
+            iStatus = FT_writerPut(psWriter, psWriter->pcPath,
+                                   ulChildLength + 1);
+         if (iStatus != SUCCESS)
+            return iStatus;
+         continue;
       }
-      /* then add all nodes that are directories into the array */
-      for (c = 0; c < Node_getNumChildren(n); c++)
+
+      if (psWriter->ulPending == psWriter->ulPendingSize)
       {
-         int iStatus;
-         Node_T oNChild = NULL;
-         iStatus = Node_getChild(n, c, &oNChild);
-         assert(iStatus == SUCCESS);
-         if (Node_getType(oNChild) == NODE_DIR)
-            i = FT_preOrderTraversal(oNChild, d, i);
+         psNewPending = realloc(psWriter->psPending,
+                                2 * psWriter->ulPendingSize *
+                                sizeof(struct ftPending));
+         if (psNewPending == NULL)
+            return MEMORY_ERROR;
+         psWriter->psPending = psNewPending;
+         psWriter->ulPendingSize *= 2;
       }
+      psWriter->psPending[psWriter->ulPending].oNDir = oNChild;
+      psWriter->psPending[psWriter->ulPending].ulLength = ulLength;
+      psWriter->ulPending++;
+   }
+
+   /* the pending directories are taken from the end, so reverse
+      oNDir's to have them come out in order */
+   ulLast = psWriter->ulPending;
+   while (ulFirst + 1 < ulLast)
+   {
+      ulLast--;
+      sSwap = psWriter->psPending[ulFirst];
+      psWriter->psPending[ulFirst] = psWriter->psPending[ulLast];
+      psWriter->psPending[ulLast] = sSwap;
+      ulFirst++;
    }
-   return i;
+   return SUCCESS;
 }
 
 /*
-  Alternate version of strlen that uses pulAcc as an in-out parameter
-  to accumulate a string length, rather than returning the length of
-  oNNode's path, and also always adds one addition byte to the sum.
+  Writes the subtree rooted at oNNode, whose path of ulLength bytes is
+  already in psWriter's path buffer, in depth-first order with files
+  before directories at each level. Keeps the directories still to be
+  written in psWriter rather than on the call stack, so that a deep
+  subtree needs no deep recursion. Returns SUCCESS, or MEMORY_ERROR
+  or the sink's status if either fails.
 */
-static void FT_strlenAccumulate(Node_T oNNode, size_t *pulAcc)
+static int FT_writeSubtree(struct ftWriter *psWriter, Node_T oNNode,
+                           size_t ulLength)
 {
-   assert(pulAcc != NULL);
+   struct ftPending sNext;
+   size_t ulChildLength;
+   int iStatus;
 
-   if (oNNode != NULL)
-      *pulAcc += (Path_getStrLength(Node_getPath(oNNode)) + 1);
+   assert(psWriter != NULL);
+   assert(oNNode != NULL);
+
+   iStatus = FT_writeDir(psWriter, oNNode, ulLength);
+   while (iStatus == SUCCESS && psWriter->ulPending != 0)
+   {
+      sNext = psWriter->psPending[--psWriter->ulPending];
+      /* everything written since sNext was set aside lies below its
+         parent, so the buffer still holds the parent's path */
+      iStatus = FT_writerDescend(psWriter, sNext.ulLength, sNext.oNDir,
+                                 &ulChildLength);
+      if (iStatus == SUCCESS)
+         iStatus = FT_writeDir(psWriter, sNext.oNDir, ulChildLength);
+   }
+   return iStatus;
 }
 
 /*
-  Alternate version of strcat that inverts the typical argument
-  order, appending oNNode's path onto pcAcc, and also always adds one
-  newline at the end of the concatenated string.
+  Streams oFTree's string representation to *pfSink as
+  FT_toStringCallbackIn does, for a caller that already holds oFTree's
+  lock.
 */
-static void FT_strcatAccumulate(Node_T oNNode, char *pcAcc)
+static int FT_writeLocked(FT_T oFTree,
+                          int (*pfSink)(const char *pcChunk,
+                                        size_t ulLength, void *pvExtra),
+                          void *pvExtra)
 {
-   assert(pcAcc != NULL);
+   struct ftWriter *psWriter;
+   Atom_T oAName;
+   size_t ulLength;
+   int iStatus = SUCCESS;
 
-   if (oNNode != NULL)
+   assert(oFTree != NULL);
+   assert(pfSink != NULL);
+
+   if (oFTree->oNRoot == NULL)
+      return SUCCESS;
+
+   psWriter = malloc(sizeof(struct ftWriter));
+   if (psWriter == NULL)
+      return MEMORY_ERROR;
+   psWriter->pfSink = pfSink;
+   psWriter->pvExtra = pvExtra;
+   psWriter->ulBuffered = 0;
+
+   /* seed the path buffer with the root's name and newline */
+   oAName = Node_getName(oFTree->oNRoot);
+   ulLength = Atom_getLength(oAName);
+   psWriter->ulPathSize = 2 * (ulLength + 1);
+   psWriter->pcPath = malloc(psWriter->ulPathSize);
+   if (psWriter->pcPath == NULL)
+   {
+      free(psWriter);
+      return MEMORY_ERROR;
+   }
+   memcpy(psWriter->pcPath, Atom_getString(oAName), ulLength);
+   psWriter->pcPath[ulLength] = '\n';
+
+   psWriter->ulPending = 0;
+   psWriter->ulPendingSize = FT_WRITER_PENDING;
+   psWriter->psPending = malloc(psWriter->ulPendingSize *
+                                sizeof(struct ftPending));
+   if (psWriter->psPending == NULL)
    {
-      strcat(pcAcc, Path_getPathname(Node_getPath(oNNode)));
-      strcat(pcAcc, "\n");
+      free(psWriter->pcPath);
+      free(psWriter);
+      return MEMORY_ERROR;
    }
+
+   iStatus = FT_writeSubtree(psWriter, oFTree->oNRoot, ulLength);
+   if (iStatus == SUCCESS)
+      iStatus = FT_writerFlush(psWriter);
+
+   free(psWriter->psPending);
+   free(psWriter->pcPath);
+   free(psWriter);
+   return iStatus;
 }
-/*--------------------------------------------------------------------*/
 
-char *FT_toString(void)
+int FT_toStringCallbackIn(FT_T oFTree,
+                          int (*pfSink)(const char *pcChunk,
+                                        size_t ulLength, void *pvExtra),
+                          void *pvExtra)
 {
-   DynArray_T nodes;
-   size_t totalStrlen = 1;
-   char *result = NULL;
+   int iStatus;
 
-   if (!bIsInitialized)
-      return NULL;
+   assert(oFTree != NULL);
+   assert(pfSink != NULL);
+
+   /* writers under latches hold the FT lock only for reading, so a
+      consistent picture of the whole tree needs it for writing */
+   FT_lockWrite(oFTree);
+   iStatus = FT_writeLocked(oFTree, pfSink, pvExtra);
+   FT_unlock(oFTree);
+   return iStatus;
+}
+
+/*
+  A sink for FT_toStringCallback that writes the ulLength bytes at
+  pcChunk to the stream pvFile. Returns SUCCESS, or EOF if the write
+  fails.
+*/
+static int FT_fileSink(const char *pcChunk, size_t ulLength,
+                       void *pvFile)
+{
+   assert(pcChunk != NULL);
+   assert(pvFile != NULL);
+
+   if (fwrite(pcChunk, 1, ulLength, (FILE *)pvFile) != ulLength)
+      return EOF;
+   return SUCCESS;
+}
+
+int FT_writeToIn(FT_T oFTree, FILE *psFile)
+{
+   assert(oFTree != NULL);
+   assert(psFile != NULL);
+
+   return FT_toStringCallbackIn(oFTree, FT_fileSink, psFile);
+}
+
+/* A string being built by FT_stringSink */
+struct ftString {
+   /* the string so far, always '\0'-terminated */
+   char *pcString;
+   /* the write cursor: the string length of pcString */
+   size_t ulLength;
+   /* the number of bytes allocated for pcString */
+   size_t ulSize;
+};
+
+/*
+  A sink for FT_toStringCallback that appends the ulLength bytes at
+  pcChunk to the struct ftString pvString at its write cursor,
+  doubling the allocation as needed. Returns SUCCESS, or MEMORY_ERROR
+  if the string could not grow.
+*/
+static int FT_stringSink(const char *pcChunk, size_t ulLength,
+                         void *pvString)
+{
+   struct ftString *psString = (struct ftString *)pvString;
+   size_t ulNewSize;
+   char *pcNew;
+
+   assert(pcChunk != NULL);
+   assert(psString != NULL);
+
+   if (psString->ulLength + ulLength + 1 > psString->ulSize)
+   {
+      ulNewSize = 2 * psString->ulSize;
+      if (ulNewSize < psString->ulLength + ulLength + 1)
+         ulNewSize = psString->ulLength + ulLength + 1;
+      pcNew = realloc(psString->pcString, ulNewSize);
+      if (pcNew == NULL)
+         return MEMORY_ERROR;
+      psString->pcString = pcNew;
+      psString->ulSize = ulNewSize;
+   }
+
+   memcpy(psString->pcString + psString->ulLength, pcChunk, ulLength);
+   psString->ulLength += ulLength;
+   psString->pcString[psString->ulLength] = '\0';
+   return SUCCESS;
+}
+/*--------------------------------------------------------------------*/
+
+char *FT_toStringIn(FT_T oFTree)
+{
+   struct ftString sString;
 
-   nodes = DynArray_new(ulCount);
-   (void)FT_preOrderTraversal(oNRoot, nodes, 0);
+   assert(oFTree != NULL);
 
-   DynArray_map(nodes, (void (*)(void *, void *))FT_strlenAccumulate,
-                (void *)&totalStrlen);
+   sString.ulLength = 0;
+   sString.ulSize = FT_WRITER_BUFSIZE;
+   sString.pcString = malloc(sString.ulSize);
+   if (sString.pcString == NULL)
+      return NULL;
+   *sString.pcString = '\0';
 
-   result = malloc(totalStrlen);
-   if (result == NULL)
+   if (FT_toStringCallbackIn(oFTree, FT_stringSink, &sString) !=
+       SUCCESS)
    {
-      DynArray_free(nodes);
+      free(sString.pcString);
       return NULL;
    }
-   *result = '\0';
 
-   DynArray_map(nodes, (void (*)(void *, void *))FT_strcatAccumulate,
-                (void *)result);
+   return sString.pcString;
+}
+
+int FT_toStringCallback(int (*pfSink)(const char *pcChunk,
+                                      size_t ulLength, void *pvExtra),
+                        void *pvExtra)
+{
+   assert(pfSink != NULL);
+
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return FT_toStringCallbackIn(&sDefaultTree, pfSink, pvExtra);
+}
+
+int FT_writeTo(FILE *psFile)
+{
+   assert(psFile != NULL);
+
+   if (!bIsInitialized)
+      return INITIALIZATION_ERROR;
+
+   return FT_writeToIn(&sDefaultTree, psFile);
+}
 
-   DynArray_free(nodes);
+char *FT_toString(void)
+{
+   if (!bIsInitialized)
+      return NULL;
 
-   return result;
+   return FT_toStringIn(&sDefaultTree);
 }
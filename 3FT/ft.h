@@ -13,8 +13,17 @@
 */
 
 #include <stddef.h>
+#include <stdio.h>
 #include "a4def.h"
 
+/*
+  An FT_T is one File Tree, independent of every other: trees share no
+  state, so different trees may be used from different threads at
+  once. The functions below that take no FT_T all work on a single
+  default tree, which FT_init and FT_destroy create and tear down.
+*/
+typedef struct ft *FT_T;
+
 /*
    Inserts a new directory into the FT with absolute path pcPath.
    Returns SUCCESS if the new directory is inserted successfully.
@@ -64,6 +73,29 @@ int FT_rmDir(const char *pcPath);
 int FT_insertFile(const char *pcPath, void *pvContents,
                   size_t ulLength);
 
+/*
+  Inserts ulCount new files into the FT at once, the file at index i
+  with absolute path apcPaths[i] and contents apvContents[i] of size
+  aulLengths[i] bytes, and sets aiStatuses[i] to what FT_insertFile
+  would have returned for it. The files are inserted as if by calls to
+  FT_insertFile in increasing order of path (as strcmp compares them),
+  files with the same path in the order given: of two files with the
+  same path only the first is inserted, and a file below a path that
+  the batch also gives as a file fails with NOT_A_DIRECTORY. Sorting
+  brings together the files in each directory, and each file's search
+  starts from the deepest directory it shares with the one before it,
+  so a directory shared by many files is searched for only once.
+  Other writers and FT_snapshot see all of the batch or none of it,
+  though lookups in concurrent mode may see it part done. Returns
+  SUCCESS once every file has its status. Otherwise, sets every
+  status and returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to sort the batch
+*/
+int FT_insertFiles(const char **apcPaths, void **apvContents,
+                   const size_t *aulLengths, size_t ulCount,
+                   int *aiStatuses);
+
 /*
   Returns TRUE if the FT contains a file with absolute path
   pcPath and FALSE if not or if there is an error while checking.
@@ -119,6 +151,136 @@ void *FT_replaceFileContents(const char *pcPath, void *pvNewContents,
 */
 int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize);
 
+/*
+  Looks up ulCount absolute paths at once, setting aiStatuses[i] to
+  what FT_stat would return for apcPaths[i] and, when that is SUCCESS,
+  abIsFile[i] and (for a file) aulSizes[i] as FT_stat would set them;
+  entries FT_stat would leave unchanged are left unchanged. The paths
+  are sorted and split into a few runs that are walked side by side: a
+  run searches each directory once for all its paths under it, and
+  while one run waits for memory the others go on, so their cache
+  misses overlap. Each result is as the FT was at some moment during
+  the call. Returns SUCCESS once every path has its status.
+  Otherwise, sets every status and returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to sort the batch
+*/
+int FT_statMany(const char **apcPaths, size_t ulCount,
+                int *aiStatuses, boolean *abIsFile, size_t *aulSizes);
+
+/*
+  Looks up ulCount absolute paths at once as FT_statMany does, setting
+  abContains[i] to TRUE if the FT contains apcPaths[i] as a directory
+  or a file, or FALSE if not or if there is an error of any kind.
+  Returns the number of paths the FT contains.
+*/
+size_t FT_containsMany(const char **apcPaths, size_t ulCount,
+                       boolean *abContains);
+
+/*
+  Every directory and file in the FT has an ID, a nonzero number that
+  stays the same for as long as the node stays in the FT and that
+  FT_statById turns back into the node with one table lookup and no
+  walk from the root. Once the node is removed (or the FT is cleared,
+  loaded, or replaced by a journal's replay), its ID no longer finds
+  anything, even if a node is made at the same path again; IDs are
+  reused only with a new generation in their high half, so a stale ID
+  never finds another node by mistake. A snapshot (see FT_snapshot)
+  has no IDs of its own, so FT_getIdIn and FT_statByIdIn must not be
+  given one.
+*/
+
+/*
+  Sets *pulId to the ID of the directory or file of the FT with
+  absolute path pcPath. Returns SUCCESS, or otherwise leaves *pulId
+  unchanged and returns the status FT_stat would.
+*/
+int FT_getId(const char *pcPath, size_t *pulId);
+
+/*
+  Works as FT_stat does, but for the node with ID ulId, which must be
+  0 or an ID that FT_getId has given. Returns SUCCESS, or otherwise
+  leaves *pbIsFile and *pulSize unchanged and returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * NO_SUCH_PATH if no node in the FT has ID ulId
+*/
+int FT_statById(size_t ulId, boolean *pbIsFile, size_t *pulSize);
+
+/*
+  An FTDir_T is a handle on one directory of an FT, through which the
+  entries directly in that directory are reached by name alone: the
+  directory is found once, when the handle is opened, and each call
+  after that searches only its list of children, so no path is parsed
+  and no walk from the root is made. A handle refers to its directory
+  by path. Once that directory is removed (or its FT is cleared,
+  loaded, or replaced by a journal's replay), calls through the handle
+  return NO_SUCH_PATH, and should a directory be made at the path
+  again, they reach the new one; a handle is never left pointing at a
+  freed node. A handle may be used from only one thread at a time,
+  though any number of handles may be open on the same FT, and it
+  must be closed before its FT is freed.
+*/
+typedef struct ftDir *FTDir_T;
+
+/*
+  Opens a handle on the directory of the FT with absolute path pcPath.
+  Returns SUCCESS and sets *poDDir to the handle if successful.
+  Otherwise, sets *poDDir to NULL and returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if pcPath does not represent a well-formatted path
+  * CONFLICTING_PATH if the root exists but is not a prefix of pcPath
+  * NO_SUCH_PATH if absolute path pcPath does not exist in the FT
+  * NOT_A_DIRECTORY if pcPath is in the FT as a file not a directory
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_openDir(const char *pcPath, FTDir_T *poDDir);
+
+/* Closes handle oDDir. Does nothing if oDDir is NULL. */
+void FT_closeDir(FTDir_T oDDir);
+
+/*
+  Looks up the entry named pcName, a single path component, in the
+  directory of handle oDDir. Returns SUCCESS if it exists, and sets
+  *pbIsFile to whether it is a file and *ppvContents and *pulLength
+  to its contents and their length (NULL and 0 for a directory), all
+  as of one moment. Otherwise, leaves them unchanged and returns:
+  * BAD_PATH if pcName is empty or contains a '/'
+  * CONFLICTING_PATH if the root is no longer a prefix of the path of
+                     oDDir's directory
+  * NO_SUCH_PATH if there is no such entry, or no directory is at the
+                 path of oDDir's directory any more
+  * NOT_A_DIRECTORY if a file is now at the path of oDDir's directory
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_lookupAt(FTDir_T oDDir, const char *pcName, boolean *pbIsFile,
+                void **ppvContents, size_t *pulLength);
+
+/*
+  Inserts a new file with contents pvContents of length ulLength,
+  named pcName, a single path component, into the directory of handle
+  oDDir, as FT_insertFile would with the directory's path and pcName
+  joined. Returns SUCCESS if the new file is inserted successfully.
+  Otherwise, returns:
+  * BAD_PATH if pcName is empty or contains a '/'
+  * CONFLICTING_PATH if the root is no longer a prefix of the path of
+                     oDDir's directory
+  * NO_SUCH_PATH if no directory is at the path of oDDir's directory
+                 any more
+  * NOT_A_DIRECTORY if a file is now at the path of oDDir's directory
+  * ALREADY_IN_TREE if the directory already has an entry pcName
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_insertFileAt(FTDir_T oDDir, const char *pcName,
+                    void *pvContents, size_t ulLength);
+
+/*
+  Looks up the entry named pcName in the directory of handle oDDir as
+  FT_lookupAt does, returning the same status, and sets *pbIsFile and
+  *pulSize as FT_stat would for it.
+*/
+int FT_statAt(FTDir_T oDDir, const char *pcName, boolean *pbIsFile,
+              size_t *pulSize);
+
 /*
   Sets the FT data structure to an initialized state.
   The data structure is initially empty.
@@ -128,13 +290,257 @@ int FT_stat(const char *pcPath, boolean *pbIsFile, size_t *pulSize);
 int FT_init(void);
 
 /*
-  Removes all contents of the data structure and
+  Removes all contents of the data structure, closes its journal if
+  one is open (see FT_openJournal), and
   returns it to an uninitialized state.
   Returns INITIALIZATION_ERROR if not already initialized,
   and SUCCESS otherwise.
 */
 int FT_destroy(void);
 
+/*
+  Turns the FT's full-path index on if bEnable is TRUE, or off if it is
+  FALSE. While the index is on, looking up a path that is in the FT
+  (FT_containsDir, FT_containsFile, FT_getFileContents,
+  FT_replaceFileContents, FT_stat, and the search in FT_rmDir and
+  FT_rmFile) takes a single hash probe instead of a walk from the root,
+  at the cost of some memory per node and extra work on every insert
+  and removal. Turning the index on builds it from the current tree.
+  The index is dropped by FT_destroy.
+  Returns SUCCESS if the index is in the requested state.
+  Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_setPathIndex(boolean bEnable);
+
+/*
+  Turns concurrent mode on for the FT if bEnable is TRUE, or off if it
+  is FALSE. In concurrent mode the FT may be used from many threads at
+  once. Lookups (FT_containsDir, FT_containsFile, FT_getFileContents,
+  FT_stat) take no lock at all while the path index is off, so they
+  run in parallel with each other and with changes; nodes that a
+  change removes are freed only once every lookup that might still
+  be looking at them has finished. Changes (FT_insertDir,
+  FT_insertFile, FT_rmDir, FT_rmFile, FT_replaceFileContents) in
+  different directories run in parallel too: each locks only
+  the directories it walks through, and only the one it changes for
+  writing. Creating or removing the root, the string functions, and
+  FT_setPathIndex lock the whole FT, as does every change while the
+  path index is on. Outside concurrent mode no locking is done at all.
+  Must not be called while any other thread may be using the FT;
+  FT_init, FT_destroy, and FT_setConcurrent itself are never safe to
+  call concurrently. FT_init starts with concurrent mode off.
+  Returns SUCCESS if the FT is in the requested mode.
+  Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_setConcurrent(boolean bEnable);
+
+/*
+  Turns background reclamation on for the FT if bEnable is TRUE, or
+  off if it is FALSE. While it is on, FT_rmDir and FT_rmFile unlink
+  the node removed and hand its subtree to a thread of the FT's own,
+  which gives back the subtree's IDs and frees it in bounded batches,
+  so that neither call spends time on each node removed, except to
+  take it out of the path index while that is on, or to wait out
+  changes under way inside the subtree in concurrent mode. FT_destroy
+  hands over the whole tree the same way. Memory comes back a little
+  later, and removing the root still gives back its IDs before
+  returning. Turning it off first waits for everything already handed
+  over to be freed. Must not be called while any other thread may be
+  using the FT. FT_init starts with background reclamation off.
+  Returns SUCCESS if the FT is in the requested mode.
+  Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated or the thread could
+                 not be started
+*/
+int FT_setReclaimer(boolean bEnable);
+
+/*
+  Waits until everything removed from the FT so far has been freed,
+  for a caller that needs the memory back now; returns at once if
+  background reclamation is off. Returns INITIALIZATION_ERROR if the
+  FT is not in an initialized state, and SUCCESS otherwise.
+*/
+int FT_reclaim(void);
+
+/*
+  Returns a snapshot of the FT: a new FT_T that reads exactly as the FT
+  does now, for as long as it lives, whatever changes the FT goes
+  through afterwards. Takes constant time, however big the FT is: the
+  snapshot shares every node with the FT, and a later change copies
+  only the directories on the path from the root to the one it
+  changes, leaving all other subtrees shared. The snapshot may be read
+  with any of the FT_T functions that do not change a tree
+  (FT_containsDirIn, FT_containsFileIn, FT_getFileContentsIn,
+  FT_statIn, and the string functions), from any number of threads at
+  once and while the FT itself is being changed, but must never be
+  changed itself, nor have its index or concurrent mode turned on.
+  File contents are shared, not copied. Free the snapshot with FT_free
+  when done; it may outlive the FT. In concurrent mode, taking a
+  snapshot locks the whole FT for a moment, and while one is alive,
+  a change to a shared path locks the whole FT instead of latching
+  just its directories. Returns NULL if the FT is not in an
+  initialized state or memory could not be allocated.
+*/
+FT_T FT_snapshot(void);
+
+/*
+  Saves the FT to the file pcFile, replacing anything there before, as
+  a compact binary image: every node once, in preorder, with each
+  distinct name stored once and the contents of every file (its size
+  bytes, copied from where its contents point). The image is of one
+  moment of the FT, even while other threads change it, and holds
+  the FT's lock only as long as FT_snapshot does. The image is written
+  beside pcFile and synced before it is renamed over pcFile, so a
+  crash leaves pcFile holding either the old image or the new one,
+  and pcFile's directory is synced after the rename, so once this
+  returns SUCCESS it is the new one.
+  Returns SUCCESS if the image was saved.
+  Otherwise returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * EOF if writing to pcFile failed, leaving it as it was, or if
+        syncing its directory failed
+*/
+int FT_save(const char *pcFile);
+
+/*
+  Replaces everything in the FT with the tree saved in the file pcFile
+  by FT_save, mapping the file into memory and building the tree in
+  one pass over it, without parsing any path. Each loaded file's
+  contents point into a private copy-on-write mapping of pcFile that
+  lives as long as any node loaded with it: they may be read and
+  changed in place, but must not be freed. The path index and
+  concurrent mode stay as they were. Concurrent lookups see either
+  the whole old tree or the whole new one. Must not be called while
+  the FT has a journal open (see FT_openJournal).
+  Returns SUCCESS if the tree was loaded.
+  Otherwise, leaves the FT unchanged and returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * NO_SUCH_PATH if pcFile does not exist
+  * EOF if pcFile could not be read, or is not an image saved by
+        FT_save on the same kind of machine
+*/
+int FT_load(const char *pcFile);
+
+/*
+  Replaces everything in the FT with a tree built from a stream of
+  paths, calling (*pfNext)(&pcPath, &bIsFile, &pvContents, &ulLength,
+  pvExtra) for each until it returns FALSE. Each call that returns
+  TRUE sets pcPath to an absolute path, which need only stay valid
+  until the next call, and bIsFile to TRUE and pvContents and
+  ulLength to its contents and their size if it is a file, or
+  bIsFile to FALSE if it is a directory. Any directory on the way to
+  a path that the stream did not give, the root included, is made
+  along with it.
+  The paths must come in the order the FT keeps them: each after all
+  paths before it component by component, comparing components as
+  strcmp does, so that every directory comes before everything in it
+  and its children come in increasing order of name. Since each path
+  then continues the last one, the tree is built in a single pass,
+  each node appended where it belongs without searching, and each
+  directory's children are stored at exactly the size they need. The
+  path index and concurrent mode stay as they were; concurrent
+  lookups see either the whole old tree or the whole new one. Must not
+  be called while the FT has a journal open (see FT_openJournal).
+  Returns SUCCESS if the whole stream was loaded.
+  Otherwise, leaves the FT unchanged and returns, for the first path
+  that could not be loaded:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * BAD_PATH if the path does not represent a well-formatted path
+  * CONFLICTING_PATH if the path is not under the first path's root,
+                     would make a file the root, or is out of order
+  * NOT_A_DIRECTORY if a proper prefix of the path was given as a file
+  * ALREADY_IN_TREE if the path was given before (as dir or file)
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int FT_bulkLoad(boolean (*pfNext)(const char **ppcPath,
+                                  boolean *pbIsFile,
+                                  void **ppvContents, size_t *pulLength,
+                                  void *pvExtra),
+                void *pvExtra);
+
+/*
+  Makes the FT durable: restores it from the image pcImage and the
+  journal pcJournal, then records every later successful
+  FT_insertDir, FT_insertFile, FT_rmDir, FT_rmFile, and
+  FT_replaceFileContents in pcJournal, so that the next
+  FT_openJournal after a crash brings the FT back. Call it right
+  after FT_init. Replaces everything in the FT with the image, as
+  FT_load does (or with nothing, if pcImage does not exist), and then
+  replays on top of it each change in the journal made after the
+  image was saved. Replayed files' contents point into memory that
+  lives as long as the nodes do, and so must not be freed either.
+
+  Changes are appended to the journal in memory and written ulBatch
+  (at least 1) at a time, each batch followed by one fdatasync: the
+  change that completes a batch writes it, while changes on other
+  threads go on into the next one. With ulBatch 1 every change is on
+  the disk before it returns; with more, a crash loses at most the
+  changes since the last batch, in exchange for far fewer syncs.
+  FT_sync forces out the partial batch. The contents of an inserted
+  or replaced file are copied into the journal when the change is
+  made, so later changes made in place through the pointer are not
+  recorded. FT_checkpoint bounds the journal's growth.
+
+  Must not be called while any other thread may be using the FT, nor
+  while a journal is open. The journal stays open until
+  FT_closeJournal or FT_destroy.
+  Returns SUCCESS if the FT was restored and the journal opened.
+  Otherwise, returns status:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * EOF if pcImage or pcJournal could not be read or written, is not
+        an image or journal written on the same kind of machine, or
+        does not belong with the other
+  and leaves the FT unchanged if pcImage could not be loaded, or empty
+  if it could.
+*/
+int FT_openJournal(const char *pcImage, const char *pcJournal,
+                   size_t ulBatch);
+
+/*
+  Writes out every change recorded in the FT's journal so far, however
+  few, and returns once they are all on the disk. May be called while
+  other threads change the FT. Returns SUCCESS if every change since
+  FT_openJournal is on the disk, or if no journal is open.
+  Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory ran out while recording a change, after
+                 which the journal records nothing more
+  * EOF if writing the journal failed, after which it records nothing
+        more
+*/
+int FT_sync(void);
+
+/*
+  Saves the FT to the image given to FT_openJournal, as FT_save does,
+  and empties the journal of every change the image holds, so that
+  the journal, and the time FT_openJournal takes to replay it, stay
+  bounded. May be called while other threads change the FT: it holds
+  the FT's lock only while it syncs the journal, starts a new one, and
+  takes a snapshot, and changes made meanwhile go to the new journal.
+  A crash at any point leaves an image and journals that
+  FT_openJournal restores in full. Does nothing if no journal is open.
+  Returns SUCCESS if the image was saved and the journal emptied.
+  Otherwise, leaves the journal as it was, to be emptied by a later
+  FT_checkpoint, and returns the status FT_sync or FT_save would.
+*/
+int FT_checkpoint(void);
+
+/*
+  Syncs and closes the FT's journal, after which changes are no longer
+  recorded. Must not be called while any other thread may be using
+  the FT. Returns SUCCESS if every recorded change is on the disk, or
+  if no journal was open, and otherwise the status FT_sync would.
+*/
+int FT_closeJournal(void);
+
 /*
   Returns a string representation of the
   data structure, or NULL if the structure is
@@ -149,4 +555,104 @@ int FT_destroy(void);
 */
 char *FT_toString(void);
 
+/*
+  Streams the string representation of the data structure (exactly
+  what FT_toString would return, without the trailing '\0') to the
+  function *pfSink, in chunks of at most a few kilobytes except for
+  single paths longer than that. Each call passes a chunk pcChunk of
+  ulLength bytes, not '\0'-terminated, and pvExtra as given here.
+  *pfSink must return SUCCESS to continue; any other value stops the
+  stream. In concurrent mode, *pfSink runs while the whole FT is
+  locked, so it must not use the FT. Runs in time linear in the
+  size of the representation.
+  Returns SUCCESS if the whole representation was passed to *pfSink.
+  Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * the value *pfSink returned, if it returned other than SUCCESS
+*/
+int FT_toStringCallback(int (*pfSink)(const char *pcChunk,
+                                      size_t ulLength, void *pvExtra),
+                        void *pvExtra);
+
+/*
+  Writes the string representation of the data structure (as
+  FT_toString would return it) to psFile, streaming it as described
+  for FT_toStringCallback. Returns SUCCESS if successful.
+  Otherwise, returns:
+  * INITIALIZATION_ERROR if the FT is not in an initialized state
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * EOF if writing to psFile failed
+*/
+int FT_writeTo(FILE *psFile);
+
+/*
+  Returns a new, empty FT, or NULL if insufficient memory is
+  available. The FT is ready to use at once; it needs no FT_init, and
+  starts with concurrent mode off.
+*/
+FT_T FT_new(void);
+
+/*
+  Frees oFTree and every node in it that no other tree shares (see
+  FT_snapshot), closing its journal if one is open (see
+  FT_openJournal). With background reclamation on (see
+  FT_setReclaimer), the nodes are freed after it returns; turn it off
+  first to have them freed before. Does nothing if oFTree is NULL.
+*/
+void FT_free(FT_T oFTree);
+
+/*
+  Each of the following works exactly as the function of the same name
+  without "In", but on oFTree instead of the default tree. Since an
+  FT_T is always initialized, none returns INITIALIZATION_ERROR.
+*/
+int FT_insertDirIn(FT_T oFTree, const char *pcPath);
+boolean FT_containsDirIn(FT_T oFTree, const char *pcPath);
+int FT_rmDirIn(FT_T oFTree, const char *pcPath);
+int FT_insertFileIn(FT_T oFTree, const char *pcPath, void *pvContents,
+                    size_t ulLength);
+int FT_insertFilesIn(FT_T oFTree, const char **apcPaths,
+                     void **apvContents, const size_t *aulLengths,
+                     size_t ulCount, int *aiStatuses);
+boolean FT_containsFileIn(FT_T oFTree, const char *pcPath);
+int FT_rmFileIn(FT_T oFTree, const char *pcPath);
+void *FT_getFileContentsIn(FT_T oFTree, const char *pcPath);
+void *FT_replaceFileContentsIn(FT_T oFTree, const char *pcPath,
+                               void *pvNewContents, size_t ulNewLength);
+int FT_statIn(FT_T oFTree, const char *pcPath, boolean *pbIsFile,
+              size_t *pulSize);
+int FT_statManyIn(FT_T oFTree, const char **apcPaths, size_t ulCount,
+                  int *aiStatuses, boolean *abIsFile, size_t *aulSizes);
+size_t FT_containsManyIn(FT_T oFTree, const char **apcPaths,
+                         size_t ulCount, boolean *abContains);
+int FT_getIdIn(FT_T oFTree, const char *pcPath, size_t *pulId);
+int FT_statByIdIn(FT_T oFTree, size_t ulId, boolean *pbIsFile,
+                  size_t *pulSize);
+int FT_openDirIn(FT_T oFTree, const char *pcPath, FTDir_T *poDDir);
+int FT_setPathIndexIn(FT_T oFTree, boolean bEnable);
+int FT_setConcurrentIn(FT_T oFTree, boolean bEnable);
+int FT_setReclaimerIn(FT_T oFTree, boolean bEnable);
+int FT_reclaimIn(FT_T oFTree);
+FT_T FT_snapshotIn(FT_T oFTree);
+int FT_saveIn(FT_T oFTree, const char *pcFile);
+int FT_loadIn(FT_T oFTree, const char *pcFile);
+int FT_bulkLoadIn(FT_T oFTree,
+                  boolean (*pfNext)(const char **ppcPath,
+                                    boolean *pbIsFile,
+                                    void **ppvContents,
+                                    size_t *pulLength, void *pvExtra),
+                  void *pvExtra);
+int FT_openJournalIn(FT_T oFTree, const char *pcImage,
+                     const char *pcJournal, size_t ulBatch);
+int FT_syncIn(FT_T oFTree);
+int FT_checkpointIn(FT_T oFTree);
+int FT_closeJournalIn(FT_T oFTree);
+char *FT_toStringIn(FT_T oFTree);
+int FT_toStringCallbackIn(FT_T oFTree,
+                          int (*pfSink)(const char *pcChunk,
+                                        size_t ulLength, void *pvExtra),
+                          void *pvExtra);
+int FT_writeToIn(FT_T oFTree, FILE *psFile);
+
 #endif
@@ -0,0 +1,868 @@
+/*--------------------------------------------------------------------*/
+/* ft_bench.c                                                         */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+/* clock_gettime and pthreads are POSIX, not ISO C */
+#define _XOPEN_SOURCE 600
+
+#include <assert.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dynarray.h"
+#include "ft.h"
+#include "nodeFT.h"
+#include "path.h"
+
+/* The number of lookups timed for each depth */
+#define BENCH_DEPTH_LOOKUPS 1000000
+
+/* The deepest directory chain the depth benchmark builds */
+#define BENCH_DEPTH_MAX 64
+
+/* The number of siblings beside each directory of the chain */
+#define BENCH_DEPTH_SIBLINGS 16
+
+/* The number of project directories in the monorepo-shaped tree */
+#define BENCH_BYTES_PROJECTS 1000
+
+/* The deepest directory below a project in the monorepo-shaped tree */
+#define BENCH_BYTES_DEPTH 5
+
+/* The longest path the monorepo-shaped tree has */
+#define BENCH_BYTES_PATH 128
+
+/* The most threads the scaling benchmark runs at once */
+#define BENCH_THREADS_MAX 64
+
+/* The number of lookups each thread of the scaling benchmark makes */
+#define BENCH_THREADS_LOOKUPS 400000
+
+/* The number of files each thread of the scaling benchmark inserts */
+#define BENCH_THREADS_INSERTS 100000
+
+/* The number of files the scaling benchmark's readers look up */
+#define BENCH_THREADS_FILES 4096
+
+/* The number of files the journal benchmark inserts in all */
+#define BENCH_JOURNAL_INSERTS 20000
+
+/* The files the journal benchmark keeps its image and journal in */
+#define BENCH_JOURNAL_IMAGE "ft_bench.img"
+#define BENCH_JOURNAL_FILE "ft_bench.jnl"
+
+/* The number of directories the bulk load benchmark loads */
+#define BENCH_BULK_DIRS 1000
+
+/* The number of files the bulk load benchmark puts in each directory */
+#define BENCH_BULK_FILES 1000
+
+/* The number of children the fanout benchmark spreads over its
+   directories, whatever their fanout */
+#define BENCH_FANOUT_CHILDREN 400000
+
+/* The number of lookups timed for each fanout */
+#define BENCH_FANOUT_LOOKUPS 4000000
+
+/* The number of names in apcBenchDirs */
+#define BENCH_DIR_NAMES 12
+
+/* The number of names in apcBenchFiles */
+#define BENCH_FILE_NAMES 16
+
+/* The names of directories in the monorepo-shaped tree */
+static const char *apcBenchDirs[BENCH_DIR_NAMES] = {
+   "src", "lib", "test", "internal", "api", "util", "core", "impl",
+   "proto", "config", "scripts", "common"
+};
+
+/* The names of files in the monorepo-shaped tree */
+static const char *apcBenchFiles[BENCH_FILE_NAMES] = {
+   "BUILD", "README.md", "Makefile", "index.ts", "main.go", "util.c",
+   "util.h", "types.h", "__init__.py", "config.yaml", "test_main.py",
+   "package.json", "CMakeLists.txt", "LICENSE", "handler.go",
+   "Service.java"
+};
+
+/* One thread of the scaling and journal benchmarks */
+struct benchThread {
+   /* the thread's number, from 0, which picks the paths it uses */
+   size_t ulThread;
+   /* the number of calls the thread makes */
+   size_t ulCalls;
+   /* the status of the first call that failed, or SUCCESS */
+   int iStatus;
+   /* the thread itself */
+   pthread_t sThread;
+};
+
+/* The bulk load benchmark's stream of paths: where it is */
+struct benchStream {
+   /* the path last given */
+   char acPath[32];
+   /* the index of the next path to give, in the order the FT keeps */
+   size_t ulNext;
+};
+
+/* The state of the benchmarks' pseudo-random number generator */
+static unsigned long ulBenchSeed = 1;
+
+/* Returns the time in seconds on a clock that only goes forward. */
+static double Bench_now(void) {
+   struct timespec sTime;
+
+   (void) clock_gettime(CLOCK_MONOTONIC, &sTime);
+   return (double) sTime.tv_sec + (double) sTime.tv_nsec * 1e-9;
+}
+
+/*
+  Returns the next number from 0 to 32767 of a fixed pseudo-random
+  sequence, the same on every machine.
+*/
+static size_t Bench_random(void) {
+   ulBenchSeed = (ulBenchSeed * 1103515245UL + 12345UL) & 0xffffffffUL;
+   return (size_t) ((ulBenchSeed >> 16) & 0x7fff);
+}
+
+/*
+  Returns the number of bytes the program has allocated with malloc and
+  not yet freed.
+*/
+static size_t Bench_allocated(void) {
+   struct mallinfo2 sInfo;
+
+   sInfo = mallinfo2();
+   return sInfo.uordblks + sInfo.hblkhd;
+}
+
+/*
+  Builds in the FT a chain of ulDepth directories under the root "r",
+  each with BENCH_DEPTH_SIBLINGS sibling directories beside it, and a
+  file "leaf" at the bottom, writing the file's path into pcPath.
+  Returns SUCCESS, or the status of the insert that failed.
+*/
+static int Bench_buildChain(size_t ulDepth, char *pcPath) {
+   char acSibling[BENCH_DEPTH_MAX * 8 + 32];
+   size_t ulLevel;
+   size_t i;
+   int iStatus;
+
+   assert(pcPath != NULL);
+
+   strcpy(pcPath, "r");
+   iStatus = FT_insertDir(pcPath);
+   for(ulLevel = 1; ulLevel < ulDepth && iStatus == SUCCESS;
+       ulLevel++) {
+      for(i = 0; i < BENCH_DEPTH_SIBLINGS && iStatus == SUCCESS; i++) {
+         sprintf(acSibling, "%s/s%02lu", pcPath, (unsigned long) i);
+         iStatus = FT_insertDir(acSibling);
+      }
+      sprintf(pcPath + strlen(pcPath), "/l%02lu",
+              (unsigned long) ulLevel);
+      if(iStatus == SUCCESS)
+         iStatus = FT_insertDir(pcPath);
+   }
+   strcat(pcPath, "/leaf");
+   if(iStatus == SUCCESS)
+      iStatus = FT_insertFile(pcPath, NULL, 0);
+   return iStatus;
+}
+
+/*
+  Times FT_stat on a file at the bottom of directory chains of
+  doubling depth, walking from the root and then through the path
+  index, and prints the time per lookup and per level of the walk.
+  Returns 0, or 1 if the tree could not be built.
+*/
+static int Bench_depth(void) {
+   char acPath[BENCH_DEPTH_MAX * 8 + 32];
+   size_t ulDepth;
+   size_t ulSize;
+   size_t i;
+   boolean bIsFile;
+   double dStart;
+   double dWalk;
+   double dIndex;
+
+   printf("%6s %10s %10s %10s\n", "depth", "walk ns", "ns/level",
+          "index ns");
+   for(ulDepth = 1; ulDepth <= BENCH_DEPTH_MAX; ulDepth *= 2) {
+      if(FT_init() != SUCCESS)
+         return 1;
+      if(Bench_buildChain(ulDepth, acPath) != SUCCESS) {
+         (void) FT_destroy();
+         return 1;
+      }
+
+      dStart = Bench_now();
+      for(i = 0; i < BENCH_DEPTH_LOOKUPS; i++)
+         if(FT_stat(acPath, &bIsFile, &ulSize) != SUCCESS)
+            return 1;
+      dWalk = (Bench_now() - dStart) * 1e9 / BENCH_DEPTH_LOOKUPS;
+
+      if(FT_setPathIndex(TRUE) != SUCCESS)
+         return 1;
+      dStart = Bench_now();
+      for(i = 0; i < BENCH_DEPTH_LOOKUPS; i++)
+         if(FT_stat(acPath, &bIsFile, &ulSize) != SUCCESS)
+            return 1;
+      dIndex = (Bench_now() - dStart) * 1e9 / BENCH_DEPTH_LOOKUPS;
+
+      printf("%6lu %10.1f %10.1f %10.1f\n", (unsigned long) ulDepth,
+             dWalk, dWalk / (double) (ulDepth + 1), dIndex);
+      (void) FT_destroy();
+   }
+   return 0;
+}
+
+/*
+  Fills the FT's directory with the path in pcPath, ulDepth levels
+  below a project directory, with a few files and then a few
+  subdirectories, each filled the same way down to BENCH_BYTES_DEPTH,
+  all named from the pools of common names so that, as in a real
+  repository, the same names come up again and again. Adds the number
+  of nodes inserted to *pulNodes and the lengths of their paths to
+  *pulPathBytes. Returns SUCCESS, or the status of the insert that
+  failed.
+*/
+static int Bench_fillDir(char *pcPath, size_t ulDepth,
+                         size_t *pulNodes, size_t *pulPathBytes) {
+   size_t ulLength;
+   size_t ulFirst;
+   size_t ulCount;
+   size_t i;
+   int iStatus = SUCCESS;
+
+   assert(pcPath != NULL);
+   assert(pulNodes != NULL);
+   assert(pulPathBytes != NULL);
+
+   ulLength = strlen(pcPath);
+
+   ulFirst = Bench_random();
+   ulCount = 2 + Bench_random() % 10;
+   for(i = 0; i < ulCount && iStatus == SUCCESS; i++) {
+      sprintf(pcPath + ulLength, "/%s",
+              apcBenchFiles[(ulFirst + i) % BENCH_FILE_NAMES]);
+      iStatus = FT_insertFile(pcPath, NULL, 0);
+      (*pulNodes)++;
+      *pulPathBytes += strlen(pcPath);
+   }
+
+   if(ulDepth < BENCH_BYTES_DEPTH) {
+      ulFirst = Bench_random();
+      ulCount = Bench_random() % 5;
+      for(i = 0; i < ulCount && iStatus == SUCCESS; i++) {
+         sprintf(pcPath + ulLength, "/%s",
+                 apcBenchDirs[(ulFirst + i) % BENCH_DIR_NAMES]);
+         iStatus = FT_insertDir(pcPath);
+         (*pulNodes)++;
+         *pulPathBytes += strlen(pcPath);
+         if(iStatus == SUCCESS)
+            iStatus = Bench_fillDir(pcPath, ulDepth + 1, pulNodes,
+                                    pulPathBytes);
+      }
+   }
+
+   pcPath[ulLength] = '\0';
+   return iStatus;
+}
+
+/*
+  Builds a monorepo-shaped tree of BENCH_BYTES_PROJECTS projects and
+  prints how many bytes of the heap it takes per node, with the path
+  index off and then on, beside the average length of a node's full
+  path. Returns 0, or 1 if the tree could not be built.
+*/
+static int Bench_bytes(void) {
+   char acPath[BENCH_BYTES_PATH];
+   size_t ulBefore;
+   size_t ulTree;
+   size_t ulIndex;
+   size_t ulNodes = 1;
+   size_t ulPathBytes = 1;
+   size_t i;
+   int iStatus;
+
+   ulBefore = Bench_allocated();
+   if(FT_init() != SUCCESS)
+      return 1;
+   iStatus = FT_insertDir("r");
+   for(i = 0; i < BENCH_BYTES_PROJECTS && iStatus == SUCCESS; i++) {
+      sprintf(acPath, "r/project%04lu", (unsigned long) i);
+      iStatus = FT_insertDir(acPath);
+      ulNodes++;
+      ulPathBytes += strlen(acPath);
+      if(iStatus == SUCCESS)
+         iStatus = Bench_fillDir(acPath, 0, &ulNodes, &ulPathBytes);
+   }
+   if(iStatus != SUCCESS) {
+      (void) FT_destroy();
+      return 1;
+   }
+   ulTree = Bench_allocated() - ulBefore;
+
+   if(FT_setPathIndex(TRUE) != SUCCESS) {
+      (void) FT_destroy();
+      return 1;
+   }
+   ulIndex = Bench_allocated() - ulBefore;
+
+   printf("%lu nodes, %.1f path bytes per node\n",
+          (unsigned long) ulNodes,
+          (double) ulPathBytes / (double) ulNodes);
+   printf("%-12s %10.1f bytes/node\n", "tree",
+          (double) ulTree / (double) ulNodes);
+   printf("%-12s %10.1f bytes/node\n", "tree+index",
+          (double) ulIndex / (double) ulNodes);
+   (void) FT_destroy();
+   return 0;
+}
+
+/*
+  Looks up BENCH_THREADS_LOOKUPS of the files that Bench_fillFlat made,
+  starting at a point of its own for the struct benchThread pvThread,
+  and records the first status that was not SUCCESS. Returns NULL.
+*/
+static void *Bench_reader(void *pvThread) {
+   struct benchThread *psThread = pvThread;
+   char acPath[32];
+   boolean bIsFile;
+   size_t ulSize;
+   size_t ulFile;
+   size_t i;
+   int iStatus;
+
+   assert(psThread != NULL);
+
+   for(i = 0; i < psThread->ulCalls; i++) {
+      ulFile = (i * 7919 + psThread->ulThread * 131)
+               % BENCH_THREADS_FILES;
+      sprintf(acPath, "r/d%02lu/f%04lu", (unsigned long) (ulFile % 64),
+              (unsigned long) ulFile);
+      iStatus = FT_stat(acPath, &bIsFile, &ulSize);
+      if(iStatus != SUCCESS && psThread->iStatus == SUCCESS)
+         psThread->iStatus = iStatus;
+   }
+   return NULL;
+}
+
+/*
+  Inserts files into a directory of its own for the struct
+  benchThread pvThread, and records the first status that was not
+  SUCCESS. Returns NULL.
+*/
+static void *Bench_writer(void *pvThread) {
+   struct benchThread *psThread = pvThread;
+   char acPath[32];
+   size_t i;
+   int iStatus;
+
+   assert(psThread != NULL);
+
+   for(i = 0; i < psThread->ulCalls; i++) {
+      sprintf(acPath, "r/w%02lu/f%06lu",
+              (unsigned long) psThread->ulThread, (unsigned long) i);
+      iStatus = FT_insertFile(acPath, NULL, 0);
+      if(iStatus != SUCCESS && psThread->iStatus == SUCCESS)
+         psThread->iStatus = iStatus;
+   }
+   return NULL;
+}
+
+/*
+  Fills the FT with an empty directory for each of ulThreads writers
+  and, if bReaders is TRUE, BENCH_THREADS_FILES files spread over 64
+  directories for Bench_reader. Returns SUCCESS, or the status of the
+  insert that failed.
+*/
+static int Bench_fillFlat(size_t ulThreads, boolean bReaders) {
+   char acPath[32];
+   size_t i;
+   int iStatus;
+
+   iStatus = FT_insertDir("r");
+   for(i = 0; i < 64 && bReaders && iStatus == SUCCESS; i++) {
+      sprintf(acPath, "r/d%02lu", (unsigned long) i);
+      iStatus = FT_insertDir(acPath);
+   }
+   for(i = 0; i < BENCH_THREADS_FILES && bReaders && iStatus == SUCCESS;
+       i++) {
+      sprintf(acPath, "r/d%02lu/f%04lu", (unsigned long) (i % 64),
+              (unsigned long) i);
+      iStatus = FT_insertFile(acPath, NULL, 0);
+   }
+   for(i = 0; i < ulThreads && iStatus == SUCCESS; i++) {
+      sprintf(acPath, "r/w%02lu", (unsigned long) i);
+      iStatus = FT_insertDir(acPath);
+   }
+   return iStatus;
+}
+
+/*
+  Runs ulThreads threads of *pfThread at once on the FT, each making
+  ulCalls calls, and returns the calls per second they made together,
+  or a negative number if any call failed.
+*/
+static double Bench_runThreads(void *(*pfThread)(void *),
+                               size_t ulCalls, size_t ulThreads) {
+   struct benchThread asThreads[BENCH_THREADS_MAX];
+   double dStart;
+   double dTime;
+   size_t ulStarted;
+   size_t i;
+   int iStatus = SUCCESS;
+
+   assert(pfThread != NULL);
+   assert(ulThreads <= BENCH_THREADS_MAX);
+
+   dStart = Bench_now();
+   for(ulStarted = 0; ulStarted < ulThreads; ulStarted++) {
+      asThreads[ulStarted].ulThread = ulStarted;
+      asThreads[ulStarted].ulCalls = ulCalls;
+      asThreads[ulStarted].iStatus = SUCCESS;
+      if(pthread_create(&asThreads[ulStarted].sThread, NULL, pfThread,
+                        &asThreads[ulStarted]) != 0)
+         break;
+   }
+   for(i = 0; i < ulStarted; i++) {
+      (void) pthread_join(asThreads[i].sThread, NULL);
+      if(asThreads[i].iStatus != SUCCESS)
+         iStatus = asThreads[i].iStatus;
+   }
+   dTime = Bench_now() - dStart;
+
+   if(ulStarted < ulThreads || iStatus != SUCCESS)
+      return -1.0;
+   return (double) (ulCalls * ulThreads) / dTime;
+}
+
+/*
+  Runs ulThreads threads of *pfThread on a new FT filled by
+  Bench_fillFlat, in concurrent mode with the path index on if bIndex
+  is TRUE, and returns the millions of calls per second they made
+  together, each making ulCalls, or a negative number if any call
+  failed.
+*/
+static double Bench_scale(void *(*pfThread)(void *), size_t ulCalls,
+                          boolean bIndex, size_t ulThreads) {
+   double dRate = -1.0;
+
+   if(FT_init() != SUCCESS)
+      return -1.0;
+   if(Bench_fillFlat(ulThreads, TRUE) == SUCCESS &&
+      FT_setPathIndex(bIndex) == SUCCESS &&
+      FT_setConcurrent(TRUE) == SUCCESS)
+      dRate = Bench_runThreads(pfThread, ulCalls, ulThreads) * 1e-6;
+   (void) FT_destroy();
+   return dRate;
+}
+
+/*
+  Runs readers and then writers in disjoint directories on the FT in
+  concurrent mode, with 1, 2, 4, and so on up to ulMax threads, each
+  with the path index off and then on, and prints the millions of
+  calls per second that all of the threads made together. Returns 0,
+  or 1 if a call failed.
+*/
+static int Bench_threads(size_t ulMax) {
+   double adRates[4];
+   size_t ulThreads;
+   size_t i;
+
+   printf("%7s %10s %10s %10s %10s\n", "threads", "read M/s",
+          "+index", "write M/s", "+index");
+   for(ulThreads = 1; ulThreads <= ulMax; ulThreads *= 2) {
+      adRates[0] = Bench_scale(Bench_reader, BENCH_THREADS_LOOKUPS,
+                               FALSE, ulThreads);
+      adRates[1] = Bench_scale(Bench_reader, BENCH_THREADS_LOOKUPS,
+                               TRUE, ulThreads);
+      adRates[2] = Bench_scale(Bench_writer, BENCH_THREADS_INSERTS,
+                               FALSE, ulThreads);
+      adRates[3] = Bench_scale(Bench_writer, BENCH_THREADS_INSERTS,
+                               TRUE, ulThreads);
+      for(i = 0; i < 4; i++)
+         if(adRates[i] < 0.0)
+            return 1;
+      printf("%7lu %10.2f %10.2f %10.2f %10.2f\n",
+             (unsigned long) ulThreads, adRates[0], adRates[1],
+             adRates[2], adRates[3]);
+   }
+   return 0;
+}
+
+/*
+  Inserts BENCH_JOURNAL_INSERTS files in all from 1, 2, 4, and so on
+  up to ulMax threads at once, in concurrent mode, with a journal
+  written ulBatch changes at a time, or with none if ulBatch is 0, and
+  prints the thousands of inserts per second that all of the threads
+  made together. Returns 0, or 1 if a call failed.
+*/
+static int Bench_journal(size_t ulBatch, size_t ulMax) {
+   double dRate;
+   size_t ulThreads;
+   int iStatus;
+
+   printf("%7s %10s\n", "threads", "inserts k/s");
+   for(ulThreads = 1; ulThreads <= ulMax; ulThreads *= 2) {
+      (void) remove(BENCH_JOURNAL_IMAGE);
+      (void) remove(BENCH_JOURNAL_FILE);
+      iStatus = FT_init();
+      if(iStatus == SUCCESS && ulBatch > 0)
+         iStatus = FT_openJournal(BENCH_JOURNAL_IMAGE,
+                                  BENCH_JOURNAL_FILE, ulBatch);
+      if(iStatus == SUCCESS)
+         iStatus = Bench_fillFlat(ulThreads, FALSE);
+      if(iStatus == SUCCESS)
+         iStatus = FT_setConcurrent(TRUE);
+
+      dRate = -1.0;
+      if(iStatus == SUCCESS)
+         dRate = Bench_runThreads(Bench_writer,
+                                  BENCH_JOURNAL_INSERTS / ulThreads,
+                                  ulThreads);
+      if(iStatus == SUCCESS && FT_closeJournal() != SUCCESS)
+         dRate = -1.0;
+      (void) FT_destroy();
+      (void) remove(BENCH_JOURNAL_IMAGE);
+      (void) remove(BENCH_JOURNAL_FILE);
+      if(dRate < 0.0)
+         return 1;
+      printf("%7lu %10.1f\n", (unsigned long) ulThreads, dRate * 1e-3);
+   }
+   return 0;
+}
+
+/*
+  Gives the next path of the struct benchStream pvStream, as
+  FT_bulkLoad asks: the root "r", then BENCH_BULK_DIRS directories
+  under it, each followed by its BENCH_BULK_FILES empty files. Returns
+  FALSE once every path has been given.
+*/
+static boolean Bench_nextPath(const char **ppcPath, boolean *pbIsFile,
+                              void **ppvContents, size_t *pulLength,
+                              void *pvStream) {
+   struct benchStream *psStream = pvStream;
+   size_t ulDir;
+   size_t ulFile;
+
+   assert(psStream != NULL);
+
+   if(psStream->ulNext == BENCH_BULK_DIRS * (BENCH_BULK_FILES + 1) + 1)
+      return FALSE;
+   if(psStream->ulNext == 0) {
+      strcpy(psStream->acPath, "r");
+      *pbIsFile = FALSE;
+   }
+   else {
+      ulDir = (psStream->ulNext - 1) / (BENCH_BULK_FILES + 1);
+      ulFile = (psStream->ulNext - 1) % (BENCH_BULK_FILES + 1);
+      if(ulFile == 0)
+         sprintf(psStream->acPath, "r/d%04lu", (unsigned long) ulDir);
+      else
+         sprintf(psStream->acPath, "r/d%04lu/f%04lu",
+                 (unsigned long) ulDir, (unsigned long) (ulFile - 1));
+      *pbIsFile = (boolean) (ulFile != 0);
+   }
+   *ppcPath = psStream->acPath;
+   *ppvContents = NULL;
+   *pulLength = 0;
+   psStream->ulNext++;
+   return TRUE;
+}
+
+/*
+  Builds a tree of BENCH_BULK_DIRS directories of BENCH_BULK_FILES
+  files each, once by inserting each path in the order the FT keeps
+  them and once by bulk loading the same paths, and prints the time
+  each took in all and per path. Returns 0, or 1 if a call failed.
+*/
+static int Bench_bulk(void) {
+   struct benchStream sStream;
+   const char *pcPath;
+   void *pvContents;
+   size_t ulLength;
+   size_t ulPaths = 0;
+   boolean bIsFile;
+   double dStart;
+   double dInsert;
+   double dLoad;
+   int iStatus;
+
+   iStatus = FT_init();
+   sStream.ulNext = 0;
+   dStart = Bench_now();
+   while(iStatus == SUCCESS &&
+         Bench_nextPath(&pcPath, &bIsFile, &pvContents, &ulLength,
+                        &sStream)) {
+      if(bIsFile)
+         iStatus = FT_insertFile(pcPath, pvContents, ulLength);
+      else
+         iStatus = FT_insertDir(pcPath);
+      ulPaths++;
+   }
+   dInsert = Bench_now() - dStart;
+   (void) FT_destroy();
+   if(iStatus != SUCCESS)
+      return 1;
+
+   iStatus = FT_init();
+   sStream.ulNext = 0;
+   dStart = Bench_now();
+   if(iStatus == SUCCESS)
+      iStatus = FT_bulkLoad(Bench_nextPath, &sStream);
+   dLoad = Bench_now() - dStart;
+   (void) FT_destroy();
+   if(iStatus != SUCCESS)
+      return 1;
+
+   printf("%lu paths\n", (unsigned long) ulPaths);
+   printf("%-12s %8.3f s %8.1f ns/path\n", "inserts", dInsert,
+          dInsert * 1e9 / (double) ulPaths);
+   printf("%-12s %8.3f s %8.1f ns/path\n", "bulk load", dLoad,
+          dLoad * 1e9 / (double) ulPaths);
+   return 0;
+}
+
+/*
+  Returns <0, 0, or >0 as the string pvName1 sorts before, with, or
+  after the string pvName2.
+*/
+static int Bench_compareNames(const void *pvName1,
+                              const void *pvName2) {
+   return strcmp((const char *) pvName1, (const char *) pvName2);
+}
+
+/*
+  Frees the strings in each of the ulDirs arrays of aoNames, up to the
+  first that is NULL, and the arrays themselves.
+*/
+static void Bench_freeNames(DynArray_T *aoNames, size_t ulDirs) {
+   size_t ulDir;
+   size_t i;
+
+   assert(aoNames != NULL);
+
+   for(ulDir = 0; ulDir < ulDirs && aoNames[ulDir] != NULL; ulDir++) {
+      for(i = 0; i < DynArray_getLength(aoNames[ulDir]); i++)
+         free(DynArray_get(aoNames[ulDir], i));
+      DynArray_free(aoNames[ulDir]);
+   }
+}
+
+/*
+  Makes ulDirs directories under oNRoot, into aoNDirs, and gives each
+  ulFanout children, named so that they do not come in sorted order.
+  Keeps a sorted array of its own copies of each directory's names in
+  aoNames. Returns SUCCESS, or the status of the call that failed.
+*/
+static int Bench_fillFanout(Node_T oNRoot, size_t ulFanout,
+                            size_t ulDirs, Node_T *aoNDirs,
+                            DynArray_T *aoNames) {
+   char acName[32];
+   char *pcName;
+   Node_T oNChild;
+   size_t ulDir;
+   size_t i;
+   int iStatus = SUCCESS;
+
+   assert(oNRoot != NULL);
+   assert(aoNDirs != NULL);
+   assert(aoNames != NULL);
+
+   for(ulDir = 0; ulDir < ulDirs && iStatus == SUCCESS; ulDir++) {
+      sprintf(acName, "d%06lu", (unsigned long) ulDir);
+      iStatus = Node_newChild(oNRoot, acName, NODE_DIR, NULL, 0,
+                              &aoNDirs[ulDir]);
+      if(iStatus == SUCCESS) {
+         aoNames[ulDir] = DynArray_new(0);
+         if(aoNames[ulDir] == NULL)
+            iStatus = MEMORY_ERROR;
+      }
+      for(i = 0; i < ulFanout && iStatus == SUCCESS; i++) {
+         sprintf(acName, "e%07lu.dat",
+                 (unsigned long) (i * 7919 % 10000019));
+         iStatus = Node_newChild(aoNDirs[ulDir], acName, NODE_DIR,
+                                 NULL, 0, &oNChild);
+         pcName = malloc(strlen(acName) + 1);
+         if(iStatus == SUCCESS && pcName == NULL)
+            iStatus = MEMORY_ERROR;
+         if(iStatus == SUCCESS &&
+            !DynArray_add(aoNames[ulDir], strcpy(pcName, acName))) {
+            free(pcName);
+            iStatus = MEMORY_ERROR;
+         }
+         else if(iStatus != SUCCESS)
+            free(pcName);
+      }
+      if(iStatus == SUCCESS)
+         DynArray_sort(aoNames[ulDir], Bench_compareNames);
+   }
+   return iStatus;
+}
+
+/*
+  Picks the next random child for the fanout benchmark out of ulDirs
+  directories of ulFanout children each, setting *pulDir to its
+  directory and returning its index in that directory's sorted names.
+*/
+static size_t Bench_pick(size_t ulFanout, size_t ulDirs,
+                         size_t *pulDir) {
+   size_t ulHigh;
+
+   assert(pulDir != NULL);
+
+   ulHigh = Bench_random() << 15;
+   *pulDir = (ulHigh | Bench_random()) % ulDirs;
+   ulHigh = Bench_random() << 15;
+   return (ulHigh | Bench_random()) % ulFanout;
+}
+
+/*
+  Spreads BENCH_FANOUT_CHILDREN children over directories of 8, 64,
+  1000 and 100000 children each, and prints the time per child it
+  took to insert them in random order and then, for random children,
+  the time per search of their directory's own children by
+  Node_hasChildComponent, the time per lookup by Node_findChild,
+  which uses the directory's index once it has one, and the time per
+  DynArray_bsearch over a sorted array of the same names. Returns 0,
+  or 1 if a call failed.
+*/
+static int Bench_fanout(void) {
+   static const size_t aulFanouts[] = {8, 64, 1000, 100000};
+   DynArray_T *aoNames;
+   Node_T *aoNDirs;
+   Node_T oNRoot = NULL;
+   Node_T oNChild;
+   Path_T oPPath;
+   size_t ulFanout;
+   size_t ulDirs;
+   size_t ulDir;
+   size_t ulIndex;
+   size_t f;
+   size_t i;
+   double dStart;
+   double dInsert;
+   double dSearch;
+   double dFind = 0.0;
+   double dBsearch;
+   int iStatus;
+
+   printf("%7s %10s %10s %10s %10s\n", "fanout", "insert ns",
+          "search ns", "find ns", "bsearch ns");
+   for(f = 0; f < sizeof(aulFanouts) / sizeof(aulFanouts[0]); f++) {
+      ulFanout = aulFanouts[f];
+      ulDirs = BENCH_FANOUT_CHILDREN / ulFanout;
+      aoNames = calloc(ulDirs, sizeof(DynArray_T));
+      aoNDirs = calloc(ulDirs, sizeof(Node_T));
+      iStatus = Path_new("r", &oPPath);
+      if(iStatus == SUCCESS) {
+         iStatus = Node_new(oPPath, NODE_DIR, NULL, &oNRoot);
+         Path_free(oPPath);
+      }
+      if(iStatus == SUCCESS && (aoNames == NULL || aoNDirs == NULL))
+         iStatus = MEMORY_ERROR;
+
+      dStart = Bench_now();
+      if(iStatus == SUCCESS)
+         iStatus = Bench_fillFanout(oNRoot, ulFanout, ulDirs, aoNDirs,
+                                    aoNames);
+      dInsert = (Bench_now() - dStart) * 1e9 / BENCH_FANOUT_CHILDREN;
+
+      /* every loop draws the same children in the same order */
+      ulBenchSeed = 1;
+      dStart = Bench_now();
+      for(i = 0; i < BENCH_FANOUT_LOOKUPS && iStatus == SUCCESS; i++) {
+         ulIndex = Bench_pick(ulFanout, ulDirs, &ulDir);
+         if(!Node_hasChildComponent(aoNDirs[ulDir],
+                                    DynArray_get(aoNames[ulDir],
+                                                 ulIndex),
+                                    &ulIndex))
+            iStatus = NO_SUCH_PATH;
+      }
+      dSearch = (Bench_now() - dStart) * 1e9 / BENCH_FANOUT_LOOKUPS;
+
+      ulBenchSeed = 1;
+      dStart = Bench_now();
+      for(i = 0; i < BENCH_FANOUT_LOOKUPS && iStatus == SUCCESS; i++) {
+         ulIndex = Bench_pick(ulFanout, ulDirs, &ulDir);
+         if(!Node_findChild(aoNDirs[ulDir],
+                            DynArray_get(aoNames[ulDir], ulIndex),
+                            &oNChild))
+            iStatus = NO_SUCH_PATH;
+      }
+      dFind = (Bench_now() - dStart) * 1e9 / BENCH_FANOUT_LOOKUPS;
+
+      ulBenchSeed = 1;
+      dStart = Bench_now();
+      for(i = 0; i < BENCH_FANOUT_LOOKUPS && iStatus == SUCCESS; i++) {
+         ulIndex = Bench_pick(ulFanout, ulDirs, &ulDir);
+         if(!DynArray_bsearch(aoNames[ulDir],
+                              DynArray_get(aoNames[ulDir], ulIndex),
+                              &ulIndex, Bench_compareNames))
+            iStatus = NO_SUCH_PATH;
+      }
+      dBsearch = (Bench_now() - dStart) * 1e9 / BENCH_FANOUT_LOOKUPS;
+
+      if(aoNames != NULL)
+         Bench_freeNames(aoNames, ulDirs);
+      free(aoNames);
+      free(aoNDirs);
+      if(oNRoot != NULL)
+         (void) Node_free(oNRoot);
+      oNRoot = NULL;
+      if(iStatus != SUCCESS)
+         return 1;
+      printf("%7lu %10.1f %10.1f %10.1f %10.1f\n",
+             (unsigned long) ulFanout, dInsert, dSearch, dFind,
+             dBsearch);
+   }
+   return 0;
+}
+
+/*
+  Runs the benchmark named by argv[1]:
+  * depth: lookup time against the depth of the path looked up
+  * bytes: heap bytes per node of a monorepo-shaped tree
+  * fanout: insert and search time against the number of children of
+    the directory searched
+  * threads [N]: lookups and inserts per second from 1 to N threads
+    (8 if N is not given) at once
+  * journal B [N]: journaled inserts per second from 1 to N threads
+    (1 if N is not given) at once, with a batch of B, or no journal if
+    B is 0
+  * bulk: time to build a tree by inserts and by a bulk load
+  Prints each benchmark's results to stdout. Returns 0 if the
+  benchmark ran, or 1 if it failed or no known one was named.
+*/
+int main(int argc, char *argv[]) {
+   size_t ulMax;
+
+   if(argc == 2 && strcmp(argv[1], "depth") == 0)
+      return Bench_depth();
+   if(argc == 2 && strcmp(argv[1], "bytes") == 0)
+      return Bench_bytes();
+   if(argc == 2 && strcmp(argv[1], "fanout") == 0)
+      return Bench_fanout();
+   if((argc == 2 || argc == 3) && strcmp(argv[1], "threads") == 0) {
+      ulMax = (argc == 3) ? (size_t) atol(argv[2]) : 8;
+      if(ulMax >= 1 && ulMax <= BENCH_THREADS_MAX)
+         return Bench_threads(ulMax);
+   }
+   if((argc == 3 || argc == 4) && strcmp(argv[1], "journal") == 0) {
+      ulMax = (argc == 4) ? (size_t) atol(argv[3]) : 1;
+      if(ulMax >= 1 && ulMax <= BENCH_THREADS_MAX)
+         return Bench_journal((size_t) atol(argv[2]), ulMax);
+   }
+   if(argc == 2 && strcmp(argv[1], "bulk") == 0)
+      return Bench_bulk();
+
+   fprintf(stderr, "usage: %s depth|bytes|fanout|threads [N]|"
+           "journal B [N]|bulk\n", argv[0]);
+   return 1;
+}
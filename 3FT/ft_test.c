@@ -0,0 +1,837 @@
+/*--------------------------------------------------------------------*/
+/* ft_test.c                                                          */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+/* fork, waitpid, and _exit are POSIX, not ISO C */
+#define _XOPEN_SOURCE 600
+
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ft.h"
+
+/* The files the tests save images and journals to */
+#define TEST_IMAGE "ft_test.img"
+#define TEST_JOURNAL "ft_test.jnl"
+
+/* The depth of the chain of directories Test_deepChain writes */
+#define TEST_CHAIN_DEPTH 4000
+
+/* The stack Test_deepChain writes the chain on, far less than it
+   would need if writing took a call per level */
+#define TEST_CHAIN_STACK (128 * 1024)
+
+/* The paths a bulk load is given, in the order the FT keeps them */
+static const char *apcTestSorted[] = {
+   "r", "r/a", "r/a/x", "r/a/y", "r/b", "r/b/c", "r/b/c/d", "r/e"
+};
+
+/* Whether each path of apcTestSorted is a file */
+static const boolean abTestSortedFile[] = {
+   FALSE, FALSE, TRUE, TRUE, FALSE, FALSE, TRUE, TRUE
+};
+
+/* A stream of paths for FT_bulkLoadIn: the array and where it is */
+struct testStream {
+   /* the paths */
+   const char **apcPaths;
+   /* whether each path is a file */
+   const boolean *abIsFile;
+   /* the number of paths */
+   size_t ulCount;
+   /* the index of the next path to give */
+   size_t ulNext;
+};
+
+/*
+  Gives the next path of the struct testStream pvStream, as
+  FT_bulkLoadIn asks, with contents equal to the path for a file.
+  Returns FALSE once every path has been given.
+*/
+static boolean Test_next(const char **ppcPath, boolean *pbIsFile,
+                         void **ppvContents, size_t *pulLength,
+                         void *pvStream) {
+   struct testStream *psStream = pvStream;
+
+   assert(psStream != NULL);
+
+   if(psStream->ulNext == psStream->ulCount)
+      return FALSE;
+   *ppcPath = psStream->apcPaths[psStream->ulNext];
+   *pbIsFile = psStream->abIsFile[psStream->ulNext];
+   if(*pbIsFile) {
+      *ppvContents = (void *) *ppcPath;
+      *pulLength = strlen(*ppcPath);
+   }
+   psStream->ulNext++;
+   return TRUE;
+}
+
+/*
+  Bulk loads oFTree with the ulCount paths apcPaths, of which those
+  with abIsFile TRUE are files. Returns the status FT_bulkLoadIn
+  returns.
+*/
+static int Test_load(FT_T oFTree, const char **apcPaths,
+                     const boolean *abIsFile, size_t ulCount) {
+   struct testStream sStream;
+
+   sStream.apcPaths = apcPaths;
+   sStream.abIsFile = abIsFile;
+   sStream.ulCount = ulCount;
+   sStream.ulNext = 0;
+   return FT_bulkLoadIn(oFTree, Test_next, &sStream);
+}
+
+/*
+  Asserts that oFTree1 and oFTree2 have the same string
+  representation.
+*/
+static void Test_assertSame(FT_T oFTree1, FT_T oFTree2) {
+   char *pcString1;
+   char *pcString2;
+
+   pcString1 = FT_toStringIn(oFTree1);
+   pcString2 = FT_toStringIn(oFTree2);
+   assert(pcString1 != NULL);
+   assert(pcString2 != NULL);
+   assert(strcmp(pcString1, pcString2) == 0);
+   free(pcString1);
+   free(pcString2);
+}
+
+/*
+  Asserts that oFTree has a file at pcPath whose contents are the
+  string pcContents, without its '\0'.
+*/
+static void Test_assertFile(FT_T oFTree, const char *pcPath,
+                            const char *pcContents) {
+   boolean bIsFile = FALSE;
+   size_t ulSize = 0;
+   void *pvContents;
+
+   assert(FT_statIn(oFTree, pcPath, &bIsFile, &ulSize) == SUCCESS);
+   assert(bIsFile);
+   assert(ulSize == strlen(pcContents));
+   pvContents = FT_getFileContentsIn(oFTree, pcPath);
+   assert(ulSize == 0 || memcmp(pvContents, pcContents, ulSize) == 0);
+}
+
+/*
+  Checks that a snapshot keeps reading as the FT did when it was
+  taken, whatever is later inserted, removed, or replaced in the FT,
+  and after the FT is freed.
+*/
+static void Test_snapshot(void) {
+   FT_T oFTree;
+   FT_T oFTSnap;
+   FT_T oFTEmpty;
+   char *pcBefore;
+   char *pcAfter;
+   char *pcSnap;
+   char acOld[] = "old";
+   char acNew[] = "newer";
+
+   oFTree = FT_new();
+   assert(oFTree != NULL);
+
+   /* a snapshot of an empty FT stays empty */
+   oFTEmpty = FT_snapshotIn(oFTree);
+   assert(oFTEmpty != NULL);
+
+   assert(FT_insertDirIn(oFTree, "r/a") == SUCCESS);
+   assert(FT_insertFileIn(oFTree, "r/a/f", acOld, 3) == SUCCESS);
+   assert(FT_insertFileIn(oFTree, "r/b/g", NULL, 0) == SUCCESS);
+   pcBefore = FT_toStringIn(oFTree);
+   assert(pcBefore != NULL);
+
+   oFTSnap = FT_snapshotIn(oFTree);
+   assert(oFTSnap != NULL);
+
+   /* change the FT in every way a snapshot must not see */
+   assert(FT_replaceFileContentsIn(oFTree, "r/a/f", acNew, 5) ==
+          acOld);
+   assert(FT_rmFileIn(oFTree, "r/b/g") == SUCCESS);
+   assert(FT_rmDirIn(oFTree, "r/b") == SUCCESS);
+   assert(FT_insertFileIn(oFTree, "r/a/h", NULL, 0) == SUCCESS);
+   assert(FT_insertDirIn(oFTree, "r/c/d") == SUCCESS);
+   pcAfter = FT_toStringIn(oFTree);
+   assert(pcAfter != NULL);
+   assert(strcmp(pcBefore, pcAfter) != 0);
+
+   pcSnap = FT_toStringIn(oFTSnap);
+   assert(pcSnap != NULL);
+   assert(strcmp(pcSnap, pcBefore) == 0);
+   free(pcSnap);
+   Test_assertFile(oFTSnap, "r/a/f", "old");
+   Test_assertFile(oFTree, "r/a/f", "newer");
+   assert(FT_containsFileIn(oFTSnap, "r/b/g"));
+   assert(!FT_containsFileIn(oFTSnap, "r/a/h"));
+   assert(!FT_containsDirIn(oFTSnap, "r/c"));
+
+   /* the snapshot outlives the FT */
+   FT_free(oFTree);
+   pcSnap = FT_toStringIn(oFTSnap);
+   assert(pcSnap != NULL);
+   assert(strcmp(pcSnap, pcBefore) == 0);
+   free(pcSnap);
+   FT_free(oFTSnap);
+
+   pcSnap = FT_toStringIn(oFTEmpty);
+   assert(pcSnap != NULL);
+   assert(strcmp(pcSnap, "") == 0);
+   free(pcSnap);
+   FT_free(oFTEmpty);
+
+   free(pcBefore);
+   free(pcAfter);
+
+   /* the default tree has no snapshot before it is initialized */
+   assert(FT_snapshot() == NULL);
+}
+
+/*
+  Checks that a tree saved by FT_saveIn loads back equal, contents
+  and all, and that loading fails cleanly when there is no image or
+  the file is not one.
+*/
+static void Test_saveLoad(void) {
+   FT_T oFTree;
+   FT_T oFTLoaded;
+   FILE *psFile;
+   char acData[] = "contents";
+   size_t ulId;
+   size_t ulSize;
+   boolean bIsFile;
+
+   oFTree = FT_new();
+   assert(oFTree != NULL);
+   assert(FT_insertDirIn(oFTree, "r") == SUCCESS);
+   assert(FT_insertFileIn(oFTree, "r/a/f", acData, 8) == SUCCESS);
+   assert(FT_insertFileIn(oFTree, "r/a/g", NULL, 0) == SUCCESS);
+   assert(FT_insertDirIn(oFTree, "r/b/c/d") == SUCCESS);
+   assert(FT_saveIn(oFTree, TEST_IMAGE) == SUCCESS);
+
+   oFTLoaded = FT_new();
+   assert(oFTLoaded != NULL);
+   assert(FT_insertDirIn(oFTLoaded, "z") == SUCCESS);
+   assert(FT_getIdIn(oFTLoaded, "z", &ulId) == SUCCESS);
+   assert(FT_loadIn(oFTLoaded, TEST_IMAGE) == SUCCESS);
+   Test_assertSame(oFTree, oFTLoaded);
+   Test_assertFile(oFTLoaded, "r/a/f", "contents");
+   Test_assertFile(oFTLoaded, "r/a/g", "");
+   /* loading replaced everything, the old IDs included */
+   assert(!FT_containsDirIn(oFTLoaded, "z"));
+   assert(FT_statByIdIn(oFTLoaded, ulId, &bIsFile, &ulSize) ==
+          NO_SUCH_PATH);
+
+   /* a loaded tree can be changed like any other */
+   assert(FT_insertFileIn(oFTLoaded, "r/b/h", NULL, 0) == SUCCESS);
+   assert(FT_rmDirIn(oFTLoaded, "r/a") == SUCCESS);
+
+   /* a failed load leaves the tree as it was */
+   assert(FT_loadIn(oFTLoaded, "ft_test.none") == NO_SUCH_PATH);
+   assert(FT_containsFileIn(oFTLoaded, "r/b/h"));
+   psFile = fopen(TEST_IMAGE, "w");
+   assert(psFile != NULL);
+   assert(fputs("not an image", psFile) != EOF);
+   assert(fclose(psFile) == 0);
+   assert(FT_loadIn(oFTLoaded, TEST_IMAGE) == EOF);
+   assert(FT_containsFileIn(oFTLoaded, "r/b/h"));
+
+   /* an empty tree saves and loads as an empty tree */
+   FT_free(oFTree);
+   oFTree = FT_new();
+   assert(oFTree != NULL);
+   assert(FT_saveIn(oFTree, TEST_IMAGE) == SUCCESS);
+   assert(FT_loadIn(oFTLoaded, TEST_IMAGE) == SUCCESS);
+   Test_assertSame(oFTree, oFTLoaded);
+
+   FT_free(oFTree);
+   FT_free(oFTLoaded);
+   assert(remove(TEST_IMAGE) == 0);
+
+   assert(FT_save(TEST_IMAGE) == INITIALIZATION_ERROR);
+   assert(FT_load(TEST_IMAGE) == INITIALIZATION_ERROR);
+}
+
+/* The contents of the journal test's file, before and after */
+static char acTestOne[] = "one";
+static char acTestTwo[] = "two!";
+
+/*
+  Makes in oFTree the first part of the changes the journal test
+  records if bFirst is TRUE, or the rest of them if it is FALSE.
+  Returns TRUE if each change gave the result it should.
+*/
+static boolean Test_journalChanges(FT_T oFTree, boolean bFirst) {
+   if(bFirst)
+      return (boolean)
+         (FT_insertDirIn(oFTree, "r/a") == SUCCESS &&
+          FT_insertFileIn(oFTree, "r/a/f", acTestOne, 3) == SUCCESS &&
+          FT_insertDirIn(oFTree, "r/b/c") == SUCCESS &&
+          FT_insertFileIn(oFTree, "r/b/c/g", NULL, 0) == SUCCESS);
+   return (boolean)
+      (FT_replaceFileContentsIn(oFTree, "r/a/f", acTestTwo, 4) ==
+       acTestOne &&
+       FT_rmFileIn(oFTree, "r/b/c/g") == SUCCESS &&
+       FT_rmDirIn(oFTree, "r/b") == SUCCESS &&
+       FT_insertDirIn(oFTree, "r/d") == SUCCESS);
+}
+
+/*
+  Makes the journal test's changes in a child process with a journal
+  open on TEST_IMAGE and TEST_JOURNAL, taking a checkpoint after the
+  first part of them if bCheckpoint is TRUE, and has the child exit
+  without closing the journal or freeing the tree, as a crash would.
+*/
+static void Test_journalCrash(boolean bCheckpoint) {
+   pid_t iPid;
+   int iWaitStatus;
+   FT_T oFTree;
+
+   iPid = fork();
+   assert(iPid >= 0);
+   if(iPid == 0) {
+      oFTree = FT_new();
+      if(oFTree == NULL ||
+         FT_openJournalIn(oFTree, TEST_IMAGE, TEST_JOURNAL, 1) !=
+         SUCCESS)
+         _exit(1);
+      if(!Test_journalChanges(oFTree, TRUE) ||
+         (bCheckpoint && FT_checkpointIn(oFTree) != SUCCESS) ||
+         !Test_journalChanges(oFTree, FALSE))
+         _exit(1);
+      _exit(0);
+   }
+   assert(waitpid(iPid, &iWaitStatus, 0) == iPid);
+   assert(WIFEXITED(iWaitStatus) && WEXITSTATUS(iWaitStatus) == 0);
+}
+
+/*
+  Checks that a journal with a batch of 1 brings back every change
+  after a crash, with and without a checkpoint before it, and that
+  the replayed tree goes on recording changes.
+*/
+static void Test_journal(void) {
+   FT_T oFTExpected;
+   FT_T oFTree;
+   int i;
+
+   oFTExpected = FT_new();
+   assert(oFTExpected != NULL);
+   assert(Test_journalChanges(oFTExpected, TRUE));
+   assert(Test_journalChanges(oFTExpected, FALSE));
+
+   for(i = 0; i < 2; i++) {
+      (void) remove(TEST_IMAGE);
+      (void) remove(TEST_JOURNAL);
+      Test_journalCrash((boolean) i);
+
+      oFTree = FT_new();
+      assert(oFTree != NULL);
+      assert(FT_openJournalIn(oFTree, TEST_IMAGE, TEST_JOURNAL, 1) ==
+             SUCCESS);
+      Test_assertSame(oFTExpected, oFTree);
+      Test_assertFile(oFTree, "r/a/f", "two!");
+
+      /* the restored tree records on, and a checkpoint keeps it all */
+      assert(FT_insertFileIn(oFTree, "r/d/e", NULL, 0) == SUCCESS);
+      assert(FT_checkpointIn(oFTree) == SUCCESS);
+      assert(FT_rmDirIn(oFTree, "r/d") == SUCCESS);
+      assert(FT_syncIn(oFTree) == SUCCESS);
+      assert(FT_closeJournalIn(oFTree) == SUCCESS);
+      FT_free(oFTree);
+
+      oFTree = FT_new();
+      assert(oFTree != NULL);
+      assert(FT_openJournalIn(oFTree, TEST_IMAGE, TEST_JOURNAL, 1) ==
+             SUCCESS);
+      assert(FT_containsFileIn(oFTree, "r/a/f"));
+      assert(!FT_containsDirIn(oFTree, "r/d"));
+      FT_free(oFTree);
+   }
+   FT_free(oFTExpected);
+   (void) remove(TEST_IMAGE);
+   (void) remove(TEST_JOURNAL);
+
+   /* with no journal, syncing, checkpointing, and closing do nothing */
+   oFTree = FT_new();
+   assert(oFTree != NULL);
+   assert(FT_syncIn(oFTree) == SUCCESS);
+   assert(FT_checkpointIn(oFTree) == SUCCESS);
+   assert(FT_closeJournalIn(oFTree) == SUCCESS);
+   FT_free(oFTree);
+
+   assert(FT_openJournal(TEST_IMAGE, TEST_JOURNAL, 1) ==
+          INITIALIZATION_ERROR);
+   assert(FT_sync() == INITIALIZATION_ERROR);
+   assert(FT_checkpoint() == INITIALIZATION_ERROR);
+}
+
+/*
+  Checks that a bulk load builds the same tree as inserting the same
+  paths one at a time, makes the directories the stream leaves out,
+  and leaves the tree unchanged when the stream is bad.
+*/
+static void Test_bulkLoad(void) {
+   enum {SORTED = sizeof(apcTestSorted) / sizeof(apcTestSorted[0])};
+   static const char *apcImplied[] = {"r/a/x", "r/b/c/d"};
+   static const boolean abImplied[] = {TRUE, TRUE};
+   static const char *apcUnsorted[] = {"r", "r/b", "r/a"};
+   static const char *apcTwice[] = {"r", "r/a", "r/a"};
+   static const char *apcBelow[] = {"r/a", "r/a/b"};
+   static const boolean abBelow[] = {TRUE, FALSE};
+   static const char *apcRoots[] = {"r/a", "s/a"};
+   static const char *apcBad[] = {"r", "r//a"};
+   static const char *apcFileRoot[] = {"r"};
+   static const boolean abDirs[] = {FALSE, FALSE, FALSE};
+   FT_T oFTree;
+   FT_T oFTLoaded;
+   char *pcBefore;
+   char *pcAfter;
+   size_t i;
+
+   oFTree = FT_new();
+   assert(oFTree != NULL);
+   for(i = 0; i < SORTED; i++) {
+      if(abTestSortedFile[i])
+         assert(FT_insertFileIn(oFTree, apcTestSorted[i],
+                                (void *) apcTestSorted[i],
+                                strlen(apcTestSorted[i])) == SUCCESS);
+      else
+         assert(FT_insertDirIn(oFTree, apcTestSorted[i]) == SUCCESS);
+   }
+
+   oFTLoaded = FT_new();
+   assert(oFTLoaded != NULL);
+   assert(Test_load(oFTLoaded, apcTestSorted, abTestSortedFile,
+                        SORTED) == SUCCESS);
+   Test_assertSame(oFTree, oFTLoaded);
+   Test_assertFile(oFTLoaded, "r/b/c/d", "r/b/c/d");
+   /* the loaded tree takes inserts like any other */
+   assert(FT_insertFileIn(oFTLoaded, "r/a/w", NULL, 0) == SUCCESS);
+   assert(FT_insertFileIn(oFTLoaded, "r/a/y", NULL, 0) ==
+          NOT_A_DIRECTORY);
+   assert(FT_insertDirIn(oFTLoaded, "r/b/c") == ALREADY_IN_TREE);
+
+   /* directories the stream leaves out are made along the way */
+   FT_free(oFTree);
+   oFTree = FT_new();
+   assert(oFTree != NULL);
+   assert(FT_insertDirIn(oFTree, "r") == SUCCESS);
+   for(i = 0; i < 2; i++)
+      assert(FT_insertFileIn(oFTree, apcImplied[i],
+                             (void *) apcImplied[i],
+                             strlen(apcImplied[i])) == SUCCESS);
+   assert(Test_load(oFTLoaded, apcImplied, abImplied, 2) ==
+          SUCCESS);
+   Test_assertSame(oFTree, oFTLoaded);
+
+   /* each bad stream is refused and leaves the tree as it was */
+   pcBefore = FT_toStringIn(oFTLoaded);
+   assert(pcBefore != NULL);
+   assert(Test_load(oFTLoaded, apcUnsorted, abDirs, 3) ==
+          CONFLICTING_PATH);
+   assert(Test_load(oFTLoaded, apcTwice, abDirs, 3) ==
+          ALREADY_IN_TREE);
+   assert(Test_load(oFTLoaded, apcBelow, abBelow, 2) ==
+          NOT_A_DIRECTORY);
+   assert(Test_load(oFTLoaded, apcRoots, abDirs, 2) ==
+          CONFLICTING_PATH);
+   assert(Test_load(oFTLoaded, apcBad, abDirs, 2) == BAD_PATH);
+   assert(Test_load(oFTLoaded, apcFileRoot, abBelow, 1) ==
+          CONFLICTING_PATH);
+   pcAfter = FT_toStringIn(oFTLoaded);
+   assert(pcAfter != NULL);
+   assert(strcmp(pcBefore, pcAfter) == 0);
+   free(pcBefore);
+   free(pcAfter);
+
+   /* an empty stream empties the tree */
+   assert(Test_load(oFTLoaded, apcTestSorted, abTestSortedFile, 0) ==
+          SUCCESS);
+   pcAfter = FT_toStringIn(oFTLoaded);
+   assert(pcAfter != NULL);
+   assert(strcmp(pcAfter, "") == 0);
+   free(pcAfter);
+
+   FT_free(oFTree);
+   FT_free(oFTLoaded);
+}
+
+/*
+  Checks the status FT_insertFilesIn gives each file of a batch and
+  the results FT_statManyIn and FT_containsManyIn give each path.
+*/
+static void Test_batches(void) {
+   enum {INSERTS = 7, LOOKUPS = 7};
+   static const char *apcInserts[INSERTS] = {
+      "r/x/f2", "r/x/f1", "r/x/f1", "r/x/f1/g", "q/f", "r//f", "r/y"
+   };
+   static const int aiInsertStatuses[INSERTS] = {
+      SUCCESS, SUCCESS, NOT_A_DIRECTORY, NOT_A_DIRECTORY,
+      CONFLICTING_PATH, BAD_PATH, ALREADY_IN_TREE
+   };
+   static const char *apcLookups[LOOKUPS] = {
+      "r/x/f1", "r/x", "r/x/f3", "r//x", "q", "r/x/f1/g", "r/x/f2"
+   };
+   static const int aiLookupStatuses[LOOKUPS] = {
+      SUCCESS, SUCCESS, NO_SUCH_PATH, BAD_PATH, CONFLICTING_PATH,
+      NO_SUCH_PATH, SUCCESS
+   };
+   void *apvContents[INSERTS];
+   size_t aulLengths[INSERTS];
+   int aiStatuses[LOOKUPS];
+   boolean abIsFile[LOOKUPS];
+   size_t aulSizes[LOOKUPS];
+   boolean abContains[LOOKUPS];
+   FT_T oFTree;
+   size_t i;
+
+   for(i = 0; i < INSERTS; i++) {
+      apvContents[i] = (void *) apcInserts[i];
+      aulLengths[i] = i;
+   }
+
+   oFTree = FT_new();
+   assert(oFTree != NULL);
+   assert(FT_insertDirIn(oFTree, "r/y") == SUCCESS);
+   assert(FT_insertFilesIn(oFTree, apcInserts, apvContents, aulLengths,
+                           INSERTS, aiStatuses) == SUCCESS);
+   for(i = 0; i < INSERTS; i++)
+      assert(aiStatuses[i] == aiInsertStatuses[i]);
+   /* of the two "r/x/f1", the first given is the one inserted, and
+      the second fails as FT_insertFileIn does over a file */
+   assert(FT_getFileContentsIn(oFTree, "r/x/f1") == apvContents[1]);
+
+   for(i = 0; i < LOOKUPS; i++) {
+      abIsFile[i] = FALSE;
+      aulSizes[i] = 99;
+   }
+   assert(FT_statManyIn(oFTree, apcLookups, LOOKUPS, aiStatuses,
+                        abIsFile, aulSizes) == SUCCESS);
+   for(i = 0; i < LOOKUPS; i++)
+      assert(aiStatuses[i] == aiLookupStatuses[i]);
+   assert(abIsFile[0] && aulSizes[0] == 1);
+   assert(!abIsFile[1] && aulSizes[1] == 99);
+   assert(!abIsFile[2] && aulSizes[2] == 99);
+   assert(abIsFile[6] && aulSizes[6] == 0);
+
+   assert(FT_containsManyIn(oFTree, apcLookups, LOOKUPS, abContains)
+          == 3);
+   for(i = 0; i < LOOKUPS; i++)
+      assert(abContains[i] == (aiLookupStatuses[i] == SUCCESS));
+
+   /* an empty batch is nothing to do */
+   assert(FT_insertFilesIn(oFTree, apcInserts, apvContents, aulLengths,
+                           0, aiStatuses) == SUCCESS);
+   assert(FT_statManyIn(oFTree, apcLookups, 0, aiStatuses, abIsFile,
+                        aulSizes) == SUCCESS);
+   FT_free(oFTree);
+
+   /* before initialization every status says so */
+   assert(FT_insertFiles(apcInserts, apvContents, aulLengths, INSERTS,
+                         aiStatuses) == INITIALIZATION_ERROR);
+   for(i = 0; i < INSERTS; i++)
+      assert(aiStatuses[i] == INITIALIZATION_ERROR);
+   assert(FT_statMany(apcLookups, LOOKUPS, aiStatuses, abIsFile,
+                      aulSizes) == INITIALIZATION_ERROR);
+   for(i = 0; i < LOOKUPS; i++)
+      assert(aiStatuses[i] == INITIALIZATION_ERROR);
+   assert(FT_containsMany(apcLookups, LOOKUPS, abContains) == 0);
+}
+
+/*
+  Checks that IDs and directory handles stop finding anything once
+  their node is removed, whether by itself or with its directory, and
+  that a new node at the same path gets a new ID.
+*/
+static void Test_removed(void) {
+   FT_T oFTree;
+   FTDir_T oDDir;
+   FTDir_T oDSub;
+   size_t ulFileId;
+   size_t ulDirId;
+   size_t ulNewId;
+   size_t ulSize = 7;
+   boolean bIsFile = TRUE;
+   void *pvContents = NULL;
+
+   oFTree = FT_new();
+   assert(oFTree != NULL);
+   assert(FT_insertDirIn(oFTree, "r/a/b") == SUCCESS);
+   assert(FT_insertFileIn(oFTree, "r/a/b/f", NULL, 4) == SUCCESS);
+   assert(FT_getIdIn(oFTree, "r/a/b/f", &ulFileId) == SUCCESS);
+   assert(FT_getIdIn(oFTree, "r/a/b", &ulDirId) == SUCCESS);
+   assert(ulFileId != 0 && ulDirId != 0 && ulFileId != ulDirId);
+   assert(FT_statByIdIn(oFTree, ulFileId, &bIsFile, &ulSize) ==
+          SUCCESS);
+   assert(bIsFile && ulSize == 4);
+   assert(FT_getIdIn(oFTree, "r/a/c", &ulNewId) == NO_SUCH_PATH);
+   assert(FT_statByIdIn(oFTree, 0, &bIsFile, &ulSize) == NO_SUCH_PATH);
+
+   assert(FT_openDirIn(oFTree, "r/a/b", &oDDir) == SUCCESS);
+   assert(FT_openDirIn(oFTree, "r/a/b/f", &oDSub) == NOT_A_DIRECTORY);
+   assert(oDSub == NULL);
+   assert(FT_openDirIn(oFTree, "r/z", &oDSub) == NO_SUCH_PATH);
+   assert(oDSub == NULL);
+   assert(FT_statAt(oDDir, "f", &bIsFile, &ulSize) == SUCCESS);
+   assert(FT_statAt(oDDir, "a/f", &bIsFile, &ulSize) == BAD_PATH);
+   assert(FT_insertFileAt(oDDir, "f", NULL, 0) == ALREADY_IN_TREE);
+
+   /* removing the file takes its ID with it, and a new file at the
+      same path gets a new one */
+   assert(FT_rmFileIn(oFTree, "r/a/b/f") == SUCCESS);
+   bIsFile = FALSE;
+   ulSize = 7;
+   assert(FT_statByIdIn(oFTree, ulFileId, &bIsFile, &ulSize) ==
+          NO_SUCH_PATH);
+   assert(!bIsFile && ulSize == 7);
+   assert(FT_statAt(oDDir, "f", &bIsFile, &ulSize) == NO_SUCH_PATH);
+   assert(FT_insertFileAt(oDDir, "f", NULL, 2) == SUCCESS);
+   assert(FT_getIdIn(oFTree, "r/a/b/f", &ulNewId) == SUCCESS);
+   assert(ulNewId != ulFileId);
+   assert(FT_statByIdIn(oFTree, ulFileId, &bIsFile, &ulSize) ==
+          NO_SUCH_PATH);
+
+   /* removing a directory above takes every ID below it, and the
+      handle on the directory finds nothing */
+   assert(FT_rmDirIn(oFTree, "r/a") == SUCCESS);
+   assert(FT_statByIdIn(oFTree, ulDirId, &bIsFile, &ulSize) ==
+          NO_SUCH_PATH);
+   assert(FT_statByIdIn(oFTree, ulNewId, &bIsFile, &ulSize) ==
+          NO_SUCH_PATH);
+   assert(FT_statAt(oDDir, "f", &bIsFile, &ulSize) == NO_SUCH_PATH);
+   assert(FT_lookupAt(oDDir, "f", &bIsFile, &pvContents, &ulSize) ==
+          NO_SUCH_PATH);
+   assert(FT_insertFileAt(oDDir, "g", NULL, 0) == NO_SUCH_PATH);
+   assert(!FT_containsDirIn(oFTree, "r/a"));
+
+   /* with a file where its directory was, the handle says so */
+   assert(FT_insertFileIn(oFTree, "r/a", NULL, 0) == SUCCESS);
+   assert(FT_statAt(oDDir, "f", &bIsFile, &ulSize) == NO_SUCH_PATH);
+   assert(FT_rmFileIn(oFTree, "r/a") == SUCCESS);
+   assert(FT_insertFileIn(oFTree, "r/a/b", NULL, 0) == SUCCESS);
+   assert(FT_statAt(oDDir, "f", &bIsFile, &ulSize) == NOT_A_DIRECTORY);
+   assert(FT_insertFileAt(oDDir, "f", NULL, 0) == NOT_A_DIRECTORY);
+   FT_closeDir(oDDir);
+
+   /* removing the root leaves a handle on it nothing to find */
+   assert(FT_openDirIn(oFTree, "r", &oDDir) == SUCCESS);
+   assert(FT_rmDirIn(oFTree, "r") == SUCCESS);
+   assert(FT_statAt(oDDir, "a", &bIsFile, &ulSize) == NO_SUCH_PATH);
+   FT_closeDir(oDDir);
+   FT_closeDir(NULL);
+
+   FT_free(oFTree);
+
+   assert(FT_openDir("r", &oDDir) == INITIALIZATION_ERROR);
+   assert(oDDir == NULL);
+   assert(FT_getId("r", &ulNewId) == INITIALIZATION_ERROR);
+   assert(FT_statById(0, &bIsFile, &ulSize) ==
+          INITIALIZATION_ERROR);
+}
+
+/*
+  Checks that a handle whose directory is removed and made again
+  reaches the new directory, whether or not a call through it came in
+  between, and that removals elsewhere, and a snapshot's copy of its
+  path, leave it reaching the same one. Runs once
+  in each of the FT's modes: plain, with the path index on, and in
+  concurrent mode with background reclamation, where the old
+  directory is freed behind the handle's back.
+*/
+static void Test_recreated(void) {
+   FT_T oFTree;
+   FT_T oFTSnapshot;
+   FTDir_T oDDir;
+   size_t ulSize;
+   boolean bIsFile;
+   int iMode;
+
+   for(iMode = 0; iMode < 3; iMode++) {
+      oFTree = FT_new();
+      assert(oFTree != NULL);
+      if(iMode == 1)
+         assert(FT_setPathIndexIn(oFTree, TRUE) == SUCCESS);
+      if(iMode == 2) {
+         assert(FT_setConcurrentIn(oFTree, TRUE) == SUCCESS);
+         assert(FT_setReclaimerIn(oFTree, TRUE) == SUCCESS);
+      }
+      assert(FT_insertDirIn(oFTree, "r/a/b") == SUCCESS);
+      assert(FT_insertFileIn(oFTree, "r/a/b/f", NULL, 1) == SUCCESS);
+      assert(FT_insertDirIn(oFTree, "r/z/y") == SUCCESS);
+      assert(FT_openDirIn(oFTree, "r/a/b", &oDDir) == SUCCESS);
+      assert(FT_statAt(oDDir, "f", &bIsFile, &ulSize) == SUCCESS);
+      assert(bIsFile && ulSize == 1);
+
+      /* gone, then made again: the handle finds the new, empty one */
+      assert(FT_rmDirIn(oFTree, "r/a") == SUCCESS);
+      assert(FT_statAt(oDDir, "f", &bIsFile, &ulSize) == NO_SUCH_PATH);
+      assert(FT_insertDirIn(oFTree, "r/a/b") == SUCCESS);
+      assert(FT_statAt(oDDir, "f", &bIsFile, &ulSize) == NO_SUCH_PATH);
+      assert(FT_insertFileAt(oDDir, "g", NULL, 2) == SUCCESS);
+      assert(FT_containsFileIn(oFTree, "r/a/b/g"));
+
+      /* removed and made again with no call through the handle in
+         between: it must not use the directory it found before */
+      assert(FT_rmDirIn(oFTree, "r/a/b") == SUCCESS);
+      assert(FT_insertFileIn(oFTree, "r/a/b/h", NULL, 3) == SUCCESS);
+      assert(FT_reclaimIn(oFTree) == SUCCESS);
+      assert(FT_statAt(oDDir, "g", &bIsFile, &ulSize) == NO_SUCH_PATH);
+      assert(FT_statAt(oDDir, "h", &bIsFile, &ulSize) == SUCCESS);
+      assert(bIsFile && ulSize == 3);
+
+      /* removals elsewhere leave it on the same directory */
+      assert(FT_rmDirIn(oFTree, "r/z/y") == SUCCESS);
+      assert(FT_rmFileIn(oFTree, "r/a/b/h") == SUCCESS);
+      assert(FT_rmDirIn(oFTree, "r/z") == SUCCESS);
+      assert(FT_insertFileAt(oDDir, "i", NULL, 0) == SUCCESS);
+      assert(FT_containsFileIn(oFTree, "r/a/b/i"));
+      assert(FT_statAt(oDDir, "h", &bIsFile, &ulSize) == NO_SUCH_PATH);
+
+      /* the copy made for a snapshot takes the directory's place */
+      oFTSnapshot = FT_snapshotIn(oFTree);
+      assert(oFTSnapshot != NULL);
+      assert(FT_insertFileAt(oDDir, "k", NULL, 0) == SUCCESS);
+      assert(FT_insertFileIn(oFTree, "r/a/b/l", NULL, 0) == SUCCESS);
+      assert(FT_statAt(oDDir, "l", &bIsFile, &ulSize) == SUCCESS);
+      assert(!FT_containsFileIn(oFTSnapshot, "r/a/b/k"));
+      FT_free(oFTSnapshot);
+
+      /* and so does the root's removal and remaking */
+      assert(FT_rmDirIn(oFTree, "r") == SUCCESS);
+      assert(FT_statAt(oDDir, "i", &bIsFile, &ulSize) == NO_SUCH_PATH);
+      assert(FT_insertDirIn(oFTree, "r/a/b") == SUCCESS);
+      assert(FT_insertFileAt(oDDir, "j", NULL, 0) == SUCCESS);
+      assert(FT_statAt(oDDir, "j", &bIsFile, &ulSize) == SUCCESS);
+      assert(FT_statAt(oDDir, "i", &bIsFile, &ulSize) == NO_SUCH_PATH);
+
+      FT_closeDir(oDDir);
+      if(iMode == 2)
+         assert(FT_setReclaimerIn(oFTree, FALSE) == SUCCESS);
+      FT_free(oFTree);
+   }
+}
+
+/* A tree for Test_writeChain to write, and what it should write */
+struct testChain {
+   /* the tree */
+   FT_T oFTree;
+   /* its expected string representation */
+   const char *pcExpected;
+};
+
+/*
+  Returns pvChain, a struct testChain, if FT_toStringIn writes its
+  tree as expected, or NULL if not.
+*/
+static void *Test_writeChain(void *pvChain) {
+   struct testChain *psChain = pvChain;
+   char *pcString;
+   boolean bSame;
+
+   assert(psChain != NULL);
+
+   pcString = FT_toStringIn(psChain->oFTree);
+   if(pcString == NULL)
+      return NULL;
+   bSame = (boolean) (strcmp(pcString, psChain->pcExpected) == 0);
+   free(pcString);
+   return bSame ? pvChain : NULL;
+}
+
+/*
+  Checks that FT_toString writes a chain of TEST_CHAIN_DEPTH
+  directories ending in a file, both for the tree and for a snapshot
+  of it, on a thread with a stack of only TEST_CHAIN_STACK bytes.
+*/
+static void Test_deepChain(void) {
+   struct testChain sChain;
+   pthread_attr_t sAttr;
+   pthread_t sThread;
+   FT_T oFTree;
+   FT_T oFTSnapshot;
+   void *pvResult;
+   char *pcPath;
+   char *pcExpected;
+   size_t ulLength;
+   size_t ulOffset;
+   size_t i;
+   int iTree;
+
+   /* the path "r/d/.../d/f", and each prefix of it on its own line */
+   pcPath = malloc(2 * TEST_CHAIN_DEPTH + 4);
+   assert(pcPath != NULL);
+   pcExpected = malloc((TEST_CHAIN_DEPTH + 2) *
+                       (2 * TEST_CHAIN_DEPTH + 4));
+   assert(pcExpected != NULL);
+   strcpy(pcPath, "r");
+   ulLength = 1;
+   ulOffset = 0;
+   for(i = 0; i <= TEST_CHAIN_DEPTH; i++) {
+      memcpy(pcExpected + ulOffset, pcPath, ulLength);
+      ulOffset += ulLength;
+      pcExpected[ulOffset++] = '\n';
+      strcpy(pcPath + ulLength, i < TEST_CHAIN_DEPTH ? "/d" : "/f");
+      ulLength += 2;
+   }
+   memcpy(pcExpected + ulOffset, pcPath, ulLength);
+   ulOffset += ulLength;
+   strcpy(pcExpected + ulOffset, "\n");
+
+   oFTree = FT_new();
+   assert(oFTree != NULL);
+   assert(FT_insertDirIn(oFTree, "r") == SUCCESS);
+   assert(FT_insertFileIn(oFTree, pcPath, NULL, 0) == SUCCESS);
+   oFTSnapshot = FT_snapshotIn(oFTree);
+   assert(oFTSnapshot != NULL);
+   /* the live tree's copies must not lead the snapshot's walk astray */
+   assert(FT_rmFileIn(oFTree, pcPath) == SUCCESS);
+   assert(FT_insertFileIn(oFTree, pcPath, NULL, 0) == SUCCESS);
+
+   assert(pthread_attr_init(&sAttr) == 0);
+   assert(pthread_attr_setstacksize(&sAttr, TEST_CHAIN_STACK) == 0);
+   sChain.pcExpected = pcExpected;
+   for(iTree = 0; iTree < 2; iTree++) {
+      sChain.oFTree = iTree == 0 ? oFTree : oFTSnapshot;
+      assert(pthread_create(&sThread, &sAttr, Test_writeChain,
+                            &sChain) == 0);
+      assert(pthread_join(sThread, &pvResult) == 0);
+      assert(pvResult == &sChain);
+   }
+   (void) pthread_attr_destroy(&sAttr);
+
+   FT_free(oFTSnapshot);
+   FT_free(oFTree);
+   free(pcExpected);
+   free(pcPath);
+}
+
+/*
+  Runs each test of the FT's snapshots, images, journals, bulk loads,
+  batches, IDs, directory handles, and deep trees, checking the
+  results and statuses of every call.
+  A failed check stops the program with an assertion failure.
+  Returns 0 if every check passed.
+*/
+int main(void) {
+   Test_snapshot();
+   Test_saveLoad();
+   Test_journal();
+   Test_bulkLoad();
+   Test_batches();
+   Test_removed();
+   Test_recreated();
+   Test_deepChain();
+   return 0;
+}
@@ -0,0 +1,260 @@
+/*--------------------------------------------------------------------*/
+/* idTable.c                                                          */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "idTable.h"
+
+/* The number of bits of an ID that hold its slot number */
+#define IDTABLE_SLOT_BITS (sizeof(size_t) * CHAR_BIT / 2)
+
+/* The mask of those bits */
+#define IDTABLE_SLOT_MASK (((size_t) 1 << IDTABLE_SLOT_BITS) - 1)
+
+/* log2 of the number of slots in the first chunk */
+#define IDTABLE_FIRST_BITS 6
+
+/* The number of chunks, enough for every slot number an ID can hold */
+#define IDTABLE_CHUNKS (sizeof(size_t) * CHAR_BIT / 2 + 1)
+
+/* One slot of the table */
+struct idTableSlot {
+   /* the object the slot's ID refers to, or NULL while it is free */
+   void *pvObject;
+   /* the generation of the slot's current or next ID, never 0 */
+   size_t ulGeneration;
+};
+
+/*
+  A table of IDs. Its slots are kept in chunks that double in size, so
+  a chunk is never moved once made and lock-free lookups need no
+  epoch of their own: slot i lives in chunk k, where i + 2^FIRST_BITS
+  first reaches 2^(FIRST_BITS + k).
+*/
+struct idTable {
+   /* the chunks made so far, the rest NULL */
+   struct idTableSlot *apsChunks[IDTABLE_CHUNKS];
+   /* the number of slots ever handed out, which are all below the
+      ones never used */
+   size_t ulSlots;
+   /* the number of slots in the chunks made so far */
+   size_t ulCapacity;
+   /* the free slots below ulSlots, most recently freed last */
+   size_t *aulFree;
+   /* the number of free slots in aulFree */
+   size_t ulFree;
+   /* the number of entries aulFree has room for */
+   size_t ulFreeCapacity;
+};
+
+/*
+  Sets *pulChunk and *pulOffset to the chunk that slot ulSlot lives in
+  and its place in that chunk.
+*/
+static void IdTable_locate(size_t ulSlot, size_t *pulChunk,
+                           size_t *pulOffset) {
+   size_t ulBiased;
+   size_t ulChunk = 0;
+
+   assert(pulChunk != NULL);
+   assert(pulOffset != NULL);
+
+   ulBiased = (ulSlot >> IDTABLE_FIRST_BITS) + 1;
+   while((ulBiased >>= 1) != 0)
+      ulChunk++;
+   *pulChunk = ulChunk;
+   *pulOffset = ulSlot + ((size_t) 1 << IDTABLE_FIRST_BITS) -
+                ((size_t) 1 << (IDTABLE_FIRST_BITS + ulChunk));
+}
+
+IdTable_T IdTable_new(void) {
+   struct idTable *psTable;
+   size_t c;
+
+   psTable = malloc(sizeof(struct idTable));
+   if(psTable == NULL)
+      return NULL;
+
+   for(c = 0; c < IDTABLE_CHUNKS; c++)
+      psTable->apsChunks[c] = NULL;
+   psTable->ulSlots = 0;
+   psTable->ulCapacity = 0;
+   psTable->aulFree = NULL;
+   psTable->ulFree = 0;
+   psTable->ulFreeCapacity = 0;
+   return psTable;
+}
+
+void IdTable_free(IdTable_T oItTable) {
+   size_t c;
+
+   if(oItTable == NULL)
+      return;
+
+   for(c = 0; c < IDTABLE_CHUNKS; c++)
+      free(oItTable->apsChunks[c]);
+   free(oItTable->aulFree);
+   free(oItTable);
+}
+
+int IdTable_reserve(IdTable_T oItTable, size_t ulExtra) {
+   struct idTableSlot *psChunk;
+   size_t *aulFree;
+   size_t ulNeeded;
+   size_t ulChunk;
+   size_t ulOffset;
+   size_t ulSize;
+   size_t i;
+
+   assert(oItTable != NULL);
+
+   /* freed slots are handed out first */
+   if(ulExtra <= oItTable->ulFree)
+      return SUCCESS;
+   ulNeeded = oItTable->ulSlots + (ulExtra - oItTable->ulFree);
+   if(ulNeeded - 1 > IDTABLE_SLOT_MASK)
+      return MEMORY_ERROR;
+
+   /* every slot handed out may be freed, so the free list must have
+      room for them all before IdTable_remove is asked to add one */
+   if(ulNeeded > oItTable->ulFreeCapacity) {
+      ulSize = (oItTable->ulFreeCapacity == 0) ?
+         ((size_t) 1 << IDTABLE_FIRST_BITS) :
+         oItTable->ulFreeCapacity;
+      while(ulSize < ulNeeded)
+         ulSize *= 2;
+      aulFree = realloc(oItTable->aulFree, ulSize * sizeof(size_t));
+      if(aulFree == NULL)
+         return MEMORY_ERROR;
+      oItTable->aulFree = aulFree;
+      oItTable->ulFreeCapacity = ulSize;
+   }
+
+   while(oItTable->ulCapacity < ulNeeded) {
+      IdTable_locate(oItTable->ulCapacity, &ulChunk, &ulOffset);
+      assert(ulOffset == 0);
+      ulSize = (size_t) 1 << (IDTABLE_FIRST_BITS + ulChunk);
+      psChunk = malloc(ulSize * sizeof(struct idTableSlot));
+      if(psChunk == NULL)
+         return MEMORY_ERROR;
+      for(i = 0; i < ulSize; i++) {
+         psChunk[i].pvObject = NULL;
+         psChunk[i].ulGeneration = 1;
+      }
+      __atomic_store_n(&oItTable->apsChunks[ulChunk], psChunk,
+                       __ATOMIC_RELEASE);
+      oItTable->ulCapacity += ulSize;
+   }
+   return SUCCESS;
+}
+
+int IdTable_add(IdTable_T oItTable, void *pvObject, size_t *pulId) {
+   struct idTableSlot *psSlot;
+   size_t ulSlot;
+   size_t ulChunk;
+   size_t ulOffset;
+   int iStatus;
+
+   assert(oItTable != NULL);
+   assert(pvObject != NULL);
+   assert(pulId != NULL);
+
+   iStatus = IdTable_reserve(oItTable, 1);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   if(oItTable->ulFree > 0)
+      ulSlot = oItTable->aulFree[--oItTable->ulFree];
+   else
+      ulSlot = oItTable->ulSlots++;
+
+   IdTable_locate(ulSlot, &ulChunk, &ulOffset);
+   psSlot = &oItTable->apsChunks[ulChunk][ulOffset];
+   __atomic_store_n(&psSlot->pvObject, pvObject, __ATOMIC_SEQ_CST);
+   *pulId = (psSlot->ulGeneration << IDTABLE_SLOT_BITS) | ulSlot;
+   return SUCCESS;
+}
+
+/*
+  Returns the slot of oItTable that ulId names, which must be in use.
+*/
+static struct idTableSlot *IdTable_slotInUse(IdTable_T oItTable,
+                                             size_t ulId) {
+   struct idTableSlot *psSlot;
+   size_t ulChunk;
+   size_t ulOffset;
+
+   assert(oItTable != NULL);
+
+   IdTable_locate(ulId & IDTABLE_SLOT_MASK, &ulChunk, &ulOffset);
+   assert(ulChunk < IDTABLE_CHUNKS);
+   psSlot = &oItTable->apsChunks[ulChunk][ulOffset];
+   assert(psSlot->ulGeneration == ulId >> IDTABLE_SLOT_BITS);
+   assert(psSlot->pvObject != NULL);
+   return psSlot;
+}
+
+void IdTable_set(IdTable_T oItTable, size_t ulId, void *pvObject) {
+   assert(pvObject != NULL);
+
+   __atomic_store_n(&IdTable_slotInUse(oItTable, ulId)->pvObject,
+                    pvObject, __ATOMIC_SEQ_CST);
+}
+
+void IdTable_remove(IdTable_T oItTable, size_t ulId) {
+   struct idTableSlot *psSlot;
+   size_t ulGeneration;
+
+   psSlot = IdTable_slotInUse(oItTable, ulId);
+
+   /* the object goes before the generation moves on, so a lookup that
+      sees the old generation on both sides of reading the object
+      cannot have read the slot's next one */
+   __atomic_store_n(&psSlot->pvObject, NULL, __ATOMIC_SEQ_CST);
+   ulGeneration = (psSlot->ulGeneration + 1) &
+                  (((size_t) 1 << (sizeof(size_t) * CHAR_BIT -
+                                   IDTABLE_SLOT_BITS)) - 1);
+   if(ulGeneration == 0)
+      ulGeneration = 1;
+   __atomic_store_n(&psSlot->ulGeneration, ulGeneration,
+                    __ATOMIC_SEQ_CST);
+
+   assert(oItTable->ulFree < oItTable->ulFreeCapacity);
+   oItTable->aulFree[oItTable->ulFree++] = ulId & IDTABLE_SLOT_MASK;
+}
+
+void *IdTable_get(IdTable_T oItTable, size_t ulId) {
+   struct idTableSlot *psChunk;
+   struct idTableSlot *psSlot;
+   void *pvObject;
+   size_t ulGeneration;
+   size_t ulChunk;
+   size_t ulOffset;
+
+   assert(oItTable != NULL);
+
+   ulGeneration = ulId >> IDTABLE_SLOT_BITS;
+   if(ulGeneration == 0)
+      return NULL;
+   IdTable_locate(ulId & IDTABLE_SLOT_MASK, &ulChunk, &ulOffset);
+   if(ulChunk >= IDTABLE_CHUNKS)
+      return NULL;
+   psChunk = __atomic_load_n(&oItTable->apsChunks[ulChunk],
+                             __ATOMIC_ACQUIRE);
+   if(psChunk == NULL)
+      return NULL;
+
+   psSlot = &psChunk[ulOffset];
+   if(__atomic_load_n(&psSlot->ulGeneration, __ATOMIC_SEQ_CST) !=
+      ulGeneration)
+      return NULL;
+   pvObject = __atomic_load_n(&psSlot->pvObject, __ATOMIC_SEQ_CST);
+   if(__atomic_load_n(&psSlot->ulGeneration, __ATOMIC_SEQ_CST) !=
+      ulGeneration)
+      return NULL;
+   return pvObject;
+}
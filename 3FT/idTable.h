@@ -0,0 +1,63 @@
+/*--------------------------------------------------------------------*/
+/* idTable.h                                                          */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#ifndef IDTABLE_INCLUDED
+#define IDTABLE_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  An IdTable_T hands out small, dense IDs for objects and maps each ID
+  back to its object with one array index. An ID is a slot number in
+  its low half and that slot's generation in its high half; freeing an
+  ID bumps its slot's generation before the slot is handed out again,
+  so a stale ID never finds the slot's next object. No ID is ever 0.
+  Lookups take no lock, and may run while one thread at a time adds,
+  changes or removes IDs; objects looked up must be kept alive by the
+  caller (as an epoch keeps nodes alive) until it is done with them.
+*/
+typedef struct idTable *IdTable_T;
+
+/*
+  Returns a new, empty table, or NULL if insufficient memory is
+  available.
+*/
+IdTable_T IdTable_new(void);
+
+/* Frees oItTable. The objects in it are not affected. */
+void IdTable_free(IdTable_T oItTable);
+
+/*
+  Ensures that the next ulExtra calls to IdTable_add on oItTable will
+  not need to allocate memory. Returns SUCCESS, or MEMORY_ERROR if
+  memory could not be allocated to complete request.
+*/
+int IdTable_reserve(IdTable_T oItTable, size_t ulExtra);
+
+/*
+  Hands out a free ID of oItTable for pvObject, which must not be NULL.
+  Returns SUCCESS and sets *pulId to the ID, or returns MEMORY_ERROR if
+  memory could not be allocated to complete request.
+*/
+int IdTable_add(IdTable_T oItTable, void *pvObject, size_t *pulId);
+
+/*
+  Makes ID ulId of oItTable, which must be in use, refer to pvObject
+  instead of the object it was handed out for.
+*/
+void IdTable_set(IdTable_T oItTable, size_t ulId, void *pvObject);
+
+/* Frees ID ulId of oItTable, which must be in use. */
+void IdTable_remove(IdTable_T oItTable, size_t ulId);
+
+/*
+  Returns the object that ID ulId of oItTable refers to, or NULL if
+  ulId is not in use, including if it has been freed since it was
+  handed out.
+*/
+void *IdTable_get(IdTable_T oItTable, size_t ulId);
+
+#endif
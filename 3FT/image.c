@@ -0,0 +1,634 @@
+/*--------------------------------------------------------------------*/
+/* image.c                                                            */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+/* open, fstat, fsync, and mmap are POSIX, not ISO C */
+#define _XOPEN_SOURCE 600
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "image.h"
+#include "journal.h"
+#include "path.h"
+
+/*
+  An image holds, in order: a header, one record per node in
+  preorder, the name table, and the contents of every file, back to
+  back in preorder. Numbers are size_t in the saving machine's byte
+  order, which the header records, so that an image from a different
+  kind of machine is refused instead of misread.
+*/
+
+/* The number of bytes of magic at the start of every image */
+#define IMAGE_MAGIC_LENGTH 8
+
+/* Stored in the header to tell the byte order the image was saved in */
+#define IMAGE_ORDER ((size_t) 0x01020304UL)
+
+/* The length recorded for a file whose contents are NULL */
+#define IMAGE_NULL ((size_t) -1)
+
+/* The suffix of the file an image is written to before taking the
+   place of the one it replaces */
+#define IMAGE_TEMP_SUFFIX ".tmp"
+
+/* The number of slots the table of saved names starts with */
+#define IMAGE_INITIAL_SLOTS 64
+
+/* The first bytes of every image; the last one is sizeof(size_t) */
+static const char acImageMagic[IMAGE_MAGIC_LENGTH - 1] =
+   {'F', 'T', 'I', 'M', 'A', 'G', 'E'};
+
+/* The start of an image */
+struct imageHeader {
+   /* acImageMagic, then sizeof(size_t) */
+   char acMagic[IMAGE_MAGIC_LENGTH];
+   /* IMAGE_ORDER */
+   size_t ulOrder;
+   /* the tag given to Image_save */
+   size_t ulTag;
+   /* the number of records */
+   size_t ulNodes;
+   /* the number of bytes in the name table */
+   size_t ulNameBytes;
+   /* the number of bytes of file contents */
+   size_t ulContentBytes;
+};
+
+/* One node of an image */
+struct imageRecord {
+   /* the offset of the node's '\0'-terminated name in the name
+      table */
+   size_t ulName;
+   /* the node's number of children, shifted up one bit, with the
+      low bit set if the node is a file */
+   size_t ulShape;
+   /* the length of a file's contents, or IMAGE_NULL if they are
+      NULL; 0 for a directory */
+   size_t ulLength;
+};
+
+/* One slot of the table from names already saved to their offsets */
+struct imageName {
+   /* the name, or NULL if the slot is empty */
+   Atom_T oAName;
+   /* the offset of the name in the name table */
+   size_t ulOffset;
+};
+
+/* The state of one Image_save */
+struct imageWriter {
+   /* the file being written */
+   FILE *psFile;
+   /* the name table so far, kept until every record is written */
+   char *pcNames;
+   /* the number of bytes used and allocated in pcNames */
+   size_t ulNameBytes;
+   size_t ulNameCapacity;
+   /* an open-addressing table of the names in pcNames, at most half
+      full; all nodes of one tree intern their names in one table, so
+      equal names are the same atom */
+   struct imageName *psSlots;
+   /* the number of slots in psSlots, always a power of two */
+   size_t ulSlots;
+   /* the number of occupied slots */
+   size_t ulUsed;
+   /* the number of records written */
+   size_t ulNodes;
+   /* the number of bytes of contents the records account for */
+   size_t ulContentBytes;
+};
+
+/* A directory being filled by Image_load */
+struct imageFrame {
+   /* the directory */
+   Node_T oNDir;
+   /* the number of its children still to come */
+   size_t ulLeft;
+};
+
+/* Returns the hash of oAName's characters, with the FNV-1a step. */
+static size_t Image_hash(Atom_T oAName) {
+   const char *pcName;
+   size_t ulLength;
+   size_t ulHash = (size_t) 2166136261UL;
+   size_t i;
+
+   assert(oAName != NULL);
+
+   pcName = Atom_getString(oAName);
+   ulLength = Atom_getLength(oAName);
+   for(i = 0; i < ulLength; i++) {
+      ulHash ^= (unsigned char) pcName[i];
+      ulHash *= (size_t) 16777619UL;
+   }
+   return ulHash;
+}
+
+/*
+  Doubles psWriter's table of saved names. Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated to complete request.
+*/
+static int Image_growNames(struct imageWriter *psWriter) {
+   struct imageName *psNew;
+   size_t ulSlots;
+   size_t i, j;
+
+   assert(psWriter != NULL);
+
+   ulSlots = 2 * psWriter->ulSlots;
+   psNew = calloc(ulSlots, sizeof(struct imageName));
+   if(psNew == NULL)
+      return MEMORY_ERROR;
+
+   for(i = 0; i < psWriter->ulSlots; i++) {
+      if(psWriter->psSlots[i].oAName == NULL)
+         continue;
+      for(j = Image_hash(psWriter->psSlots[i].oAName) & (ulSlots - 1);
+          psNew[j].oAName != NULL; j = (j + 1) & (ulSlots - 1))
+         ;
+      psNew[j] = psWriter->psSlots[i];
+   }
+   free(psWriter->psSlots);
+   psWriter->psSlots = psNew;
+   psWriter->ulSlots = ulSlots;
+   return SUCCESS;
+}
+
+/*
+  Sets *pulOffset to the offset of oAName in psWriter's name table,
+  adding it if it is not there yet. Returns SUCCESS, or MEMORY_ERROR
+  if memory could not be allocated to complete request.
+*/
+static int Image_nameOffset(struct imageWriter *psWriter,
+                            Atom_T oAName, size_t *pulOffset) {
+   char *pcNew;
+   size_t ulLength;
+   size_t ulCapacity;
+   size_t i;
+
+   assert(psWriter != NULL);
+   assert(oAName != NULL);
+   assert(pulOffset != NULL);
+
+   for(i = Image_hash(oAName) & (psWriter->ulSlots - 1);
+       psWriter->psSlots[i].oAName != NULL;
+       i = (i + 1) & (psWriter->ulSlots - 1))
+      if(psWriter->psSlots[i].oAName == oAName) {
+         *pulOffset = psWriter->psSlots[i].ulOffset;
+         return SUCCESS;
+      }
+
+   /* a new name: append it, then claim slot i */
+   ulLength = Atom_getLength(oAName) + 1;
+   if(psWriter->ulNameBytes + ulLength > psWriter->ulNameCapacity) {
+      ulCapacity = 2 * psWriter->ulNameCapacity + ulLength;
+      pcNew = realloc(psWriter->pcNames, ulCapacity);
+      if(pcNew == NULL)
+         return MEMORY_ERROR;
+      psWriter->pcNames = pcNew;
+      psWriter->ulNameCapacity = ulCapacity;
+   }
+   memcpy(psWriter->pcNames + psWriter->ulNameBytes,
+          Atom_getString(oAName), ulLength);
+   psWriter->psSlots[i].oAName = oAName;
+   psWriter->psSlots[i].ulOffset = psWriter->ulNameBytes;
+   *pulOffset = psWriter->ulNameBytes;
+   psWriter->ulNameBytes += ulLength;
+
+   if(2 * ++psWriter->ulUsed > psWriter->ulSlots)
+      return Image_growNames(psWriter);
+   return SUCCESS;
+}
+
+/*
+  Writes the records of the subtree rooted at oNNode to psWriter's
+  file in preorder. Returns SUCCESS if successful. Otherwise, returns:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * EOF if writing failed
+*/
+static int Image_writeRecords(struct imageWriter *psWriter,
+                              Node_T oNNode) {
+   struct imageRecord sRecord;
+   Node_T oNChild = NULL;
+   size_t ulChildren;
+   size_t c;
+   int iStatus;
+
+   assert(psWriter != NULL);
+   assert(oNNode != NULL);
+
+   iStatus = Image_nameOffset(psWriter, Node_getName(oNNode),
+                              &sRecord.ulName);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   ulChildren = Node_getNumChildren(oNNode);
+   sRecord.ulShape = ulChildren << 1;
+   sRecord.ulLength = 0;
+   if(Node_getType(oNNode) == NODE_FILE) {
+      sRecord.ulShape |= 1;
+      if(Node_getContent(oNNode) == NULL)
+         sRecord.ulLength = IMAGE_NULL;
+      else {
+         sRecord.ulLength = Node_getContentSize(oNNode);
+         psWriter->ulContentBytes += sRecord.ulLength;
+      }
+   }
+   if(fwrite(&sRecord, sizeof(sRecord), 1, psWriter->psFile) != 1)
+      return EOF;
+   psWriter->ulNodes++;
+
+   for(c = 0; c < ulChildren; c++) {
+      iStatus = Node_getChild(oNNode, c, &oNChild);
+      assert(iStatus == SUCCESS);
+      iStatus = Image_writeRecords(psWriter, oNChild);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+   return SUCCESS;
+}
+
+/*
+  Writes the contents of every file in the subtree rooted at oNNode to
+  psFile in preorder. Returns SUCCESS, or EOF if writing failed.
+*/
+static int Image_writeContents(FILE *psFile, Node_T oNNode) {
+   Node_T oNChild = NULL;
+   size_t ulLength;
+   size_t c;
+   int iStatus;
+
+   assert(psFile != NULL);
+   assert(oNNode != NULL);
+
+   if(Node_getType(oNNode) == NODE_FILE) {
+      ulLength = Node_getContentSize(oNNode);
+      if(Node_getContent(oNNode) != NULL && ulLength != 0 &&
+         fwrite(Node_getContent(oNNode), 1, ulLength, psFile)
+            != ulLength)
+         return EOF;
+      return SUCCESS;
+   }
+
+   for(c = 0; c < Node_getNumChildren(oNNode); c++) {
+      iStatus = Node_getChild(oNNode, c, &oNChild);
+      assert(iStatus == SUCCESS);
+      iStatus = Image_writeContents(psFile, oNChild);
+      if(iStatus != SUCCESS)
+         return iStatus;
+   }
+   return SUCCESS;
+}
+
+/*
+  Writes the image of the tree rooted at oNRoot, or of an empty tree if
+  oNRoot is NULL, with tag ulTag to psFile, and makes sure it reached
+  the disk. Returns SUCCESS if successful. Otherwise, returns:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * EOF if writing failed
+*/
+static int Image_write(Node_T oNRoot, size_t ulTag, FILE *psFile) {
+   struct imageWriter sWriter;
+   struct imageHeader sHeader;
+   int iStatus = SUCCESS;
+
+   assert(psFile != NULL);
+
+   sWriter.psFile = psFile;
+   sWriter.pcNames = NULL;
+   sWriter.ulNameBytes = 0;
+   sWriter.ulNameCapacity = 0;
+   sWriter.ulSlots = IMAGE_INITIAL_SLOTS;
+   sWriter.ulUsed = 0;
+   sWriter.ulNodes = 0;
+   sWriter.ulContentBytes = 0;
+   sWriter.psSlots = calloc(sWriter.ulSlots, sizeof(struct imageName));
+   if(sWriter.psSlots == NULL)
+      return MEMORY_ERROR;
+
+   /* the header's counts are only known at the end, so it is written
+      twice */
+   memset(&sHeader, 0, sizeof(sHeader));
+   memcpy(sHeader.acMagic, acImageMagic, sizeof(acImageMagic));
+   sHeader.acMagic[IMAGE_MAGIC_LENGTH - 1] = (char) sizeof(size_t);
+   sHeader.ulOrder = IMAGE_ORDER;
+   sHeader.ulTag = ulTag;
+   if(fwrite(&sHeader, sizeof(sHeader), 1, psFile) != 1)
+      iStatus = EOF;
+
+   if(iStatus == SUCCESS && oNRoot != NULL)
+      iStatus = Image_writeRecords(&sWriter, oNRoot);
+   if(iStatus == SUCCESS && sWriter.ulNameBytes != 0 &&
+      fwrite(sWriter.pcNames, 1, sWriter.ulNameBytes, psFile)
+         != sWriter.ulNameBytes)
+      iStatus = EOF;
+   if(iStatus == SUCCESS && oNRoot != NULL)
+      iStatus = Image_writeContents(psFile, oNRoot);
+
+   if(iStatus == SUCCESS) {
+      sHeader.ulNodes = sWriter.ulNodes;
+      sHeader.ulNameBytes = sWriter.ulNameBytes;
+      sHeader.ulContentBytes = sWriter.ulContentBytes;
+      if(fseek(psFile, 0L, SEEK_SET) != 0 ||
+         fwrite(&sHeader, sizeof(sHeader), 1, psFile) != 1 ||
+         fflush(psFile) != 0 || fsync(fileno(psFile)) != 0)
+         iStatus = EOF;
+   }
+
+   free(sWriter.pcNames);
+   free(sWriter.psSlots);
+   return iStatus;
+}
+
+int Image_save(Node_T oNRoot, size_t ulTag, const char *pcFile) {
+   FILE *psFile;
+   char *pcTemp;
+   int iStatus;
+
+   assert(pcFile != NULL);
+
+   /* the image is written beside pcFile and then renamed over it, so
+      that pcFile always holds a whole image, and a tree still mapped
+      from the old one keeps it */
+   pcTemp = malloc(strlen(pcFile) + sizeof(IMAGE_TEMP_SUFFIX));
+   if(pcTemp == NULL)
+      return MEMORY_ERROR;
+   strcpy(pcTemp, pcFile);
+   strcat(pcTemp, IMAGE_TEMP_SUFFIX);
+
+   psFile = fopen(pcTemp, "wb");
+   if(psFile == NULL) {
+      free(pcTemp);
+      return EOF;
+   }
+   iStatus = Image_write(oNRoot, ulTag, psFile);
+   if(fclose(psFile) != 0 && iStatus == SUCCESS)
+      iStatus = EOF;
+   if(iStatus == SUCCESS && rename(pcTemp, pcFile) != 0)
+      iStatus = EOF;
+   if(iStatus != SUCCESS)
+      (void) remove(pcTemp);
+   /* the rename lives in the directory, which has to reach the disk
+      too before the image can be counted on after a crash */
+   else
+      iStatus = Journal_syncDirectory(pcFile);
+
+   free(pcTemp);
+   return iStatus;
+}
+
+/* Unmaps the ulLength-byte mapping at pvBlock made by Image_load. */
+static void Image_unmap(void *pvBlock, size_t ulLength) {
+   assert(pvBlock != NULL);
+
+   (void) munmap(pvBlock, ulLength);
+}
+
+/*
+  Returns TRUE if the ulSize-byte image at pcImage has a header that
+  this machine can read and sizes that add up to ulSize, and FALSE if
+  not.
+*/
+static boolean Image_isValid(const char *pcImage, size_t ulSize) {
+   const struct imageHeader *psHeader;
+   size_t ulRest;
+
+   assert(pcImage != NULL);
+
+   if(ulSize < sizeof(struct imageHeader))
+      return FALSE;
+   psHeader = (const struct imageHeader *) pcImage;
+   if(memcmp(psHeader->acMagic, acImageMagic, sizeof(acImageMagic)) ||
+      psHeader->acMagic[IMAGE_MAGIC_LENGTH - 1] !=
+         (char) sizeof(size_t) ||
+      psHeader->ulOrder != IMAGE_ORDER)
+      return FALSE;
+
+   /* compare by division first, so that no size can overflow */
+   ulRest = ulSize - sizeof(struct imageHeader);
+   if(psHeader->ulNodes > ulRest / sizeof(struct imageRecord))
+      return FALSE;
+   ulRest -= psHeader->ulNodes * sizeof(struct imageRecord);
+   if(psHeader->ulNameBytes > ulRest ||
+      psHeader->ulContentBytes != ulRest - psHeader->ulNameBytes)
+      return FALSE;
+
+   /* every name must end inside the table */
+   if(psHeader->ulNameBytes != 0 &&
+      pcImage[ulSize - psHeader->ulContentBytes - 1] != '\0')
+      return FALSE;
+   return (boolean) (psHeader->ulNodes != 0 ||
+                     psHeader->ulNameBytes == 0);
+}
+
+/*
+  Builds the tree in the valid ulSize-byte image at pcImage, whose
+  header says it has at least one node. Returns an int SUCCESS status
+  and sets *poNRoot to the new root if successful. Otherwise, frees
+  whatever it built, sets *poNRoot to NULL, and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * EOF if the records do not describe a well-formed tree
+*/
+static int Image_build(char *pcImage, size_t ulSize, Node_T *poNRoot) {
+   const struct imageHeader *psHeader;
+   const struct imageRecord *psRecords;
+   const char *pcNames;
+   char *pcContents;
+   struct imageFrame *psStack;
+   struct imageFrame *psNewStack;
+   size_t ulDepth = 0;
+   size_t ulStackSize = 16;
+   size_t ulOffset = 0;
+   size_t ulChildren;
+   size_t ulLength;
+   size_t i;
+   Path_T oPPath = NULL;
+   Node_T oNRoot = NULL;
+   Node_T oNNew = NULL;
+   NodeType nodeType;
+   int iStatus;
+
+   assert(pcImage != NULL);
+   assert(poNRoot != NULL);
+
+   psHeader = (const struct imageHeader *) pcImage;
+   psRecords = (const struct imageRecord *)
+      (pcImage + sizeof(struct imageHeader));
+   pcNames = (const char *) (psRecords + psHeader->ulNodes);
+   pcContents = pcImage + (ulSize - psHeader->ulContentBytes);
+   *poNRoot = NULL;
+
+   psStack = malloc(ulStackSize * sizeof(struct imageFrame));
+   if(psStack == NULL)
+      return MEMORY_ERROR;
+
+   /* the first record is the root, which must be a directory */
+   if(psRecords[0].ulName >= psHeader->ulNameBytes ||
+      (psRecords[0].ulShape & 1)) {
+      free(psStack);
+      return EOF;
+   }
+   iStatus = Path_new(pcNames + psRecords[0].ulName, &oPPath);
+   if(iStatus == SUCCESS) {
+      if(Path_getDepth(oPPath) == 1)
+         iStatus = Node_new(oPPath, NODE_DIR, NULL, &oNRoot);
+      else
+         iStatus = BAD_PATH;
+      Path_free(oPPath);
+   }
+   if(iStatus != SUCCESS) {
+      free(psStack);
+      return (iStatus == MEMORY_ERROR) ? MEMORY_ERROR : EOF;
+   }
+   psStack[0].oNDir = oNRoot;
+   psStack[0].ulLeft = psRecords[0].ulShape >> 1;
+   ulDepth = 1;
+
+   /* every later record is the next child of the deepest directory
+      that still expects one */
+   for(i = 1; i < psHeader->ulNodes; i++) {
+      while(ulDepth > 0 && psStack[ulDepth - 1].ulLeft == 0)
+         ulDepth--;
+      if(ulDepth == 0 || psRecords[i].ulName >= psHeader->ulNameBytes) {
+         iStatus = EOF;
+         break;
+      }
+      psStack[ulDepth - 1].ulLeft--;
+
+      ulChildren = psRecords[i].ulShape >> 1;
+      nodeType = (psRecords[i].ulShape & 1) ? NODE_FILE : NODE_DIR;
+      if(nodeType == NODE_FILE && ulChildren != 0) {
+         iStatus = EOF;
+         break;
+      }
+      iStatus = Node_newLast(psStack[ulDepth - 1].oNDir,
+                             pcNames + psRecords[i].ulName, nodeType,
+                             &oNNew);
+      if(iStatus != SUCCESS) {
+         if(iStatus != MEMORY_ERROR)
+            iStatus = EOF;
+         break;
+      }
+
+      if(nodeType == NODE_FILE) {
+         ulLength = psRecords[i].ulLength;
+         if(ulLength == IMAGE_NULL)
+            Node_setContents(oNNew, NULL, 0);
+         else if(ulLength > psHeader->ulContentBytes - ulOffset) {
+            iStatus = EOF;
+            break;
+         }
+         else {
+            Node_setContents(oNNew, pcContents + ulOffset, ulLength);
+            ulOffset += ulLength;
+         }
+      }
+      else if(ulChildren != 0) {
+         if(ulDepth == ulStackSize) {
+            psNewStack = realloc(psStack, 2 * ulStackSize *
+                                    sizeof(struct imageFrame));
+            if(psNewStack == NULL) {
+               iStatus = MEMORY_ERROR;
+               break;
+            }
+            psStack = psNewStack;
+            ulStackSize *= 2;
+         }
+         psStack[ulDepth].oNDir = oNNew;
+         psStack[ulDepth].ulLeft = ulChildren;
+         ulDepth++;
+      }
+   }
+
+   /* every directory must have got all its children, and every byte
+      of contents must belong to some file */
+   if(iStatus == SUCCESS) {
+      while(ulDepth > 0 && psStack[ulDepth - 1].ulLeft == 0)
+         ulDepth--;
+      if(ulDepth != 0 || ulOffset != psHeader->ulContentBytes)
+         iStatus = EOF;
+   }
+
+   free(psStack);
+   if(iStatus != SUCCESS) {
+      (void) Node_free(oNRoot);
+      return iStatus;
+   }
+   *poNRoot = oNRoot;
+   return SUCCESS;
+}
+
+int Image_load(const char *pcFile, Node_T *poNRoot, size_t *pulNodes,
+               size_t *pulTag) {
+   struct stat sStat;
+   void *pvImage;
+   size_t ulSize;
+   size_t ulNodes;
+   size_t ulTag;
+   int iFd;
+   int iStatus;
+
+   assert(pcFile != NULL);
+   assert(poNRoot != NULL);
+   assert(pulNodes != NULL);
+   assert(pulTag != NULL);
+
+   *poNRoot = NULL;
+
+   iFd = open(pcFile, O_RDONLY);
+   if(iFd < 0)
+      return (errno == ENOENT) ? NO_SUCH_PATH : EOF;
+   if(fstat(iFd, &sStat) != 0 || sStat.st_size <= 0 ||
+      (size_t) sStat.st_size < sizeof(struct imageHeader)) {
+      (void) close(iFd);
+      return EOF;
+   }
+   ulSize = (size_t) sStat.st_size;
+
+   /* a private mapping lets clients change contents in place without
+      touching the file */
+   pvImage = mmap(NULL, ulSize, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                  iFd, 0);
+   (void) close(iFd);
+   if(pvImage == MAP_FAILED)
+      return EOF;
+
+   if(!Image_isValid(pvImage, ulSize)) {
+      (void) munmap(pvImage, ulSize);
+      return EOF;
+   }
+   ulNodes = ((const struct imageHeader *) pvImage)->ulNodes;
+   ulTag = ((const struct imageHeader *) pvImage)->ulTag;
+   if(ulNodes == 0) {
+      (void) munmap(pvImage, ulSize);
+      *pulNodes = 0;
+      *pulTag = ulTag;
+      return SUCCESS;
+   }
+
+   iStatus = Image_build(pvImage, ulSize, poNRoot);
+   if(iStatus != SUCCESS) {
+      (void) munmap(pvImage, ulSize);
+      return iStatus;
+   }
+   if(Node_addBacking(*poNRoot, pvImage, ulSize, Image_unmap)
+         != SUCCESS) {
+      (void) Node_free(*poNRoot);
+      *poNRoot = NULL;
+      (void) munmap(pvImage, ulSize);
+      return MEMORY_ERROR;
+   }
+   *pulNodes = ulNodes;
+   *pulTag = ulTag;
+   return SUCCESS;
+}
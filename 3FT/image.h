@@ -0,0 +1,55 @@
+/*--------------------------------------------------------------------*/
+/* image.h                                                            */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#ifndef IMAGE_INCLUDED
+#define IMAGE_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "nodeFT.h"
+
+/*
+  An image is a tree of nodes saved to a file in one compact binary
+  block: a record per node in preorder, each naming its entry in a
+  table of distinct names and giving its number of children, followed
+  by every file's contents. Loading maps the file into memory and
+  rebuilds the tree in one linear pass, without parsing any path;
+  loaded files' contents are served straight from the mapping.
+*/
+
+/*
+  Writes the tree rooted at oNRoot, or an empty tree if oNRoot is NULL,
+  to the file pcFile as an image tagged with ulTag, replacing anything
+  there before. The image is written to pcFile with ".tmp" appended,
+  synced to the disk, and only then renamed to pcFile, so pcFile holds
+  either the whole old image or the whole new one, and a tree mapped
+  from the old one keeps it. The directory is synced after the rename,
+  so the new image survives a crash once this returns. No thread may
+  change the tree meanwhile. Returns SUCCESS if successful. Otherwise
+  returns:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * EOF if pcFile could not be written, in which case it is left as
+    it was, or if the directory could not be synced
+*/
+int Image_save(Node_T oNRoot, size_t ulTag, const char *pcFile);
+
+/*
+  Builds a new tree from the image in the file pcFile. Returns an int
+  SUCCESS status and sets *poNRoot to the new tree's root (NULL if
+  the image is of an empty tree), *pulNodes to its number of nodes,
+  and *pulTag to the image's tag if successful. Every file's contents
+  point into pcFile's mapping, which is private to the new tree and
+  lives as long as it does (see Node_addBacking), so they may be
+  changed in place but never freed.
+  Otherwise, sets *poNRoot to NULL and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * NO_SUCH_PATH if pcFile does not exist
+  * EOF if pcFile could not be read, or is not an image saved by
+        Image_save on the same kind of machine
+*/
+int Image_load(const char *pcFile, Node_T *poNRoot, size_t *pulNodes,
+               size_t *pulTag);
+
+#endif
@@ -0,0 +1,710 @@
+/*--------------------------------------------------------------------*/
+/* journal.c                                                          */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+/* open, fdatasync, ftruncate, and pthreads are POSIX, not ISO C */
+#define _XOPEN_SOURCE 600
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+/*
+  A journal file holds a header and then records back to back. Each
+  record is a struct journalRecord, the path with its '\0', and the
+  contents, if any, padded with zeros to a multiple of sizeof(size_t)
+  so that the next record is aligned wherever the file is read to.
+  Numbers are size_t in the writing machine's byte order, which the
+  header records.
+*/
+
+/* The number of bytes of magic at the start of every journal */
+#define JOURNAL_MAGIC_LENGTH 8
+
+/* Stored in the header to tell the byte order the journal is in */
+#define JOURNAL_ORDER ((size_t) 0x01020304UL)
+
+/* The number of bytes a journal's buffers start with */
+#define JOURNAL_INITIAL_BYTES 4096
+
+/* The first bytes of every journal; the last one is sizeof(size_t) */
+static const char acJournalMagic[JOURNAL_MAGIC_LENGTH - 1] =
+   {'F', 'T', 'J', 'O', 'U', 'R', 'N'};
+
+/* The start of a journal file */
+struct journalHeader {
+   /* acJournalMagic, then sizeof(size_t) */
+   char acMagic[JOURNAL_MAGIC_LENGTH];
+   /* JOURNAL_ORDER */
+   size_t ulOrder;
+};
+
+/* One change */
+struct journalRecord {
+   /* the record's sequence number */
+   size_t ulSeq;
+   /* the JournalOp, shifted up one bit, with the low bit set if the
+      contents are NULL */
+   size_t ulKind;
+   /* the number of bytes in the path, including its '\0' */
+   size_t ulPathBytes;
+   /* the length of the contents, which follow the path unless they
+      are NULL; 0 for a change that takes no contents */
+   size_t ulLength;
+   /* the checksum of the record, with this field 0, and all that
+      follows it */
+   size_t ulCheck;
+};
+
+/* A growable run of encoded records */
+struct journalBuffer {
+   /* the bytes, or NULL while none are allocated */
+   char *pcBytes;
+   /* the number of bytes used and allocated */
+   size_t ulUsed;
+   size_t ulCapacity;
+};
+
+struct journal {
+   /* the file, opened for appending */
+   int iFd;
+   /* the file's name */
+   char *pcFile;
+   /* the number of records to write at once */
+   size_t ulBatch;
+   /* the lock on every field below */
+   pthread_mutex_t sMutex;
+   /* signalled whenever a writer finishes a batch */
+   pthread_cond_t sWritten;
+   /* the records appended since the last batch was taken, and the
+      buffer that the batch being written, if any, is in */
+   struct journalBuffer sFill;
+   struct journalBuffer sSpare;
+   /* the number of records in sFill */
+   size_t ulFillRecords;
+   /* the number of the last record appended, and of the last one
+      known to be on the disk */
+   size_t ulLastSeq;
+   size_t ulWrittenSeq;
+   /* TRUE while a thread is writing a batch out of sSpare */
+   boolean bWriting;
+   /* SUCCESS, or the first error, after which nothing more is
+      recorded */
+   int iError;
+};
+
+/* Returns the number of bytes of padding to add after ulLength. */
+static size_t Journal_padding(size_t ulLength) {
+   return (sizeof(size_t) - ulLength % sizeof(size_t)) %
+      sizeof(size_t);
+}
+
+/*
+  Returns ulHash updated with the ulLength bytes at pvBytes, with the
+  FNV-1a step.
+*/
+static size_t Journal_checksum(size_t ulHash, const void *pvBytes,
+                               size_t ulLength) {
+   const unsigned char *pucBytes = pvBytes;
+   size_t i;
+
+   for(i = 0; i < ulLength; i++) {
+      ulHash ^= pucBytes[i];
+      ulHash *= (size_t) 16777619UL;
+   }
+   return ulHash;
+}
+
+/* Returns TRUE if eOp is a change that takes contents. */
+static boolean Journal_hasContents(JournalOp eOp) {
+   return (boolean) (eOp == JOURNAL_INSERT_FILE ||
+                     eOp == JOURNAL_REPLACE);
+}
+
+/*
+  Writes all ulLength bytes at pcBytes to iFd. Returns SUCCESS, or EOF
+  if writing failed.
+*/
+static int Journal_writeAll(int iFd, const char *pcBytes,
+                            size_t ulLength) {
+   ssize_t lWritten;
+
+   assert(pcBytes != NULL || ulLength == 0);
+
+   while(ulLength > 0) {
+      lWritten = write(iFd, pcBytes, ulLength);
+      if(lWritten < 0) {
+         if(errno == EINTR)
+            continue;
+         return EOF;
+      }
+      pcBytes += lWritten;
+      ulLength -= (size_t) lWritten;
+   }
+   return SUCCESS;
+}
+
+/*
+  Writes a header to the empty file iFd and syncs it. Returns SUCCESS,
+  or EOF if writing failed.
+*/
+static int Journal_writeHeader(int iFd) {
+   struct journalHeader sHeader;
+
+   memset(&sHeader, 0, sizeof(sHeader));
+   memcpy(sHeader.acMagic, acJournalMagic, sizeof(acJournalMagic));
+   sHeader.acMagic[JOURNAL_MAGIC_LENGTH - 1] = (char) sizeof(size_t);
+   sHeader.ulOrder = JOURNAL_ORDER;
+   if(Journal_writeAll(iFd, (const char *) &sHeader, sizeof(sHeader))
+         != SUCCESS ||
+      fdatasync(iFd) != 0)
+      return EOF;
+   return SUCCESS;
+}
+
+/*
+  Opens the journal file pcFile for appending, creating it with a
+  header if it does not exist or is empty. Returns the file
+  descriptor, or -1 if the file could not be opened or written.
+*/
+static int Journal_openFile(const char *pcFile) {
+   struct stat sStat;
+   int iFd;
+
+   assert(pcFile != NULL);
+
+   iFd = open(pcFile, O_WRONLY | O_CREAT | O_APPEND, 0666);
+   if(iFd < 0)
+      return -1;
+   if(fstat(iFd, &sStat) != 0 ||
+      (sStat.st_size == 0 && Journal_writeHeader(iFd) != SUCCESS)) {
+      (void) close(iFd);
+      return -1;
+   }
+   return iFd;
+}
+
+int Journal_open(const char *pcFile, size_t ulNextSeq, size_t ulBatch,
+                 Journal_T *poJJournal) {
+   Journal_T oJJournal;
+
+   assert(pcFile != NULL);
+   assert(ulNextSeq > 0);
+   assert(ulBatch > 0);
+   assert(poJJournal != NULL);
+
+   *poJJournal = NULL;
+
+   oJJournal = calloc(1, sizeof(struct journal));
+   if(oJJournal == NULL)
+      return MEMORY_ERROR;
+   oJJournal->pcFile = malloc(strlen(pcFile) + 1);
+   if(oJJournal->pcFile == NULL) {
+      free(oJJournal);
+      return MEMORY_ERROR;
+   }
+   strcpy(oJJournal->pcFile, pcFile);
+   if(pthread_mutex_init(&oJJournal->sMutex, NULL) != 0) {
+      free(oJJournal->pcFile);
+      free(oJJournal);
+      return MEMORY_ERROR;
+   }
+   if(pthread_cond_init(&oJJournal->sWritten, NULL) != 0) {
+      (void) pthread_mutex_destroy(&oJJournal->sMutex);
+      free(oJJournal->pcFile);
+      free(oJJournal);
+      return MEMORY_ERROR;
+   }
+
+   oJJournal->iFd = Journal_openFile(pcFile);
+   if(oJJournal->iFd < 0) {
+      (void) pthread_cond_destroy(&oJJournal->sWritten);
+      (void) pthread_mutex_destroy(&oJJournal->sMutex);
+      free(oJJournal->pcFile);
+      free(oJJournal);
+      return EOF;
+   }
+   oJJournal->ulBatch = ulBatch;
+   oJJournal->ulLastSeq = ulNextSeq - 1;
+   oJJournal->ulWrittenSeq = ulNextSeq - 1;
+   oJJournal->bWriting = FALSE;
+   oJJournal->iError = SUCCESS;
+   *poJJournal = oJJournal;
+   return SUCCESS;
+}
+
+/*
+  Makes room for ulLength more bytes in psBuffer. Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated to complete request.
+*/
+static int Journal_reserve(struct journalBuffer *psBuffer,
+                           size_t ulLength) {
+   char *pcNew;
+   size_t ulCapacity;
+
+   assert(psBuffer != NULL);
+
+   if(ulLength <= psBuffer->ulCapacity - psBuffer->ulUsed)
+      return SUCCESS;
+   ulCapacity = psBuffer->ulCapacity;
+   if(ulCapacity == 0)
+      ulCapacity = JOURNAL_INITIAL_BYTES;
+   while(ulCapacity - psBuffer->ulUsed < ulLength) {
+      if(ulCapacity > ((size_t) -1) / 2)
+         return MEMORY_ERROR;
+      ulCapacity *= 2;
+   }
+   pcNew = realloc(psBuffer->pcBytes, ulCapacity);
+   if(pcNew == NULL)
+      return MEMORY_ERROR;
+   psBuffer->pcBytes = pcNew;
+   psBuffer->ulCapacity = ulCapacity;
+   return SUCCESS;
+}
+
+void Journal_append(Journal_T oJJournal, JournalOp eOp,
+                    const char *pcPath, const void *pvContents,
+                    size_t ulLength) {
+   struct journalRecord sRecord;
+   struct journalBuffer *psFill;
+   size_t ulPathBytes;
+   size_t ulStored;
+   size_t ulTotal;
+   size_t ulStart;
+   size_t ulCheck;
+
+   assert(oJJournal != NULL);
+   assert(pcPath != NULL);
+
+   if(!Journal_hasContents(eOp)) {
+      pvContents = NULL;
+      ulLength = 0;
+   }
+   ulPathBytes = strlen(pcPath) + 1;
+   ulStored = (pvContents == NULL) ? 0 : ulLength;
+   ulTotal = sizeof(sRecord) + ulPathBytes;
+
+   (void) pthread_mutex_lock(&oJJournal->sMutex);
+   psFill = &oJJournal->sFill;
+   if(oJJournal->iError != SUCCESS ||
+      ulStored > ((size_t) -1) - sizeof(size_t) - ulTotal ||
+      Journal_reserve(psFill, ulTotal + ulStored +
+                         Journal_padding(ulTotal + ulStored))
+         != SUCCESS) {
+      if(oJJournal->iError == SUCCESS)
+         oJJournal->iError = MEMORY_ERROR;
+      (void) pthread_mutex_unlock(&oJJournal->sMutex);
+      return;
+   }
+
+   ulTotal += ulStored;
+   sRecord.ulSeq = ++oJJournal->ulLastSeq;
+   sRecord.ulKind = ((size_t) eOp << 1) |
+      (size_t) (Journal_hasContents(eOp) && pvContents == NULL);
+   sRecord.ulPathBytes = ulPathBytes;
+   sRecord.ulLength = ulLength;
+   sRecord.ulCheck = 0;
+
+   ulStart = psFill->ulUsed;
+   memcpy(psFill->pcBytes + ulStart, &sRecord, sizeof(sRecord));
+   memcpy(psFill->pcBytes + ulStart + sizeof(sRecord), pcPath,
+          ulPathBytes);
+   if(ulStored != 0)
+      memcpy(psFill->pcBytes + ulStart + sizeof(sRecord) + ulPathBytes,
+             pvContents, ulStored);
+   memset(psFill->pcBytes + ulStart + ulTotal, 0,
+          Journal_padding(ulTotal));
+   ulTotal += Journal_padding(ulTotal);
+
+   ulCheck = Journal_checksum((size_t) 2166136261UL,
+                              psFill->pcBytes + ulStart, ulTotal);
+   memcpy(psFill->pcBytes + ulStart +
+             offsetof(struct journalRecord, ulCheck),
+          &ulCheck, sizeof(ulCheck));
+   psFill->ulUsed += ulTotal;
+   oJJournal->ulFillRecords++;
+   (void) pthread_mutex_unlock(&oJJournal->sMutex);
+}
+
+/*
+  Writes and syncs every record in oJJournal's fill buffer, for a
+  caller that holds its lock while no other thread is writing. Drops
+  the lock during the I/O, so that other threads may append meanwhile,
+  and takes it again before returning.
+*/
+static void Journal_writeBatch(Journal_T oJJournal) {
+   struct journalBuffer sBatch;
+   size_t ulBatchSeq;
+   int iStatus;
+
+   assert(oJJournal != NULL);
+   assert(!oJJournal->bWriting);
+
+   /* the batch moves to the spare buffer, which is empty, and appends
+      go on into the old spare */
+   sBatch = oJJournal->sFill;
+   oJJournal->sFill = oJJournal->sSpare;
+   oJJournal->sFill.ulUsed = 0;
+   oJJournal->sSpare = sBatch;
+   oJJournal->ulFillRecords = 0;
+   ulBatchSeq = oJJournal->ulLastSeq;
+   oJJournal->bWriting = TRUE;
+   (void) pthread_mutex_unlock(&oJJournal->sMutex);
+
+   iStatus = Journal_writeAll(oJJournal->iFd, sBatch.pcBytes,
+                              sBatch.ulUsed);
+   if(iStatus == SUCCESS && fdatasync(oJJournal->iFd) != 0)
+      iStatus = EOF;
+
+   (void) pthread_mutex_lock(&oJJournal->sMutex);
+   oJJournal->bWriting = FALSE;
+   if(iStatus == SUCCESS)
+      oJJournal->ulWrittenSeq = ulBatchSeq;
+   else if(oJJournal->iError == SUCCESS)
+      oJJournal->iError = EOF;
+   (void) pthread_cond_broadcast(&oJJournal->sWritten);
+}
+
+void Journal_commit(Journal_T oJJournal) {
+   assert(oJJournal != NULL);
+
+   /* whoever fills a batch writes it, and keeps writing while the
+      threads that appended meanwhile fill more */
+   (void) pthread_mutex_lock(&oJJournal->sMutex);
+   while(!oJJournal->bWriting && oJJournal->iError != EOF &&
+         oJJournal->ulFillRecords >= oJJournal->ulBatch)
+      Journal_writeBatch(oJJournal);
+   (void) pthread_mutex_unlock(&oJJournal->sMutex);
+}
+
+/*
+  Syncs oJJournal as Journal_sync does, for a caller that holds its
+  lock.
+*/
+static int Journal_syncLocked(Journal_T oJJournal) {
+   size_t ulTarget;
+
+   assert(oJJournal != NULL);
+
+   ulTarget = oJJournal->ulLastSeq;
+   while(oJJournal->ulWrittenSeq < ulTarget) {
+      if(oJJournal->bWriting)
+         (void) pthread_cond_wait(&oJJournal->sWritten,
+                                  &oJJournal->sMutex);
+      else if(oJJournal->iError == EOF)
+         break;
+      else
+         Journal_writeBatch(oJJournal);
+   }
+   return oJJournal->iError;
+}
+
+int Journal_sync(Journal_T oJJournal) {
+   int iStatus;
+
+   assert(oJJournal != NULL);
+
+   (void) pthread_mutex_lock(&oJJournal->sMutex);
+   iStatus = Journal_syncLocked(oJJournal);
+   (void) pthread_mutex_unlock(&oJJournal->sMutex);
+   return iStatus;
+}
+
+size_t Journal_getLastSeq(Journal_T oJJournal) {
+   size_t ulLastSeq;
+
+   assert(oJJournal != NULL);
+
+   (void) pthread_mutex_lock(&oJJournal->sMutex);
+   ulLastSeq = oJJournal->ulLastSeq;
+   (void) pthread_mutex_unlock(&oJJournal->sMutex);
+   return ulLastSeq;
+}
+
+int Journal_rotate(Journal_T oJJournal, const char *pcOld) {
+   int iFd;
+   int iStatus;
+
+   assert(oJJournal != NULL);
+   assert(pcOld != NULL);
+
+   (void) pthread_mutex_lock(&oJJournal->sMutex);
+   iStatus = Journal_syncLocked(oJJournal);
+   if(iStatus == SUCCESS && rename(oJJournal->pcFile, pcOld) != 0)
+      iStatus = EOF;
+   if(iStatus == SUCCESS) {
+      iFd = Journal_openFile(oJJournal->pcFile);
+      if(iFd < 0) {
+         (void) rename(pcOld, oJJournal->pcFile);
+         iStatus = EOF;
+      }
+      else {
+         (void) close(oJJournal->iFd);
+         oJJournal->iFd = iFd;
+      }
+   }
+   (void) pthread_mutex_unlock(&oJJournal->sMutex);
+
+   if(iStatus == SUCCESS)
+      iStatus = Journal_syncDirectory(oJJournal->pcFile);
+   return iStatus;
+}
+
+int Journal_close(Journal_T oJJournal) {
+   int iStatus;
+
+   if(oJJournal == NULL)
+      return SUCCESS;
+
+   iStatus = Journal_sync(oJJournal);
+   if(close(oJJournal->iFd) != 0 && iStatus == SUCCESS)
+      iStatus = EOF;
+   (void) pthread_cond_destroy(&oJJournal->sWritten);
+   (void) pthread_mutex_destroy(&oJJournal->sMutex);
+   free(oJJournal->sFill.pcBytes);
+   free(oJJournal->sSpare.pcBytes);
+   free(oJJournal->pcFile);
+   free(oJJournal);
+   return iStatus;
+}
+
+/*
+  Returns the length of the whole, well-formed record at the start of
+  the ulLeft bytes at pcRecord, numbered after ulPrevSeq, or 0 if
+  there is none.
+*/
+static size_t Journal_recordLength(const char *pcRecord, size_t ulLeft,
+                                   size_t ulPrevSeq) {
+   const struct journalRecord *psRecord;
+   struct journalRecord sCopy;
+   size_t ulStored;
+   size_t ulTotal;
+   size_t ulCheck;
+   JournalOp eOp;
+
+   assert(pcRecord != NULL);
+
+   /* compare against what is left first, so that no size can
+      overflow */
+   if(ulLeft < sizeof(struct journalRecord))
+      return 0;
+   psRecord = (const struct journalRecord *) pcRecord;
+   ulLeft -= sizeof(struct journalRecord);
+   if(psRecord->ulSeq <= ulPrevSeq ||
+      (psRecord->ulKind >> 1) > (size_t) JOURNAL_REPLACE ||
+      psRecord->ulPathBytes < 2 || psRecord->ulPathBytes > ulLeft)
+      return 0;
+   eOp = (JournalOp) (psRecord->ulKind >> 1);
+   if(!Journal_hasContents(eOp) &&
+      (psRecord->ulLength != 0 || (psRecord->ulKind & 1)))
+      return 0;
+   ulLeft -= psRecord->ulPathBytes;
+   ulStored = (psRecord->ulKind & 1) ? 0 : psRecord->ulLength;
+   if(ulStored > ulLeft)
+      return 0;
+   ulLeft -= ulStored;
+   ulTotal = sizeof(struct journalRecord) + psRecord->ulPathBytes +
+      ulStored;
+   if(Journal_padding(ulTotal) > ulLeft)
+      return 0;
+   ulTotal += Journal_padding(ulTotal);
+   if(pcRecord[sizeof(struct journalRecord) + psRecord->ulPathBytes - 1]
+         != '\0')
+      return 0;
+
+   sCopy = *psRecord;
+   sCopy.ulCheck = 0;
+   ulCheck = Journal_checksum((size_t) 2166136261UL, &sCopy,
+                              sizeof(sCopy));
+   ulCheck = Journal_checksum(ulCheck,
+                              pcRecord + sizeof(struct journalRecord),
+                              ulTotal - sizeof(struct journalRecord));
+   return (ulCheck == psRecord->ulCheck) ? ulTotal : 0;
+}
+
+/*
+  Reads all ulSize bytes of iFd into a new block. Returns an int
+  SUCCESS status and sets *ppcBlock to the block if successful.
+  Otherwise, sets *ppcBlock to NULL and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * EOF if reading failed
+*/
+static int Journal_readAll(int iFd, size_t ulSize, char **ppcBlock) {
+   char *pcBlock;
+   size_t ulRead = 0;
+   ssize_t lRead;
+
+   assert(ppcBlock != NULL);
+
+   *ppcBlock = NULL;
+   pcBlock = malloc(ulSize);
+   if(pcBlock == NULL)
+      return MEMORY_ERROR;
+   while(ulRead < ulSize) {
+      lRead = read(iFd, pcBlock + ulRead, ulSize - ulRead);
+      if(lRead < 0 && errno == EINTR)
+         continue;
+      if(lRead <= 0) {
+         free(pcBlock);
+         return EOF;
+      }
+      ulRead += (size_t) lRead;
+   }
+   *ppcBlock = pcBlock;
+   return SUCCESS;
+}
+
+int Journal_replay(const char *pcFile, size_t ulAfter,
+                   int (*pfApply)(JournalOp eOp, const char *pcPath,
+                                  void *pvContents, size_t ulLength,
+                                  void *pvExtra),
+                   void *pvExtra, size_t *pulLast, void **ppvBlock,
+                   size_t *pulBlock) {
+   const struct journalHeader *psHeader;
+   const struct journalRecord *psRecord;
+   struct stat sStat;
+   char *pcBlock = NULL;
+   char *pcContents;
+   boolean bUsed = FALSE;
+   size_t ulSize;
+   size_t ulOffset;
+   size_t ulRecord;
+   size_t ulPrevSeq = 0;
+   int iFd;
+   int iStatus = SUCCESS;
+
+   assert(pcFile != NULL);
+   assert(pfApply != NULL);
+   assert(pulLast != NULL);
+   assert(ppvBlock != NULL);
+   assert(pulBlock != NULL);
+
+   *ppvBlock = NULL;
+   *pulBlock = 0;
+   *pulLast = ulAfter;
+
+   iFd = open(pcFile, O_RDWR);
+   if(iFd < 0)
+      return (errno == ENOENT) ? NO_SUCH_PATH : EOF;
+   if(fstat(iFd, &sStat) != 0 || sStat.st_size < 0) {
+      (void) close(iFd);
+      return EOF;
+   }
+   ulSize = (size_t) sStat.st_size;
+
+   /* a file cut short before its header was whole holds nothing */
+   if(ulSize < sizeof(struct journalHeader)) {
+      if(ulSize != 0 && ftruncate(iFd, 0) != 0)
+         iStatus = EOF;
+      (void) close(iFd);
+      return iStatus;
+   }
+
+   iStatus = Journal_readAll(iFd, ulSize, &pcBlock);
+   if(iStatus != SUCCESS) {
+      (void) close(iFd);
+      return iStatus;
+   }
+   psHeader = (const struct journalHeader *) pcBlock;
+   if(memcmp(psHeader->acMagic, acJournalMagic,
+             sizeof(acJournalMagic)) ||
+      psHeader->acMagic[JOURNAL_MAGIC_LENGTH - 1] !=
+         (char) sizeof(size_t) ||
+      psHeader->ulOrder != JOURNAL_ORDER) {
+      free(pcBlock);
+      (void) close(iFd);
+      return EOF;
+   }
+
+   for(ulOffset = sizeof(struct journalHeader); ulOffset < ulSize;
+       ulOffset += ulRecord) {
+      ulRecord = Journal_recordLength(pcBlock + ulOffset,
+                                      ulSize - ulOffset, ulPrevSeq);
+      if(ulRecord == 0)
+         break;
+      psRecord = (const struct journalRecord *) (pcBlock + ulOffset);
+      ulPrevSeq = psRecord->ulSeq;
+      if(ulPrevSeq <= ulAfter)
+         continue;
+
+      *pulLast = ulPrevSeq;
+      pcContents = NULL;
+      if(Journal_hasContents((JournalOp) (psRecord->ulKind >> 1)) &&
+         !(psRecord->ulKind & 1)) {
+         pcContents = pcBlock + ulOffset +
+            sizeof(struct journalRecord) + psRecord->ulPathBytes;
+         bUsed = TRUE;
+      }
+      iStatus = (*pfApply)((JournalOp) (psRecord->ulKind >> 1),
+                           pcBlock + ulOffset +
+                              sizeof(struct journalRecord),
+                           pcContents, psRecord->ulLength, pvExtra);
+      if(iStatus != SUCCESS)
+         break;
+   }
+
+   /* whatever follows the last whole record was torn by a crash */
+   if(iStatus == SUCCESS && ulOffset < ulSize &&
+      ftruncate(iFd, (off_t) ulOffset) != 0)
+      iStatus = EOF;
+   (void) close(iFd);
+
+   if(bUsed) {
+      *ppvBlock = pcBlock;
+      *pulBlock = ulSize;
+   }
+   else
+      free(pcBlock);
+   return iStatus;
+}
+
+void Journal_release(void *pvBlock, size_t ulLength) {
+   (void) ulLength;
+   free(pvBlock);
+}
+
+int Journal_syncDirectory(const char *pcFile) {
+   const char *pcSlash;
+   char *pcDir;
+   size_t ulLength;
+   int iFd;
+   int iStatus = SUCCESS;
+
+   assert(pcFile != NULL);
+
+   pcSlash = strrchr(pcFile, '/');
+   if(pcSlash == NULL)
+      ulLength = 0;
+   else if(pcSlash == pcFile)
+      ulLength = 1;
+   else
+      ulLength = (size_t) (pcSlash - pcFile);
+
+   pcDir = malloc(ulLength + 2);
+   if(pcDir == NULL)
+      return MEMORY_ERROR;
+   if(ulLength == 0)
+      strcpy(pcDir, ".");
+   else {
+      memcpy(pcDir, pcFile, ulLength);
+      pcDir[ulLength] = '\0';
+   }
+
+   iFd = open(pcDir, O_RDONLY);
+   free(pcDir);
+   if(iFd < 0)
+      return EOF;
+   if(fsync(iFd) != 0)
+      iStatus = EOF;
+   (void) close(iFd);
+   return iStatus;
+}
@@ -0,0 +1,141 @@
+/*--------------------------------------------------------------------*/
+/* journal.h                                                          */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#ifndef JOURNAL_INCLUDED
+#define JOURNAL_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+
+/*
+  A Journal_T appends a record of each change made to a tree to a file,
+  so that the changes can be replayed after a crash. Records are
+  gathered in memory and written in batches, each followed by a single
+  fdatasync, so that many changes share the cost of one sync. Each
+  record has a sequence number, one more than the record before it,
+  and a checksum, so that replaying stops cleanly at a record that was
+  only partly written when the machine went down.
+*/
+typedef struct journal *Journal_T;
+
+/* The kinds of change a journal records */
+typedef enum {JOURNAL_INSERT_DIR, JOURNAL_INSERT_FILE, JOURNAL_RM_DIR,
+              JOURNAL_RM_FILE, JOURNAL_REPLACE} JournalOp;
+
+/*
+  Opens the journal in the file pcFile for appending, creating the
+  file if it does not exist, and numbering the first record appended
+  ulNextSeq. Records are written and synced ulBatch (at least 1) at a
+  time. A journal that is not empty must first be passed to
+  Journal_replay, which cuts off any partly written record. Returns an
+  int SUCCESS status and sets *poJJournal to the new journal if
+  successful. Otherwise, sets *poJJournal to NULL and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * EOF if pcFile could not be opened or written
+*/
+int Journal_open(const char *pcFile, size_t ulNextSeq, size_t ulBatch,
+                 Journal_T *poJJournal);
+
+/*
+  Records in oJJournal the change eOp to the '\0'-terminated absolute
+  path pcPath, along with a copy of the ulLength bytes at pvContents
+  for JOURNAL_INSERT_FILE and JOURNAL_REPLACE (pvContents may be NULL,
+  and is ignored for other changes). Only buffers the record; call
+  Journal_commit afterwards, without holding any lock that the thread
+  writing out a batch might need. Changes must be recorded in the
+  order they are made to the tree: a caller that changes the tree
+  under a lock records the change before releasing it. Safe to call
+  from many threads at once. If memory runs out, oJJournal records
+  nothing from then on, and Journal_sync reports MEMORY_ERROR.
+*/
+void Journal_append(Journal_T oJJournal, JournalOp eOp,
+                    const char *pcPath, const void *pvContents,
+                    size_t ulLength);
+
+/*
+  Writes and syncs the records buffered in oJJournal if there are at
+  least a batch of them and no other thread is already doing so;
+  otherwise returns at once, leaving them to the next batch. The
+  calling thread does the writing, while other threads keep appending
+  to a second buffer. Safe to call from many threads at once.
+*/
+void Journal_commit(Journal_T oJJournal);
+
+/*
+  Writes and syncs every record appended to oJJournal so far, however
+  few, waiting for any batch already being written. Safe to call from
+  many threads at once. Returns SUCCESS if every record appended to
+  oJJournal since it was opened is on the disk. Otherwise, returns:
+  * MEMORY_ERROR if memory ran out in Journal_append
+  * EOF if writing or syncing the file failed
+*/
+int Journal_sync(Journal_T oJJournal);
+
+/*
+  Returns the sequence number of the last record appended to
+  oJJournal, or one less than the number it was opened with if none
+  has been.
+*/
+size_t Journal_getLastSeq(Journal_T oJJournal);
+
+/*
+  Syncs oJJournal as Journal_sync does, renames its file to pcOld,
+  and goes on appending to a new, empty file under its old name.
+  No thread may append to oJJournal meanwhile. Returns SUCCESS if
+  successful. Otherwise, leaves oJJournal appending to its old file
+  where possible and returns the status Journal_sync would, or EOF if
+  the rename or the new file failed.
+*/
+int Journal_rotate(Journal_T oJJournal, const char *pcOld);
+
+/*
+  Syncs and closes oJJournal, and frees it. Returns the status
+  Journal_sync would. Does nothing and returns SUCCESS if oJJournal is
+  NULL.
+*/
+int Journal_close(Journal_T oJJournal);
+
+/*
+  Calls (*pfApply)(eOp, pcPath, pvContents, ulLength, pvExtra) for
+  each record in the journal file pcFile numbered after ulAfter, in
+  order, stopping early if it returns anything but SUCCESS. Reading
+  stops at the first record that is incomplete or fails its checksum,
+  and the file is cut short there, so that records appended later
+  follow the last whole one. pcPath is valid only during the call;
+  pvContents points into a block of memory that stays valid until it
+  is passed to Journal_release. Sets *ppvBlock and *pulBlock to that
+  block and its length, or to NULL and 0 if no contents passed to
+  *pfApply point into it, whether or not replaying succeeds. Returns
+  an int SUCCESS status and sets *pulLast to the number of the last
+  record applied (or ulAfter, if none was) if successful.
+  Otherwise, returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * NO_SUCH_PATH if pcFile does not exist
+  * EOF if pcFile could not be read or cut short, or is not a journal
+        written on the same kind of machine
+  * the value *pfApply returned, if it returned other than SUCCESS
+*/
+int Journal_replay(const char *pcFile, size_t ulAfter,
+                   int (*pfApply)(JournalOp eOp, const char *pcPath,
+                                  void *pvContents, size_t ulLength,
+                                  void *pvExtra),
+                   void *pvExtra, size_t *pulLast, void **ppvBlock,
+                   size_t *pulBlock);
+
+/*
+  Frees the ulLength-byte block pvBlock returned by Journal_replay.
+  Its signature suits Node_addBacking.
+*/
+void Journal_release(void *pvBlock, size_t ulLength);
+
+/*
+  Syncs the directory that holds the file pcFile, so that a file
+  created or renamed in it survives a crash. Returns SUCCESS, or EOF
+  if the directory could not be synced, or MEMORY_ERROR if memory
+  could not be allocated to complete request.
+*/
+int Journal_syncDirectory(const char *pcFile);
+
+#endif
@@ -3,237 +3,2851 @@
 /* Author: Christopher Moretti                                        */
 /*--------------------------------------------------------------------*/
 
+/* pthread_rwlock_t is POSIX, not ISO C, so ask for it explicitly */
+#define _XOPEN_SOURCE 600
+
 #include <stdlib.h>
+#include <stddef.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
 #include "nodeFT.h"
-#include "dynarray.h"
+#include "atom.h"
+#include "pool.h"
+
+/*
+  A block of memory that nodes' contents may point into, such as a
+  mapped file, released along with the store that owns it.
+*/
+struct nodeBacking {
+   /* the block the store took before this one, or NULL */
+   struct nodeBacking *psNext;
+   /* the block and its length */
+   void *pvBlock;
+   size_t ulLength;
+   /* the function that releases it */
+   void (*pfRelease)(void *pvBlock, size_t ulLength);
+};
+
+/* The number of slots in a directory's first array of children */
+#define NODE_MIN_CHILDREN 4
+
+/*
+  The most slots a block of children has. A directory with no more
+  children than this keeps them in one sorted array; past that, the
+  array splits into a B-tree of such blocks.
+*/
+#define NODE_BLOCK_SLOTS 128
+
+/* A block with fewer slots in use than this is merged into a
+   neighbour that it fits in with */
+#define NODE_BLOCK_MIN (NODE_BLOCK_SLOTS / 4)
+
+/* The number of slots filled in each block built in bulk */
+#define NODE_BLOCK_FILL (NODE_BLOCK_SLOTS * 3 / 4)
+
+/* The number of words holding the tags of ulSlots children, packed
+   one byte per child */
+#define NODE_TAG_WORDS(ulSlots) \
+   (((ulSlots) + sizeof(size_t) - 1) / sizeof(size_t))
+
+/* A word with every byte 0x01 */
+#define NODE_TAG_ONES ((size_t) -1 / 0xFF)
+
+/* A leaf with fewer children than this is searched without its tags,
+   since comparing a name's length rules out most of them for less
+   than hashing the name sought would cost */
+#define NODE_TAG_MIN 3
+
+/* A directory with at least this many children has them indexed by
+   name too; once it is down to a quarter of this, the index goes */
+#define NODE_INDEX_MIN 512
+
+/* The most nodes that the reclaimer gives back IDs for or frees each
+   time it takes its store's mutex */
+#define NODE_RECLAIM_BATCH 1024
+
+/*
+  The allocators shared by all nodes of one tree, created with its root
+  and freed in bulk once neither the tree nor any snapshot of it is
+  left. Nodes of one tree may be created and freed from several
+  threads at once, so sMutex guards both allocators.
+*/
+struct nodeStore {
+   /* the pool that every node in the tree is allocated from */
+   Pool_T oPlPool;
+   /* the pool that every directory's latch is allocated from */
+   Pool_T oPlLatches;
+   /* the table that every name in the tree is interned in */
+   AtomTable_T oAtNames;
+   /* held while either allocator or ulTrees is in use */
+   pthread_mutex_t sMutex;
+   /* the number of roots using this store: the live tree's, if it
+      still has one, and one per snapshot shared from it */
+   size_t ulTrees;
+   /* the epoch that unlinked nodes and replaced blocks of children
+      are retired to, or NULL to free them at once */
+   Epoch_T oEEpoch;
+   /* the blocks that nodes' contents may point into, newest first */
+   struct nodeBacking *psBacking;
+   /* the table that every node in the live tree has an ID in, or
+      NULL if the tree has none */
+   IdTable_T oItIds;
+   /* the reclaimer that subtrees unlinked from the live tree are
+      handed to, or NULL to free them before Node_free returns */
+   Reclaimer_T oRReclaimer;
+   /* the number of subtrees handed to oRReclaimer whose IDs are still
+      in oItIds */
+   size_t ulDetached;
+   /* the number of nodes that oRReclaimer has counted in subtrees
+      unlinked from the live tree, and that the tree has not taken
+      back yet (see Node_takeReclaimed) */
+   size_t ulReclaimed;
+};
+
+/* The stages of freeing a subtree in the background, in order */
+enum nodeStage {
+   /* counting the subtree's nodes and giving back their IDs, unless
+      it is a whole tree */
+   NODE_STAGE_IDS,
+   /* waiting for lock-free readers that may be inside the subtree */
+   NODE_STAGE_WAIT,
+   /* dropping references to the subtree's nodes, and freeing those
+      that no snapshot keeps */
+   NODE_STAGE_FREE
+};
+
+/* A subtree unlinked from the live tree, being freed in the
+   background */
+struct nodeDetached {
+   /* the store the subtree was allocated from */
+   struct nodeStore *psStore;
+   /* the top of the subtree */
+   Node_T oNTop;
+   /* a flag for the subtree being a whole tree (TRUE), whose root
+      the store counts in ulTrees, or not (FALSE) */
+   boolean bRoot;
+   /* a flag for the subtree being all that is left of the store
+      (TRUE), so that its nodes need not be given back one by one, or
+      not (FALSE) */
+   boolean bAlone;
+   /* the stage under way */
+   enum nodeStage eStage;
+   /* the node that the stage under way goes on from, and, while
+      giving back IDs, its index among its siblings */
+   Node_T oNNext;
+   size_t ulIndex;
+   /* the number of the subtree's nodes counted so far */
+   size_t ulCount;
+};
+
+/*
+  The start of every block of a directory's children. A directory's
+  children, sorted by name, are one leaf block until they outgrow it,
+  and then a B-tree of blocks whose branches count the children below
+  each slot, so that a child is found by index as well as by name.
+  Lock-free readers may be searching the blocks while a writer changes
+  them, so every slot and length is written with atomic stores, and a
+  block is freed only through the tree's epoch once it is replaced or
+  taken out.
+*/
+struct nodeBlock {
+   /* 0 for a leaf (struct nodeChildren), whose slots are children;
+      otherwise the height above the leaves of a branch (struct
+      nodeBranch), whose slots are blocks one level down */
+   size_t ulLevel;
+   /* the number of slots in use */
+   size_t ulLength;
+   /* the next block dropped by the same change, which retires them
+      all once it is done; never read by lock-free readers */
+   struct nodeBlock *psNextDropped;
+};
+
+/* A leaf block, holding children */
+struct nodeChildren {
+   struct nodeBlock sHead;
+   /* the number of slots in aoNChildren: NODE_BLOCK_SLOTS, unless
+      this is the only block, which grows by doubling until then */
+   size_t ulCapacity;
+   /* the children; really ulCapacity long, and followed in the same
+      allocation by a byte of each one's name hash (see Node_tagsOf),
+      so that a search can rule most of them out without reaching
+      their names */
+   Node_T aoNChildren[1];
+};
+
+/* A branch block, holding blocks */
+struct nodeBranch {
+   struct nodeBlock sHead;
+   /* the blocks, never empty */
+   struct nodeBlock *apsBlocks[NODE_BLOCK_SLOTS];
+   /* the first child in each block, for searching by name */
+   Node_T aoNFirst[NODE_BLOCK_SLOTS];
+   /* the number of children in each block and all those before it,
+      for searching by index */
+   size_t aulEnds[NODE_BLOCK_SLOTS];
+};
+
+/* One slot of an index of children by name */
+struct nodeSlot {
+   /* the hash of the child's name */
+   size_t ulHash;
+   /* the child; NULL if the slot has never been used, or
+      &sRemovedChild once its child is removed */
+   struct node *psChild;
+};
+
+/*
+  An index of a wide directory's children by name, kept alongside the
+  blocks, which still give their order. Slots are found by open
+  addressing with linear probing. A removed child's slot is marked
+  rather than emptied, so a slot once used never reads as empty again,
+  and a lock-free reader probing while a writer changes the index
+  never misses a child that stays linked. An index that fills up is
+  replaced whole, and the old one retired to the tree's epoch.
+*/
+struct nodeIndex {
+   /* the number of slots less one; the number is a power of two */
+   size_t ulMask;
+   /* the number of slots that are not empty, marked ones included */
+   size_t ulUsed;
+   /* the slots; really ulMask + 1 long */
+   struct nodeSlot asSlots[1];
+};
 
-/* A node in a DT */
+/*
+  A node in a DT. A node stores only its own name; its absolute path
+  is the chain of names from the root down to it, and is rebuilt from
+  the parent links only when a caller asks for it.
+*/
 struct node {
-   /* the object corresponding to the node's absolute path */
-   Path_T oPPath;
+   /* the interned final component of the node's absolute path,
+      shared by all nodes with the same name */
+   Atom_T oAName;
+   /* the number of components in the node's absolute path */
+   size_t ulDepth;
    /* this node's parent */
    Node_T oNParent;
-   /* the object containing links to this node's children */
-   DynArray_T oDChildren;
+   /* the root block of this node's children, or NULL until the first
+      child is linked (so files never have any) */
+   struct nodeBlock *psChildren;
+   /* the index of this node's children by name, or NULL while it has
+      too few for searching the blocks to be slow */
+   struct nodeIndex *psIndex;
+   /* odd while a writer is changing the node's children or contents,
+      and bumped again when it is done, so that lock-free readers can
+      tell whether what they read was stable */
+   size_t ulVersion;
+   /* the number of blocks of children and roots of trees that refer
+      to this node; more than one only while a snapshot shares it */
+   size_t ulRefs;
+   /* the allocators of this node's tree */
+   struct nodeStore *psStore;
+   /* the node's ID in its store's table, or 0 if it has none */
+   size_t ulId;
+   /* the latch taken by Node_lockRead and Node_lockWrite, or NULL
+      for a file, which has none */
+   pthread_rwlock_t *psLatch;
    /* the type of node (if it is a file or directory) */
    NodeType type;
+   /* the number of changes under way that take this directory out of
+      the tree or fill in new directories below it (see
+      Node_beginDetach) */
+   int iDetaches;
    /* pointer to the contents of a file */
    void* pvContents;
    /* the size of the contents in the file */
    size_t ulLength;
 };
 
+/* What the index slot of a removed child points to instead; never a
+   node of any tree */
+static struct node sRemovedChild;
+
+
+/*
+  Returns a new store for a tree of nodes, or NULL if insufficient
+  memory is available.
+*/
+static struct nodeStore *Node_newStore(void) {
+   struct nodeStore *psStore;
+
+   psStore = malloc(sizeof(struct nodeStore));
+   if(psStore == NULL)
+      return NULL;
+
+   psStore->oPlPool = Pool_new(sizeof(struct node));
+   psStore->oPlLatches = Pool_new(sizeof(pthread_rwlock_t));
+   psStore->oAtNames = AtomTable_new();
+   if(psStore->oPlPool == NULL || psStore->oPlLatches == NULL ||
+      psStore->oAtNames == NULL ||
+      pthread_mutex_init(&psStore->sMutex, NULL) != 0) {
+      Pool_free(psStore->oPlPool);
+      Pool_free(psStore->oPlLatches);
+      AtomTable_free(psStore->oAtNames);
+      free(psStore);
+      return NULL;
+   }
+   psStore->ulTrees = 1;
+   psStore->oEEpoch = NULL;
+   psStore->psBacking = NULL;
+   psStore->oItIds = NULL;
+   psStore->oRReclaimer = NULL;
+   psStore->ulDetached = 0;
+   psStore->ulReclaimed = 0;
+   return psStore;
+}
+
+/*
+  Frees psStore, along with every node and name still allocated from
+  it and its backing blocks.
+*/
+static void Node_freeStore(struct nodeStore *psStore) {
+   struct nodeBacking *psNext;
+
+   assert(psStore != NULL);
+
+   for(; psStore->psBacking != NULL; psStore->psBacking = psNext) {
+      psNext = psStore->psBacking->psNext;
+      (*psStore->psBacking->pfRelease)(psStore->psBacking->pvBlock,
+                                       psStore->psBacking->ulLength);
+      free(psStore->psBacking);
+   }
+
+   Pool_free(psStore->oPlPool);
+   Pool_free(psStore->oPlLatches);
+   AtomTable_free(psStore->oAtNames);
+   (void) pthread_mutex_destroy(&psStore->sMutex);
+   free(psStore);
+}
+
+/*
+  Marks the start of a change to oNNode's children or contents, which
+  the caller must be the only writer of. The change itself must use
+  release stores, so that a reader who sees any of it also sees that
+  it started.
+*/
+static void Node_beginChange(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   /* a new file is already odd until its first contents are set */
+   __atomic_store_n(&oNNode->ulVersion, oNNode->ulVersion | 1,
+                    __ATOMIC_RELAXED);
+}
+
+/* Marks the end of the change that Node_beginChange started. */
+static void Node_endChange(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   __atomic_store_n(&oNNode->ulVersion, oNNode->ulVersion + 1,
+                    __ATOMIC_RELEASE);
+}
+
+/*
+  Returns oNNode's version for a lock-free reader about to read its
+  children or contents, first waiting out any change in progress.
+*/
+static size_t Node_beginRead(Node_T oNNode) {
+   size_t ulVersion;
+
+   assert(oNNode != NULL);
+
+   while((ulVersion = __atomic_load_n(&oNNode->ulVersion,
+                                      __ATOMIC_ACQUIRE)) & 1)
+      (void) sched_yield();
+   return ulVersion;
+}
+
+/*
+  Returns TRUE if oNNode has not changed since Node_beginRead returned
+  ulVersion, so that everything read from it in between is consistent,
+  or FALSE if the read must be retried. The reads in between must be
+  acquire loads, so that none of them can be ordered after this check.
+*/
+static boolean Node_endRead(Node_T oNNode, size_t ulVersion) {
+   assert(oNNode != NULL);
+
+   return (boolean) (__atomic_load_n(&oNNode->ulVersion,
+                                     __ATOMIC_ACQUIRE) == ulVersion);
+}
+
+/*
+  Returns the words after psLeaf's children that hold their tags, the
+  tag of the child in slot i being byte i % sizeof(size_t), counting
+  from the least significant, of word i / sizeof(size_t). Tags are
+  updated a whole word at a time with atomic stores, so that lock-free
+  readers may scan them while a writer changes the leaf.
+*/
+static size_t *Node_tagsOf(struct nodeChildren *psLeaf) {
+   assert(psLeaf != NULL);
+
+   return (size_t *) &psLeaf->aoNChildren[psLeaf->ulCapacity];
+}
+
+/*
+  Returns a new, empty leaf with room for ulCapacity children, or NULL
+  if insufficient memory is available.
+*/
+static struct nodeChildren *Node_newChildren(size_t ulCapacity) {
+   struct nodeChildren *psChildren;
+
+   psChildren = malloc(offsetof(struct nodeChildren, aoNChildren)
+                       + ulCapacity * sizeof(Node_T)
+                       + NODE_TAG_WORDS(ulCapacity) * sizeof(size_t));
+   if(psChildren == NULL)
+      return NULL;
+
+   psChildren->sHead.ulLevel = 0;
+   psChildren->sHead.ulLength = 0;
+   psChildren->ulCapacity = ulCapacity;
+   memset(Node_tagsOf(psChildren), 0,
+          NODE_TAG_WORDS(ulCapacity) * sizeof(size_t));
+   return psChildren;
+}
+
+/* Returns the tag of a name with hash ulHash. */
+static size_t Node_tagOf(size_t ulHash) {
+   return (ulHash >> 24) & 0xFF;
+}
+
+/* Returns the tag of the child in slot ulIndex of psLeaf. */
+static size_t Node_getTag(struct nodeChildren *psLeaf, size_t ulIndex) {
+   assert(psLeaf != NULL);
+   assert(ulIndex < psLeaf->ulCapacity);
+
+   return (Node_tagsOf(psLeaf)[ulIndex / sizeof(size_t)]
+           >> (8 * (ulIndex % sizeof(size_t)))) & 0xFF;
+}
+
+/*
+  Puts oNChild, with tag ulTag, in slot ulIndex of psLeaf. Only the
+  writer changing psLeaf may call this, so the word it updates cannot
+  change under it.
+*/
+static void Node_setSlot(struct nodeChildren *psLeaf, size_t ulIndex,
+                         Node_T oNChild, size_t ulTag) {
+   size_t *pulWord;
+   size_t ulShift;
+
+   assert(psLeaf != NULL);
+   assert(ulIndex < psLeaf->ulCapacity);
+
+   pulWord = &Node_tagsOf(psLeaf)[ulIndex / sizeof(size_t)];
+   ulShift = 8 * (ulIndex % sizeof(size_t));
+   __atomic_store_n(pulWord, (*pulWord & ~((size_t) 0xFF << ulShift))
+                                | (ulTag << ulShift),
+                    __ATOMIC_RELAXED);
+   __atomic_store_n(&psLeaf->aoNChildren[ulIndex], oNChild,
+                    __ATOMIC_RELEASE);
+}
+
+/* Puts oNChild in slot ulIndex of psLeaf, as Node_setSlot does, with
+   the tag of its name. */
+static void Node_putSlot(struct nodeChildren *psLeaf, size_t ulIndex,
+                         Node_T oNChild) {
+   assert(oNChild != NULL);
+
+   Node_setSlot(psLeaf, ulIndex, oNChild,
+                Node_tagOf(Atom_getHash(oNChild->oAName)));
+}
+
+/* Puts the child in slot ulFrom of psFrom in slot ulTo of psTo, as
+   Node_setSlot does. */
+static void Node_moveSlot(struct nodeChildren *psTo, size_t ulTo,
+                          struct nodeChildren *psFrom, size_t ulFrom) {
+   assert(psFrom != NULL);
+
+   Node_setSlot(psTo, ulTo, psFrom->aoNChildren[ulFrom],
+                Node_getTag(psFrom, ulFrom));
+}
+
+/*
+  Returns a new, empty branch at level ulLevel, or NULL if
+  insufficient memory is available.
+*/
+static struct nodeBranch *Node_newBranch(size_t ulLevel) {
+   struct nodeBranch *psBranch;
+
+   assert(ulLevel > 0);
+
+   psBranch = malloc(sizeof(struct nodeBranch));
+   if(psBranch == NULL)
+      return NULL;
+
+   psBranch->sHead.ulLevel = ulLevel;
+   psBranch->sHead.ulLength = 0;
+   return psBranch;
+}
+
+/* Frees psBlock and every block below it, but none of the children. */
+static void Node_freeBlocks(struct nodeBlock *psBlock) {
+   struct nodeBranch *psBranch;
+   size_t ulSlot;
+
+   assert(psBlock != NULL);
+
+   if(psBlock->ulLevel > 0) {
+      psBranch = (struct nodeBranch *) psBlock;
+      for(ulSlot = 0; ulSlot < psBlock->ulLength; ulSlot++)
+         Node_freeBlocks(psBranch->apsBlocks[ulSlot]);
+   }
+   free(psBlock);
+}
+
+/* Returns the number of children in psBlock and the blocks below it. */
+static size_t Node_countBlock(struct nodeBlock *psBlock) {
+   assert(psBlock != NULL);
+
+   if(psBlock->ulLevel == 0)
+      return psBlock->ulLength;
+   assert(psBlock->ulLength > 0);
+   return ((struct nodeBranch *) psBlock)
+      ->aulEnds[psBlock->ulLength - 1];
+}
+
+/* Returns the first child in psBlock, which must not be empty. */
+static Node_T Node_firstOf(struct nodeBlock *psBlock) {
+   assert(psBlock != NULL);
+   assert(psBlock->ulLength > 0);
+
+   if(psBlock->ulLevel == 0)
+      return ((struct nodeChildren *) psBlock)->aoNChildren[0];
+   return ((struct nodeBranch *) psBlock)->aoNFirst[0];
+}
+
+/*
+  Returns the slot of psBranch that holds the child at index ulIndex
+  among the children below it, or its last slot if ulIndex is past
+  them all.
+*/
+static size_t Node_findSlot(struct nodeBranch *psBranch,
+                            size_t ulIndex) {
+   size_t ulLow = 0;
+   size_t ulHigh;
+   size_t ulMid;
+
+   assert(psBranch != NULL);
+   assert(psBranch->sHead.ulLength > 0);
+
+   ulHigh = psBranch->sHead.ulLength - 1;
+   while(ulLow < ulHigh) {
+      ulMid = ulLow + (ulHigh - ulLow) / 2;
+      if(psBranch->aulEnds[ulMid] > ulIndex)
+         ulHigh = ulMid;
+      else
+         ulLow = ulMid + 1;
+   }
+   return ulLow;
+}
+
+/*
+  Returns the leaf below psBlock that holds the child at index
+  ulIndex, and sets *pulIndex to that child's index in the leaf.
+*/
+static struct nodeChildren *Node_leafAt(struct nodeBlock *psBlock,
+                                        size_t ulIndex,
+                                        size_t *pulIndex) {
+   struct nodeBranch *psBranch;
+   size_t ulSlot;
+
+   assert(psBlock != NULL);
+   assert(pulIndex != NULL);
+
+   while(psBlock->ulLevel > 0) {
+      psBranch = (struct nodeBranch *) psBlock;
+      ulSlot = Node_findSlot(psBranch, ulIndex);
+      if(ulSlot > 0)
+         ulIndex -= psBranch->aulEnds[ulSlot - 1];
+      psBlock = psBranch->apsBlocks[ulSlot];
+   }
+   *pulIndex = ulIndex;
+   return (struct nodeChildren *) psBlock;
+}
+
+/*
+  Returns the leaf below psRoot, which may be NULL, whose first child
+  is at index *pulNext, and advances *pulNext past the leaf's children;
+  or returns NULL once *pulNext is past every child. Visits every
+  child in order, a leaf at a time, starting from *pulNext = 0.
+*/
+static struct nodeChildren *Node_nextLeaf(struct nodeBlock *psRoot,
+                                          size_t *pulNext) {
+   struct nodeChildren *psLeaf;
+   size_t ulIndex;
+
+   assert(pulNext != NULL);
+
+   if(psRoot == NULL || *pulNext >= Node_countBlock(psRoot))
+      return NULL;
+   psLeaf = Node_leafAt(psRoot, *pulNext, &ulIndex);
+   assert(ulIndex == 0);
+   *pulNext += psLeaf->sHead.ulLength;
+   return psLeaf;
+}
+
+/*
+  Calls (*pfFree)(pvObject), which frees a block of children or drops
+  a reference to a node unlinked from the live tree, once no lock-free
+  reader can be looking at it: through psStore's epoch if it has one,
+  or at once if not.
+*/
+static void Node_retire(struct nodeStore *psStore,
+                        void (*pfFree)(void *pvObject),
+                        void *pvObject) {
+   assert(psStore != NULL);
+
+   if(psStore->oEEpoch != NULL)
+      Epoch_retire(psStore->oEEpoch, pfFree, pvObject);
+   else
+      (*pfFree)(pvObject);
+}
+
+/*
+  Compares the name of oNFirst with the component pcSecond, of string
+  length ulLength. Since all children of one parent share the parent's
+  path as a prefix, this orders siblings exactly as comparing their
+  full paths would, however deep they are.
+  Returns <0, 0, or >0 if oNFirst is "less than", "equal to", or
+  "greater than" pcSecond, respectively.
+*/
+static int Node_compareComponent(const Node_T oNFirst,
+                                 const char *pcSecond,
+                                 size_t ulLength) {
+   assert(oNFirst != NULL);
+   assert(pcSecond != NULL);
+
+   return Atom_compareChars(oNFirst->oAName, pcSecond, ulLength);
+}
+
+/*
+  Returns TRUE if oNNode's name is the component pcComponent, of
+  string length ulLength, or FALSE if not. A name of another length
+  is ruled out without reading it.
+*/
+static boolean Node_hasName(const Node_T oNNode,
+                            const char *pcComponent, size_t ulLength) {
+   assert(oNNode != NULL);
+   assert(pcComponent != NULL);
+
+   return (boolean) (Atom_getLength(oNNode->oAName) == ulLength &&
+                     memcmp(Atom_getString(oNNode->oAName),
+                            pcComponent, ulLength) == 0);
+}
+
+/*
+  Puts oNChild, which must not be in it, in psIndex, which must have a
+  slot free. Lock-free readers may be probing psIndex meanwhile.
+*/
+static void Node_indexPut(struct nodeIndex *psIndex, Node_T oNChild) {
+   struct nodeSlot *psSlot;
+   size_t ulHash;
+   size_t i;
+
+   assert(psIndex != NULL);
+   assert(oNChild != NULL);
+   assert(psIndex->ulUsed < psIndex->ulMask);
+
+   ulHash = Atom_getHash(oNChild->oAName);
+   for(i = ulHash & psIndex->ulMask;
+       psIndex->asSlots[i].psChild != NULL &&
+       psIndex->asSlots[i].psChild != &sRemovedChild;
+       i = (i + 1) & psIndex->ulMask)
+      ;
+   psSlot = &psIndex->asSlots[i];
+   if(psSlot->psChild == NULL)
+      psIndex->ulUsed++;
+   __atomic_store_n(&psSlot->ulHash, ulHash, __ATOMIC_RELAXED);
+   __atomic_store_n(&psSlot->psChild, oNChild, __ATOMIC_RELEASE);
+}
+
+/* Returns the slot of psIndex that holds oNChild, which must be in
+   it. */
+static struct nodeSlot *Node_indexSlot(struct nodeIndex *psIndex,
+                                       Node_T oNChild) {
+   size_t i;
+
+   assert(psIndex != NULL);
+   assert(oNChild != NULL);
+
+   for(i = Atom_getHash(oNChild->oAName) & psIndex->ulMask;
+       psIndex->asSlots[i].psChild != oNChild;
+       i = (i + 1) & psIndex->ulMask)
+      assert(psIndex->asSlots[i].psChild != NULL);
+   return &psIndex->asSlots[i];
+}
+
+/*
+  Returns a new index of oNNode's children, with at least four slots
+  per child so that it can take as many again before it fills up, or
+  NULL if insufficient memory is available.
+*/
+static struct nodeIndex *Node_buildIndex(Node_T oNNode) {
+   struct nodeIndex *psIndex;
+   struct nodeChildren *psLeaf;
+   size_t ulSlots = NODE_INDEX_MIN;
+   size_t ulNext = 0;
+   size_t i;
+
+   assert(oNNode != NULL);
+
+   while(ulSlots < 4 * Node_countBlock(oNNode->psChildren))
+      ulSlots *= 2;
+   psIndex = calloc(1, offsetof(struct nodeIndex, asSlots)
+                       + ulSlots * sizeof(struct nodeSlot));
+   if(psIndex == NULL)
+      return NULL;
+   psIndex->ulMask = ulSlots - 1;
+   psIndex->ulUsed = 0;
+   while((psLeaf = Node_nextLeaf(oNNode->psChildren, &ulNext)) != NULL)
+      for(i = 0; i < psLeaf->sHead.ulLength; i++)
+         Node_indexPut(psIndex, psLeaf->aoNChildren[i]);
+   return psIndex;
+}
+
+/*
+  Searches psIndex for the child whose name is pcComponent, and
+  returns it, or NULL if there is none. Every slot is loaded
+  atomically and the probe never goes round more than once, so a
+  lock-free reader may search while a writer changes psIndex.
+*/
+static Node_T Node_indexFind(struct nodeIndex *psIndex,
+                             const char *pcComponent,
+                             size_t ulLength) {
+   Node_T oNChild;
+   size_t ulHash;
+   size_t ulProbes;
+   size_t i;
+
+   assert(psIndex != NULL);
+   assert(pcComponent != NULL);
+
+   ulHash = Atom_hash(pcComponent, ulLength);
+   i = ulHash & psIndex->ulMask;
+   for(ulProbes = 0; ulProbes <= psIndex->ulMask; ulProbes++) {
+      oNChild = __atomic_load_n(&psIndex->asSlots[i].psChild,
+                                __ATOMIC_ACQUIRE);
+      if(oNChild == NULL)
+         return NULL;
+      if(oNChild != &sRemovedChild &&
+         __atomic_load_n(&psIndex->asSlots[i].ulHash,
+                         __ATOMIC_RELAXED) == ulHash &&
+         Node_hasName(oNChild, pcComponent, ulLength))
+         return oNChild;
+      i = (i + 1) & psIndex->ulMask;
+   }
+   return NULL;
+}
+
+/*
+  Swaps psIndex in as oNNode's index, and retires the one it replaces,
+  if any.
+*/
+static void Node_swapIndex(Node_T oNNode, struct nodeIndex *psIndex) {
+   struct nodeIndex *psOld;
+
+   assert(oNNode != NULL);
+
+   psOld = oNNode->psIndex;
+   __atomic_store_n(&oNNode->psIndex, psIndex, __ATOMIC_RELEASE);
+   if(psOld != NULL)
+      Node_retire(oNNode->psStore, free, psOld);
+}
+
+/*
+  Adds oNChild, just linked into oNParent's blocks, to oNParent's
+  index, building the index first if oNParent has just become wide
+  enough to need one. The index only speeds up lookups, so if memory
+  for it runs out oNParent goes without, and lookups search the blocks.
+*/
+static void Node_indexChild(Node_T oNParent, Node_T oNChild) {
+   struct nodeIndex *psIndex;
+
+   assert(oNParent != NULL);
+   assert(oNChild != NULL);
+
+   psIndex = oNParent->psIndex;
+   if(psIndex != NULL && 2 * (psIndex->ulUsed + 1) <= psIndex->ulMask)
+      Node_indexPut(psIndex, oNChild);
+   else if(psIndex != NULL ||
+           Node_countBlock(oNParent->psChildren) >= NODE_INDEX_MIN)
+      Node_swapIndex(oNParent, Node_buildIndex(oNParent));
+}
+
+/*
+  Takes oNChild, about to be unlinked from oNParent's blocks, out of
+  oNParent's index, or drops the index once oNParent is narrow enough
+  to do without one.
+*/
+static void Node_unindexChild(Node_T oNParent, Node_T oNChild) {
+   assert(oNParent != NULL);
+   assert(oNChild != NULL);
+
+   if(oNParent->psIndex == NULL)
+      return;
+   if(Node_countBlock(oNParent->psChildren) <= NODE_INDEX_MIN / 4)
+      Node_swapIndex(oNParent, NULL);
+   else
+      __atomic_store_n(&Node_indexSlot(oNParent->psIndex,
+                                       oNChild)->psChild,
+                       &sRemovedChild, __ATOMIC_RELEASE);
+}
+
+/*
+  The blocks that a change to a directory's children may need, made
+  before the change starts so that it cannot fail half way. Spare
+  branches are chained through their first slot.
+*/
+struct nodeSpares {
+   /* a leaf to split a full one into, or NULL */
+   struct nodeChildren *psLeaf;
+   /* the branches to split full ones into or to grow a new root */
+   struct nodeBranch *psBranches;
+};
+
+/* Frees the blocks of psSpares that were not used. */
+static void Node_freeSpares(struct nodeSpares *psSpares) {
+   struct nodeBranch *psNext;
+
+   assert(psSpares != NULL);
+
+   free(psSpares->psLeaf);
+   psSpares->psLeaf = NULL;
+   for(; psSpares->psBranches != NULL;
+       psSpares->psBranches = psNext) {
+      psNext = (struct nodeBranch *) psSpares->psBranches->apsBlocks[0];
+      free(psSpares->psBranches);
+   }
+}
+
+/*
+  Fills psSpares with the blocks that adding a child at index ulIndex
+  below psRoot, a full tree of blocks, may need: one leaf if its leaf
+  is full, and a branch for each full branch above that, plus one for
+  a new root if every block down the way is full. Returns SUCCESS, or
+  frees them all and returns MEMORY_ERROR if memory could not be
+  allocated to complete request.
+*/
+static int Node_reserveSpares(struct nodeBlock *psRoot, size_t ulIndex,
+                              struct nodeSpares *psSpares) {
+   struct nodeBlock *psBlock;
+   struct nodeBranch *psBranch;
+   size_t ulHeight = 0;
+   size_t ulFull = 0;
+   size_t ulSlot;
+
+   assert(psRoot != NULL);
+   assert(psSpares != NULL);
+
+   psSpares->psLeaf = NULL;
+   psSpares->psBranches = NULL;
+
+   /* count the full blocks in a row just above and at the leaf */
+   for(psBlock = psRoot; psBlock->ulLevel > 0;
+       psBlock = psBranch->apsBlocks[ulSlot]) {
+      psBranch = (struct nodeBranch *) psBlock;
+      ulFull = (psBlock->ulLength == NODE_BLOCK_SLOTS) ? ulFull + 1 : 0;
+      ulSlot = Node_findSlot(psBranch, ulIndex);
+      if(ulSlot > 0)
+         ulIndex -= psBranch->aulEnds[ulSlot - 1];
+      ulHeight++;
+   }
+   if(psBlock->ulLength < ((struct nodeChildren *) psBlock)->ulCapacity)
+      return SUCCESS;
+
+   psSpares->psLeaf = Node_newChildren(NODE_BLOCK_SLOTS);
+   if(psSpares->psLeaf == NULL)
+      return MEMORY_ERROR;
+   if(ulFull == ulHeight)
+      ulFull++;
+   for(; ulFull > 0; ulFull--) {
+      psBranch = Node_newBranch(1);
+      if(psBranch == NULL) {
+         Node_freeSpares(psSpares);
+         return MEMORY_ERROR;
+      }
+      psBranch->apsBlocks[0] =
+         (struct nodeBlock *) psSpares->psBranches;
+      psSpares->psBranches = psBranch;
+   }
+   return SUCCESS;
+}
+
+/* Takes a spare branch for level ulLevel from psSpares. */
+static struct nodeBranch *Node_takeBranch(struct nodeSpares *psSpares,
+                                          size_t ulLevel) {
+   struct nodeBranch *psBranch;
+
+   assert(psSpares != NULL);
+   assert(psSpares->psBranches != NULL);
+
+   psBranch = psSpares->psBranches;
+   psSpares->psBranches = (struct nodeBranch *) psBranch->apsBlocks[0];
+   psBranch->sHead.ulLevel = ulLevel;
+   return psBranch;
+}
+
+/*
+  Puts oNChild at index ulIndex of psLeaf, which has room for it,
+  shifting later children up in place; readers see the version change
+  and search again.
+*/
+static void Node_leafPut(struct nodeChildren *psLeaf, size_t ulIndex,
+                         Node_T oNChild) {
+   size_t ulLength;
+   size_t i;
+
+   assert(psLeaf != NULL);
+
+   ulLength = psLeaf->sHead.ulLength;
+   assert(ulIndex <= ulLength);
+   assert(ulLength < psLeaf->ulCapacity);
+
+   for(i = ulLength; i > ulIndex; i--)
+      Node_moveSlot(psLeaf, i, psLeaf, i - 1);
+   Node_putSlot(psLeaf, ulIndex, oNChild);
+   __atomic_store_n(&psLeaf->sHead.ulLength, ulLength + 1,
+                    __ATOMIC_RELEASE);
+}
+
+/*
+  Puts psBlock into slot ulSlot of psBranch, which has room for it.
+  The children of psBlock must have just been split off from the
+  block in slot ulSlot - 1, whose end has not been lowered yet.
+*/
+static void Node_branchPut(struct nodeBranch *psBranch, size_t ulSlot,
+                           struct nodeBlock *psBlock) {
+   size_t ulLength;
+   size_t i;
+
+   assert(psBranch != NULL);
+   assert(psBlock != NULL);
+
+   ulLength = psBranch->sHead.ulLength;
+   assert(ulSlot > 0 && ulSlot <= ulLength);
+   assert(ulLength < NODE_BLOCK_SLOTS);
+
+   for(i = ulLength; i > ulSlot; i--) {
+      __atomic_store_n(&psBranch->apsBlocks[i],
+                       psBranch->apsBlocks[i - 1], __ATOMIC_RELEASE);
+      __atomic_store_n(&psBranch->aoNFirst[i],
+                       psBranch->aoNFirst[i - 1], __ATOMIC_RELEASE);
+      __atomic_store_n(&psBranch->aulEnds[i],
+                       psBranch->aulEnds[i - 1], __ATOMIC_RELEASE);
+   }
+   __atomic_store_n(&psBranch->apsBlocks[ulSlot], psBlock,
+                    __ATOMIC_RELEASE);
+   __atomic_store_n(&psBranch->aoNFirst[ulSlot], Node_firstOf(psBlock),
+                    __ATOMIC_RELEASE);
+   __atomic_store_n(&psBranch->aulEnds[ulSlot],
+                    psBranch->aulEnds[ulSlot - 1], __ATOMIC_RELEASE);
+   __atomic_store_n(&psBranch->aulEnds[ulSlot - 1],
+                    psBranch->aulEnds[ulSlot - 1] -
+                    Node_countBlock(psBlock), __ATOMIC_RELEASE);
+   __atomic_store_n(&psBranch->sHead.ulLength, ulLength + 1,
+                    __ATOMIC_RELEASE);
+}
+
+/*
+  Adds oNChild at index ulIndex among the children below psBlock,
+  splitting blocks that are full with spares from psSpares. Returns
+  the new block split off from psBlock to follow it, or NULL if
+  psBlock had room.
+*/
+static struct nodeBlock *Node_insertBlock(struct nodeBlock *psBlock,
+                                          size_t ulIndex,
+                                          Node_T oNChild,
+                                          struct nodeSpares *psSpares) {
+   struct nodeChildren *psLeaf;
+   struct nodeChildren *psRightLeaf;
+   struct nodeBranch *psBranch;
+   struct nodeBranch *psRight;
+   struct nodeBlock *psNew;
+   size_t ulLength;
+   size_t ulHalf;
+   size_t ulSlot;
+   size_t i;
+
+   assert(psBlock != NULL);
+   assert(psSpares != NULL);
+
+   ulLength = psBlock->ulLength;
+   if(psBlock->ulLevel == 0) {
+      psLeaf = (struct nodeChildren *) psBlock;
+      if(ulLength < psLeaf->ulCapacity) {
+         Node_leafPut(psLeaf, ulIndex, oNChild);
+         return NULL;
+      }
+
+      /* move the upper half to a new leaf, then add to either half */
+      psRightLeaf = psSpares->psLeaf;
+      psSpares->psLeaf = NULL;
+      assert(psRightLeaf != NULL);
+      ulHalf = ulLength / 2;
+      for(i = ulHalf; i < ulLength; i++)
+         Node_moveSlot(psRightLeaf, i - ulHalf, psLeaf, i);
+      psRightLeaf->sHead.ulLength = ulLength - ulHalf;
+      __atomic_store_n(&psLeaf->sHead.ulLength, ulHalf,
+                       __ATOMIC_RELEASE);
+      if(ulIndex <= ulHalf)
+         Node_leafPut(psLeaf, ulIndex, oNChild);
+      else
+         Node_leafPut(psRightLeaf, ulIndex - ulHalf, oNChild);
+      return &psRightLeaf->sHead;
+   }
+
+   psBranch = (struct nodeBranch *) psBlock;
+   ulSlot = Node_findSlot(psBranch, ulIndex);
+   psNew = Node_insertBlock(psBranch->apsBlocks[ulSlot],
+                            (ulSlot > 0) ? ulIndex -
+                               psBranch->aulEnds[ulSlot - 1] : ulIndex,
+                            oNChild, psSpares);
+   for(i = ulSlot; i < ulLength; i++)
+      __atomic_store_n(&psBranch->aulEnds[i], psBranch->aulEnds[i] + 1,
+                       __ATOMIC_RELEASE);
+   __atomic_store_n(&psBranch->aoNFirst[ulSlot],
+                    Node_firstOf(psBranch->apsBlocks[ulSlot]),
+                    __ATOMIC_RELEASE);
+   if(psNew == NULL)
+      return NULL;
+
+   if(ulLength < NODE_BLOCK_SLOTS) {
+      Node_branchPut(psBranch, ulSlot + 1, psNew);
+      return NULL;
+   }
+
+   /* move the upper half to a new branch, then add to either half */
+   psRight = Node_takeBranch(psSpares, psBlock->ulLevel);
+   ulHalf = ulLength / 2;
+   for(i = ulHalf; i < ulLength; i++) {
+      psRight->apsBlocks[i - ulHalf] = psBranch->apsBlocks[i];
+      psRight->aoNFirst[i - ulHalf] = psBranch->aoNFirst[i];
+      psRight->aulEnds[i - ulHalf] =
+         psBranch->aulEnds[i] - psBranch->aulEnds[ulHalf - 1];
+   }
+   psRight->sHead.ulLength = ulLength - ulHalf;
+   __atomic_store_n(&psBranch->sHead.ulLength, ulHalf,
+                    __ATOMIC_RELEASE);
+   if(ulSlot + 1 <= ulHalf)
+      Node_branchPut(psBranch, ulSlot + 1, psNew);
+   else
+      Node_branchPut(psRight, ulSlot + 1 - ulHalf, psNew);
+   return &psRight->sHead;
+}
+
+/*
+  Links new child oNChild into oNParent's children at index ulIndex.
+  Returns SUCCESS if the new child was added successfully, or
+  MEMORY_ERROR if allocation fails adding oNChild to the children.
+*/
+static int Node_addChild(Node_T oNParent, Node_T oNChild,
+                         size_t ulIndex) {
+   struct nodeChildren *psOld;
+   struct nodeChildren *psNew;
+   struct nodeBranch *psRoot;
+   struct nodeBlock *psSplit;
+   struct nodeSpares sSpares;
+   size_t ulLength;
+   size_t i;
+   int iStatus;
+
+   assert(oNParent != NULL);
+   assert(oNChild != NULL);
+
+   /* a directory's only leaf grows by doubling until it is full;
+      fill a bigger one and swap it in whole, so readers still
+      searching the old one are not disturbed */
+   psOld = (struct nodeChildren *) oNParent->psChildren;
+   if(psOld == NULL || (psOld->sHead.ulLevel == 0 &&
+                        psOld->sHead.ulLength == psOld->ulCapacity &&
+                        psOld->ulCapacity < NODE_BLOCK_SLOTS)) {
+      ulLength = (psOld == NULL) ? 0 : psOld->sHead.ulLength;
+      assert(ulIndex <= ulLength);
+      psNew = Node_newChildren((psOld == NULL) ? NODE_MIN_CHILDREN :
+                               (2 * psOld->ulCapacity <
+                                NODE_BLOCK_SLOTS)
+                               ? 2 * psOld->ulCapacity
+                               : NODE_BLOCK_SLOTS);
+      if(psNew == NULL)
+         return MEMORY_ERROR;
+      for(i = 0; i < ulIndex; i++)
+         Node_moveSlot(psNew, i, psOld, i);
+      Node_putSlot(psNew, ulIndex, oNChild);
+      for(i = ulIndex; i < ulLength; i++)
+         Node_moveSlot(psNew, i + 1, psOld, i);
+      psNew->sHead.ulLength = ulLength + 1;
+      __atomic_store_n(&oNParent->psChildren, &psNew->sHead,
+                       __ATOMIC_RELEASE);
+      if(psOld != NULL)
+         Node_retire(oNParent->psStore, free, psOld);
+      Node_indexChild(oNParent, oNChild);
+      return SUCCESS;
+   }
+
+   /* otherwise add in place, splitting full blocks on the way up */
+   assert(ulIndex <= Node_countBlock(oNParent->psChildren));
+   iStatus = Node_reserveSpares(oNParent->psChildren, ulIndex,
+                                &sSpares);
+   if(iStatus != SUCCESS)
+      return iStatus;
+   Node_beginChange(oNParent);
+   psSplit = Node_insertBlock(oNParent->psChildren, ulIndex, oNChild,
+                              &sSpares);
+   if(psSplit != NULL) {
+      /* the old root and the block split off it go under a new one */
+      psRoot = Node_takeBranch(&sSpares,
+                               oNParent->psChildren->ulLevel + 1);
+      psRoot->apsBlocks[0] = oNParent->psChildren;
+      psRoot->aoNFirst[0] = Node_firstOf(oNParent->psChildren);
+      psRoot->aulEnds[0] = Node_countBlock(oNParent->psChildren);
+      psRoot->apsBlocks[1] = psSplit;
+      psRoot->aoNFirst[1] = Node_firstOf(psSplit);
+      psRoot->aulEnds[1] = psRoot->aulEnds[0] +
+                           Node_countBlock(psSplit);
+      psRoot->sHead.ulLength = 2;
+      __atomic_store_n(&oNParent->psChildren, &psRoot->sHead,
+                       __ATOMIC_RELEASE);
+   }
+   Node_endChange(oNParent);
+   assert(sSpares.psLeaf == NULL && sSpares.psBranches == NULL);
+   Node_indexChild(oNParent, oNChild);
+   return SUCCESS;
+}
+
+/* Frees pvBlock, a block, and every block below it, as Node_freeBlocks
+   does. */
+static void Node_releaseBlocks(void *pvBlock) {
+   Node_freeBlocks(pvBlock);
+}
+
+/*
+  Adds psBlock, which no longer holds any children or blocks still in
+  use, to the list *ppsDropped. Blocks cannot be retired during a
+  change, since retiring may wait for readers that are themselves
+  waiting for the change to end.
+*/
+static void Node_dropBlock(struct nodeBlock *psBlock,
+                           struct nodeBlock **ppsDropped) {
+   assert(psBlock != NULL);
+   assert(ppsDropped != NULL);
+
+   psBlock->psNextDropped = *ppsDropped;
+   *ppsDropped = psBlock;
+}
+
+/*
+  Takes the block in slot ulSlot out of psBranch, which must have
+  another, shifting later slots down, and adds it to *ppsDropped.
+*/
+static void Node_branchDrop(struct nodeBranch *psBranch, size_t ulSlot,
+                            struct nodeBlock **ppsDropped) {
+   struct nodeBlock *psBlock;
+   size_t ulLength;
+   size_t ulCount;
+   size_t i;
+
+   assert(psBranch != NULL);
+
+   ulLength = psBranch->sHead.ulLength;
+   assert(ulSlot < ulLength);
+   assert(ulLength > 1);
+
+   psBlock = psBranch->apsBlocks[ulSlot];
+   ulCount = psBranch->aulEnds[ulSlot] -
+             ((ulSlot > 0) ? psBranch->aulEnds[ulSlot - 1] : 0);
+   for(i = ulSlot; i + 1 < ulLength; i++) {
+      __atomic_store_n(&psBranch->apsBlocks[i],
+                       psBranch->apsBlocks[i + 1], __ATOMIC_RELEASE);
+      __atomic_store_n(&psBranch->aoNFirst[i],
+                       psBranch->aoNFirst[i + 1], __ATOMIC_RELEASE);
+      __atomic_store_n(&psBranch->aulEnds[i],
+                       psBranch->aulEnds[i + 1] - ulCount,
+                       __ATOMIC_RELEASE);
+   }
+   __atomic_store_n(&psBranch->sHead.ulLength, ulLength - 1,
+                    __ATOMIC_RELEASE);
+   Node_dropBlock(psBlock, ppsDropped);
+}
+
+/*
+  Moves everything in the block in slot ulSlot + 1 of psBranch to the
+  end of the block in slot ulSlot, which has room for it, and drops
+  the emptied block into *ppsDropped.
+*/
+static void Node_mergeBlocks(struct nodeBranch *psBranch,
+                             size_t ulSlot,
+                             struct nodeBlock **ppsDropped) {
+   struct nodeBlock *psLeft;
+   struct nodeBlock *psRight;
+   struct nodeChildren *psLeftLeaf;
+   struct nodeChildren *psRightLeaf;
+   struct nodeBranch *psLeftBranch;
+   struct nodeBranch *psRightBranch;
+   size_t ulLeft;
+   size_t ulCount;
+   size_t i;
+
+   assert(psBranch != NULL);
+   assert(ulSlot + 1 < psBranch->sHead.ulLength);
+
+   psLeft = psBranch->apsBlocks[ulSlot];
+   psRight = psBranch->apsBlocks[ulSlot + 1];
+   ulLeft = psLeft->ulLength;
+   assert(ulLeft + psRight->ulLength <= NODE_BLOCK_SLOTS);
+
+   if(psLeft->ulLevel == 0) {
+      psLeftLeaf = (struct nodeChildren *) psLeft;
+      psRightLeaf = (struct nodeChildren *) psRight;
+      for(i = 0; i < psRight->ulLength; i++)
+         Node_moveSlot(psLeftLeaf, ulLeft + i, psRightLeaf, i);
+   }
+   else {
+      psLeftBranch = (struct nodeBranch *) psLeft;
+      psRightBranch = (struct nodeBranch *) psRight;
+      ulCount = Node_countBlock(psLeft);
+      for(i = 0; i < psRight->ulLength; i++) {
+         __atomic_store_n(&psLeftBranch->apsBlocks[ulLeft + i],
+                          psRightBranch->apsBlocks[i],
+                          __ATOMIC_RELEASE);
+         __atomic_store_n(&psLeftBranch->aoNFirst[ulLeft + i],
+                          psRightBranch->aoNFirst[i], __ATOMIC_RELEASE);
+         __atomic_store_n(&psLeftBranch->aulEnds[ulLeft + i],
+                          psRightBranch->aulEnds[i] + ulCount,
+                          __ATOMIC_RELEASE);
+      }
+   }
+   __atomic_store_n(&psLeft->ulLength, ulLeft + psRight->ulLength,
+                    __ATOMIC_RELEASE);
+
+   /* the left block now ends where the right one did */
+   __atomic_store_n(&psBranch->aulEnds[ulSlot],
+                    psBranch->aulEnds[ulSlot + 1], __ATOMIC_RELEASE);
+
+   /* what was in the right block is the left one's now */
+   __atomic_store_n(&psRight->ulLength, 0, __ATOMIC_RELEASE);
+   Node_branchDrop(psBranch, ulSlot + 1, ppsDropped);
+}
+
+/*
+  Takes the child at index ulIndex among the children below psBlock
+  out, dropping blocks that empty and merging ones that run low into a
+  neighbour they fit in, and adds the blocks dropped to *ppsDropped.
+  Never needs memory, so it cannot fail.
+*/
+static void Node_removeBlock(struct nodeBlock *psBlock, size_t ulIndex,
+                             struct nodeBlock **ppsDropped) {
+   struct nodeChildren *psLeaf;
+   struct nodeBranch *psBranch;
+   struct nodeBlock *psChild;
+   size_t ulLength;
+   size_t ulSlot;
+   size_t i;
+
+   assert(psBlock != NULL);
+
+   ulLength = psBlock->ulLength;
+   if(psBlock->ulLevel == 0) {
+      psLeaf = (struct nodeChildren *) psBlock;
+      assert(ulIndex < ulLength);
+      for(i = ulIndex; i + 1 < ulLength; i++)
+         Node_moveSlot(psLeaf, i, psLeaf, i + 1);
+      __atomic_store_n(&psBlock->ulLength, ulLength - 1,
+                       __ATOMIC_RELEASE);
+      return;
+   }
+
+   psBranch = (struct nodeBranch *) psBlock;
+   ulSlot = Node_findSlot(psBranch, ulIndex);
+   psChild = psBranch->apsBlocks[ulSlot];
+   Node_removeBlock(psChild, (ulSlot > 0) ?
+                    ulIndex - psBranch->aulEnds[ulSlot - 1] : ulIndex,
+                    ppsDropped);
+   for(i = ulSlot; i < ulLength; i++)
+      __atomic_store_n(&psBranch->aulEnds[i], psBranch->aulEnds[i] - 1,
+                       __ATOMIC_RELEASE);
+
+   if(Node_countBlock(psChild) == 0) {
+      /* an emptied block is dropped, unless it is psBranch's only one,
+         in which case psBranch is emptied and dropped in turn */
+      if(ulLength > 1)
+         Node_branchDrop(psBranch, ulSlot, ppsDropped);
+      return;
+   }
+   __atomic_store_n(&psBranch->aoNFirst[ulSlot], Node_firstOf(psChild),
+                    __ATOMIC_RELEASE);
+
+   if(psChild->ulLength < NODE_BLOCK_MIN && ulLength > 1) {
+      if(ulSlot + 1 == ulLength)
+         ulSlot--;
+      if(psBranch->apsBlocks[ulSlot]->ulLength +
+         psBranch->apsBlocks[ulSlot + 1]->ulLength <= NODE_BLOCK_SLOTS)
+         Node_mergeBlocks(psBranch, ulSlot, ppsDropped);
+   }
+}
+
+/*
+  Unlinks the child at index ulIndex of oNParent's children. Never
+  needs memory, so it cannot fail.
+*/
+static void Node_removeChild(Node_T oNParent, size_t ulIndex) {
+   struct nodeChildren *psLeaf;
+   struct nodeBlock *psRoot;
+   struct nodeBlock *psDropped = NULL;
+   size_t ulLeafIndex;
+
+   assert(oNParent != NULL);
+   assert(oNParent->psChildren != NULL);
+   assert(ulIndex < Node_countBlock(oNParent->psChildren));
+
+   if(oNParent->psIndex != NULL) {
+      psLeaf = Node_leafAt(oNParent->psChildren, ulIndex, &ulLeafIndex);
+      Node_unindexChild(oNParent, psLeaf->aoNChildren[ulLeafIndex]);
+   }
+
+   Node_beginChange(oNParent);
+   Node_removeBlock(oNParent->psChildren, ulIndex, &psDropped);
+
+   /* a root with one slot left is replaced by the block in it, until
+      a directory that shrinks far enough is back to a single leaf */
+   for(psRoot = oNParent->psChildren;
+       psRoot->ulLevel > 0 && psRoot->ulLength == 1;
+       psRoot = oNParent->psChildren) {
+      __atomic_store_n(&oNParent->psChildren,
+                       ((struct nodeBranch *) psRoot)->apsBlocks[0],
+                       __ATOMIC_RELEASE);
+      __atomic_store_n(&psRoot->ulLength, 0, __ATOMIC_RELEASE);
+      Node_dropBlock(psRoot, &psDropped);
+   }
+   Node_endChange(oNParent);
+
+   while(psDropped != NULL) {
+      psRoot = psDropped;
+      psDropped = psDropped->psNextDropped;
+      Node_retire(oNParent->psStore, Node_releaseBlocks, psRoot);
+   }
+}
+
+/*
+  Makes the child at index ulIndex of oNParent's children oNChild, an
+  equivalent node with the same name. Readers searching meanwhile find
+  either one, so no version change is needed.
+*/
+static void Node_replaceChild(Node_T oNParent, size_t ulIndex,
+                              Node_T oNChild) {
+   struct nodeBlock *psBlock;
+   struct nodeBranch *psBranch;
+   struct nodeSlot *psSlot;
+   size_t ulSlot;
+
+   assert(oNParent != NULL);
+   assert(oNChild != NULL);
+
+   for(psBlock = oNParent->psChildren; psBlock->ulLevel > 0;
+       psBlock = psBranch->apsBlocks[ulSlot]) {
+      psBranch = (struct nodeBranch *) psBlock;
+      ulSlot = Node_findSlot(psBranch, ulIndex);
+      if(ulSlot > 0)
+         ulIndex -= psBranch->aulEnds[ulSlot - 1];
+      if(ulIndex == 0)
+         __atomic_store_n(&psBranch->aoNFirst[ulSlot], oNChild,
+                          __ATOMIC_RELEASE);
+   }
+   if(oNParent->psIndex != NULL) {
+      psSlot = Node_indexSlot(oNParent->psIndex,
+                  ((struct nodeChildren *) psBlock)
+                     ->aoNChildren[ulIndex]);
+      __atomic_store_n(&psSlot->psChild, oNChild, __ATOMIC_RELEASE);
+   }
+   __atomic_store_n(&((struct nodeChildren *) psBlock)
+                       ->aoNChildren[ulIndex],
+                    oNChild, __ATOMIC_RELEASE);
+}
+
+/*
+  Returns a copy of psBlock and every block below it, holding the
+  same children, or NULL if insufficient memory is available.
+*/
+static struct nodeBlock *Node_copyBlocks(struct nodeBlock *psBlock) {
+   struct nodeChildren *psLeaf;
+   struct nodeBranch *psBranch;
+   struct nodeBranch *psCopy;
+   size_t ulSlot;
+
+   assert(psBlock != NULL);
+
+   if(psBlock->ulLevel == 0) {
+      psLeaf = Node_newChildren(
+         ((struct nodeChildren *) psBlock)->ulCapacity);
+      if(psLeaf == NULL)
+         return NULL;
+      memcpy(psLeaf->aoNChildren,
+             ((struct nodeChildren *) psBlock)->aoNChildren,
+             psBlock->ulLength * sizeof(Node_T));
+      memcpy(Node_tagsOf(psLeaf),
+             Node_tagsOf((struct nodeChildren *) psBlock),
+             NODE_TAG_WORDS(psBlock->ulLength) * sizeof(size_t));
+      psLeaf->sHead.ulLength = psBlock->ulLength;
+      return &psLeaf->sHead;
+   }
+
+   psBranch = (struct nodeBranch *) psBlock;
+   psCopy = Node_newBranch(psBlock->ulLevel);
+   if(psCopy == NULL)
+      return NULL;
+   for(ulSlot = 0; ulSlot < psBlock->ulLength; ulSlot++) {
+      psCopy->apsBlocks[ulSlot] =
+         Node_copyBlocks(psBranch->apsBlocks[ulSlot]);
+      if(psCopy->apsBlocks[ulSlot] == NULL) {
+         psCopy->sHead.ulLength = ulSlot;
+         Node_freeBlocks(&psCopy->sHead);
+         return NULL;
+      }
+      psCopy->aoNFirst[ulSlot] = psBranch->aoNFirst[ulSlot];
+      psCopy->aulEnds[ulSlot] = psBranch->aulEnds[ulSlot];
+   }
+   psCopy->sHead.ulLength = psBlock->ulLength;
+   return &psCopy->sHead;
+}
+
+/* Frees the ulBlocks blocks at apsLevel, and the array itself. */
+static void Node_freeLevel(struct nodeBlock **apsLevel,
+                           size_t ulBlocks) {
+   size_t i;
+
+   assert(apsLevel != NULL);
+
+   for(i = 0; i < ulBlocks; i++)
+      Node_freeBlocks(apsLevel[i]);
+   free(apsLevel);
+}
+
+/*
+  Returns the root of a tree of blocks holding the ulCount children at
+  aoNChildren in order, or NULL if insufficient memory is available.
+  Up to a full leaf's worth go in one leaf of just their size, as a
+  directory made one child at a time would keep them; more are packed
+  three quarters full, leaving room for later children.
+*/
+static struct nodeBlock *Node_buildBlocks(Node_T *aoNChildren,
+                                          size_t ulCount) {
+   struct nodeBlock **apsLevel;
+   struct nodeChildren *psLeaf;
+   struct nodeBranch *psBranch;
+   size_t ulBlocks = 0;
+   size_t ulParents;
+   size_t ulLevel = 0;
+   size_t ulTake;
+   size_t i;
+   size_t j;
+
+   assert(aoNChildren != NULL);
+   assert(ulCount > 0);
+
+   if(ulCount <= NODE_BLOCK_SLOTS) {
+      psLeaf = Node_newChildren(ulCount);
+      if(psLeaf == NULL)
+         return NULL;
+      for(j = 0; j < ulCount; j++)
+         Node_putSlot(psLeaf, j, aoNChildren[j]);
+      psLeaf->sHead.ulLength = ulCount;
+      return &psLeaf->sHead;
+   }
+
+   apsLevel = malloc((ulCount / NODE_BLOCK_FILL + 1) *
+                     sizeof(struct nodeBlock *));
+   if(apsLevel == NULL)
+      return NULL;
+
+   for(i = 0; i < ulCount; i += ulTake) {
+      ulTake = (ulCount - i < NODE_BLOCK_FILL) ? ulCount - i
+                                               : NODE_BLOCK_FILL;
+      psLeaf = Node_newChildren(NODE_BLOCK_SLOTS);
+      if(psLeaf == NULL) {
+         Node_freeLevel(apsLevel, ulBlocks);
+         return NULL;
+      }
+      for(j = 0; j < ulTake; j++)
+         Node_putSlot(psLeaf, j, aoNChildren[i + j]);
+      psLeaf->sHead.ulLength = ulTake;
+      apsLevel[ulBlocks++] = &psLeaf->sHead;
+   }
+
+   /* each level up packs the one below in place, in order */
+   while(ulBlocks > 1) {
+      ulLevel++;
+      ulParents = 0;
+      for(i = 0; i < ulBlocks; i += ulTake) {
+         ulTake = (ulBlocks - i < NODE_BLOCK_FILL) ? ulBlocks - i
+                                                   : NODE_BLOCK_FILL;
+         psBranch = Node_newBranch(ulLevel);
+         if(psBranch == NULL) {
+            /* blocks already moved up are freed from their parents */
+            ulBlocks -= i - ulParents;
+            for(j = ulParents; j < ulBlocks; j++)
+               apsLevel[j] = apsLevel[j + i - ulParents];
+            Node_freeLevel(apsLevel, ulBlocks);
+            return NULL;
+         }
+         for(j = 0; j < ulTake; j++) {
+            psBranch->apsBlocks[j] = apsLevel[i + j];
+            psBranch->aoNFirst[j] = Node_firstOf(apsLevel[i + j]);
+            psBranch->aulEnds[j] = Node_countBlock(apsLevel[i + j]) +
+                                   ((j > 0) ? psBranch->aulEnds[j - 1]
+                                            : 0);
+         }
+         psBranch->sHead.ulLength = ulTake;
+         apsLevel[ulParents++] = &psBranch->sHead;
+      }
+      ulBlocks = ulParents;
+   }
+
+   psBranch = (struct nodeBranch *) apsLevel[0];
+   free(apsLevel);
+   return &psBranch->sHead;
+}
+
+/*
+  Returns the length, in components, of the longest prefix shared by
+  oNNode's absolute path and oPPath, found by walking oNNode's parent
+  links and comparing names against oPPath's components.
+*/
+static size_t Node_getSharedPrefixDepth(Node_T oNNode, Path_T oPPath) {
+   size_t ulShared;
+
+   assert(oNNode != NULL);
+   assert(oPPath != NULL);
+
+   /* climb to the deepest ancestor that oPPath could share */
+   while(oNNode->ulDepth > Path_getDepth(oPPath))
+      oNNode = oNNode->oNParent;
+
+   /* the shared prefix ends just above the deepest mismatch */
+   ulShared = oNNode->ulDepth;
+   while(oNNode != NULL) {
+      if(!Node_hasName(oNNode,
+             Path_getComponent(oPPath, oNNode->ulDepth - 1),
+             Path_getComponentLength(oPPath, oNNode->ulDepth - 1)))
+         ulShared = oNNode->ulDepth - 1;
+      oNNode = oNNode->oNParent;
+   }
+   return ulShared;
+}
+
+/*
+  Sets *ppsLatch to a new latch from psStore for a node of type
+  nodeType, or to NULL for a file, which needs none, for a caller that
+  holds the store's mutex. Returns SUCCESS, or MEMORY_ERROR if the
+  latch could not be made.
+*/
+static int Node_newLatch(struct nodeStore *psStore, NodeType nodeType,
+                         pthread_rwlock_t **ppsLatch) {
+   pthread_rwlock_t *psLatch;
+
+   assert(psStore != NULL);
+   assert(ppsLatch != NULL);
+
+   *ppsLatch = NULL;
+   if(nodeType == NODE_FILE)
+      return SUCCESS;
+
+   psLatch = Pool_alloc(psStore->oPlLatches);
+   if(psLatch == NULL)
+      return MEMORY_ERROR;
+   if(pthread_rwlock_init(psLatch, NULL) != 0) {
+      Pool_release(psStore->oPlLatches, psLatch);
+      return MEMORY_ERROR;
+   }
+   *ppsLatch = psLatch;
+   return SUCCESS;
+}
+
+/*
+  Destroys psLatch, made by Node_newLatch from psStore, and gives it
+  back, for a caller that holds the store's mutex. Does nothing if
+  psLatch is NULL.
+*/
+static void Node_freeLatch(struct nodeStore *psStore,
+                           pthread_rwlock_t *psLatch) {
+   assert(psStore != NULL);
+
+   if(psLatch == NULL)
+      return;
+   (void) pthread_rwlock_destroy(psLatch);
+   Pool_release(psStore->oPlLatches, psLatch);
+}
+
+/*
+  Allocates a new node from psStore named by the ulLength bytes at
+  pcName, with type nodeType, depth ulDepth, and parent oNParent, but
+  does not link it into oNParent's children. Returns an int SUCCESS
+  status and sets *poNResult to be the new node if successful.
+  Otherwise, sets *poNResult to NULL and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+static int Node_alloc(struct nodeStore *psStore, const char *pcName,
+                      size_t ulLength, NodeType nodeType,
+                      size_t ulDepth, Node_T oNParent,
+                      Node_T *poNResult) {
+   struct node *psNew;
+   int iStatus;
+
+   assert(psStore != NULL);
+   assert(pcName != NULL);
+   assert(poNResult != NULL);
+
+   /* allocate space for a new node and intern its name */
+   (void) pthread_mutex_lock(&psStore->sMutex);
+   psNew = Pool_alloc(psStore->oPlPool);
+   if(psNew == NULL)
+      iStatus = MEMORY_ERROR;
+   else {
+      iStatus = Atom_new(psStore->oAtNames, pcName, ulLength,
+                         &psNew->oAName);
+      if(iStatus != SUCCESS)
+         Pool_release(psStore->oPlPool, psNew);
+      else {
+         iStatus = Node_newLatch(psStore, nodeType, &psNew->psLatch);
+         if(iStatus != SUCCESS) {
+            Atom_free(psStore->oAtNames, psNew->oAName);
+            Pool_release(psStore->oPlPool, psNew);
+         }
+      }
+   }
+   if(iStatus != SUCCESS) {
+      (void) pthread_mutex_unlock(&psStore->sMutex);
+      *poNResult = NULL;
+      return iStatus;
+   }
+
+   /* set the node type, depth, parent, and empty contents */
+   psNew->psStore = psStore;
+   psNew->ulRefs = 1;
+   psNew->psChildren = NULL;
+   psNew->psIndex = NULL;
+   /* a new file reads as changing until its contents are first set,
+      so lock-free readers never see it without them */
+   psNew->ulVersion = (nodeType == NODE_FILE) ? 1 : 0;
+   psNew->type = nodeType;
+   psNew->iDetaches = 0;
+   psNew->ulDepth = ulDepth;
+   psNew->oNParent = oNParent;
+   psNew->pvContents = NULL;
+   psNew->ulLength = 0;
+
+   /* only a whole node gets an ID, so a lookup by ID never finds one
+      half made */
+   psNew->ulId = 0;
+   if(psStore->oItIds != NULL) {
+      iStatus = IdTable_add(psStore->oItIds, psNew, &psNew->ulId);
+      if(iStatus != SUCCESS) {
+         Node_freeLatch(psStore, psNew->psLatch);
+         Atom_free(psStore->oAtNames, psNew->oAName);
+         Pool_release(psStore->oPlPool, psNew);
+         psNew = NULL;
+      }
+   }
+   (void) pthread_mutex_unlock(&psStore->sMutex);
+
+   *poNResult = psNew;
+   return iStatus;
+}
+
+/* Gives back oNNode, made by Node_alloc but never linked anywhere. */
+static void Node_unalloc(Node_T oNNode) {
+   struct nodeStore *psStore;
+
+   assert(oNNode != NULL);
+
+   psStore = oNNode->psStore;
+   (void) pthread_mutex_lock(&psStore->sMutex);
+   Node_freeLatch(psStore, oNNode->psLatch);
+   if(oNNode->ulId != 0 && psStore->oItIds != NULL)
+      IdTable_remove(psStore->oItIds, oNNode->ulId);
+   Atom_free(psStore->oAtNames, oNNode->oAName);
+   Pool_release(psStore->oPlPool, oNNode);
+   (void) pthread_mutex_unlock(&psStore->sMutex);
+}
+
+/*
+  Creates a new node with path oPPath and parent oNParent.  Returns an
+  int SUCCESS status and sets *poNResult to be the new node if
+  successful. Otherwise, sets *poNResult to NULL and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * CONFLICTING_PATH if oNParent's path is not an ancestor of oPPath
+  * NO_SUCH_PATH if oPPath is of depth 0
+                 or oNParent's path is not oPPath's direct parent
+                 or oNParent is NULL but oPPath is not of depth 1
+  * ALREADY_IN_TREE if oNParent already has a child with this path
+*/
+int Node_new(Path_T oPPath, NodeType nodeType, Node_T oNParent, 
+             Node_T *poNResult) {
+   struct node *psNew;
+   struct nodeStore *psStore;
+   const char *pcName;
+   size_t ulDepth;
+   size_t ulIndex;
+   int iStatus;
+
+   assert(oPPath != NULL);
+
+   ulDepth = Path_getDepth(oPPath);
+
+   /* validate the new node's parent */
+   if(oNParent != NULL) {
+      /* parent must be an ancestor of child */
+      if(Node_getSharedPrefixDepth(oNParent, oPPath) <
+         oNParent->ulDepth) {
+         *poNResult = NULL;
+         return CONFLICTING_PATH;
+      }
+
+      /* parent must be exactly one level up from child */
+      if(ulDepth != oNParent->ulDepth + 1) {
+         *poNResult = NULL;
+         return NO_SUCH_PATH;
+      }
+
+      /* parent must not already have child with this path; having
+         checked the rest of the path, only the last component is left
+         to compare */
+      if(Node_hasChildComponent(oNParent,
+            Path_getComponent(oPPath, ulDepth - 1), &ulIndex)) {
+         *poNResult = NULL;
+         return ALREADY_IN_TREE;
+      }
+   }
+   else {
+      /* new node must be root */
+      /* can only create one "level" at a time */
+      if(ulDepth != 1) {
+         *poNResult = NULL;
+         return NO_SUCH_PATH;
+      }
+   }
+
+   /* use the parent's tree's allocators, or new ones if this node
+      starts a new tree */
+   if(oNParent != NULL)
+      psStore = oNParent->psStore;
+   else {
+      psStore = Node_newStore();
+      if(psStore == NULL) {
+         *poNResult = NULL;
+         return MEMORY_ERROR;
+      }
+   }
+
+   pcName = Path_getComponent(oPPath, ulDepth - 1);
+   iStatus = Node_alloc(psStore, pcName, strlen(pcName), nodeType,
+                        ulDepth, oNParent, &psNew);
+   if(iStatus != SUCCESS) {
+      if(oNParent == NULL)
+         Node_freeStore(psStore);
+      *poNResult = NULL;
+      return iStatus;
+   }
+
+   /* Link into parent's children list */
+   if(oNParent != NULL) {
+      iStatus = Node_addChild(oNParent, psNew, ulIndex);
+      if(iStatus != SUCCESS) {
+         Node_unalloc(psNew);
+         *poNResult = NULL;
+         return iStatus;
+      }
+   }
+
+   *poNResult = psNew;
+
+   return SUCCESS;
+}
+
+int Node_newLast(Node_T oNParent, const char *pcName,
+                 NodeType nodeType, Node_T *poNResult) {
+   Node_T oNNew;
+   Node_T oNLast;
+   size_t ulLength;
+   size_t ulCount;
+   int iStatus;
+
+   assert(oNParent != NULL);
+   assert(pcName != NULL);
+   assert(poNResult != NULL);
+
+   *poNResult = NULL;
+   ulLength = strlen(pcName);
+   if(oNParent->type != NODE_DIR || ulLength == 0 ||
+      strchr(pcName, '/') != NULL)
+      return CONFLICTING_PATH;
+
+   /* keeping the children sorted needs only the last one checked */
+   ulCount = Node_getNumChildren(oNParent);
+   if(ulCount > 0) {
+      iStatus = Node_getChild(oNParent, ulCount - 1, &oNLast);
+      assert(iStatus == SUCCESS);
+      if(Node_compareComponent(oNLast, pcName, ulLength) >= 0)
+         return CONFLICTING_PATH;
+   }
+
+   iStatus = Node_alloc(oNParent->psStore, pcName, ulLength, nodeType,
+                        oNParent->ulDepth + 1, oNParent, &oNNew);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   iStatus = Node_addChild(oNParent, oNNew, ulCount);
+   if(iStatus != SUCCESS) {
+      Node_unalloc(oNNew);
+      return iStatus;
+   }
+
+   *poNResult = oNNew;
+   return SUCCESS;
+}
+
+int Node_newChild(Node_T oNParent, const char *pcName,
+                  NodeType nodeType, void *pvContents, size_t ulLength,
+                  Node_T *poNResult) {
+   Node_T oNNew;
+   size_t ulNameLength;
+   size_t ulIndex;
+   int iStatus;
+
+   assert(oNParent != NULL);
+   assert(pcName != NULL);
+   assert(poNResult != NULL);
+
+   *poNResult = NULL;
+   ulNameLength = strlen(pcName);
+   if(oNParent->type != NODE_DIR || ulNameLength == 0 ||
+      strchr(pcName, '/') != NULL)
+      return CONFLICTING_PATH;
+
+   if(Node_hasChildComponent(oNParent, pcName, &ulIndex))
+      return ALREADY_IN_TREE;
+
+   iStatus = Node_alloc(oNParent->psStore, pcName, ulNameLength,
+                        nodeType, oNParent->ulDepth + 1, oNParent,
+                        &oNNew);
+   if(iStatus != SUCCESS)
+      return iStatus;
+
+   /* a file linked while still odd could hold up a reader that a
+      retire in Node_addChild then waits out, so no reader may reach
+      it before it is whole */
+   if(nodeType == NODE_FILE) {
+      oNNew->pvContents = pvContents;
+      oNNew->ulLength = ulLength;
+      oNNew->ulVersion = 0;
+   }
+
+   iStatus = Node_addChild(oNParent, oNNew, ulIndex);
+   if(iStatus != SUCCESS) {
+      Node_unalloc(oNNew);
+      return iStatus;
+   }
+
+   *poNResult = oNNew;
+   return SUCCESS;
+}
+
+int Node_newUnlinked(Node_T oNParent, const char *pcName,
+                     NodeType nodeType, Node_T *poNResult) {
+   size_t ulLength;
+
+   assert(oNParent != NULL);
+   assert(pcName != NULL);
+   assert(poNResult != NULL);
+
+   *poNResult = NULL;
+   ulLength = strlen(pcName);
+   if(oNParent->type != NODE_DIR || ulLength == 0 ||
+      strchr(pcName, '/') != NULL)
+      return CONFLICTING_PATH;
+
+   return Node_alloc(oNParent->psStore, pcName, ulLength, nodeType,
+                     oNParent->ulDepth + 1, oNParent, poNResult);
+}
+
+int Node_linkChildren(Node_T oNParent, Node_T *aoNChildren,
+                      size_t ulCount) {
+   struct nodeBlock *psChildren;
+   size_t i;
+
+   assert(oNParent != NULL);
+   assert(oNParent->type == NODE_DIR);
+   assert(oNParent->psChildren == NULL);
+   assert(aoNChildren != NULL || ulCount == 0);
+
+   if(ulCount == 0)
+      return SUCCESS;
+
+   for(i = 0; i < ulCount; i++) {
+      assert(aoNChildren[i]->oNParent == oNParent);
+      assert(i == 0 || Atom_compare(aoNChildren[i - 1]->oAName,
+                                    aoNChildren[i]->oAName) < 0);
+   }
+   psChildren = Node_buildBlocks(aoNChildren, ulCount);
+   if(psChildren == NULL)
+      return MEMORY_ERROR;
+   __atomic_store_n(&oNParent->psChildren, psChildren,
+                    __ATOMIC_RELEASE);
+   if(ulCount >= NODE_INDEX_MIN)
+      Node_swapIndex(oNParent, Node_buildIndex(oNParent));
+   return SUCCESS;
+}
+
+/* Returns the child at index ulIndex of oNParent's children, which
+   must have that many. */
+static Node_T Node_childAt(Node_T oNParent, size_t ulIndex) {
+   struct nodeChildren *psLeaf;
+   size_t ulLeafIndex;
+
+   assert(oNParent != NULL);
+   assert(oNParent->psChildren != NULL);
+
+   psLeaf = Node_leafAt(oNParent->psChildren, ulIndex, &ulLeafIndex);
+   return psLeaf->aoNChildren[ulLeafIndex];
+}
+
+/*
+  Goes on taking down a subtree that Node_takeDown started on, from
+  oNNode, for at most ulSteps steps of constant work each. Calls
+  (*pfDrop) on each child of a node being taken down to drop one
+  reference to it; where that was the last, takes that node down too,
+  and calls (*pfRelease) on it once its children are done. Returns
+  the node to go on from, or NULL once the whole subtree is done.
+  Rather than recursing, it keeps its place in the nodes being taken
+  down themselves: a node's parent link becomes the way back up, and
+  its file length the index of its next child to drop. So it needs
+  constant stack however deep the subtree is, and can stop anywhere.
+*/
+static Node_T Node_takeDownSome(Node_T oNNode, size_t ulSteps,
+                                boolean (*pfDrop)(Node_T oNNode),
+                                void (*pfRelease)(Node_T oNNode)) {
+   Node_T oNUp = NULL;
+   Node_T oNNext;
+
+   assert(pfDrop != NULL);
+   assert(pfRelease != NULL);
+
+   for(; oNNode != NULL && ulSteps > 0; ulSteps--) {
+      if(oNNode->psChildren != NULL &&
+         oNNode->ulLength < Node_countBlock(oNNode->psChildren)) {
+         oNNext = Node_childAt(oNNode, oNNode->ulLength++);
+         if((*pfDrop)(oNNext)) {
+            oNNext->oNParent = oNNode;
+            oNNext->ulLength = 0;
+            oNNode = oNNext;
+         }
+      }
+      else {
+         oNUp = oNNode->oNParent;
+         if(oNNode->psChildren != NULL)
+            Node_freeBlocks(oNNode->psChildren);
+         free(oNNode->psIndex);
+         (*pfRelease)(oNNode);
+         oNNode = oNUp;
+      }
+   }
+   return oNNode;
+}
+
+/*
+  Starts taking down the subtree rooted at oNNode, which no thread but
+  the caller can reach any more, by calling (*pfDrop) on oNNode to
+  drop one reference to it. Returns oNNode, for Node_takeDownSome to
+  take down, if that was the last, or NULL if there is nothing to do.
+*/
+static Node_T Node_startTakeDown(Node_T oNNode,
+                                 boolean (*pfDrop)(Node_T oNNode)) {
+   assert(oNNode != NULL);
+   assert(pfDrop != NULL);
+
+   if(!(*pfDrop)(oNNode))
+      return NULL;
+   oNNode->oNParent = NULL;
+   oNNode->ulLength = 0;
+   return oNNode;
+}
+
+/*
+  Takes down the whole subtree rooted at oNNode, which no thread but
+  the caller can reach any more, as Node_startTakeDown and
+  Node_takeDownSome do.
+*/
+static void Node_takeDown(Node_T oNNode,
+                          boolean (*pfDrop)(Node_T oNNode),
+                          void (*pfRelease)(Node_T oNNode)) {
+   assert(oNNode != NULL);
+
+   (void) Node_takeDownSome(Node_startTakeDown(oNNode, pfDrop),
+                            (size_t) -1, pfDrop, pfRelease);
+}
+
+/* Returns TRUE: a node only ever held by one tree has no other
+   reference to drop. */
+static boolean Node_dropOnly(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->ulRefs == 1);
+   (void) oNNode;
+
+   return TRUE;
+}
+
+void Node_discard(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   Node_takeDown(oNNode, Node_dropOnly, Node_unalloc);
+}
+
+int Node_addBacking(Node_T oNNode, void *pvBlock, size_t ulLength,
+                    void (*pfRelease)(void *pvBlock,
+                                      size_t ulLength)) {
+   struct nodeBacking *psBacking;
+   struct nodeStore *psStore;
+
+   assert(oNNode != NULL);
+   assert(pvBlock != NULL);
+   assert(pfRelease != NULL);
+
+   psBacking = malloc(sizeof(struct nodeBacking));
+   if(psBacking == NULL)
+      return MEMORY_ERROR;
+   psBacking->pvBlock = pvBlock;
+   psBacking->ulLength = ulLength;
+   psBacking->pfRelease = pfRelease;
+
+   psStore = oNNode->psStore;
+   (void) pthread_mutex_lock(&psStore->sMutex);
+   psBacking->psNext = psStore->psBacking;
+   psStore->psBacking = psBacking;
+   (void) pthread_mutex_unlock(&psStore->sMutex);
+   return SUCCESS;
+}
+
+void *Node_getContent(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return oNNode->pvContents;
+}
+
+size_t Node_getContentSize(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return oNNode->ulLength;
+}
+
+
+void Node_setContents(Node_T oNNode, void* pvContents, size_t ulLength) {
+   assert(oNNode != NULL);
+
+   Node_beginChange(oNNode);
+   __atomic_store_n(&oNNode->pvContents, pvContents, __ATOMIC_RELEASE);
+   __atomic_store_n(&oNNode->ulLength, ulLength, __ATOMIC_RELEASE);
+   Node_endChange(oNNode);
+}
+
+void Node_readContents(Node_T oNNode, void **ppvContents,
+                       size_t *pulLength) {
+   size_t ulVersion;
+
+   assert(oNNode != NULL);
+   assert(ppvContents != NULL);
+   assert(pulLength != NULL);
+
+   do {
+      ulVersion = Node_beginRead(oNNode);
+      *ppvContents = __atomic_load_n(&oNNode->pvContents,
+                                     __ATOMIC_ACQUIRE);
+      *pulLength = __atomic_load_n(&oNNode->ulLength, __ATOMIC_ACQUIRE);
+   } while(!Node_endRead(oNNode, ulVersion));
+}
+
+/* Destroys oNNode's latch. Its store is about to be freed in bulk, so
+   neither the node nor its name is given back on its own. */
+static void Node_destroyLatch(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   if(oNNode->psLatch != NULL)
+      (void) pthread_rwlock_destroy(oNNode->psLatch);
+}
+
+/*
+  Destroys the subtree rooted at oNNode, the root of the last tree
+  using its store. Nothing else refers to any node in it, and the
+  store is about to be freed in bulk, so no node or name is given back
+  on its own.
+*/
+static void Node_destroy(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   Node_takeDown(oNNode, Node_dropOnly, Node_destroyLatch);
+}
+
+/* Drops one reference to oNNode, and returns TRUE if it was the
+   last. */
+static boolean Node_dropRef(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return (boolean) (__atomic_sub_fetch(&oNNode->ulRefs, 1,
+                                        __ATOMIC_ACQ_REL) == 0);
+}
+
+/* Gives back oNNode, which no tree refers to any more, and its name
+   to its store. */
+static void Node_release(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   Node_freeLatch(oNNode->psStore, oNNode->psLatch);
+   Atom_free(oNNode->psStore->oAtNames, oNNode->oAName);
+   Pool_release(oNNode->psStore->oPlPool, oNNode);
+}
+
+/*
+  Drops one reference to oNNode. If that was the last, gives back its
+  name and struct node and drops its references to its children in
+  turn. The caller must hold the store's mutex.
+*/
+static void Node_unrefLocked(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   Node_takeDown(oNNode, Node_dropRef, Node_release);
+}
+
+/* Drops one reference to pvNode, a Node_T, under its store's mutex. */
+static void Node_unref(void *pvNode) {
+   Node_T oNNode = pvNode;
+   struct nodeStore *psStore;
+
+   assert(oNNode != NULL);
+
+   psStore = oNNode->psStore;
+   (void) pthread_mutex_lock(&psStore->sMutex);
+   Node_unrefLocked(oNNode);
+   (void) pthread_mutex_unlock(&psStore->sMutex);
+}
+
+/*
+  Drops one tree's reference to its root pvRoot, a Node_T. The last
+  tree using the store frees the store and everything left in it in
+  bulk; any other tree frees only the nodes that no other tree shares.
+*/
+static void Node_releaseTree(void *pvRoot) {
+   Node_T oNRoot = pvRoot;
+   struct nodeStore *psStore;
+   boolean bLast;
+
+   assert(oNRoot != NULL);
+
+   psStore = oNRoot->psStore;
+   (void) pthread_mutex_lock(&psStore->sMutex);
+   bLast = (boolean) (--psStore->ulTrees == 0);
+   if(!bLast)
+      Node_unrefLocked(oNRoot);
+   (void) pthread_mutex_unlock(&psStore->sMutex);
+
+   if(bLast) {
+      Node_destroy(oNRoot);
+      Node_freeStore(psStore);
+   }
+}
+
+/*
+  Searches the first ulCount slots of psLeaf for the child whose name
+  is pcComponent, of string length ulLength, comparing names only
+  where the tags match. Returns
+  the child and sets *pulIndex to its slot if there is one; otherwise
+  returns NULL. Safe for lock-free readers, as Node_search is.
+*/
+static Node_T Node_leafFind(struct nodeChildren *psLeaf,
+                            size_t ulCount, const char *pcComponent,
+                            size_t ulLength, size_t *pulIndex) {
+   size_t *pulTags;
+   Node_T oNChild;
+   size_t ulPattern;
+   size_t ulWord;
+   size_t ulMatch;
+   size_t ulIndex;
+   size_t w;
+
+   assert(psLeaf != NULL);
+   assert(ulCount <= psLeaf->ulCapacity);
+   assert(pcComponent != NULL);
+   assert(pulIndex != NULL);
+
+   if(ulCount < NODE_TAG_MIN) {
+      for(ulIndex = 0; ulIndex < ulCount; ulIndex++) {
+         oNChild = __atomic_load_n(&psLeaf->aoNChildren[ulIndex],
+                                   __ATOMIC_ACQUIRE);
+         if(Node_hasName(oNChild, pcComponent, ulLength)) {
+            *pulIndex = ulIndex;
+            return oNChild;
+         }
+      }
+      return NULL;
+   }
+
+   ulPattern = NODE_TAG_ONES *
+      Node_tagOf(Atom_hash(pcComponent, ulLength));
+   pulTags = Node_tagsOf(psLeaf);
+   for(w = 0; w < NODE_TAG_WORDS(ulCount); w++) {
+      /* each byte of ulWord is 0 where a tag matches, and ulMatch has
+         the top bit of each such byte set; it may also have that of a
+         byte just above one, which the name comparison rules out */
+      ulWord = __atomic_load_n(&pulTags[w], __ATOMIC_ACQUIRE)
+               ^ ulPattern;
+      ulMatch = (ulWord - NODE_TAG_ONES) & ~ulWord
+                & (NODE_TAG_ONES << 7);
+      for(; ulMatch != 0; ulMatch &= ulMatch - 1) {
+         ulIndex = w * sizeof(size_t)
+                   + (size_t) __builtin_ctzl(ulMatch) / 8;
+         if(ulIndex >= ulCount)
+            break;
+         oNChild = __atomic_load_n(&psLeaf->aoNChildren[ulIndex],
+                                   __ATOMIC_ACQUIRE);
+         if(Node_hasName(oNChild, pcComponent, ulLength)) {
+            *pulIndex = ulIndex;
+            return oNChild;
+         }
+      }
+   }
+   return NULL;
+}
 
 /*
-  Links new child oNChild into oNParent's children array at index
-  ulIndex. Returns SUCCESS if the new child was added successfully,
-  or  MEMORY_ERROR if allocation fails adding oNChild to the array.
+  Searches the blocks rooted at psBlock, which may be NULL, for the
+  child whose name is pcComponent, of string length ulLength. Returns
+  the child and sets *pulIndex to its index if there is one; otherwise
+  returns NULL and sets *pulIndex to the index it would be inserted
+  at. pulIndex may be NULL if the caller needs neither index. Every
+  field that can change is loaded atomically and every length is kept
+  within its block, so a lock-free reader may search while a writer
+  changes the blocks, but must then check the parent's version before
+  trusting the result.
 */
-static int Node_addChild(Node_T oNParent, Node_T oNChild,
-                         size_t ulIndex) {
-   assert(oNParent != NULL);
-   assert(oNChild != NULL);
+static Node_T Node_search(struct nodeBlock *psBlock,
+                          const char *pcComponent, size_t ulLength,
+                          size_t *pulIndex) {
+   struct nodeBranch *psBranch;
+   struct nodeChildren *psLeaf;
+   Node_T oNChild;
+   size_t ulOffset = 0;
+   size_t ulLow;
+   size_t ulHigh;
+   size_t ulMid;
+   int iCompare;
 
-   if(DynArray_addAt(oNParent->oDChildren, ulIndex, oNChild))
-      return SUCCESS;
-   else
-      return MEMORY_ERROR;
+   assert(pcComponent != NULL);
+
+   /* in each branch, go down the last slot whose first child is not
+      after pcComponent, or the first slot if every one is */
+   while(psBlock != NULL && psBlock->ulLevel > 0) {
+      psBranch = (struct nodeBranch *) psBlock;
+      ulHigh = __atomic_load_n(&psBlock->ulLength, __ATOMIC_ACQUIRE);
+      if(ulHigh > NODE_BLOCK_SLOTS)
+         ulHigh = NODE_BLOCK_SLOTS;
+      if(ulHigh == 0)
+         psBlock = NULL;
+      else {
+         ulLow = 1;
+         while(ulLow < ulHigh) {
+            ulMid = ulLow + (ulHigh - ulLow) / 2;
+            oNChild = __atomic_load_n(&psBranch->aoNFirst[ulMid],
+                                      __ATOMIC_ACQUIRE);
+            if(Node_compareComponent(oNChild, pcComponent,
+                                     ulLength) <= 0)
+               ulLow = ulMid + 1;
+            else
+               ulHigh = ulMid;
+         }
+         ulLow--;
+         if(ulLow > 0)
+            ulOffset += __atomic_load_n(&psBranch->aulEnds[ulLow - 1],
+                                        __ATOMIC_ACQUIRE);
+         psBlock = __atomic_load_n(&psBranch->apsBlocks[ulLow],
+                                   __ATOMIC_ACQUIRE);
+      }
+   }
+
+   ulLow = 0;
+   ulHigh = 0;
+   psLeaf = (struct nodeChildren *) psBlock;
+   if(psLeaf != NULL) {
+      ulHigh = __atomic_load_n(&psLeaf->sHead.ulLength,
+                               __ATOMIC_ACQUIRE);
+      if(ulHigh > psLeaf->ulCapacity)
+         ulHigh = psLeaf->ulCapacity;
+      oNChild = Node_leafFind(psLeaf, ulHigh, pcComponent, ulLength,
+                              &ulMid);
+      if(oNChild != NULL) {
+         if(pulIndex != NULL)
+            *pulIndex = ulOffset + ulMid;
+         return oNChild;
+      }
+   }
+   if(pulIndex == NULL)
+      return NULL;
+
+   /* otherwise find where such a child would go */
+   while(ulLow < ulHigh) {
+      ulMid = ulLow + (ulHigh - ulLow) / 2;
+      oNChild = __atomic_load_n(&psLeaf->aoNChildren[ulMid],
+                                __ATOMIC_ACQUIRE);
+      iCompare = Node_compareComponent(oNChild, pcComponent, ulLength);
+      if(iCompare == 0) {
+         *pulIndex = ulOffset + ulMid;
+         return oNChild;
+      }
+      if(iCompare < 0)
+         ulLow = ulMid + 1;
+      else
+         ulHigh = ulMid;
+   }
+   *pulIndex = ulOffset + ulLow;
+   return NULL;
+}
+
+Node_T Node_nextInSubtree(Node_T oNRoot, Node_T oNNode,
+                          size_t *pulIndex) {
+   Node_T oNParent;
+
+   assert(oNRoot != NULL);
+   assert(oNNode != NULL);
+   assert(pulIndex != NULL);
+
+   if(Node_getNumChildren(oNNode) > 0) {
+      *pulIndex = 0;
+      return Node_childAt(oNNode, 0);
+   }
+
+   /* climb until some ancestor has a next child, searching for each
+      directory climbed out of to learn where it sits in its parent */
+   while(oNNode != oNRoot) {
+      oNParent = oNNode->oNParent;
+      assert(oNParent != NULL);
+      if(*pulIndex + 1 < Node_getNumChildren(oNParent))
+         return Node_childAt(oNParent, ++*pulIndex);
+      oNNode = oNParent;
+      if(oNNode != oNRoot)
+         (void) Node_search(oNNode->oNParent->psChildren,
+                            Atom_getString(oNNode->oAName),
+                            Atom_getLength(oNNode->oAName), pulIndex);
+   }
+   return NULL;
 }
 
 /*
-  Compares the string representation of oNfirst with a string
-  pcSecond representing a node's path.
-  Returns <0, 0, or >0 if oNFirst is "less than", "equal to", or
-  "greater than" pcSecond, respectively.
+  Gives back the IDs of every node in the subtree rooted at oNNode to
+  oItIds, unless it is NULL, and returns the number of nodes in it.
+  The caller must hold the store's mutex.
 */
-static int Node_compareString(const Node_T oNFirst,
-                                 const char *pcSecond) {
-   assert(oNFirst != NULL);
-   assert(pcSecond != NULL);
+static size_t Node_dropIds(Node_T oNNode, IdTable_T oItIds) {
+   Node_T oNNext = oNNode;
+   size_t ulIndex = 0;
+   size_t ulCount = 0;
 
-   return Path_compareString(oNFirst->oPPath, pcSecond);
+   assert(oNNode != NULL);
+
+   do {
+      if(oItIds != NULL && oNNext->ulId != 0)
+         IdTable_remove(oItIds, oNNext->ulId);
+      ulCount++;
+   } while((oNNext = Node_nextInSubtree(oNNode, oNNext,
+                                        &ulIndex)) != NULL);
+   return ulCount;
 }
 
 /*
-  Compares oNFirst and oNSecond lexicographically based on their paths.
-  Returns <0, 0, or >0 if onFirst is "less than", "equal to", or
-  "greater than" oNSecond, respectively.
+  Gives back the IDs of the subtree rooted at oNNode, just unlinked
+  from the live tree, if the tree has an ID table; they are no longer
+  the live tree's to hand out, even for nodes that a snapshot keeps.
+  If bRoot is TRUE, oNNode was the root, and the table no longer
+  belongs to its store. Returns the number of nodes in the subtree.
 */
-static int Node_compare(Node_T oNFirst, Node_T oNSecond) {
-   assert(oNFirst != NULL);
-   assert(oNSecond != NULL);
+static size_t Node_dropSubtreeIds(Node_T oNNode, boolean bRoot) {
+   struct nodeStore *psStore;
+   size_t ulCount;
 
-   return Path_comparePath(oNFirst->oPPath, oNSecond->oPPath);
+   assert(oNNode != NULL);
+
+   /* subtrees handed to the reclaimer earlier cannot be reached from
+      the root any more, so their IDs must go back to the table before
+      it leaves the store; only the tree's writers ever set or take
+      away the table, so it may be read without the mutex */
+   psStore = oNNode->psStore;
+   if(bRoot && psStore->oItIds != NULL &&
+      __atomic_load_n(&psStore->ulDetached, __ATOMIC_SEQ_CST) != 0)
+      Reclaimer_wait(psStore->oRReclaimer);
+
+   (void) pthread_mutex_lock(&psStore->sMutex);
+   ulCount = Node_dropIds(oNNode, psStore->oItIds);
+   if(bRoot)
+      psStore->oItIds = NULL;
+   (void) pthread_mutex_unlock(&psStore->sMutex);
+   return ulCount;
 }
 
 /*
-  Creates a new node with path oPPath and parent oNParent.  Returns an
-  int SUCCESS status and sets *poNResult to be the new node if
-  successful. Otherwise, sets *poNResult to NULL and returns status:
-  * MEMORY_ERROR if memory could not be allocated to complete request
-  * CONFLICTING_PATH if oNParent's path is not an ancestor of oPPath
-  * NO_SUCH_PATH if oPPath is of depth 0
-                 or oNParent's path is not oPPath's direct parent
-                 or oNParent is NULL but oPPath is not of depth 1
-  * ALREADY_IN_TREE if oNParent already has a child with this path
+  Takes pvDetached, a struct nodeDetached handed to the store's
+  reclaimer, one step further, holding the store's mutex for at most
+  NODE_RECLAIM_BATCH nodes' worth of work. Returns FALSE if there is
+  more to do, or frees pvDetached and returns TRUE once its subtree
+  is freed.
 */
-int Node_new(Path_T oPPath, NodeType nodeType, Node_T oNParent, 
-             Node_T *poNResult) {
-   struct node *psNew;
-   Path_T oPParentPath = NULL;
-   Path_T oPNewPath = NULL;
-   size_t ulParentDepth;
+static boolean Node_reclaimStep(void *pvDetached) {
+   struct nodeDetached *psDetached = pvDetached;
+   struct nodeStore *psStore;
+   Epoch_T oEEpoch;
+   boolean bDone = FALSE;
+   boolean bFreeStore = FALSE;
+   size_t i;
+
+   assert(psDetached != NULL);
+
+   psStore = psDetached->psStore;
+   (void) pthread_mutex_lock(&psStore->sMutex);
+   switch(psDetached->eStage) {
+      case NODE_STAGE_IDS:
+         /* the table is looked at afresh each batch, as the tree may
+            have let go of it meanwhile */
+         for(i = 0; psDetached->oNNext != NULL &&
+                    i < NODE_RECLAIM_BATCH; i++) {
+            if(psStore->oItIds != NULL &&
+               psDetached->oNNext->ulId != 0)
+               IdTable_remove(psStore->oItIds,
+                              psDetached->oNNext->ulId);
+            psDetached->ulCount++;
+            psDetached->oNNext =
+               Node_nextInSubtree(psDetached->oNTop,
+                                  psDetached->oNNext,
+                                  &psDetached->ulIndex);
+         }
+         if(psDetached->oNNext == NULL) {
+            (void) __atomic_add_fetch(&psStore->ulReclaimed,
+                                      psDetached->ulCount,
+                                      __ATOMIC_RELAXED);
+            (void) __atomic_sub_fetch(&psStore->ulDetached, 1,
+                                      __ATOMIC_SEQ_CST);
+            psDetached->eStage = NODE_STAGE_WAIT;
+         }
+         break;
+
+      case NODE_STAGE_WAIT:
+         /* the epoch's mutex comes before the store's, and whatever
+            was retired before the subtree is freed with it, so that
+            no node outlives its store */
+         oEEpoch = psStore->oEEpoch;
+         (void) pthread_mutex_unlock(&psStore->sMutex);
+         if(oEEpoch != NULL)
+            Epoch_reclaim(oEEpoch);
+         (void) pthread_mutex_lock(&psStore->sMutex);
+
+         /* no snapshot can be taken of a tree that is gone, so a
+            tree that is the last one stays so */
+         psDetached->bAlone = (boolean) (psDetached->bRoot &&
+                                         psStore->ulTrees == 1);
+         psDetached->oNNext =
+            Node_startTakeDown(psDetached->oNTop,
+                               psDetached->bAlone ? Node_dropOnly
+                                                  : Node_dropRef);
+         psDetached->eStage = NODE_STAGE_FREE;
+         break;
+
+      case NODE_STAGE_FREE:
+         if(psDetached->bAlone)
+            psDetached->oNNext =
+               Node_takeDownSome(psDetached->oNNext,
+                                 NODE_RECLAIM_BATCH, Node_dropOnly,
+                                 Node_destroyLatch);
+         else
+            psDetached->oNNext =
+               Node_takeDownSome(psDetached->oNNext,
+                                 NODE_RECLAIM_BATCH, Node_dropRef,
+                                 Node_release);
+         if(psDetached->oNNext == NULL) {
+            bDone = TRUE;
+            if(psDetached->bRoot)
+               bFreeStore = (boolean) (--psStore->ulTrees == 0);
+         }
+         break;
+   }
+   (void) pthread_mutex_unlock(&psStore->sMutex);
+
+   if(bFreeStore)
+      Node_freeStore(psStore);
+   if(bDone)
+      free(psDetached);
+   return bDone;
+}
+
+size_t Node_free(Node_T oNNode) {
+   struct nodeStore *psStore;
+   struct nodeDetached *psDetached = NULL;
+   Node_T oNParent;
+   boolean bDetached = FALSE;
    size_t ulIndex;
-   int iStatus;
+   size_t ulCount;
 
-   assert(oPPath != NULL);
+   assert(oNNode != NULL);
 
-   /* allocate space for a new node */
-   psNew = malloc(sizeof(struct node));
-   if(psNew == NULL) {
-      *poNResult = NULL;
-      return MEMORY_ERROR;
+   psStore = oNNode->psStore;
+   oNParent = oNNode->oNParent;
+   if(psStore->oRReclaimer != NULL)
+      psDetached = malloc(sizeof(struct nodeDetached));
+
+   /* a lookup by ID that finds a node whose ID is still to be given
+      back must see that it is out of the tree as soon as it is */
+   if(psDetached != NULL && oNParent != NULL) {
+      bDetached = TRUE;
+      (void) __atomic_add_fetch(&psStore->ulDetached, 1,
+                                __ATOMIC_SEQ_CST);
+      __atomic_store_n(&oNNode->oNParent, NULL, __ATOMIC_SEQ_CST);
    }
 
-   /* set the node type */
-   psNew->type = nodeType;
+   /* remove from parent's list */
+   if(oNParent != NULL &&
+      Node_search(oNParent->psChildren, Atom_getString(oNNode->oAName),
+                  Atom_getLength(oNNode->oAName), &ulIndex) == oNNode)
+      Node_removeChild(oNParent, ulIndex);
 
-   /* set the new node's path */
-   iStatus = Path_dup(oPPath, &oPNewPath);
-   if(iStatus != SUCCESS) {
-      free(psNew);
-      *poNResult = NULL;
-      return iStatus;
+   /* the rest of the work is the reclaimer's, if it can take it, but
+      a whole tree's IDs go back at once, since its table may be given
+      a new tree straight away */
+   if(psDetached != NULL) {
+      if(oNParent == NULL && psStore->oItIds != NULL)
+         (void) Node_dropSubtreeIds(oNNode, TRUE);
+      psDetached->psStore = psStore;
+      psDetached->oNTop = oNNode;
+      psDetached->bRoot = (boolean) (oNParent == NULL);
+      psDetached->bAlone = FALSE;
+      psDetached->eStage = (oNParent == NULL) ? NODE_STAGE_WAIT
+                                              : NODE_STAGE_IDS;
+      psDetached->oNNext = oNNode;
+      psDetached->ulIndex = 0;
+      psDetached->ulCount = 0;
+      if(Reclaimer_add(psStore->oRReclaimer, Node_reclaimStep,
+                       psDetached) == SUCCESS)
+         return 0;
+
+      /* subtrees are freed in the order they were unlinked, so this
+         one waits for its turn */
+      free(psDetached);
+      Reclaimer_wait(psStore->oRReclaimer);
    }
-   psNew->oPPath = oPNewPath;
 
-   /* validate and set the new node's parent */
-   if(oNParent != NULL) {
-      size_t ulSharedDepth;
+   ulCount = Node_dropSubtreeIds(oNNode, (boolean) (oNParent == NULL));
+   if(bDetached)
+      (void) __atomic_sub_fetch(&psStore->ulDetached, 1,
+                                __ATOMIC_SEQ_CST);
 
-      oPParentPath = oNParent->oPPath;
-      ulParentDepth = Path_getDepth(oPParentPath);
-      ulSharedDepth = Path_getSharedPrefixDepth(psNew->oPPath,
-                                                oPParentPath);
-      /* parent must be an ancestor of child */
-      if(ulSharedDepth < ulParentDepth) {
-         Path_free(psNew->oPPath);
-         free(psNew);
-         *poNResult = NULL;
-         return CONFLICTING_PATH;
-      }
+   /* lock-free readers may still be inside the subtree, so it must
+      outlive them; a snapshot may keep parts of it alive longer */
+   Node_retire(psStore,
+               (oNParent == NULL) ? Node_releaseTree : Node_unref,
+               oNNode);
+   return ulCount;
+}
 
-      /* parent must be exactly one level up from child */
-      if(Path_getDepth(psNew->oPPath) != ulParentDepth + 1) {
-         Path_free(psNew->oPPath);
-         free(psNew);
-         *poNResult = NULL;
-         return NO_SUCH_PATH;
-      }
+size_t Node_takeReclaimed(Node_T oNRoot) {
+   assert(oNRoot != NULL);
+   assert(oNRoot->oNParent == NULL);
+
+   return __atomic_exchange_n(&oNRoot->psStore->ulReclaimed, 0,
+                              __ATOMIC_RELAXED);
+}
+
+void Node_shareTree(Node_T oNRoot) {
+   struct nodeStore *psStore;
+
+   assert(oNRoot != NULL);
+   assert(oNRoot->oNParent == NULL);
+
+   psStore = oNRoot->psStore;
+   (void) pthread_mutex_lock(&psStore->sMutex);
+   psStore->ulTrees++;
+   (void) pthread_mutex_unlock(&psStore->sMutex);
+   __atomic_add_fetch(&oNRoot->ulRefs, 1, __ATOMIC_RELAXED);
+}
+
+void Node_dropTree(Node_T oNRoot) {
+   assert(oNRoot != NULL);
+
+   Node_releaseTree(oNRoot);
+}
+
+boolean Node_isShared(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return (boolean) (__atomic_load_n(&oNNode->ulRefs,
+                                     __ATOMIC_ACQUIRE) > 1);
+}
+
+int Node_unshare(Node_T oNNode, Node_T *poNRoot, Node_T *poNResult) {
+   struct nodeStore *psStore;
+   struct nodeBlock *psChildren = NULL;
+   struct nodeChildren *psLeaf;
+   struct node *psCopy;
+   Node_T oNChild;
+   size_t ulNext = 0;
+   size_t ulIndex;
+
+   assert(oNNode != NULL);
+   assert(poNResult != NULL);
+   assert(oNNode->oNParent == NULL ||
+          !Node_isShared(oNNode->oNParent));
+   assert(oNNode->oNParent != NULL || poNRoot != NULL);
 
-      /* parent must not already have child with this path */
-      if(Node_hasChild(oNParent, oPPath, &ulIndex)) {
-         Path_free(psNew->oPPath);
-         free(psNew);
+   if(!Node_isShared(oNNode)) {
+      *poNResult = oNNode;
+      return SUCCESS;
+   }
+
+   /* allocate everything before touching the tree */
+   if(oNNode->psChildren != NULL) {
+      psChildren = Node_copyBlocks(oNNode->psChildren);
+      if(psChildren == NULL) {
          *poNResult = NULL;
-         return ALREADY_IN_TREE;
+         return MEMORY_ERROR;
       }
    }
-   else {
-      /* new node must be root */
-      /* can only create one "level" at a time */
-      if(Path_getDepth(psNew->oPPath) != 1) {
-         Path_free(psNew->oPPath);
-         free(psNew);
-         *poNResult = NULL;
-         return NO_SUCH_PATH;
+   psStore = oNNode->psStore;
+   (void) pthread_mutex_lock(&psStore->sMutex);
+   psCopy = Pool_alloc(psStore->oPlPool);
+   if(psCopy != NULL) {
+      if(Node_newLatch(psStore, oNNode->type,
+                       &psCopy->psLatch) != SUCCESS) {
+         Pool_release(psStore->oPlPool, psCopy);
+         psCopy = NULL;
       }
+      else
+         psCopy->oAName = Atom_dup(oNNode->oAName);
    }
-   psNew->oNParent = oNParent;
-
-   /* initialize the new node */
-   psNew->oDChildren = DynArray_new(0);
-   if(psNew->oDChildren == NULL) {
-      Path_free(psNew->oPPath);
-      free(psNew);
+   (void) pthread_mutex_unlock(&psStore->sMutex);
+   if(psCopy == NULL) {
+      if(psChildren != NULL)
+         Node_freeBlocks(psChildren);
       *poNResult = NULL;
       return MEMORY_ERROR;
    }
 
-   /* Link into parent's children list */
-   if(oNParent != NULL) {
-      iStatus = Node_addChild(oNParent, psNew, ulIndex);
-      if(iStatus != SUCCESS) {
-         Path_free(psNew->oPPath);
-         free(psNew);
-         *poNResult = NULL;
-         return iStatus;
+   psCopy->ulDepth = oNNode->ulDepth;
+   psCopy->oNParent = oNNode->oNParent;
+   psCopy->psChildren = psChildren;
+   /* the original's index still holds the original's children, and
+      only the live tree changes, so the copy gets its own */
+   psCopy->psIndex = NULL;
+   if(oNNode->psIndex != NULL)
+      psCopy->psIndex = Node_buildIndex(psCopy);
+   psCopy->ulVersion = 0;
+   psCopy->ulRefs = 1;
+   psCopy->psStore = psStore;
+   psCopy->ulId = oNNode->ulId;
+   psCopy->type = oNNode->type;
+   psCopy->iDetaches = 0;
+   psCopy->pvContents = oNNode->pvContents;
+   psCopy->ulLength = oNNode->ulLength;
+
+   /* the copy shares every child with the original, and only the
+      live tree climbs parent links, so they now lead to the copy */
+   while((psLeaf = Node_nextLeaf(psChildren, &ulNext)) != NULL)
+      for(ulIndex = 0; ulIndex < psLeaf->sHead.ulLength; ulIndex++) {
+         oNChild = psLeaf->aoNChildren[ulIndex];
+         __atomic_add_fetch(&oNChild->ulRefs, 1, __ATOMIC_RELAXED);
+         __atomic_store_n(&oNChild->oNParent, psCopy,
+                          __ATOMIC_RELEASE);
       }
+
+   /* the copy has the original's name, so putting it in the same slot
+      keeps the children sorted; a lock-free reader finds either one,
+      and must no longer find the original once it is retired */
+   if(psCopy->oNParent != NULL) {
+      oNChild = Node_search(psCopy->oNParent->psChildren,
+                            Atom_getString(psCopy->oAName),
+                            Atom_getLength(psCopy->oAName), &ulIndex);
+      assert(oNChild == oNNode);
+      Node_replaceChild(psCopy->oNParent, ulIndex, psCopy);
    }
+   else
+      __atomic_store_n(poNRoot, psCopy, __ATOMIC_RELEASE);
 
-   *poNResult = psNew;
+   /* the live tree's ID for the node now finds the copy */
+   if(psCopy->ulId != 0) {
+      (void) pthread_mutex_lock(&psStore->sMutex);
+      if(psStore->oItIds != NULL)
+         IdTable_set(psStore->oItIds, psCopy->ulId, psCopy);
+      (void) pthread_mutex_unlock(&psStore->sMutex);
+   }
 
+   Node_retire(psStore, Node_unref, oNNode);
+   *poNResult = psCopy;
    return SUCCESS;
 }
 
-void *Node_getContent(Node_T oNNode) {
+void Node_setEpoch(Node_T oNNode, Epoch_T oEEpoch) {
+   struct nodeStore *psStore;
+
    assert(oNNode != NULL);
 
-   return oNNode->pvContents;
+   /* the reclaimer reads it under the mutex */
+   psStore = oNNode->psStore;
+   (void) pthread_mutex_lock(&psStore->sMutex);
+   psStore->oEEpoch = oEEpoch;
+   (void) pthread_mutex_unlock(&psStore->sMutex);
 }
 
-size_t Node_getContentSize(Node_T oNNode) {
+void Node_setReclaimer(Node_T oNNode, Reclaimer_T oRReclaimer) {
    assert(oNNode != NULL);
+   assert(oRReclaimer != NULL ||
+          oNNode->psStore->ulDetached == 0);
 
-   return oNNode->ulLength;
+   oNNode->psStore->oRReclaimer = oRReclaimer;
 }
 
+/*
+  Gives every node of the subtree rooted at oNNode an ID in oItIds,
+  which has room for them all.
+*/
+static void Node_addIds(Node_T oNNode, IdTable_T oItIds) {
+   Node_T oNNext = oNNode;
+   size_t ulIndex = 0;
+   int iStatus;
 
-void Node_setContents(Node_T oNNode, void* pvContents, size_t ulLength) {
    assert(oNNode != NULL);
-   
-   oNNode->pvContents = pvContents;
-   oNNode->ulLength = ulLength;
+
+   do {
+      assert(oNNext->ulId == 0);
+      iStatus = IdTable_add(oItIds, oNNext, &oNNext->ulId);
+      assert(iStatus == SUCCESS);
+   } while((oNNext = Node_nextInSubtree(oNNode, oNNext,
+                                        &ulIndex)) != NULL);
+   (void) iStatus;
 }
 
-size_t Node_free(Node_T oNNode) {
-   size_t ulIndex;
-   size_t ulCount = 0;
+void Node_setIds(Node_T oNRoot, IdTable_T oItIds) {
+   struct nodeStore *psStore;
+
+   assert(oNRoot != NULL);
+   assert(oNRoot->oNParent == NULL);
+   assert(oItIds != NULL);
+
+   psStore = oNRoot->psStore;
+   (void) pthread_mutex_lock(&psStore->sMutex);
+   assert(psStore->oItIds == NULL);
+   Node_addIds(oNRoot, oItIds);
+   psStore->oItIds = oItIds;
+   (void) pthread_mutex_unlock(&psStore->sMutex);
+}
+
+void Node_forgetIds(Node_T oNRoot) {
+   struct nodeStore *psStore;
+
+   assert(oNRoot != NULL);
+   assert(oNRoot->oNParent == NULL);
+
+   psStore = oNRoot->psStore;
+   (void) pthread_mutex_lock(&psStore->sMutex);
+   psStore->oItIds = NULL;
+   (void) pthread_mutex_unlock(&psStore->sMutex);
+}
+
+Node_T Node_findById(Node_T oNRoot, IdTable_T oItIds, size_t ulId) {
+   Node_T oNNode;
+   Node_T oNTop;
+   Node_T oNParent;
+   size_t ulDetached;
 
+   assert(oNRoot != NULL);
+   assert(oItIds != NULL);
+
+   /* read before the table: a node found there while no subtree had
+      IDs left to give back was still in the tree when this was read,
+      since Node_free counts a subtree before unlinking it */
+   ulDetached = __atomic_load_n(&oNRoot->psStore->ulDetached,
+                                __ATOMIC_SEQ_CST);
+   oNNode = IdTable_get(oItIds, ulId);
+   if(oNNode == NULL || ulDetached == 0)
+      return oNNode;
+
+   /* otherwise the node is in the tree only if climbing from it
+      reaches the root rather than the top of an unlinked subtree */
+   oNTop = oNNode;
+   while((oNParent = __atomic_load_n(&oNTop->oNParent,
+                                     __ATOMIC_ACQUIRE)) != NULL)
+      oNTop = oNParent;
+   return (oNTop->ulDepth == 1) ? oNNode : NULL;
+}
+
+size_t Node_getId(Node_T oNNode) {
    assert(oNNode != NULL);
 
-   /* remove from parent's list */
-   if(oNNode->oNParent != NULL) {
-      if(DynArray_bsearch(
-            oNNode->oNParent->oDChildren,
-            oNNode, &ulIndex,
-            (int (*)(const void *, const void *)) Node_compare)
-        )
-         (void) DynArray_removeAt(oNNode->oNParent->oDChildren,
-                                  ulIndex);
-   }
+   return oNNode->ulId;
+}
+
+int Node_getPath(Node_T oNNode, Path_T *poPResult) {
+   char *pcPath;
+   int iStatus;
+
+   assert(oNNode != NULL);
+   assert(poPResult != NULL);
 
-   /* recursively remove children */
-   while(DynArray_getLength(oNNode->oDChildren) != 0) {
-      ulCount += Node_free(DynArray_get(oNNode->oDChildren, 0));
+   pcPath = Node_toString(oNNode);
+   if(pcPath == NULL) {
+      *poPResult = NULL;
+      return MEMORY_ERROR;
    }
-   DynArray_free(oNNode->oDChildren);
 
-   /* remove path */
-   Path_free(oNNode->oPPath);
+   iStatus = Path_new(pcPath, poPResult);
+   free(pcPath);
+   return iStatus;
+}
 
-   /* finally, free the struct node */
-   free(oNNode);
-   ulCount++;
-   return ulCount;
+size_t Node_getPathLength(Node_T oNNode) {
+   size_t ulLength;
+
+   assert(oNNode != NULL);
+
+   /* each name, plus one delimiter between each pair of levels */
+   ulLength = oNNode->ulDepth - 1;
+   for(; oNNode != NULL; oNNode = oNNode->oNParent)
+      ulLength += Atom_getLength(oNNode->oAName);
+   return ulLength;
+}
+
+Atom_T Node_getName(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return oNNode->oAName;
+}
+
+size_t Node_getDepth(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   return oNNode->ulDepth;
 }
 
-Path_T Node_getPath(Node_T oNNode) {
+boolean Node_isPath(Node_T oNNode, const char *pcPath,
+                    size_t ulLength) {
+   const char *pcEnd;
+   size_t ulNameLength;
+
    assert(oNNode != NULL);
+   assert(pcPath != NULL);
 
-   return oNNode->oPPath;
+   /* match names against pcPath from its end, climbing to the root */
+   pcEnd = pcPath + ulLength;
+   for(; oNNode != NULL; oNNode = oNNode->oNParent) {
+      ulNameLength = Atom_getLength(oNNode->oAName);
+      if((size_t) (pcEnd - pcPath) < ulNameLength)
+         return FALSE;
+      pcEnd -= ulNameLength;
+      if(memcmp(pcEnd, Atom_getString(oNNode->oAName), ulNameLength))
+         return FALSE;
+      if(oNNode->oNParent != NULL) {
+         if(pcEnd == pcPath || *--pcEnd != '/')
+            return FALSE;
+      }
+   }
+   return (boolean) (pcEnd == pcPath);
 }
 
 NodeType Node_getType(Node_T oNNode) {
@@ -248,31 +2862,106 @@ boolean Node_hasChild(Node_T oNParent, Path_T oPPath,
    assert(oPPath != NULL);
    assert(pulChildID != NULL);
 
-   /* *pulChildID is the index into oNParent->oDChildren */
-   return DynArray_bsearch(oNParent->oDChildren,
-            (char*) Path_getPathname(oPPath), pulChildID,
-            (int (*)(const void*,const void*)) Node_compareString);
+   /* only a path one level below oNParent can name its child */
+   if(Path_getDepth(oPPath) != oNParent->ulDepth + 1 ||
+      Node_getSharedPrefixDepth(oNParent, oPPath) < oNParent->ulDepth) {
+      *pulChildID = 0;
+      return FALSE;
+   }
+
+   return Node_hasChildComponent(oNParent,
+            Path_getComponent(oPPath, oNParent->ulDepth), pulChildID);
+}
+
+boolean Node_hasChildComponent(Node_T oNParent, const char *pcComponent,
+                               size_t *pulChildID) {
+   assert(oNParent != NULL);
+   assert(pcComponent != NULL);
+   assert(pulChildID != NULL);
+
+   /* *pulChildID is the child's index among all of oNParent's */
+   return (boolean) (Node_search(oNParent->psChildren, pcComponent,
+                                 strlen(pcComponent), pulChildID)
+                     != NULL);
+}
+
+boolean Node_findChild(Node_T oNParent, const char *pcComponent,
+                       Node_T *poNResult) {
+   struct nodeBlock *psChildren;
+   struct nodeIndex *psIndex;
+   Node_T oNChild;
+   size_t ulVersion;
+   size_t ulLength;
+
+   assert(oNParent != NULL);
+   assert(pcComponent != NULL);
+   assert(poNResult != NULL);
+
+   /* a file never has children, and its type never changes */
+   if(oNParent->type != NODE_DIR) {
+      *poNResult = NULL;
+      return FALSE;
+   }
+
+   /* a wide directory is looked up in its index instead */
+   ulLength = strlen(pcComponent);
+   do {
+      ulVersion = Node_beginRead(oNParent);
+      psIndex = __atomic_load_n(&oNParent->psIndex, __ATOMIC_ACQUIRE);
+      if(psIndex != NULL)
+         oNChild = Node_indexFind(psIndex, pcComponent, ulLength);
+      else {
+         psChildren = __atomic_load_n(&oNParent->psChildren,
+                                      __ATOMIC_ACQUIRE);
+         oNChild = Node_search(psChildren, pcComponent, ulLength,
+                               NULL);
+      }
+   } while(!Node_endRead(oNParent, ulVersion));
+
+   *poNResult = oNChild;
+   return (boolean) (oNChild != NULL);
+}
+
+void Node_prefetch(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   __builtin_prefetch(oNNode);
+}
+
+void Node_prefetchChildren(Node_T oNNode) {
+   struct nodeBlock *psChildren;
+
+   assert(oNNode != NULL);
+
+   psChildren = __atomic_load_n(&oNNode->psChildren, __ATOMIC_RELAXED);
+   if(psChildren != NULL)
+      __builtin_prefetch(psChildren);
 }
 
 size_t Node_getNumChildren(Node_T oNParent) {
    assert(oNParent != NULL);
 
-   return DynArray_getLength(oNParent->oDChildren);
+   if(oNParent->psChildren == NULL)
+      return 0;
+   return Node_countBlock(oNParent->psChildren);
 }
 
 int  Node_getChild(Node_T oNParent, size_t ulChildID,
                    Node_T *poNResult) {
+   struct nodeChildren *psLeaf;
+   size_t ulIndex;
 
    assert(oNParent != NULL);
    assert(poNResult != NULL);
 
-   /* ulChildID is the index into oNParent->oDChildren */
+   /* ulChildID is the child's index among all of oNParent's */
    if(ulChildID >= Node_getNumChildren(oNParent)) {
       *poNResult = NULL;
       return NO_SUCH_PATH;
    }
    else {
-      *poNResult = DynArray_get(oNParent->oDChildren, ulChildID);
+      psLeaf = Node_leafAt(oNParent->psChildren, ulChildID, &ulIndex);
+      *poNResult = psLeaf->aoNChildren[ulIndex];
       return SUCCESS;
    }
 }
@@ -285,12 +2974,90 @@ Node_T Node_getParent(Node_T oNNode) {
 
 char *Node_toString(Node_T oNNode) {
    char *copyPath;
+   char *pcInsert;
+   size_t ulLength;
+   size_t ulNameLength;
 
    assert(oNNode != NULL);
 
-   copyPath = malloc(Path_getStrLength(Node_getPath(oNNode))+1);
+   ulLength = Node_getPathLength(oNNode);
+   copyPath = malloc(ulLength+1);
    if(copyPath == NULL)
       return NULL;
-   else
-      return strcpy(copyPath, Path_getPathname(Node_getPath(oNNode)));
+
+   /* fill in names from the end, climbing towards the root */
+   pcInsert = copyPath + ulLength;
+   *pcInsert = '\0';
+   for(; oNNode != NULL; oNNode = oNNode->oNParent) {
+      ulNameLength = Atom_getLength(oNNode->oAName);
+      pcInsert -= ulNameLength;
+      memcpy(pcInsert, Atom_getString(oNNode->oAName), ulNameLength);
+      if(pcInsert != copyPath)
+         *--pcInsert = '/';
+   }
+   return copyPath;
+}
+
+void Node_lockRead(Node_T oNNode) {
+   int iStatus;
+
+   assert(oNNode != NULL);
+   assert(oNNode->psLatch != NULL);
+
+   iStatus = pthread_rwlock_rdlock(oNNode->psLatch);
+   assert(iStatus == 0);
+   (void) iStatus;
+}
+
+void Node_lockWrite(Node_T oNNode) {
+   int iStatus;
+
+   assert(oNNode != NULL);
+   assert(oNNode->psLatch != NULL);
+
+   iStatus = pthread_rwlock_wrlock(oNNode->psLatch);
+   assert(iStatus == 0);
+   (void) iStatus;
+}
+
+boolean Node_tryLockWrite(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->psLatch != NULL);
+
+   return (boolean) (pthread_rwlock_trywrlock(oNNode->psLatch) == 0);
+}
+
+void Node_unlock(Node_T oNNode) {
+   int iStatus;
+
+   assert(oNNode != NULL);
+   assert(oNNode->psLatch != NULL);
+
+   iStatus = pthread_rwlock_unlock(oNNode->psLatch);
+   assert(iStatus == 0);
+   (void) iStatus;
+}
+
+void Node_beginDetach(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->type == NODE_DIR);
+
+   (void) __atomic_add_fetch(&oNNode->iDetaches, 1, __ATOMIC_SEQ_CST);
+}
+
+void Node_endDetach(Node_T oNNode) {
+   assert(oNNode != NULL);
+   assert(oNNode->iDetaches > 0);
+
+   (void) __atomic_sub_fetch(&oNNode->iDetaches, 1, __ATOMIC_SEQ_CST);
+}
+
+boolean Node_isDetaching(Node_T oNNode) {
+   assert(oNNode != NULL);
+
+   for(; oNNode != NULL;
+       oNNode = __atomic_load_n(&oNNode->oNParent, __ATOMIC_ACQUIRE))
+      if(__atomic_load_n(&oNNode->iDetaches, __ATOMIC_SEQ_CST) != 0)
+         return TRUE;
+   return FALSE;
 }
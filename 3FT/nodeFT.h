@@ -9,6 +9,10 @@
 #include <stddef.h>
 #include "a4def.h"
 #include "path.h"
+#include "atom.h"
+#include "epoch.h"
+#include "idTable.h"
+#include "reclaimer.h"
 
 
 /* An enum to represent the different filetypes*/
@@ -34,17 +38,212 @@ typedef struct node *Node_T;
                  or oNParent's path is not oPPath's direct parent
                  or oNParent is NULL but oPPath is not of depth 1
   * ALREADY_IN_TREE if oNParent already has a child with this path
+  A new file must be given its contents with Node_setContents before
+  a lock-free reader (see Node_findChild) reaches it; until then such
+  readers wait on it.
 */
 int Node_new(Path_T oPPath, NodeType nodeType, Node_T oNParent, 
              Node_T *poNResult);
 
+/*
+  Creates a new node of type nodeType as the last child of oNParent,
+  with final path component pcName, without needing a Path_T. Since
+  the node goes at the end, loading children in sorted order costs
+  constant time per child. Returns an int SUCCESS status and sets
+  *poNResult to be the new node if successful. Otherwise, sets
+  *poNResult to NULL and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * CONFLICTING_PATH if oNParent is not a directory, pcName is not a
+                     single component, or pcName does not sort after
+                     every child oNParent already has
+  As with Node_new, a new file's contents must be set before a
+  lock-free reader reaches it.
+*/
+int Node_newLast(Node_T oNParent, const char *pcName,
+                 NodeType nodeType, Node_T *poNResult);
+
+/*
+  Creates a new node of type nodeType among the children of oNParent,
+  with final path component pcName, without needing a Path_T. A new
+  file has contents pvContents of size ulLength from the moment it is
+  linked, so lock-free readers never wait on it; a new directory
+  ignores both. Returns an int SUCCESS status and sets *poNResult to
+  be the new node if successful. Otherwise, sets *poNResult to NULL
+  and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * CONFLICTING_PATH if oNParent is not a directory or pcName is not a
+                     single component
+  * ALREADY_IN_TREE if oNParent already has a child named pcName
+*/
+int Node_newChild(Node_T oNParent, const char *pcName,
+                  NodeType nodeType, void *pvContents, size_t ulLength,
+                  Node_T *poNResult);
+
+/*
+  Creates a new node of type nodeType with final path component pcName
+  whose parent is oNParent, but which is not yet among oNParent's
+  children: it is linked there later, along with all its siblings, by
+  Node_linkChildren. Until then no lookup can reach it. Returns an int
+  SUCCESS status and sets *poNResult to be the new node if successful.
+  Otherwise, sets *poNResult to NULL and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  * CONFLICTING_PATH if oNParent is not a directory or pcName is not a
+                     single component
+*/
+int Node_newUnlinked(Node_T oNParent, const char *pcName,
+                     NodeType nodeType, Node_T *poNResult);
+
+/*
+  Makes the ulCount nodes in aoNChildren, all made by Node_newUnlinked
+  with parent oNParent and sorted by name without repeats, the children
+  of directory oNParent, which must have none yet. Up to a block's
+  worth fill one block of exactly ulCount slots; more are packed into
+  blocks left three quarters full. Returns SUCCESS, or MEMORY_ERROR
+  if memory could not be allocated to complete request, in which case
+  the nodes stay unlinked.
+*/
+int Node_linkChildren(Node_T oNParent, Node_T *aoNChildren,
+                      size_t ulCount);
+
+/*
+  Gives back oNNode, made by Node_newUnlinked and never linked, along
+  with every node linked below it.
+*/
+void Node_discard(Node_T oNNode);
+
+/*
+  Ties the ulLength-byte block at pvBlock, such as a file mapping that
+  contents point into, to the tree oNNode is in: once neither the tree
+  nor any snapshot of it is left, (*pfRelease)(pvBlock, ulLength) is
+  called. A tree may hold any number of blocks. Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated to complete request,
+  in which case the block is not tied to the tree.
+*/
+int Node_addBacking(Node_T oNNode, void *pvBlock, size_t ulLength,
+                    void (*pfRelease)(void *pvBlock,
+                                      size_t ulLength));
+
 /*
   Destroys and frees all memory allocated for the subtree rooted at
   oNNode, i.e., deletes this node and all its descendents. Returns the
-  number of nodes deleted.
+  number of nodes deleted, or 0 if the subtree was handed to the
+  tree's reclaimer, which counts them later (see Node_takeReclaimed).
+  Nodes of one tree may be created and freed from several threads at
+  once, so long as no two threads change the same node's children at
+  the same time and no thread is still using a node being freed.
+  Lock-free readers are the exception: if the tree has an epoch (see
+  Node_setEpoch), the subtree is unlinked at once but only freed once
+  they have left it. Nodes that a snapshot (see Node_shareTree) still
+  shares outlive the call too, until the last tree using them lets
+  go. If the tree has a reclaimer (see Node_setReclaimer), only
+  unlinking the subtree is left to the call, which then takes time
+  independent of the subtree's size, unless it is a whole tree with
+  IDs: the rest, counting its nodes included, is done on the
+  reclaimer's thread.
 */
 size_t Node_free(Node_T oNNode);
 
+/*
+  Returns the number of nodes that the reclaimer of the live tree
+  rooted at oNRoot has counted in subtrees that Node_free handed to
+  it since the last call, for the tree to take out of its own count.
+  Takes constant time.
+*/
+size_t Node_takeReclaimed(Node_T oNRoot);
+
+/*
+  Takes a new tree's reference to the root oNRoot, so that the new
+  tree, a snapshot, shares every node with oNRoot's tree until one of
+  the two changes. No node that is shared may be changed: a tree that
+  changes one first makes it private with Node_unshare. Takes constant
+  time.
+*/
+void Node_shareTree(Node_T oNRoot);
+
+/*
+  Drops the reference to the root oNRoot that Node_shareTree took,
+  freeing at once every node that no other tree still uses.
+*/
+void Node_dropTree(Node_T oNRoot);
+
+/*
+  Returns TRUE if oNNode is shared with a snapshot and so must not be
+  changed, and FALSE if only one tree uses it.
+*/
+boolean Node_isShared(Node_T oNNode);
+
+/*
+  Makes oNNode private to the live tree it is in, whose parent must
+  already be private: if a snapshot shares oNNode, copies it, with
+  the same children shared by both, into its place in the live tree.
+  Returns an int SUCCESS status and sets *poNResult to the private
+  node (oNNode itself if it was not shared) if successful. Otherwise,
+  leaves the tree unchanged, sets *poNResult to NULL and returns
+  status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+  A copied root is published to *poNRoot, where lock-free readers find
+  the tree's root, before the original is released; poNRoot is unused
+  for any other node. The original is released as Node_free releases
+  nodes, so lock-free readers may still be inside it.
+*/
+int Node_unshare(Node_T oNNode, Node_T *poNRoot, Node_T *poNResult);
+
+/*
+  Sets the epoch that lock-free readers of oNNode's tree read under to
+  oEEpoch, or to none if oEEpoch is NULL. While there is one, nodes
+  unlinked by Node_free and blocks of children replaced by Node_new
+  and Node_free are retired to it instead of being freed at once.
+  Must not be called while any other thread may be using the tree.
+*/
+void Node_setEpoch(Node_T oNNode, Epoch_T oEEpoch);
+
+/*
+  Sets the reclaimer that Node_free hands the subtrees it unlinks from
+  oNNode's tree to, or to none if oRReclaimer is NULL, in which case
+  they are freed as before. The reclaimer gives back their IDs, waits
+  for lock-free readers through the tree's epoch, and frees them, a
+  bounded batch at a time, in the order they were unlinked. A tree
+  with a reclaimer and IDs must also have an epoch, so that lookups by
+  ID (see Node_findById) can safely run meanwhile. The old reclaimer,
+  if any, must have freed everything handed to it. Must not be called
+  while any other thread may be using the tree.
+*/
+void Node_setReclaimer(Node_T oNNode, Reclaimer_T oRReclaimer);
+
+/*
+  Gives every node of the tree rooted at oNRoot, which has no IDs yet,
+  an ID in oItIds, which must already have room for them all (see
+  IdTable_reserve). From then on, each node made in the tree gets an
+  ID of its own, Node_unshare passes a node's ID to its copy, and
+  Node_free gives back the IDs of the nodes it unlinks; freeing the
+  root leaves the tree without a table again. Must not be called while
+  any other thread may be changing the tree.
+*/
+void Node_setIds(Node_T oNRoot, IdTable_T oItIds);
+
+/*
+  Takes the table of IDs away from the tree rooted at oNRoot without
+  giving back any node's ID, for a caller about to free both the tree
+  and the table. Takes constant time.
+*/
+void Node_forgetIds(Node_T oNRoot);
+
+/*
+  Returns the node of the live tree rooted at oNRoot that has ID ulId
+  in oItIds, the tree's table, or NULL if there is none. A node of a
+  subtree that Node_free has unlinked is not returned, even while its
+  ID is still to be given back. Safe for lock-free readers; as with
+  IdTable_get, the caller must keep the node found alive through the
+  tree's epoch.
+*/
+Node_T Node_findById(Node_T oNRoot, IdTable_T oItIds, size_t ulId);
+
+/*
+  Returns oNNode's ID in its tree's table of IDs, or 0 if the tree has
+  none (see Node_setIds).
+*/
+size_t Node_getId(Node_T oNNode);
+
 /*
   Returns a pointer to the contents field of oNNode.
 */
@@ -55,12 +254,50 @@ size_t Node_getContentSize(Node_T oNNode);
 
 /*
   Sets the contents of oNNode to pvContents and the size field of oNNode
-  to ulLength. 
+  to ulLength. Lock-free readers may be in Node_readContents meanwhile,
+  but no other thread may be changing oNNode's contents or children.
 */
 void Node_setContents(Node_T oNNode, void* pvContents, size_t ulLength);
 
-/* Returns the path object representing oNNode's absolute path. */
-Path_T Node_getPath(Node_T oNNode);
+/*
+  Sets *ppvContents and *pulLength to oNNode's contents and size as of
+  one moment, without any latch: retries for as long as a concurrent
+  Node_setContents is changing them.
+*/
+void Node_readContents(Node_T oNNode, void **ppvContents,
+                       size_t *pulLength);
+
+/*
+  Builds a new path object representing oNNode's absolute path from
+  the names of oNNode and its ancestors. Returns an int SUCCESS status
+  and sets *poPResult to be the new path if successful; the path is
+  then owned by the caller, who must Path_free it. Otherwise, sets
+  *poPResult to NULL and returns status:
+  * MEMORY_ERROR if memory could not be allocated to complete request
+*/
+int Node_getPath(Node_T oNNode, Path_T *poPResult);
+
+/*
+  Returns the length (not including trailing '\0') of the string
+  representation of oNNode's absolute path, without building it.
+*/
+size_t Node_getPathLength(Node_T oNNode);
+
+/* Returns the interned final component of oNNode's absolute path. */
+Atom_T Node_getName(Node_T oNNode);
+
+/*
+  Returns the number of components in oNNode's absolute path, so the
+  root has depth 1.
+*/
+size_t Node_getDepth(Node_T oNNode);
+
+/*
+  Returns TRUE if oNNode's absolute path is exactly the ulLength-byte
+  pathname at pcPath, and FALSE if not. Compares against oNNode's
+  chain of names without building its path.
+*/
+boolean Node_isPath(Node_T oNNode, const char *pcPath, size_t ulLength);
 
 /* Returns the type field of oNNode */
 NodeType Node_getType(Node_T oNNode);
@@ -77,6 +314,43 @@ NodeType Node_getType(Node_T oNNode);
 boolean Node_hasChild(Node_T oNParent, Path_T oPPath,
                          size_t *pulChildID);
 
+/*
+  Returns TRUE if oNParent has a child whose final path component is
+  pcComponent. Returns FALSE if it does not.
+
+  Sets *pulChildID exactly as Node_hasChild does. Unlike Node_hasChild,
+  this needs no Path_T for the child, so a caller walking down the tree
+  can pass the components of one already-parsed path level by level.
+*/
+boolean Node_hasChildComponent(Node_T oNParent, const char *pcComponent,
+                               size_t *pulChildID);
+
+/*
+  Returns TRUE and sets *poNResult to the child of oNParent whose final
+  path component is pcComponent, or returns FALSE and sets *poNResult
+  to NULL if there is none. Unlike the other Node_ functions, needs no
+  latch even while other threads change oNParent's children: it
+  searches again until no change overlapped it. The caller must be
+  inside the tree's epoch, so that no node it reaches this way is freed
+  under it.
+*/
+boolean Node_findChild(Node_T oNParent, const char *pcComponent,
+                       Node_T *poNResult);
+
+/*
+  Hints that oNNode is about to be read, so that its cache line can be
+  on its way while the caller does other work. Never faults, and safe
+  wherever Node_findChild is.
+*/
+void Node_prefetch(Node_T oNNode);
+
+/*
+  Hints that oNNode's children are about to be searched, as
+  Node_prefetch does for the node itself. Reads oNNode, so works best
+  once a Node_prefetch of it has had time to arrive.
+*/
+void Node_prefetchChildren(Node_T oNNode);
+
 /* Returns the number of children that oNParent has. */
 size_t Node_getNumChildren(Node_T oNParent);
 
@@ -95,6 +369,21 @@ int Node_getChild(Node_T oNParent, size_t ulChildID,
 */
 Node_T Node_getParent(Node_T oNNode);
 
+/*
+  Returns the node after oNNode in a pre-order walk of the subtree
+  rooted at oNRoot, which holds oNNode: its first child if it has
+  any, and otherwise the next sibling of it or of its nearest ancestor
+  below oNRoot that has one. Returns NULL once the walk is done.
+  *pulIndex must be oNNode's index among its parent's children (any
+  value for oNRoot itself), and is set to that of the node returned.
+  Climbs parent links, so only walks the live tree, and the subtree
+  must not change during the walk. Needs no space of its own, however
+  deep the subtree is; a walk searches only for each directory that
+  it climbs out of.
+*/
+Node_T Node_nextInSubtree(Node_T oNRoot, Node_T oNNode,
+                          size_t *pulIndex);
+
 /*
   Returns a string representation for oNNode, or NULL if
   there is an allocation error.
@@ -104,4 +393,54 @@ Node_T Node_getParent(Node_T oNNode);
 */
 char *Node_toString(Node_T oNNode);
 
+/*
+  Acquires oNNode's latch for reading, waiting while a writer holds it.
+  Any number of readers may hold the latch at once. Latches are only
+  an aid to callers: no Node_ function takes one itself. Only
+  directories have latches; a file's fields are covered by its
+  parent's.
+*/
+void Node_lockRead(Node_T oNNode);
+
+/*
+  Acquires oNNode's latch for writing, waiting until no other reader
+  or writer holds it.
+*/
+void Node_lockWrite(Node_T oNNode);
+
+/*
+  Acquires oNNode's latch for writing if no other thread holds it, and
+  returns TRUE if it did or FALSE if not, without waiting either way.
+*/
+boolean Node_tryLockWrite(Node_T oNNode);
+
+/*
+  Releases oNNode's latch, taken by Node_lockRead, Node_lockWrite or
+  Node_tryLockWrite.
+*/
+void Node_unlock(Node_T oNNode);
+
+/*
+  Marks oNNode, a directory, as the top of a change under way that
+  takes it out of its tree, or that fills in new directories below it
+  under oNNode's latch rather than their own, for a caller that holds
+  the latch of oNNode or of its parent for writing. The mark is how a
+  thread that latches a directory without latching its ancestors
+  first tells whether such a change may still be at work on it (see
+  Node_isDetaching).
+*/
+void Node_beginDetach(Node_T oNNode);
+
+/*
+  Ends a change marked on oNNode by Node_beginDetach. A directory that
+  the change took out of the tree may stay marked.
+*/
+void Node_endDetach(Node_T oNNode);
+
+/*
+  Returns TRUE if oNNode or any of its ancestors is marked by
+  Node_beginDetach, and FALSE if none is. Safe for lock-free readers.
+*/
+boolean Node_isDetaching(Node_T oNNode);
+
 #endif
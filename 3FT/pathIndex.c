@@ -0,0 +1,222 @@
+/*--------------------------------------------------------------------*/
+/* pathIndex.c                                                        */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "pathIndex.h"
+
+/* The number of slots a new index starts with */
+#define PATHINDEX_INITIAL_SLOTS 64
+
+/* One slot of the open-addressing table */
+struct pathIndexEntry {
+   /* the hash of oNNode's absolute path */
+   size_t ulHash;
+   /* the indexed node, or NULL if the slot is empty */
+   Node_T oNNode;
+};
+
+/*
+  A hash index from absolute path to node, using linear probing. The
+  table is kept at most half full, and removals shift later entries
+  back rather than leaving tombstones.
+*/
+struct pathIndex {
+   /* the table of slots */
+   struct pathIndexEntry *psEntries;
+   /* the number of slots in psEntries, always a power of two */
+   size_t ulSlots;
+   /* the number of occupied slots */
+   size_t ulCount;
+};
+
+/*
+  Returns ulHash extended over the ulLength bytes at pcBytes with the
+  FNV-1a step.
+*/
+static size_t PathIndex_extend(size_t ulHash, const char *pcBytes,
+                               size_t ulLength) {
+   size_t i;
+
+   assert(pcBytes != NULL);
+
+   for(i = 0; i < ulLength; i++) {
+      ulHash ^= (unsigned char) pcBytes[i];
+      ulHash *= (size_t) 16777619UL;
+   }
+   return ulHash;
+}
+
+size_t PathIndex_hash(const char *pcPath, size_t ulLength) {
+   assert(pcPath != NULL);
+
+   return PathIndex_extend((size_t) 2166136261UL, pcPath, ulLength);
+}
+
+size_t PathIndex_hashChild(size_t ulParentHash, const char *pcName,
+                           size_t ulLength) {
+   assert(pcName != NULL);
+
+   return PathIndex_extend(PathIndex_extend(ulParentHash, "/", 1),
+                           pcName, ulLength);
+}
+
+size_t PathIndex_hashParent(size_t ulChildHash, const char *pcName,
+                            size_t ulLength) {
+   size_t ulInverse = (size_t) 16777619UL;
+   size_t i;
+
+   assert(pcName != NULL);
+
+   /* each Newton step doubles the low bits that the odd FNV prime's
+      inverse gets right, from the three that it starts with */
+   for(i = 0; i < 5; i++)
+      ulInverse *= (size_t) 2 - (size_t) 16777619UL * ulInverse;
+
+   /* undo PathIndex_extend's steps in reverse, delimiter last */
+   for(i = ulLength; i > 0; i--) {
+      ulChildHash *= ulInverse;
+      ulChildHash ^= (unsigned char) pcName[i - 1];
+   }
+   ulChildHash *= ulInverse;
+   ulChildHash ^= (unsigned char) '/';
+   return ulChildHash;
+}
+
+/*
+  Stores oNNode with hash ulHash in the first free slot of psEntries,
+  a table of ulSlots slots that has room for it.
+*/
+static void PathIndex_place(struct pathIndexEntry *psEntries,
+                            size_t ulSlots, size_t ulHash,
+                            Node_T oNNode) {
+   size_t i;
+
+   assert(psEntries != NULL);
+   assert(oNNode != NULL);
+
+   for(i = ulHash & (ulSlots - 1); psEntries[i].oNNode != NULL;
+       i = (i + 1) & (ulSlots - 1))
+      ;
+   psEntries[i].ulHash = ulHash;
+   psEntries[i].oNNode = oNNode;
+}
+
+PathIndex_T PathIndex_new(void) {
+   struct pathIndex *psIndex;
+
+   psIndex = malloc(sizeof(struct pathIndex));
+   if(psIndex == NULL)
+      return NULL;
+
+   psIndex->ulSlots = PATHINDEX_INITIAL_SLOTS;
+   psIndex->ulCount = 0;
+   psIndex->psEntries = calloc(psIndex->ulSlots,
+                               sizeof(struct pathIndexEntry));
+   if(psIndex->psEntries == NULL) {
+      free(psIndex);
+      return NULL;
+   }
+   return psIndex;
+}
+
+void PathIndex_free(PathIndex_T oIIndex) {
+   if(oIIndex == NULL)
+      return;
+
+   free(oIIndex->psEntries);
+   free(oIIndex);
+}
+
+int PathIndex_reserve(PathIndex_T oIIndex, size_t ulExtra) {
+   struct pathIndexEntry *psNew;
+   size_t ulNewSlots;
+   size_t i;
+
+   assert(oIIndex != NULL);
+
+   ulNewSlots = oIIndex->ulSlots;
+   while(2 * (oIIndex->ulCount + ulExtra) > ulNewSlots)
+      ulNewSlots *= 2;
+   if(ulNewSlots == oIIndex->ulSlots)
+      return SUCCESS;
+
+   psNew = calloc(ulNewSlots, sizeof(struct pathIndexEntry));
+   if(psNew == NULL)
+      return MEMORY_ERROR;
+
+   for(i = 0; i < oIIndex->ulSlots; i++)
+      if(oIIndex->psEntries[i].oNNode != NULL)
+         PathIndex_place(psNew, ulNewSlots,
+                         oIIndex->psEntries[i].ulHash,
+                         oIIndex->psEntries[i].oNNode);
+
+   free(oIIndex->psEntries);
+   oIIndex->psEntries = psNew;
+   oIIndex->ulSlots = ulNewSlots;
+   return SUCCESS;
+}
+
+int PathIndex_put(PathIndex_T oIIndex, size_t ulHash, Node_T oNNode) {
+   assert(oIIndex != NULL);
+   assert(oNNode != NULL);
+
+   if(PathIndex_reserve(oIIndex, 1) != SUCCESS)
+      return MEMORY_ERROR;
+
+   PathIndex_place(oIIndex->psEntries, oIIndex->ulSlots, ulHash,
+                   oNNode);
+   oIIndex->ulCount++;
+   return SUCCESS;
+}
+
+Node_T PathIndex_get(PathIndex_T oIIndex, size_t ulHash,
+                     const char *pcPath, size_t ulLength) {
+   size_t ulMask;
+   size_t i;
+
+   assert(oIIndex != NULL);
+   assert(pcPath != NULL);
+
+   ulMask = oIIndex->ulSlots - 1;
+   for(i = ulHash & ulMask; oIIndex->psEntries[i].oNNode != NULL;
+       i = (i + 1) & ulMask) {
+      if(oIIndex->psEntries[i].ulHash == ulHash &&
+         Node_isPath(oIIndex->psEntries[i].oNNode, pcPath, ulLength))
+         return oIIndex->psEntries[i].oNNode;
+   }
+   return NULL;
+}
+
+void PathIndex_remove(PathIndex_T oIIndex, size_t ulHash,
+                      Node_T oNNode) {
+   struct pathIndexEntry *psEntries;
+   size_t ulMask;
+   size_t i, j, ulHome;
+
+   assert(oIIndex != NULL);
+   assert(oNNode != NULL);
+
+   psEntries = oIIndex->psEntries;
+   ulMask = oIIndex->ulSlots - 1;
+   for(i = ulHash & ulMask; psEntries[i].oNNode != oNNode;
+       i = (i + 1) & ulMask)
+      if(psEntries[i].oNNode == NULL)
+         return;
+
+   /* close the gap at i by shifting back any later entry in the same
+      probe run whose home slot is not between the gap and itself */
+   for(j = (i + 1) & ulMask; psEntries[j].oNNode != NULL;
+       j = (j + 1) & ulMask) {
+      ulHome = psEntries[j].ulHash & ulMask;
+      if(((j - ulHome) & ulMask) >= ((j - i) & ulMask)) {
+         psEntries[i] = psEntries[j];
+         i = j;
+      }
+   }
+   psEntries[i].oNNode = NULL;
+   oIIndex->ulCount--;
+}
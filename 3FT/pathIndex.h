@@ -0,0 +1,79 @@
+/*--------------------------------------------------------------------*/
+/* pathIndex.h                                                        */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#ifndef PATHINDEX_INCLUDED
+#define PATHINDEX_INCLUDED
+
+#include <stddef.h>
+#include "a4def.h"
+#include "nodeFT.h"
+
+/*
+  A PathIndex_T maps absolute pathnames to the nodes of an FT in one
+  hash probe. It stores only each node and its path's hash; a hit is
+  confirmed against the node's own chain of names, so no pathname is
+  ever copied into the index. Hashes are built so that a child's can be
+  derived from its parent's without the full pathname in hand.
+*/
+typedef struct pathIndex *PathIndex_T;
+
+/*
+  Returns a new, empty path index, or NULL if insufficient memory is
+  available.
+*/
+PathIndex_T PathIndex_new(void);
+
+/* Frees oIIndex. The indexed nodes themselves are not affected. */
+void PathIndex_free(PathIndex_T oIIndex);
+
+/* Returns the hash of the ulLength-byte pathname at pcPath. */
+size_t PathIndex_hash(const char *pcPath, size_t ulLength);
+
+/*
+  Returns the hash of the path formed by appending a delimiter and the
+  ulLength-byte component pcName to the path whose hash is
+  ulParentHash.
+*/
+size_t PathIndex_hashChild(size_t ulParentHash, const char *pcName,
+                           size_t ulLength);
+
+/*
+  Returns the hash of the path that PathIndex_hashChild extended by
+  the ulLength-byte component pcName into the path whose hash is
+  ulChildHash, so that a walk can climb back up without keeping the
+  hashes it had on the way down.
+*/
+size_t PathIndex_hashParent(size_t ulChildHash, const char *pcName,
+                            size_t ulLength);
+
+/*
+  Ensures that the next ulExtra calls to PathIndex_put on oIIndex will
+  not need to allocate memory. Returns SUCCESS, or MEMORY_ERROR if
+  memory could not be allocated to complete request.
+*/
+int PathIndex_reserve(PathIndex_T oIIndex, size_t ulExtra);
+
+/*
+  Adds oNNode, whose absolute path hashes to ulHash, to oIIndex.
+  oNNode must not already be in oIIndex. Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated to complete request.
+*/
+int PathIndex_put(PathIndex_T oIIndex, size_t ulHash, Node_T oNNode);
+
+/*
+  Returns the node in oIIndex whose absolute path is the ulLength-byte
+  pathname at pcPath, which hashes to ulHash, or NULL if there is none.
+*/
+Node_T PathIndex_get(PathIndex_T oIIndex, size_t ulHash,
+                     const char *pcPath, size_t ulLength);
+
+/*
+  Removes oNNode, whose absolute path hashes to ulHash, from oIIndex if
+  it is there.
+*/
+void PathIndex_remove(PathIndex_T oIIndex, size_t ulHash,
+                      Node_T oNNode);
+
+#endif
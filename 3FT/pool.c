@@ -0,0 +1 @@
+../0shared/pool.c
\ No newline at end of file
@@ -0,0 +1 @@
+../0shared/pool.h
\ No newline at end of file
@@ -0,0 +1,178 @@
+/*--------------------------------------------------------------------*/
+/* reclaimer.c                                                        */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "reclaimer.h"
+
+/* An object waiting to be freed */
+struct reclaimerItem {
+   /* the object handed over just after this one */
+   struct reclaimerItem *psNext;
+   /* the function that frees part of the object per call */
+   boolean (*pfStep)(void *pvObject);
+   /* the object itself */
+   void *pvObject;
+};
+
+/* A background thread and the objects waiting for it */
+struct reclaimer {
+   /* guards every field below */
+   pthread_mutex_t sMutex;
+   /* signalled when an object is handed over or the reclaimer let go
+      of, for the thread */
+   pthread_cond_t sWork;
+   /* signalled when the thread finishes a batch, for waiters */
+   pthread_cond_t sDone;
+   /* the objects waiting, oldest first, and the newest */
+   struct reclaimerItem *psFirst;
+   struct reclaimerItem *psLast;
+   /* the number of objects ever handed over, and of those freed */
+   size_t ulAdded;
+   size_t ulFreed;
+   /* a flag for having been let go of (TRUE) or not (FALSE) */
+   boolean bClosing;
+};
+
+/*
+  Runs the thread of pvReclaimer, a Reclaimer_T: takes every object
+  waiting as a batch and frees it, until the reclaimer is let go of
+  and nothing is left. Returns NULL.
+*/
+static void *Reclaimer_run(void *pvReclaimer) {
+   struct reclaimer *psReclaimer = pvReclaimer;
+   struct reclaimerItem *psBatch;
+   struct reclaimerItem *psNext;
+   size_t ulFreed;
+
+   assert(psReclaimer != NULL);
+
+   (void) pthread_mutex_lock(&psReclaimer->sMutex);
+   for(;;) {
+      while(psReclaimer->psFirst == NULL && !psReclaimer->bClosing)
+         (void) pthread_cond_wait(&psReclaimer->sWork,
+                                  &psReclaimer->sMutex);
+      if(psReclaimer->psFirst == NULL)
+         break;
+      psBatch = psReclaimer->psFirst;
+      psReclaimer->psFirst = NULL;
+      psReclaimer->psLast = NULL;
+      (void) pthread_mutex_unlock(&psReclaimer->sMutex);
+
+      /* free the batch with nothing held, so that more can be handed
+         over meanwhile */
+      for(ulFreed = 0; psBatch != NULL; psBatch = psNext, ulFreed++) {
+         psNext = psBatch->psNext;
+         while(!(*psBatch->pfStep)(psBatch->pvObject))
+            ;
+         free(psBatch);
+      }
+
+      (void) pthread_mutex_lock(&psReclaimer->sMutex);
+      psReclaimer->ulFreed += ulFreed;
+      (void) pthread_cond_broadcast(&psReclaimer->sDone);
+   }
+   (void) pthread_mutex_unlock(&psReclaimer->sMutex);
+
+   (void) pthread_cond_destroy(&psReclaimer->sDone);
+   (void) pthread_cond_destroy(&psReclaimer->sWork);
+   (void) pthread_mutex_destroy(&psReclaimer->sMutex);
+   free(psReclaimer);
+   return NULL;
+}
+
+Reclaimer_T Reclaimer_new(void) {
+   struct reclaimer *psReclaimer;
+   pthread_t sThread;
+
+   psReclaimer = malloc(sizeof(struct reclaimer));
+   if(psReclaimer == NULL)
+      return NULL;
+
+   if(pthread_mutex_init(&psReclaimer->sMutex, NULL) != 0) {
+      free(psReclaimer);
+      return NULL;
+   }
+   if(pthread_cond_init(&psReclaimer->sWork, NULL) != 0) {
+      (void) pthread_mutex_destroy(&psReclaimer->sMutex);
+      free(psReclaimer);
+      return NULL;
+   }
+   if(pthread_cond_init(&psReclaimer->sDone, NULL) != 0) {
+      (void) pthread_cond_destroy(&psReclaimer->sWork);
+      (void) pthread_mutex_destroy(&psReclaimer->sMutex);
+      free(psReclaimer);
+      return NULL;
+   }
+   psReclaimer->psFirst = NULL;
+   psReclaimer->psLast = NULL;
+   psReclaimer->ulAdded = 0;
+   psReclaimer->ulFreed = 0;
+   psReclaimer->bClosing = FALSE;
+
+   /* nobody joins the thread: it frees the reclaimer as it exits */
+   if(pthread_create(&sThread, NULL, Reclaimer_run, psReclaimer) != 0) {
+      (void) pthread_cond_destroy(&psReclaimer->sDone);
+      (void) pthread_cond_destroy(&psReclaimer->sWork);
+      (void) pthread_mutex_destroy(&psReclaimer->sMutex);
+      free(psReclaimer);
+      return NULL;
+   }
+   (void) pthread_detach(sThread);
+   return psReclaimer;
+}
+
+void Reclaimer_free(Reclaimer_T oRReclaimer) {
+   if(oRReclaimer == NULL)
+      return;
+
+   (void) pthread_mutex_lock(&oRReclaimer->sMutex);
+   assert(!oRReclaimer->bClosing);
+   oRReclaimer->bClosing = TRUE;
+   (void) pthread_cond_signal(&oRReclaimer->sWork);
+   (void) pthread_mutex_unlock(&oRReclaimer->sMutex);
+}
+
+int Reclaimer_add(Reclaimer_T oRReclaimer,
+                  boolean (*pfStep)(void *pvObject), void *pvObject) {
+   struct reclaimerItem *psItem;
+
+   assert(oRReclaimer != NULL);
+   assert(pfStep != NULL);
+
+   psItem = malloc(sizeof(struct reclaimerItem));
+   if(psItem == NULL)
+      return MEMORY_ERROR;
+   psItem->psNext = NULL;
+   psItem->pfStep = pfStep;
+   psItem->pvObject = pvObject;
+
+   (void) pthread_mutex_lock(&oRReclaimer->sMutex);
+   assert(!oRReclaimer->bClosing);
+   if(oRReclaimer->psLast == NULL)
+      oRReclaimer->psFirst = psItem;
+   else
+      oRReclaimer->psLast->psNext = psItem;
+   oRReclaimer->psLast = psItem;
+   oRReclaimer->ulAdded++;
+   (void) pthread_cond_signal(&oRReclaimer->sWork);
+   (void) pthread_mutex_unlock(&oRReclaimer->sMutex);
+   return SUCCESS;
+}
+
+void Reclaimer_wait(Reclaimer_T oRReclaimer) {
+   size_t ulAdded;
+
+   assert(oRReclaimer != NULL);
+
+   (void) pthread_mutex_lock(&oRReclaimer->sMutex);
+   ulAdded = oRReclaimer->ulAdded;
+   while(oRReclaimer->ulFreed < ulAdded)
+      (void) pthread_cond_wait(&oRReclaimer->sDone,
+                               &oRReclaimer->sMutex);
+   (void) pthread_mutex_unlock(&oRReclaimer->sMutex);
+}
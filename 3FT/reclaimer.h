@@ -0,0 +1,52 @@
+/*--------------------------------------------------------------------*/
+/* reclaimer.h                                                        */
+/* Author: Stan Zhelokhovtsev                                         */
+/*--------------------------------------------------------------------*/
+
+#ifndef RECLAIMER_INCLUDED
+#define RECLAIMER_INCLUDED
+
+#include "a4def.h"
+
+/*
+  A Reclaimer_T frees objects on a background thread of its own, so
+  that whoever lets go of a large object need not wait while it is
+  freed. Objects are freed one at a time, in the order they were
+  handed over, each by a function that frees a bounded part of it per
+  call, so a large object never keeps a lock shared with other threads
+  for long.
+*/
+typedef struct reclaimer *Reclaimer_T;
+
+/*
+  Returns a new reclaimer with its thread started and nothing to free,
+  or NULL if insufficient memory is available or the thread could not
+  be started.
+*/
+Reclaimer_T Reclaimer_new(void);
+
+/*
+  Lets go of oRReclaimer without waiting: its thread frees everything
+  already handed to it, and then exits and frees the reclaimer itself.
+  Nothing more may be handed to it. Does nothing if oRReclaimer is
+  NULL.
+*/
+void Reclaimer_free(Reclaimer_T oRReclaimer);
+
+/*
+  Hands pvObject to oRReclaimer, whose thread calls (*pfStep)(pvObject)
+  until it returns TRUE, each call freeing a bounded part of pvObject,
+  once every object handed over earlier is freed. Returns SUCCESS, or
+  MEMORY_ERROR if memory could not be allocated to complete request,
+  in which case the caller still owns pvObject.
+*/
+int Reclaimer_add(Reclaimer_T oRReclaimer,
+                  boolean (*pfStep)(void *pvObject), void *pvObject);
+
+/*
+  Waits until oRReclaimer has freed every object handed to it before
+  this call.
+*/
+void Reclaimer_wait(Reclaimer_T oRReclaimer);
+
+#endif